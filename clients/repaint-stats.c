@@ -0,0 +1,260 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <wayland-client.h>
+#include "weston-repaint-stats-client-protocol.h"
+#include "shared/helpers.h"
+#include "shared/xalloc.h"
+
+struct stats_output {
+	struct wl_output *output;
+	uint32_t global_name;
+	char *make;
+	char *model;
+	int32_t width, height, refresh;
+	struct wl_list link;
+};
+
+struct stats_app {
+	struct wl_display *display;
+	struct wl_registry *registry;
+	struct weston_repaint_stats *stats;
+	struct wl_list output_list;
+};
+
+static const char * const stage_names[] = {
+	[WESTON_REPAINT_STATS_REPORT_STAGE_ACCUMULATE_DAMAGE] =
+		"accumulate damage (us)",
+	[WESTON_REPAINT_STATS_REPORT_STAGE_OUTPUT_REPAINT] =
+		"output repaint (us)",
+	[WESTON_REPAINT_STATS_REPORT_STAGE_START_TO_POSTED] =
+		"start to posted (us)",
+	[WESTON_REPAINT_STATS_REPORT_STAGE_POSTED_TO_FINISH] =
+		"posted to finish (us)",
+	[WESTON_REPAINT_STATS_REPORT_STAGE_DAMAGE_AREA] =
+		"damage area (px)",
+	[WESTON_REPAINT_STATS_REPORT_STAGE_DRAW_CALLS] =
+		"draw calls",
+	[WESTON_REPAINT_STATS_REPORT_STAGE_STATE_CHANGES] =
+		"state changes",
+};
+
+static void
+output_handle_geometry(void *data, struct wl_output *wl_output,
+		       int32_t x, int32_t y,
+		       int32_t physical_width, int32_t physical_height,
+		       int32_t subpixel, const char *make, const char *model,
+		       int32_t transform)
+{
+	struct stats_output *output = data;
+
+	free(output->make);
+	free(output->model);
+	output->make = xstrdup(make);
+	output->model = xstrdup(model);
+}
+
+static void
+output_handle_mode(void *data, struct wl_output *wl_output,
+		   uint32_t flags, int32_t width, int32_t height,
+		   int32_t refresh)
+{
+	struct stats_output *output = data;
+
+	if (flags & WL_OUTPUT_MODE_CURRENT) {
+		output->width = width;
+		output->height = height;
+		output->refresh = refresh;
+	}
+}
+
+static const struct wl_output_listener output_listener = {
+	output_handle_geometry,
+	output_handle_mode,
+};
+
+static void
+report_handle_counters(void *data,
+		       struct weston_repaint_stats_report *report,
+		       uint32_t frames_hi, uint32_t frames_lo,
+		       uint32_t missed_hi, uint32_t missed_lo)
+{
+	struct stats_output *output = data;
+
+	printf("output %u (%s %s, %dx%d@%.2f):\n", output->global_name,
+	       output->make ? output->make : "unknown",
+	       output->model ? output->model : "unknown",
+	       output->width, output->height, output->refresh / 1000.0);
+	printf("  frames %" PRIu64 ", missed deadlines %" PRIu64 "\n",
+	       ((uint64_t)frames_hi << 32) | frames_lo,
+	       ((uint64_t)missed_hi << 32) | missed_lo);
+	printf("  %-24s %8s %8s %8s %8s %8s %8s %8s %8s\n", "",
+	       "count", "min", "mean", "p50", "p90", "p99", "p99.9", "max");
+}
+
+static void
+report_handle_histogram(void *data,
+			struct weston_repaint_stats_report *report,
+			uint32_t stage, uint32_t count,
+			uint32_t min, uint32_t max, uint32_t mean,
+			uint32_t p50, uint32_t p90, uint32_t p99,
+			uint32_t p999)
+{
+	const char *name = "unknown";
+
+	if (stage < ARRAY_LENGTH(stage_names))
+		name = stage_names[stage];
+
+	printf("  %-24s %8u %8u %8u %8u %8u %8u %8u %8u\n", name,
+	       count, min, mean, p50, p90, p99, p999, max);
+}
+
+static void
+report_handle_done(void *data, struct weston_repaint_stats_report *report)
+{
+	weston_repaint_stats_report_destroy(report);
+}
+
+static const struct weston_repaint_stats_report_listener report_listener = {
+	report_handle_counters,
+	report_handle_histogram,
+	report_handle_done,
+};
+
+static void
+handle_global(void *data, struct wl_registry *registry,
+	      uint32_t name, const char *interface, uint32_t version)
+{
+	struct stats_app *app = data;
+	struct stats_output *output;
+
+	if (strcmp(interface, "wl_output") == 0) {
+		output = xzalloc(sizeof *output);
+		output->global_name = name;
+		output->output = wl_registry_bind(registry, name,
+						  &wl_output_interface, 1);
+		wl_output_add_listener(output->output, &output_listener,
+				       output);
+		wl_list_insert(app->output_list.prev, &output->link);
+	} else if (strcmp(interface, "weston_repaint_stats") == 0) {
+		app->stats = wl_registry_bind(registry, name,
+					      &weston_repaint_stats_interface,
+					      MIN(version, 2));
+	}
+}
+
+static void
+handle_global_remove(void *data, struct wl_registry *registry,
+		     uint32_t name)
+{
+}
+
+static const struct wl_registry_listener registry_listener = {
+	handle_global,
+	handle_global_remove,
+};
+
+static void
+usage(int error_code)
+{
+	fprintf(stderr, "Usage: weston-repaint-stats [OPTIONS]\n\n"
+		"Print the repaint statistics of every output.\n\n"
+		"  --reset\tClear the statistics after printing them\n"
+		"  --help\tThis help text\n\n");
+
+	exit(error_code);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct stats_app app = { 0 };
+	struct stats_output *output, *tmp;
+	struct weston_repaint_stats_report *report;
+	int reset = 0;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--reset") == 0)
+			reset = 1;
+		else if (strcmp(argv[i], "--help") == 0)
+			usage(EXIT_SUCCESS);
+		else
+			usage(EXIT_FAILURE);
+	}
+
+	app.display = wl_display_connect(NULL);
+	if (app.display == NULL) {
+		fprintf(stderr, "failed to create display: %m\n");
+		return EXIT_FAILURE;
+	}
+
+	wl_list_init(&app.output_list);
+	app.registry = wl_display_get_registry(app.display);
+	wl_registry_add_listener(app.registry, &registry_listener, &app);
+
+	/* Globals, then the output descriptions. */
+	wl_display_roundtrip(app.display);
+	wl_display_roundtrip(app.display);
+
+	if (app.stats == NULL) {
+		fprintf(stderr, "display doesn't support repaint statistics\n");
+		return EXIT_FAILURE;
+	}
+
+	wl_list_for_each(output, &app.output_list, link) {
+		report = weston_repaint_stats_get_output_stats(app.stats,
+							       output->output);
+		weston_repaint_stats_report_add_listener(report,
+							 &report_listener,
+							 output);
+		if (reset)
+			weston_repaint_stats_reset(app.stats, output->output);
+	}
+
+	/* Requests are handled in order, so every report is complete
+	 * after one roundtrip. */
+	wl_display_roundtrip(app.display);
+
+	wl_list_for_each_safe(output, tmp, &app.output_list, link) {
+		wl_output_destroy(output->output);
+		free(output->make);
+		free(output->model);
+		free(output);
+	}
+	weston_repaint_stats_destroy(app.stats);
+	wl_registry_destroy(app.registry);
+	wl_display_disconnect(app.display);
+
+	return EXIT_SUCCESS;
+}
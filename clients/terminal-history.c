@@ -0,0 +1,266 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "shared/helpers.h"
+#include "shared/xalloc.h"
+#include "terminal-history.h"
+
+/* Each row is stored as its cells up to the last non-empty one,
+ * followed by its attributes as runs of equal cells:
+ *
+ *	uint16_t n_chars, n_runs;
+ *	union utf8_char chars[n_chars];
+ *	struct history_run runs[n_runs];
+ */
+struct history_run {
+	uint16_t length;
+	struct attr attr;
+};
+
+void
+history_init(struct history *history, int rows)
+{
+	history->n_blocks = (rows + HISTORY_BLOCK_ROWS - 1) /
+		HISTORY_BLOCK_ROWS + 1;
+	history->blocks = xzalloc(history->n_blocks *
+				  sizeof *history->blocks);
+	history->begin = 0;
+	history->end = 0;
+	history->bytes = history->n_blocks * sizeof *history->blocks;
+}
+
+void
+history_release(struct history *history)
+{
+	uint32_t i;
+
+	for (i = 0; i < history->n_blocks; i++)
+		free(history->blocks[i].data);
+	free(history->blocks);
+}
+
+static struct history_block *
+history_get_block(struct history *history, uint32_t row)
+{
+	return &history->blocks[(row / HISTORY_BLOCK_ROWS) %
+				history->n_blocks];
+}
+
+int
+history_contains(struct history *history, uint32_t row)
+{
+	return row - history->begin < history->end - history->begin;
+}
+
+/* Start over at row, for when the gap to the last stored row is
+ * bigger than the whole history. */
+static void
+history_reset(struct history *history, uint32_t row)
+{
+	history->begin = row - row % HISTORY_BLOCK_ROWS;
+	history->end = history->begin;
+}
+
+/* The stored size of a row, data may be NULL for an empty row. */
+static uint32_t
+history_row_size(const union utf8_char *data, const struct attr *attr,
+		 int width, uint16_t *n_chars, uint16_t *n_runs)
+{
+	int c;
+
+	*n_chars = 0;
+	*n_runs = 0;
+	if (data) {
+		for (c = width; c > 0 && data[c - 1].ch == 0; c--)
+			;
+		*n_chars = c;
+		for (c = 0; c < width; c++)
+			if (c == 0 || memcmp(&attr[c], &attr[c - 1],
+					     sizeof *attr) != 0)
+				(*n_runs)++;
+	}
+
+	return 2 * sizeof(uint16_t) + *n_chars * sizeof *data +
+		*n_runs * sizeof(struct history_run);
+}
+
+static void
+history_write_row(char *p, const union utf8_char *data,
+		  const struct attr *attr, int width,
+		  uint16_t n_chars, uint16_t n_runs)
+{
+	struct history_run *run = NULL;
+	int c;
+
+	memcpy(p, &n_chars, sizeof n_chars);
+	memcpy(p + sizeof n_chars, &n_runs, sizeof n_runs);
+	p += 2 * sizeof(uint16_t);
+	if (n_chars)
+		memcpy(p, data, n_chars * sizeof *data);
+	p += n_chars * sizeof *data;
+
+	for (c = 0; n_runs && c < width; c++) {
+		if (c == 0 || memcmp(&attr[c], &attr[c - 1],
+				     sizeof *attr) != 0) {
+			if (c > 0)
+				p += sizeof *run;
+			run = (struct history_run *) p;
+			run->length = 0;
+			run->attr = attr[c];
+		}
+		run->length++;
+	}
+}
+
+static void
+history_block_reserve(struct history *history, struct history_block *block,
+		      uint32_t size)
+{
+	if (size <= block->alloc)
+		return;
+
+	history->bytes -= block->alloc;
+	block->alloc = MAX(size, block->alloc * 2);
+	block->data = xrealloc(block->data, block->alloc);
+	history->bytes += block->alloc;
+}
+
+/* Append a row, data may be NULL for an empty row. */
+static void
+history_push(struct history *history, const union utf8_char *data,
+	     const struct attr *attr, int width)
+{
+	struct history_block *block;
+	uint32_t i = history->end % HISTORY_BLOCK_ROWS;
+	uint16_t n_chars, n_runs;
+	uint32_t size;
+
+	block = history_get_block(history, history->end);
+	if (i == 0) {
+		block->offset[0] = 0;
+		if (history->end - history->begin >=
+		    history->n_blocks * HISTORY_BLOCK_ROWS)
+			history->begin += HISTORY_BLOCK_ROWS;
+	}
+
+	size = block->offset[i] +
+		history_row_size(data, attr, width, &n_chars, &n_runs);
+	history_block_reserve(history, block, size);
+	history_write_row(block->data + block->offset[i],
+			  data, attr, width, n_chars, n_runs);
+
+	block->offset[i + 1] = size;
+	history->end++;
+}
+
+/* Overwrite a stored row, moving the rows after it in its block. */
+static void
+history_replace(struct history *history, uint32_t row,
+		const union utf8_char *data, const struct attr *attr,
+		int width)
+{
+	struct history_block *block = history_get_block(history, row);
+	uint32_t i = row % HISTORY_BLOCK_ROWS;
+	uint32_t n, j, size, old_size;
+	uint16_t n_chars, n_runs;
+
+	/* The rows stored in this block end at n. */
+	if (history->end - row < HISTORY_BLOCK_ROWS - i)
+		n = i + history->end - row;
+	else
+		n = HISTORY_BLOCK_ROWS;
+
+	size = history_row_size(data, attr, width, &n_chars, &n_runs);
+	old_size = block->offset[i + 1] - block->offset[i];
+	history_block_reserve(history, block,
+			      block->offset[n] - old_size + size);
+
+	memmove(block->data + block->offset[i] + size,
+		block->data + block->offset[i + 1],
+		block->offset[n] - block->offset[i + 1]);
+	for (j = i + 1; j <= n; j++)
+		block->offset[j] = block->offset[j] - old_size + size;
+
+	history_write_row(block->data + block->offset[i],
+			  data, attr, width, n_chars, n_runs);
+}
+
+/* Store a row, in order after the last stored one, or over its older
+ * copy when it was re-loaded from the history and may have changed.
+ * Rows skipped over are stored empty. */
+void
+history_store(struct history *history, uint32_t row,
+	      const union utf8_char *data, const struct attr *attr,
+	      int width)
+{
+	if (row < history->end) {
+		if (history_contains(history, row))
+			history_replace(history, row, data, attr, width);
+		return;
+	}
+
+	if (row - history->end >= history->n_blocks * HISTORY_BLOCK_ROWS)
+		history_reset(history, row);
+	while (history->end < row)
+		history_push(history, NULL, NULL, 0);
+
+	history_push(history, data, attr, width);
+}
+
+/* Expand a stored row into width cells. Cells past the stored width
+ * take the attribute of the last run, or fill if there are none. */
+void
+history_get(struct history *history, uint32_t row,
+	    union utf8_char *data, struct attr *attr, int width,
+	    struct attr fill)
+{
+	struct history_block *block = history_get_block(history, row);
+	const char *p = block->data + block->offset[row % HISTORY_BLOCK_ROWS];
+	struct history_run run;
+	uint16_t n_chars, n_runs;
+	int c = 0, i, n;
+
+	memcpy(&n_chars, p, sizeof n_chars);
+	memcpy(&n_runs, p + sizeof n_chars, sizeof n_runs);
+	p += 2 * sizeof(uint16_t);
+
+	memset(data, 0, width * sizeof *data);
+	memcpy(data, p, MIN(n_chars, width) * sizeof *data);
+	p += n_chars * sizeof *data;
+
+	for (i = 0; i < n_runs && c < width; i++) {
+		memcpy(&run, p + i * sizeof run, sizeof run);
+		for (n = MIN(run.length, width - c); n > 0; n--)
+			attr[c++] = run.attr;
+		fill = run.attr;
+	}
+	for (; c < width; c++)
+		attr[c] = fill;
+}
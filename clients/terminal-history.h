@@ -0,0 +1,83 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _TERMINAL_HISTORY_H
+#define _TERMINAL_HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+union utf8_char {
+	unsigned char byte[4];
+	uint32_t ch;
+};
+
+struct attr {
+	unsigned char fg, bg;
+	char a;        /* attributes format:
+	                * 76543210
+			*    cilub */
+	char s;        /* in selection */
+};
+
+/* Rows that scrolled out of the terminal's row ring are kept in the
+ * history. Rows are packed into blocks of HISTORY_BLOCK_ROWS, and the
+ * blocks form a ring where the oldest block is dropped to make room.
+ * Rows are numbered the same way as terminal->start and terminal->end. */
+#define HISTORY_BLOCK_ROWS	64
+
+struct history_block {
+	uint32_t offset[HISTORY_BLOCK_ROWS + 1];
+	char *data;
+	uint32_t alloc;
+};
+
+struct history {
+	struct history_block *blocks;
+	uint32_t n_blocks;
+	uint32_t begin, end;
+	size_t bytes;
+};
+
+void
+history_init(struct history *history, int rows);
+
+void
+history_release(struct history *history);
+
+int
+history_contains(struct history *history, uint32_t row);
+
+void
+history_store(struct history *history, uint32_t row,
+	      const union utf8_char *data, const struct attr *attr,
+	      int width);
+
+void
+history_get(struct history *history, uint32_t row,
+	    union utf8_char *data, struct attr *attr, int width,
+	    struct attr fill);
+
+#endif
@@ -45,9 +45,11 @@
 #include <wayland-client.h>
 
 #include "shared/config-parser.h"
+#include "shared/glyph-cache.h"
 #include "shared/helpers.h"
 #include "shared/xalloc.h"
 #include "window.h"
+#include "terminal-history.h"
 
 static int option_fullscreen;
 static int option_maximize;
@@ -55,6 +57,17 @@ static char *option_font;
 static int option_font_size;
 static char *option_term;
 static char *option_shell;
+static char *option_benchmark;
+static int option_scrollback_lines;
+
+/* With --benchmark, the pty runs cat on the given file and the terminal
+ * exits once it is done, printing the throughput. */
+static struct {
+	struct timespec begin;
+	uint64_t bytes;
+	uint32_t frames;
+	uint64_t rows;
+} benchmark;
 
 static struct wl_list terminal_list;
 
@@ -99,11 +112,6 @@ terminal_run(struct terminal *terminal, const char *path);
 #define MODE_DELETE_SENDS_DEL	0x00000040
 #define MODE_ALT_SENDS_ESC	0x00000080
 
-union utf8_char {
-	unsigned char byte[4];
-	uint32_t ch;
-};
-
 enum utf8_state {
 	utf8state_start,
 	utf8state_accept,
@@ -382,13 +390,6 @@ apply_key_map(keyboard_mode mode, int sym, uint32_t modifiers, char *response)
 }
 
 struct terminal_color { double r, g, b, a; };
-struct attr {
-	unsigned char fg, bg;
-	char a;        /* attributes format:
-	                * 76543210
-			*    cilub */
-	char s;        /* in selection */
-};
 struct color_scheme {
 	struct terminal_color palette[16];
 	char border;
@@ -451,8 +452,18 @@ struct terminal {
 	keyboard_mode key_mode;
 	int data_pitch, attr_pitch;  /* The width in bytes of a line */
 	int width, height, row, column, max_width;
-	uint32_t buffer_height;
 	uint32_t start, end, saved_start, log_size;
+
+	/* The most recent rows, slot (row & (ring_rows - 1)) holds the
+	 * row in row_tag[slot]. Older rows live in the history, and are
+	 * expanded into the view rows when scrolled back to. */
+	uint32_t ring_rows;
+	uint32_t *row_tag;
+	struct history history;
+	union utf8_char *view_data;
+	struct attr *view_attr;
+	uint32_t *view_tag;
+	int view_rows;
 	wl_fixed_t smooth_scroll;
 	int saved_row, saved_column;
 	int scrolling;
@@ -471,6 +482,7 @@ struct terminal {
 	cairo_font_extents_t extents;
 	double average_width;
 	cairo_scaled_font_t *font_normal, *font_bold;
+	struct glyph_cache *glyphs_normal, *glyphs_bold;
 	uint32_t hide_cursor_serial;
 	int size_in_title;
 
@@ -483,6 +495,19 @@ struct terminal {
 	int selection_end_row, selection_end_col;
 	struct wl_list link;
 	int pace_pipe;
+
+	/* The cells as last drawn, at the buffer scale of the window.
+	 * Before the next redraw, rows scroll_top to scroll_bottom move
+	 * up by pending_scroll rows, and then the cells in the damage
+	 * spans of each row are drawn again. */
+	cairo_surface_t *canvas;
+	int canvas_scale;
+	struct terminal_damage {
+		int start, end;
+	} *damage;
+	int damage_all;
+	int pending_scroll, scroll_top, scroll_bottom;
+	int drawn_cursor, drawn_row, drawn_column;
 };
 
 /* Create default tab stops, every 8 characters */
@@ -555,24 +580,91 @@ init_color_table(struct terminal *terminal)
 	}
 }
 
+#define ROW_TAG_NONE	UINT32_MAX
+
+/* Write the row in slot to the history, before the slot is reused. */
+static void
+terminal_archive_row(struct terminal *terminal, uint32_t slot)
+{
+	struct history *history = &terminal->history;
+	uint32_t row = terminal->row_tag[slot];
+
+	if (row == ROW_TAG_NONE)
+		return;
+
+	history_store(history, row,
+		      (void *) terminal->data + slot * terminal->data_pitch,
+		      (void *) terminal->data_attr + slot * terminal->attr_pitch,
+		      terminal->width);
+}
+
+static void
+terminal_locate_row(struct terminal *terminal, int row,
+		    union utf8_char **data, struct attr **attr)
+{
+	uint32_t abs = terminal->start + row;
+	uint32_t slot = abs & (terminal->ring_rows - 1);
+	uint32_t tag = terminal->row_tag[slot];
+	int view;
+
+	*data = (void *) terminal->data + slot * terminal->data_pitch;
+	*attr = (void *) terminal->data_attr + slot * terminal->attr_pitch;
+
+	if (tag == abs)
+		return;
+
+	if (tag == ROW_TAG_NONE || (int32_t) (abs - tag) > 0) {
+		/* A newer row takes over the slot. */
+		terminal_archive_row(terminal, slot);
+		if (history_contains(&terminal->history, abs))
+			history_get(&terminal->history, abs, *data, *attr,
+				    terminal->max_width, terminal->curr_attr);
+		else {
+			memset(*data, 0, terminal->data_pitch);
+			attr_init(*attr, terminal->curr_attr,
+				  terminal->max_width);
+		}
+		terminal->row_tag[slot] = abs;
+		return;
+	}
+
+	/* Scrolled back past the ring. */
+	view = (uint32_t) row % terminal->view_rows;
+	*data = (void *) terminal->view_data + view * terminal->data_pitch;
+	*attr = (void *) terminal->view_attr + view * terminal->attr_pitch;
+	if (terminal->view_tag[view] == abs)
+		return;
+
+	if (history_contains(&terminal->history, abs))
+		history_get(&terminal->history, abs, *data, *attr,
+			    terminal->max_width, terminal->curr_attr);
+	else {
+		memset(*data, 0, terminal->data_pitch);
+		attr_init(*attr, terminal->curr_attr, terminal->max_width);
+	}
+	terminal->view_tag[view] = abs;
+}
+
 static union utf8_char *
 terminal_get_row(struct terminal *terminal, int row)
 {
-	int index;
+	union utf8_char *data;
+	struct attr *attr;
 
-	index = (row + terminal->start) & (terminal->buffer_height - 1);
+	terminal_locate_row(terminal, row, &data, &attr);
 
-	return (void *) terminal->data + index * terminal->data_pitch;
+	return data;
 }
 
 static struct attr*
 terminal_get_attr_row(struct terminal *terminal, int row)
 {
-	int index;
+	union utf8_char *data;
+	struct attr *attr;
 
-	index = (row + terminal->start) & (terminal->buffer_height - 1);
+	terminal_locate_row(terminal, row, &data, &attr);
 
-	return (void *) terminal->data_attr + index * terminal->attr_pitch;
+	return attr;
 }
 
 union decoded_attr {
@@ -629,12 +721,116 @@ terminal_decode_attr(struct terminal *terminal, int row, int col,
 	decoded->attr.a = attr.a;
 }
 
+static void
+terminal_damage_all(struct terminal *terminal)
+{
+	terminal->damage_all = 1;
+	terminal->pending_scroll = 0;
+}
+
+static void
+terminal_damage_cells(struct terminal *terminal, int row, int start, int end)
+{
+	struct terminal_damage *damage;
+
+	if (terminal->damage_all || !terminal->damage ||
+	    row < 0 || row >= terminal->height)
+		return;
+
+	if (start < 0)
+		start = 0;
+	if (end > terminal->width)
+		end = terminal->width;
+	if (start >= end)
+		return;
+
+	damage = &terminal->damage[row];
+	if (damage->start >= damage->end) {
+		damage->start = start;
+		damage->end = end;
+	} else {
+		damage->start = MIN(damage->start, start);
+		damage->end = MAX(damage->end, end);
+	}
+}
+
+static void
+terminal_damage_rows(struct terminal *terminal, int first, int last)
+{
+	int row;
+
+	for (row = first; row <= last; row++)
+		terminal_damage_cells(terminal, row, 0, terminal->width);
+}
+
+static int
+terminal_has_selection(struct terminal *terminal)
+{
+	return terminal->selection_start_row < terminal->selection_end_row ||
+		(terminal->selection_start_row == terminal->selection_end_row &&
+		 terminal->selection_start_col < terminal->selection_end_col);
+}
+
+/* Rows top to bottom moved up by d rows (down if d is negative), and the
+ * rows scrolled in were cleared. If the region is the same as for the
+ * pending scroll, this is folded into it and only the new rows get
+ * drawn, otherwise the whole region is drawn again. */
+static void
+terminal_damage_scroll(struct terminal *terminal, int top, int bottom, int d)
+{
+	int rows = bottom - top + 1;
+	int i;
+
+	if (terminal->damage_all || !terminal->damage || d == 0)
+		return;
+
+	/* The selection is drawn relative to the visible rows. */
+	if (terminal_has_selection(terminal)) {
+		terminal_damage_all(terminal);
+		return;
+	}
+
+	if (terminal->drawn_row >= top && terminal->drawn_row <= bottom) {
+		terminal->drawn_row -= d;
+		if (terminal->drawn_row < top || terminal->drawn_row > bottom)
+			terminal->drawn_row = -1;
+	}
+
+	if (terminal->pending_scroll != 0 &&
+	    (terminal->scroll_top != top ||
+	     terminal->scroll_bottom != bottom)) {
+		terminal_damage_rows(terminal, top, bottom);
+		return;
+	}
+
+	terminal->pending_scroll += d;
+	terminal->scroll_top = top;
+	terminal->scroll_bottom = bottom;
+
+	if (abs(terminal->pending_scroll) >= rows) {
+		terminal->pending_scroll = 0;
+		terminal_damage_rows(terminal, top, bottom);
+		return;
+	}
+
+	if (d > 0) {
+		for (i = top; i <= bottom - d; i++)
+			terminal->damage[i] = terminal->damage[i + d];
+		terminal_damage_rows(terminal, bottom - d + 1, bottom);
+	} else {
+		for (i = bottom; i >= top - d; i--)
+			terminal->damage[i] = terminal->damage[i + d];
+		terminal_damage_rows(terminal, top, top - d - 1);
+	}
+}
 
 static void
 terminal_scroll_buffer(struct terminal *terminal, int d)
 {
 	int i;
 
+	terminal_damage_scroll(terminal, 0, terminal->height - 1, d);
+
 	terminal->start += d;
 	if (d < 0) {
 		d = 0 - d;
@@ -665,6 +861,8 @@ terminal_scroll_window(struct terminal *terminal, int d)
 	// scrolling range is inclusive
 	window_height = terminal->margin_bottom - terminal->margin_top + 1;
 	d = d % (window_height + 1);
+	terminal_damage_scroll(terminal, terminal->margin_top,
+			       terminal->margin_bottom, d);
 	if (d < 0) {
 		d = 0 - d;
 		to_row = terminal->margin_bottom;
@@ -720,6 +918,8 @@ terminal_shift_line(struct terminal *terminal, int d)
 
 	row = terminal_get_row(terminal, terminal->row);
 	attr_row = terminal_get_attr_row(terminal, terminal->row);
+	terminal_damage_cells(terminal, terminal->row,
+			      terminal->column - 1, terminal->width);
 
 	if ((terminal->width + d) <= terminal->column)
 		d = terminal->column + 1 - terminal->width;
@@ -745,86 +945,105 @@ terminal_shift_line(struct terminal *terminal, int d)
 	}
 }
 
+/* Move the rows into a ring of rows slots, each width cells wide. Only
+ * the rows in the ring are copied, the history is left alone and
+ * adapted to the width when it is read back. */
 static void
-terminal_resize_cells(struct terminal *terminal,
-		      int width, int height)
+terminal_resize_ring(struct terminal *terminal, int width, uint32_t rows)
 {
 	union utf8_char *data;
 	struct attr *data_attr;
-	char *tab_ruler;
-	int data_pitch, attr_pitch;
-	int i, l, total_rows;
-	uint32_t d, uheight = height;
+	uint32_t *row_tag;
+	int data_pitch, attr_pitch, l;
+	uint32_t i, slot;
+
+	data_pitch = width * sizeof(union utf8_char);
+	data = xzalloc(data_pitch * rows);
+	attr_pitch = width * sizeof(struct attr);
+	data_attr = xmalloc(attr_pitch * rows);
+	attr_init(data_attr, terminal->curr_attr, width * rows);
+	row_tag = xmalloc(rows * sizeof *row_tag);
+	for (i = 0; i < rows; i++)
+		row_tag[i] = ROW_TAG_NONE;
+
+	l = MIN(width, terminal->max_width);
+	for (i = 0; i < terminal->ring_rows; i++) {
+		if (terminal->row_tag[i] == ROW_TAG_NONE)
+			continue;
+		slot = terminal->row_tag[i] & (rows - 1);
+		memcpy((void *) data + slot * data_pitch,
+		       (void *) terminal->data + i * terminal->data_pitch,
+		       l * sizeof(union utf8_char));
+		memcpy((void *) data_attr + slot * attr_pitch,
+		       (void *) terminal->data_attr + i * terminal->attr_pitch,
+		       l * sizeof(struct attr));
+		row_tag[slot] = terminal->row_tag[i];
+	}
+
+	free(terminal->data);
+	free(terminal->data_attr);
+	free(terminal->row_tag);
+
+	terminal->max_width = width;
+	terminal->ring_rows = rows;
+	terminal->data_pitch = data_pitch;
+	terminal->attr_pitch = attr_pitch;
+	terminal->data = data;
+	terminal->data_attr = data_attr;
+	terminal->row_tag = row_tag;
+}
+
+static void
+terminal_resize_cells(struct terminal *terminal,
+		      int width, int height)
+{
+	int i;
+	uint32_t d, rows;
 	struct rectangle allocation;
 	struct winsize ws;
 
-	if (uheight > terminal->buffer_height)
-		height = terminal->buffer_height;
-
 	if (terminal->width == width && terminal->height == height)
 		return;
 
-	if (terminal->data && width <= terminal->max_width) {
+	if (terminal->data) {
 		d = 0;
 		if (height < terminal->height && height <= terminal->row)
 			d = terminal->height - height;
 		else if (height > terminal->height &&
 			 terminal->height - 1 == terminal->row) {
 			d = terminal->height - height;
-			if (terminal->log_size < uheight)
+			if (terminal->log_size < (uint32_t) height)
 				d = -terminal->start;
 		}
 
 		terminal->start += d;
 		terminal->row -= d;
-	} else {
-		terminal->max_width = width;
-		data_pitch = width * sizeof(union utf8_char);
-		data = xzalloc(data_pitch * terminal->buffer_height);
-		attr_pitch = width * sizeof(struct attr);
-		data_attr = xmalloc(attr_pitch * terminal->buffer_height);
-		tab_ruler = xzalloc(width);
-		attr_init(data_attr, terminal->curr_attr,
-			  width * terminal->buffer_height);
-
-		if (terminal->data && terminal->data_attr) {
-			if (width > terminal->width)
-				l = terminal->width;
-			else
-				l = width;
-
-			if (terminal->height > height) {
-				total_rows = height;
-				i = 1 + terminal->row - height;
-				if (i > 0) {
-					terminal->start += i;
-					terminal->row = terminal->row - i;
-				}
-			} else {
-				total_rows = terminal->height;
-			}
-
-			for (i = 0; i < total_rows; i++) {
-				memcpy(&data[width * i],
-				       terminal_get_row(terminal, i),
-				       l * sizeof(union utf8_char));
-				memcpy(&data_attr[width * i],
-				       terminal_get_attr_row(terminal, i),
-				       l * sizeof(struct attr));
-			}
+	}
 
-			free(terminal->data);
-			free(terminal->data_attr);
-			free(terminal->tab_ruler);
-		}
+	/* The ring holds at least two screens, so that the rows on
+	 * screen never push each other out. */
+	rows = terminal->ring_rows ? terminal->ring_rows : 64;
+	while (rows < 2 * (uint32_t) height)
+		rows *= 2;
+	if (width > terminal->max_width || rows > terminal->ring_rows) {
+		terminal_resize_ring(terminal, MAX(width, terminal->max_width),
+				     rows);
+		free(terminal->tab_ruler);
+		terminal->tab_ruler = xzalloc(terminal->max_width);
+		terminal->view_rows = 0;
+	}
 
-		terminal->data_pitch = data_pitch;
-		terminal->attr_pitch = attr_pitch;
-		terminal->data = data;
-		terminal->data_attr = data_attr;
-		terminal->tab_ruler = tab_ruler;
-		terminal->start = 0;
+	if (height > terminal->view_rows) {
+		free(terminal->view_data);
+		free(terminal->view_attr);
+		free(terminal->view_tag);
+		terminal->view_data = xzalloc(terminal->data_pitch * height);
+		terminal->view_attr = xzalloc(terminal->attr_pitch * height);
+		terminal->view_tag = xmalloc(height * sizeof *terminal->view_tag);
+		terminal->view_rows = height;
 	}
+	for (i = 0; i < terminal->view_rows; i++)
+		terminal->view_tag[i] = ROW_TAG_NONE;
 
 	terminal->margin_bottom =
 		height - (terminal->height - terminal->margin_bottom);
@@ -832,6 +1051,10 @@ terminal_resize_cells(struct terminal *terminal,
 	terminal->height = height;
 	terminal_init_tabs(terminal);
 
+	free(terminal->damage);
+	terminal->damage = xzalloc(height * sizeof *terminal->damage);
+	terminal_damage_all(terminal);
+
 	/* Update the window size */
 	ws.ws_row = terminal->height;
 	ws.ws_col = terminal->width;
@@ -972,187 +1195,330 @@ terminal_send_selection(struct terminal *terminal, int fd)
 	fclose(fp);
 }
 
-struct glyph_run {
-	struct terminal *terminal;
-	cairo_t *cr;
-	unsigned int count;
+static void
+draw_row(struct terminal *terminal, cairo_t *cr, int row)
+{
+	union utf8_char *p_row;
 	union decoded_attr attr;
-	cairo_glyph_t glyphs[256], *g;
-};
+	int col, text_x, text_y, fg = -1;
+	struct glyph_cache *glyphs;
+	cairo_font_extents_t extents;
+	double average_width;
+	double unichar_width;
+	double d;
+
+	extents = terminal->extents;
+	average_width = terminal->average_width;
+	p_row = terminal_get_row(terminal, row);
+
+	/* paint the background */
+	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+	terminal_set_color(terminal, cr, terminal->color_scheme->border);
+	cairo_paint(cr);
+
+	for (col = 0; col < terminal->width; col++) {
+		/* get the attributes for this character cell */
+		terminal_decode_attr(terminal, row, col, &attr);
+
+		if (attr.attr.bg == terminal->color_scheme->border)
+			continue;
+
+		if (is_wide(p_row[col]))
+			unichar_width = 2 * average_width;
+		else
+			unichar_width = average_width;
+
+		terminal_set_color(terminal, cr, attr.attr.bg);
+		cairo_move_to(cr, col * average_width,
+			      row * extents.height);
+		cairo_rel_line_to(cr, unichar_width, 0);
+		cairo_rel_line_to(cr, 0, extents.height);
+		cairo_rel_line_to(cr, -unichar_width, 0);
+		cairo_close_path(cr);
+		cairo_fill(cr);
+	}
+
+	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+
+	/* paint the foreground */
+	for (col = 0; col < terminal->width; col++) {
+		/* get the attributes for this character cell */
+		terminal_decode_attr(terminal, row, col, &attr);
 
+		if (attr.attr.fg != fg) {
+			fg = attr.attr.fg;
+			terminal_set_color(terminal, cr, fg);
+		}
+
+		text_x = col * average_width;
+		text_y = extents.ascent + row * extents.height;
+		if (attr.attr.a & ATTRMASK_UNDERLINE) {
+			cairo_move_to(cr, text_x, (double)text_y + 1.5);
+			cairo_line_to(cr, text_x + average_width, (double) text_y + 1.5);
+			cairo_stroke(cr);
+		}
+
+		/* skip space glyph (RLE) we use as a placeholder of
+		   the right half of a double-width character,
+		   because RLE is not available in every font. */
+		if (p_row[col].ch == 0x200B || p_row[col].byte[0] == 0 ||
+		    (attr.attr.a & ATTRMASK_CONCEALED))
+			continue;
+
+		if (attr.attr.a & (ATTRMASK_BOLD | ATTRMASK_BLINK))
+			glyphs = terminal->glyphs_bold;
+		else
+			glyphs = terminal->glyphs_normal;
+
+		cairo_move_to(cr, text_x, text_y);
+		glyph_cache_show_text(glyphs, cr, (char *) p_row[col].byte,
+				      sizeof p_row[col].byte);
+	}
+
+	if ((terminal->mode & MODE_SHOW_CURSOR) &&
+	    !window_has_focus(terminal->window) && terminal->row == row) {
+		d = 0.5;
+
+		cairo_set_line_width(cr, 1);
+		cairo_move_to(cr, terminal->column * average_width + d,
+			      terminal->row * extents.height + d);
+		cairo_rel_line_to(cr, average_width - 2 * d, 0);
+		cairo_rel_line_to(cr, 0, extents.height - 2 * d);
+		cairo_rel_line_to(cr, -average_width + 2 * d, 0);
+		cairo_close_path(cr);
+
+		cairo_stroke(cr);
+	}
+}
+
+/* The cursor cell is drawn differently, so the cells it moves from and
+ * to need drawing too. Cells next to it are included for wide
+ * characters. */
 static void
-glyph_run_init(struct glyph_run *run, struct terminal *terminal, cairo_t *cr)
+damage_cursor(struct terminal *terminal)
 {
-	run->terminal = terminal;
-	run->cr = cr;
-	run->g = run->glyphs;
-	run->count = 0;
-	run->attr.key = 0;
+	int cursor = 0;
+
+	if (terminal->mode & MODE_SHOW_CURSOR)
+		cursor = window_has_focus(terminal->window) ? 1 : 2;
+
+	if (cursor == terminal->drawn_cursor &&
+	    terminal->row == terminal->drawn_row &&
+	    terminal->column == terminal->drawn_column)
+		return;
+
+	if (terminal->drawn_cursor)
+		terminal_damage_cells(terminal, terminal->drawn_row,
+				      terminal->drawn_column - 1,
+				      terminal->drawn_column + 2);
+	if (cursor)
+		terminal_damage_cells(terminal, terminal->row,
+				      terminal->column - 1,
+				      terminal->column + 2);
+
+	terminal->drawn_cursor = cursor;
+	terminal->drawn_row = terminal->row;
+	terminal->drawn_column = terminal->column;
 }
 
-static void
-glyph_run_flush(struct glyph_run *run, union decoded_attr attr)
+static int
+canvas_update(struct terminal *terminal, struct rectangle *allocation)
 {
-	cairo_scaled_font_t *font;
+	int scale = window_get_buffer_scale(terminal->window);
 
-	if (run->count > ARRAY_LENGTH(run->glyphs) - 10 ||
-	    (attr.key != run->attr.key)) {
-		if (run->attr.attr.a & (ATTRMASK_BOLD | ATTRMASK_BLINK))
-			font = run->terminal->font_bold;
-		else
-			font = run->terminal->font_normal;
-		cairo_set_scaled_font(run->cr, font);
-		terminal_set_color(run->terminal, run->cr,
-				   run->attr.attr.fg);
+	if (terminal->canvas &&
+	    terminal->canvas_scale == scale &&
+	    cairo_image_surface_get_width(terminal->canvas) ==
+	    allocation->width * scale &&
+	    cairo_image_surface_get_height(terminal->canvas) ==
+	    allocation->height * scale)
+		return 0;
+
+	if (terminal->canvas)
+		cairo_surface_destroy(terminal->canvas);
 
-		if (!(run->attr.attr.a & ATTRMASK_CONCEALED))
-			cairo_show_glyphs (run->cr, run->glyphs, run->count);
-		run->g = run->glyphs;
-		run->count = 0;
+	terminal->canvas =
+		cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+					   allocation->width * scale,
+					   allocation->height * scale);
+	if (cairo_surface_status(terminal->canvas) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy(terminal->canvas);
+		terminal->canvas = NULL;
+		return -1;
 	}
-	run->attr = attr;
+
+	terminal->canvas_scale = scale;
+	terminal_damage_all(terminal);
+
+	return 0;
+}
+
+/* Move the rows of the pending scroll within the canvas, instead of
+ * drawing them again. Row heights are whole pixels, so this is a plain
+ * copy of pixel rows. */
+static int
+canvas_scroll(struct terminal *terminal, int top_margin)
+{
+	int scale = terminal->canvas_scale;
+	int row_height = terminal->extents.height * scale;
+	int rows = terminal->scroll_bottom - terminal->scroll_top + 1;
+	int d = terminal->pending_scroll;
+	int stride, y;
+	unsigned char *data;
+
+	cairo_surface_flush(terminal->canvas);
+	data = cairo_image_surface_get_data(terminal->canvas);
+	stride = cairo_image_surface_get_stride(terminal->canvas);
+	y = (top_margin + terminal->scroll_top * terminal->extents.height) *
+		scale;
+	if (y < 0 || y + rows * row_height >
+	    cairo_image_surface_get_height(terminal->canvas))
+		return -1;
+
+	if (d > 0)
+		memmove(data + y * stride,
+			data + (y + d * row_height) * stride,
+			(rows - d) * row_height * stride);
+	else
+		memmove(data + (y - d * row_height) * stride,
+			data + y * stride,
+			(rows + d) * row_height * stride);
+
+	cairo_surface_mark_dirty(terminal->canvas);
+
+	return 0;
 }
 
 static void
-glyph_run_add(struct glyph_run *run, int x, int y, union utf8_char *c)
+report_damage(struct terminal *terminal, struct rectangle *allocation,
+	      int side_margin, int top_margin)
 {
-	int num_glyphs;
-	cairo_scaled_font_t *font;
+	struct terminal_damage *damage = terminal->damage;
+	int row, last, start, end;
+	int x, y;
+
+	if (terminal->damage_all) {
+		widget_damage(terminal->widget, allocation->x, allocation->y,
+			      allocation->width, allocation->height);
+		return;
+	}
 
-	num_glyphs = ARRAY_LENGTH(run->glyphs) - run->count;
+	if (terminal->pending_scroll)
+		widget_damage(terminal->widget, allocation->x,
+			      allocation->y + top_margin +
+			      terminal->scroll_top * terminal->extents.height,
+			      allocation->width,
+			      (terminal->scroll_bottom - terminal->scroll_top + 1) *
+			      terminal->extents.height);
+
+	/* One rectangle for each run of damaged rows. Glyphs may overhang
+	 * into the next cell, so one more cell goes on both sides. */
+	for (row = 0; row < terminal->height; row = last) {
+		if (damage[row].start >= damage[row].end) {
+			last = row + 1;
+			continue;
+		}
 
-	if (run->attr.attr.a & (ATTRMASK_BOLD | ATTRMASK_BLINK))
-		font = run->terminal->font_bold;
-	else
-		font = run->terminal->font_normal;
+		start = damage[row].start;
+		end = damage[row].end;
+		for (last = row + 1; last < terminal->height; last++) {
+			if (damage[last].start >= damage[last].end)
+				break;
+			start = MIN(start, damage[last].start);
+			end = MAX(end, damage[last].end);
+		}
 
-	cairo_move_to(run->cr, x, y);
-	cairo_scaled_font_text_to_glyphs (font, x, y,
-					  (char *) c->byte, 4,
-					  &run->g, &num_glyphs,
-					  NULL, NULL, NULL);
-	run->g += num_glyphs;
-	run->count += num_glyphs;
+		x = allocation->x + side_margin +
+			(start - 1) * terminal->average_width;
+		y = allocation->y + top_margin + row * terminal->extents.height;
+		widget_damage(terminal->widget, x, y,
+			      (end - start + 2) * terminal->average_width,
+			      (last - row) * terminal->extents.height);
+	}
 }
 
-
 static void
 redraw_handler(struct widget *widget, void *data)
 {
 	struct terminal *terminal = data;
-	struct rectangle allocation;
+	struct rectangle allocation, repaint;
 	cairo_t *cr;
 	int top_margin, side_margin;
-	int row, col, cursor_x, cursor_y;
-	union utf8_char *p_row;
-	union decoded_attr attr;
-	int text_x, text_y;
+	int row, cursor_x, cursor_y;
 	cairo_surface_t *surface;
-	double d;
-	struct glyph_run run;
 	cairo_font_extents_t extents;
 	double average_width;
-	double unichar_width;
+	int scale;
 
-	surface = window_get_surface(terminal->window);
 	widget_get_allocation(terminal->widget, &allocation);
-	cr = widget_cairo_create(terminal->widget);
-	cairo_rectangle(cr, allocation.x, allocation.y,
-			allocation.width, allocation.height);
-	cairo_clip(cr);
-	cairo_push_group(cr);
-
-	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
-	terminal_set_color(terminal, cr, terminal->color_scheme->border);
-	cairo_paint(cr);
-
-	cairo_set_scaled_font(cr, terminal->font_normal);
+	if (canvas_update(terminal, &allocation) < 0)
+		return;
 
 	extents = terminal->extents;
 	average_width = terminal->average_width;
 	side_margin = (allocation.width - terminal->width * average_width) / 2;
 	top_margin = (allocation.height - terminal->height * extents.height) / 2;
-
-	cairo_set_line_width(cr, 1.0);
-	cairo_translate(cr, allocation.x + side_margin,
-			allocation.y + top_margin);
-	/* paint the background */
-	for (row = 0; row < terminal->height; row++) {
-		p_row = terminal_get_row(terminal, row);
-		for (col = 0; col < terminal->width; col++) {
-			/* get the attributes for this character cell */
-			terminal_decode_attr(terminal, row, col, &attr);
-
-			if (attr.attr.bg == terminal->color_scheme->border)
-				continue;
-
-			if (is_wide(p_row[col]))
-				unichar_width = 2 * average_width;
-			else
-				unichar_width = average_width;
-
-			terminal_set_color(terminal, cr, attr.attr.bg);
-			cairo_move_to(cr, col * average_width,
-				      row * extents.height);
-			cairo_rel_line_to(cr, unichar_width, 0);
-			cairo_rel_line_to(cr, 0, extents.height);
-			cairo_rel_line_to(cr, -unichar_width, 0);
-			cairo_close_path(cr);
-			cairo_fill(cr);
-		}
+	scale = terminal->canvas_scale;
+
+	damage_cursor(terminal);
+	report_damage(terminal, &allocation, side_margin, top_margin);
+
+	cr = cairo_create(terminal->canvas);
+	cairo_scale(cr, scale, scale);
+
+	if (terminal->damage_all) {
+		cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+		terminal_set_color(terminal, cr, terminal->color_scheme->border);
+		cairo_paint(cr);
+	} else if (terminal->pending_scroll &&
+		   canvas_scroll(terminal, top_margin) < 0) {
+		terminal_damage_rows(terminal, terminal->scroll_top,
+				     terminal->scroll_bottom);
 	}
 
-	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+	cairo_set_line_width(cr, 1.0);
+	cairo_translate(cr, side_margin, top_margin);
 
-	/* paint the foreground */
-	glyph_run_init(&run, terminal, cr);
+	benchmark.frames++;
 	for (row = 0; row < terminal->height; row++) {
-		p_row = terminal_get_row(terminal, row);
-		for (col = 0; col < terminal->width; col++) {
-			/* get the attributes for this character cell */
-			terminal_decode_attr(terminal, row, col, &attr);
-
-			glyph_run_flush(&run, attr);
+		if (!terminal->damage_all &&
+		    terminal->damage[row].start >= terminal->damage[row].end)
+			continue;
 
-			text_x = col * average_width;
-			text_y = extents.ascent + row * extents.height;
-			if (attr.attr.a & ATTRMASK_UNDERLINE) {
-				terminal_set_color(terminal, cr, attr.attr.fg);
-				cairo_move_to(cr, text_x, (double)text_y + 1.5);
-				cairo_line_to(cr, text_x + average_width, (double) text_y + 1.5);
-				cairo_stroke(cr);
-			}
+		benchmark.rows++;
 
-                        /* skip space glyph (RLE) we use as a placeholder of
-                           the right half of a double-width character,
-                           because RLE is not available in every font. */
-			if (p_row[col].ch == 0x200B)
-				continue;
+		cairo_save(cr);
+		cairo_rectangle(cr, -side_margin, row * extents.height,
+				allocation.width, extents.height);
+		cairo_clip(cr);
+		draw_row(terminal, cr, row);
+		cairo_restore(cr);
 
-			glyph_run_add(&run, text_x, text_y, &p_row[col]);
-		}
+		terminal->damage[row].end = 0;
 	}
 
-	attr.key = ~0;
-	glyph_run_flush(&run, attr);
-
-	if ((terminal->mode & MODE_SHOW_CURSOR) &&
-	    !window_has_focus(terminal->window)) {
-		d = 0.5;
+	cairo_destroy(cr);
 
-		cairo_set_line_width(cr, 1);
-		cairo_move_to(cr, terminal->column * average_width + d,
-			      terminal->row * extents.height + d);
-		cairo_rel_line_to(cr, average_width - 2 * d, 0);
-		cairo_rel_line_to(cr, 0, extents.height - 2 * d);
-		cairo_rel_line_to(cr, -average_width + 2 * d, 0);
-		cairo_close_path(cr);
+	terminal->damage_all = 0;
+	terminal->pending_scroll = 0;
 
-		cairo_stroke(cr);
+	/* Only what changed since this window buffer was last used needs
+	 * to go into it. */
+	surface = window_get_surface(terminal->window);
+	cr = widget_cairo_create(terminal->widget);
+	if (widget_get_repaint_extents(terminal->widget, &repaint) == 0) {
+		cairo_rectangle(cr, repaint.x, repaint.y,
+				repaint.width, repaint.height);
+		cairo_clip(cr);
 	}
-
-	cairo_pop_group_to_source(cr);
-	cairo_paint(cr);
+	cairo_translate(cr, allocation.x, allocation.y);
+	cairo_scale(cr, 1.0 / scale, 1.0 / scale);
+	cairo_set_source_surface(cr, terminal->canvas, 0, 0);
+	cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_NEAREST);
+	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+	cairo_rectangle(cr, 0, 0,
+			allocation.width * scale, allocation.height * scale);
+	cairo_fill(cr);
 	cairo_destroy(cr);
 	cairo_surface_destroy(surface);
 
@@ -1209,6 +1575,7 @@ handle_term_parameter(struct terminal *terminal, int code, int sr)
 
 			/* set columns, but also home cursor and clear screen */
 			terminal->row = 0; terminal->column = 0;
+			terminal_damage_all(terminal);
 			for (i = 0; i < terminal->height; i++) {
 				memset(terminal_get_row(terminal, i),
 				    0, terminal->data_pitch);
@@ -1219,6 +1586,7 @@ handle_term_parameter(struct terminal *terminal, int code, int sr)
 		case 5:  /* DECSCNM */
 			if (sr)	terminal->mode |=  MODE_INVERSE;
 			else	terminal->mode &= ~MODE_INVERSE;
+			terminal_damage_all(terminal);
 			break;
 		case 6:  /* DECOM */
 			terminal->origin_mode = sr;
@@ -1438,6 +1806,8 @@ handle_escape(struct terminal *terminal)
 			       0, (terminal->width - terminal->column) * sizeof(union utf8_char));
 			attr_init(&attr_row[terminal->column],
 			       terminal->curr_attr, terminal->width - terminal->column);
+			terminal_damage_rows(terminal, terminal->row,
+					     terminal->height - 1);
 			for (i = terminal->row + 1; i < terminal->height; i++) {
 				memset(terminal_get_row(terminal, i),
 				    0, terminal->data_pitch);
@@ -1447,6 +1817,7 @@ handle_escape(struct terminal *terminal)
 		} else if (args[0] == 1) {
 			memset(row, 0, (terminal->column+1) * sizeof(union utf8_char));
 			attr_init(attr_row, terminal->curr_attr, terminal->column+1);
+			terminal_damage_rows(terminal, 0, terminal->row);
 			for (i = 0; i < terminal->row; i++) {
 				memset(terminal_get_row(terminal, i),
 				    0, terminal->data_pitch);
@@ -1462,6 +1833,7 @@ handle_escape(struct terminal *terminal)
 	case 'K':    /* EL - Erase line */
 		row = terminal_get_row(terminal, terminal->row);
 		attr_row = terminal_get_attr_row(terminal, terminal->row);
+		terminal_damage_rows(terminal, terminal->row, terminal->row);
 		if (!set[0] || args[0] == 0 || args[0] > 2) {
 			memset(&row[terminal->column], 0,
 			    (terminal->width - terminal->column) * sizeof(union utf8_char));
@@ -1490,6 +1862,8 @@ handle_escape(struct terminal *terminal)
 			       0, terminal->data_pitch);
 			attr_init(terminal_get_attr_row(terminal, terminal->row),
 				terminal->curr_attr, terminal->width);
+			terminal_damage_rows(terminal, terminal->row,
+					     terminal->row);
 		}
 		break;
 	case 'M':    /* DL - Delete <count> lines */
@@ -1505,6 +1879,8 @@ handle_escape(struct terminal *terminal)
 		} else if (terminal->row == terminal->margin_bottom) {
 			memset(terminal_get_row(terminal, terminal->row),
 			       0, terminal->data_pitch);
+			terminal_damage_rows(terminal, terminal->row,
+					     terminal->row);
 		}
 		break;
 	case 'P':    /* DCH - Delete <count> characters on current line */
@@ -1527,6 +1903,8 @@ handle_escape(struct terminal *terminal)
 		attr_row = terminal_get_attr_row(terminal, terminal->row);
 		memset(&row[terminal->column], 0, count * sizeof(union utf8_char));
 		attr_init(&attr_row[terminal->column], terminal->curr_attr, count);
+		terminal_damage_cells(terminal, terminal->row, terminal->column,
+				      terminal->column + count);
 		break;
 	case 'Z':    /* CBT */
 		count = set[0] ? args[0] : 1;
@@ -1720,6 +2098,7 @@ handle_non_csi_escape(struct terminal *terminal, char code)
 		break;
 	case 'c':    /* RIS - Reset*/
 		terminal_init(terminal);
+		terminal_damage_all(terminal);
 		break;
 	case 'H':    /* HTS - Set tab stop at current column */
 		terminal->tab_ruler[terminal->column] = 1;
@@ -1757,17 +2136,20 @@ handle_non_csi_escape(struct terminal *terminal, char code)
 static void
 handle_special_escape(struct terminal *terminal, char special, char code)
 {
-	int i, numChars;
+	union utf8_char *row;
+	int i, j;
 
 	if (special == '#') {
 		switch(code) {
 		case '8':
 			/* fill with 'E', no cheap way to do this */
-			memset(terminal->data, 0, terminal->data_pitch * terminal->height);
-			numChars = terminal->width * terminal->height;
-			for (i = 0; i < numChars; i++) {
-				terminal->data[i].byte[0] = 'E';
+			for (i = 0; i < terminal->height; i++) {
+				row = terminal_get_row(terminal, i);
+				memset(row, 0, terminal->data_pitch);
+				for (j = 0; j < terminal->width; j++)
+					row[j].byte[0] = 'E';
 			}
+			terminal_damage_all(terminal);
 			break;
 		default:
 			fprintf(stderr, "Unknown HASH escape #%c\n", code);
@@ -1903,6 +2285,8 @@ handle_special_char(struct terminal *terminal, char c)
 
 		break;
 	case '\t':
+		terminal_damage_cells(terminal, terminal->row,
+				      terminal->column, terminal->width);
 		while (terminal->column < terminal->width) {
 			if (terminal->mode & MODE_IRM)
 				terminal_shift_line(terminal, +1);
@@ -1996,15 +2380,15 @@ handle_char(struct terminal *terminal, union utf8_char utf8)
 
 	if (terminal->mode & MODE_IRM)
 		terminal_shift_line(terminal, +1);
+	terminal_damage_cells(terminal, terminal->row, terminal->column - 1,
+			      terminal->column + (is_wide(utf8) ? 3 : 2));
 	row[terminal->column] = utf8;
 	attr_row[terminal->column++] = terminal->curr_attr;
 
 	if (terminal->row + terminal->start + 1 > terminal->end)
 		terminal->end = terminal->row + terminal->start + 1;
-	if (terminal->end == terminal->buffer_height)
-		terminal->log_size = terminal->buffer_height;
-	else if (terminal->log_size < terminal->buffer_height)
-		terminal->log_size = terminal->end;
+	terminal->log_size = MIN(terminal->end, (uint32_t)
+				 (option_scrollback_lines + terminal->height));
 
 	/* cursor jump for wide character. */
 	if (is_wide(utf8))
@@ -2041,6 +2425,10 @@ terminal_data(struct terminal *terminal, const char *data, size_t length)
 	union utf8_char utf8;
 	enum utf8_state parser_state;
 
+	if (benchmark.bytes == 0)
+		clock_gettime(CLOCK_MONOTONIC, &benchmark.begin);
+	benchmark.bytes += length;
+
 	for (i = 0; i < length; i++) {
 		parser_state =
 			utf8_next_char(&terminal->state_machine, data[i]);
@@ -2181,7 +2569,7 @@ terminal_data(struct terminal *terminal, const char *data, size_t length)
 		} /* if */
 	} /* for */
 
-	window_schedule_redraw(terminal->window);
+	widget_schedule_partial_redraw(terminal->widget);
 }
 
 static void
@@ -2320,11 +2708,12 @@ handle_bound_key(struct terminal *terminal,
 			return 1;
 
 		terminal->scrolling = 1;
+		terminal_damage_scroll(terminal, 0, terminal->height - 1, -1);
 		terminal->start--;
 		terminal->row++;
 		terminal->selection_start_row++;
 		terminal->selection_end_row++;
-		widget_schedule_redraw(terminal->widget);
+		widget_schedule_partial_redraw(terminal->widget);
 		return 1;
 
 	case XKB_KEY_Down:
@@ -2335,11 +2724,12 @@ handle_bound_key(struct terminal *terminal,
 			return 1;
 
 		terminal->scrolling = 1;
+		terminal_damage_scroll(terminal, 0, terminal->height - 1, 1);
 		terminal->start++;
 		terminal->row--;
 		terminal->selection_start_row--;
 		terminal->selection_end_row--;
-		widget_schedule_redraw(terminal->widget);
+		widget_schedule_partial_redraw(terminal->widget);
 		return 1;
 
 	default:
@@ -2561,12 +2951,14 @@ key_handler(struct window *window, struct input *input, uint32_t time,
 	if (state == WL_KEYBOARD_KEY_STATE_PRESSED && len > 0) {
 		if (terminal->scrolling) {
 			d = terminal->saved_start - terminal->start;
+			terminal_damage_scroll(terminal, 0,
+					       terminal->height - 1, d);
 			terminal->row -= d;
 			terminal->selection_start_row -= d;
 			terminal->selection_end_row -= d;
 			terminal->start = terminal->saved_start;
 			terminal->scrolling = 0;
-			widget_schedule_redraw(terminal->widget);
+			widget_schedule_partial_redraw(terminal->widget);
 		}
 
 		terminal_write(terminal, ch, len);
@@ -2756,8 +3148,10 @@ click_handler(struct widget *widget, struct terminal *terminal,
 
 	terminal->selection_end_x = terminal->selection_start_x = x;
 	terminal->selection_end_y = terminal->selection_start_y = y;
-	if (recompute_selection(terminal))
-			widget_schedule_redraw(widget);
+	if (recompute_selection(terminal)) {
+		terminal_damage_all(terminal);
+		widget_schedule_redraw(widget);
+	}
 }
 
 static void
@@ -2805,8 +3199,10 @@ motion_handler(struct widget *widget,
 				   &terminal->selection_end_x,
 				   &terminal->selection_end_y);
 
-		if (recompute_selection(terminal))
+		if (recompute_selection(terminal)) {
+			terminal_damage_all(terminal);
 			widget_schedule_redraw(widget);
+		}
 	}
 
 	return CURSOR_IBEAM;
@@ -2852,12 +3248,14 @@ axis_handler(struct widget *widget,
 			terminal->saved_start = terminal->start;
 		terminal->scrolling = 1;
 
+		terminal_damage_scroll(terminal, 0, terminal->height - 1,
+				       lines);
 		terminal->start += lines;
 		terminal->row -= lines;
 		terminal->selection_start_row -= lines;
 		terminal->selection_end_row -= lines;
 
-		widget_schedule_redraw(widget);
+		widget_schedule_partial_redraw(widget);
 	}
 }
 
@@ -2903,8 +3301,10 @@ touch_motion_handler(struct widget *widget, struct input *input,
 		terminal->selection_end_x = (int)x;
 		terminal->selection_end_y = (int)y;
 
-		if (recompute_selection(terminal))
+		if (recompute_selection(terminal)) {
+			terminal_damage_all(terminal);
 			widget_schedule_redraw(widget);
+		}
 	}
 }
 
@@ -2936,9 +3336,10 @@ terminal_create(struct display *display)
 
 	terminal->display = display;
 	terminal->margin = 5;
-	terminal->buffer_height = 1024;
 	terminal->end = 1;
+	history_init(&terminal->history, option_scrollback_lines);
 
+	window_set_reuse_shm_pool(terminal->window, 1);
 	window_set_user_data(terminal->window, terminal);
 	window_set_key_handler(terminal->window, key_handler);
 	window_set_keyboard_focus_handler(terminal->window,
@@ -2976,7 +3377,12 @@ terminal_create(struct display *display)
 	terminal->font_normal = cairo_get_scaled_font (cr);
 	cairo_scaled_font_reference(terminal->font_normal);
 
+	terminal->glyphs_normal = glyph_cache_create(terminal->font_normal);
+	terminal->glyphs_bold = glyph_cache_create(terminal->font_bold);
+
 	cairo_font_extents(cr, &terminal->extents);
+	/* Whole pixel rows, so that scrolling can move pixels around. */
+	terminal->extents.height = ceil(terminal->extents.height);
 
 	/* Compute the average ascii glyph width */
 	cairo_text_extents(cr, TERMINAL_DRAW_SINGLE_WIDE_CHARACTERS,
@@ -3008,10 +3414,54 @@ terminal_destroy(struct terminal *terminal)
 	if (wl_list_empty(&terminal_list))
 		display_exit(terminal->display);
 
+	if (terminal->canvas)
+		cairo_surface_destroy(terminal->canvas);
+	glyph_cache_destroy(terminal->glyphs_normal);
+	glyph_cache_destroy(terminal->glyphs_bold);
+	free(terminal->damage);
+	free(terminal->data);
+	free(terminal->data_attr);
+	free(terminal->row_tag);
+	free(terminal->view_data);
+	free(terminal->view_attr);
+	free(terminal->view_tag);
+	free(terminal->tab_ruler);
+	history_release(&terminal->history);
 	free(terminal->title);
 	free(terminal);
 }
 
+static void
+benchmark_report(struct terminal *terminal)
+{
+	struct glyph_cache_stats normal, bold;
+	struct timespec now;
+	double seconds, mib;
+	uint64_t lookups;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	seconds = now.tv_sec - benchmark.begin.tv_sec +
+		(now.tv_nsec - benchmark.begin.tv_nsec) / 1e9;
+	mib = benchmark.bytes / (1024.0 * 1024.0);
+
+	printf("%.1f MiB in %.3f s: %.1f MiB/s, %u frames, "
+	       "%.1f rows drawn per frame\n",
+	       mib, seconds, seconds > 0 ? mib / seconds : 0.0,
+	       benchmark.frames,
+	       benchmark.frames ? (double) benchmark.rows / benchmark.frames : 0.0);
+
+	glyph_cache_get_stats(terminal->glyphs_normal, &normal);
+	glyph_cache_get_stats(terminal->glyphs_bold, &bold);
+	lookups = normal.hits + normal.misses + bold.hits + bold.misses;
+	printf("glyph cache: %.2f%% hits, %u glyphs, %zu KiB of atlas\n",
+	       lookups ? 100.0 * (normal.hits + bold.hits) / lookups : 0.0,
+	       normal.glyphs + bold.glyphs,
+	       (normal.atlas_bytes + bold.atlas_bytes) / 1024);
+	printf("scrollback: %u rows in %zu KiB\n",
+	       terminal->history.end - terminal->history.begin,
+	       terminal->history.bytes / 1024);
+}
+
 static void
 io_handler(struct task *task, uint32_t events)
 {
@@ -3021,6 +3471,13 @@ io_handler(struct task *task, uint32_t events)
 	int len;
 
 	if (events & EPOLLHUP) {
+		if (option_benchmark) {
+			/* Take in what cat wrote before exiting. */
+			while ((len = read(terminal->master,
+					   buffer, sizeof buffer)) > 0)
+				terminal_data(terminal, buffer, len);
+			benchmark_report(terminal);
+		}
 		terminal_destroy(terminal);
 		return;
 	}
@@ -3067,7 +3524,11 @@ terminal_run(struct terminal *terminal, const char *path)
 		close(pipes[0]);
 		setenv("TERM", option_term, 1);
 		setenv("COLORTERM", option_term, 1);
-		if (execl(path, path, NULL)) {
+		if (option_benchmark)
+			ret = execlp("cat", "cat", option_benchmark, NULL);
+		else
+			ret = execl(path, path, NULL);
+		if (ret) {
 			printf("exec failed: %m\n");
 			exit(EXIT_FAILURE);
 		}
@@ -3100,6 +3561,9 @@ static const struct weston_option terminal_options[] = {
 	{ WESTON_OPTION_STRING, "font", 0, &option_font },
 	{ WESTON_OPTION_INTEGER, "font-size", 0, &option_font_size },
 	{ WESTON_OPTION_STRING, "shell", 0, &option_shell },
+	{ WESTON_OPTION_STRING, "benchmark", 0, &option_benchmark },
+	{ WESTON_OPTION_INTEGER, "scrollback-lines", 0,
+	  &option_scrollback_lines },
 };
 
 int main(int argc, char *argv[])
@@ -3124,6 +3588,8 @@ int main(int argc, char *argv[])
 	weston_config_section_get_string(s, "font", &option_font, "mono");
 	weston_config_section_get_int(s, "font-size", &option_font_size, 14);
 	weston_config_section_get_string(s, "term", &option_term, "xterm");
+	weston_config_section_get_int(s, "scrollback-lines",
+				      &option_scrollback_lines, 10000);
 	weston_config_destroy(config);
 
 	if (parse_options(terminal_options,
@@ -3133,9 +3599,13 @@ int main(int argc, char *argv[])
 		       "  --maximized or -m\n"
 		       "  --font=NAME\n"
 		       "  --font-size=SIZE\n"
-		       "  --shell=NAME\n", argv[0]);
+		       "  --shell=NAME\n"
+		       "  --scrollback-lines=LINES\n"
+		       "  --benchmark=FILE\n", argv[0]);
 		return 1;
 	}
+	if (option_scrollback_lines < 0)
+		option_scrollback_lines = 0;
 
 	d = display_create(&argc, argv);
 	if (d == NULL) {
@@ -71,6 +71,7 @@ typedef void *EGLContext;
 #include <linux/input.h>
 #include <wayland-client.h>
 #include "shared/cairo-util.h"
+#include "shared/glyph-cache.h"
 #include "shared/helpers.h"
 #include "shared/xalloc.h"
 #include "shared/zalloc.h"
@@ -147,6 +148,9 @@ struct display {
 	cairo_surface_t *dummy_surface;
 	void *dummy_surface_data;
 
+	struct glyph_cache *tooltip_glyphs;
+	struct glyph_cache *menu_glyphs;
+
 	int has_rgb565;
 	int data_device_manager_version;
 };
@@ -156,6 +160,9 @@ struct window_output {
 	struct wl_list link;
 };
 
+#define SURFACE_MAX_DAMAGE 16
+#define SURFACE_DAMAGE_HISTORY 4
+
 struct toysurface {
 	/*
 	 * Prepare the surface for drawing. Ensure there is a surface
@@ -174,11 +181,20 @@ struct toysurface {
 	 * Post the surface to the server, returning the server allocation
 	 * rectangle. The Cairo surface from prepare() must be destroyed
 	 * after calling this.
+	 * damage is an array of n_damage rectangles in surface coordinates,
+	 * or NULL if the whole surface changed.
 	 */
 	void (*swap)(struct toysurface *base,
 		     enum wl_output_transform buffer_transform, int32_t buffer_scale,
+		     const struct rectangle *damage, int n_damage,
 		     struct rectangle *server_allocation);
 
+	/*
+	 * Return how many swaps ago the contents of the surface returned
+	 * by prepare() were posted, or 0 if they are undefined.
+	 */
+	int (*get_buffer_age)(struct toysurface *base);
+
 	/*
 	 * Make the toysurface current with the given EGL context.
 	 * Returns 0 on success, and negative on failure.
@@ -223,6 +239,16 @@ struct surface {
 
 	cairo_surface_t *cairo_surface;
 
+	/* Damage posted with the next swap, unless damage_all is set. */
+	int damage_all;
+	struct rectangle damage[SURFACE_MAX_DAMAGE];
+	int n_damage;
+
+	/* Extents of the damage posted with the last swaps, the most
+	 * recent first. */
+	struct rectangle damage_history[SURFACE_DAMAGE_HISTORY];
+	int n_damage_history;
+
 	struct wl_list link;
 };
 
@@ -249,6 +275,7 @@ struct window {
 	int maximized;
 
 	enum preferred_format preferred_format;
+	int reuse_shm_pool;
 
 	window_key_handler_t key_handler;
 	window_keyboard_focus_handler_t keyboard_focus_handler;
@@ -579,6 +606,7 @@ egl_window_surface_prepare(struct toysurface *base, int dx, int dy,
 static void
 egl_window_surface_swap(struct toysurface *base,
 			enum wl_output_transform buffer_transform, int32_t buffer_scale,
+			const struct rectangle *damage, int n_damage,
 			struct rectangle *server_allocation)
 {
 	struct egl_window_surface *surface = to_egl_window_surface(base);
@@ -593,6 +621,13 @@ egl_window_surface_swap(struct toysurface *base,
 				&server_allocation->height);
 }
 
+static int
+egl_window_surface_get_buffer_age(struct toysurface *base)
+{
+	/* The contents of EGL buffers are not tracked. */
+	return 0;
+}
+
 static int
 egl_window_surface_acquire(struct toysurface *base, EGLContext ctx)
 {
@@ -667,6 +702,7 @@ egl_window_surface_create(struct display *display,
 
 	surface->base.prepare = egl_window_surface_prepare;
 	surface->base.swap = egl_window_surface_swap;
+	surface->base.get_buffer_age = egl_window_surface_get_buffer_age;
 	surface->base.acquire = egl_window_surface_acquire;
 	surface->base.release = egl_window_surface_release;
 	surface->base.destroy = egl_window_surface_destroy;
@@ -957,7 +993,11 @@ struct shm_surface_leaf {
 	struct shm_surface_data *data;
 
 	struct shm_pool *resize_pool;
+	/* Kept across size changes with SURFACE_HINT_REUSE_POOL */
+	struct shm_pool *slab;
 	int busy;
+	/* Swaps since this buffer was posted, 0 if never or resized */
+	int age;
 };
 
 static void
@@ -969,6 +1009,8 @@ shm_surface_leaf_release(struct shm_surface_leaf *leaf)
 
 	if (leaf->resize_pool)
 		shm_pool_destroy(leaf->resize_pool);
+	if (leaf->slab)
+		shm_pool_destroy(leaf->slab);
 
 	memset(leaf, 0, sizeof *leaf);
 }
@@ -1056,6 +1098,28 @@ static const struct wl_buffer_listener shm_surface_buffer_listener = {
 	shm_surface_buffer_release
 };
 
+/* Make sure the leaf has a pool big enough for a buffer of the given
+ * size. The pool is only replaced when it is outgrown, and then with
+ * some headroom, so that a window being resized does not map a new
+ * pool in the client and the server for every size. */
+static void
+shm_surface_leaf_ensure_slab(struct shm_surface *surface,
+			     struct shm_surface_leaf *leaf,
+			     struct rectangle *rect)
+{
+	size_t length = data_length_for_shm_surface(rect);
+
+	if (leaf->slab && leaf->slab->size >= length)
+		return;
+
+	if (leaf->slab)
+		shm_pool_destroy(leaf->slab);
+
+	length += length / 4;
+	length = (length + 65535) & ~(size_t) 65535;
+	leaf->slab = shm_pool_create(surface->display, length);
+}
+
 static cairo_surface_t *
 shm_surface_prepare(struct toysurface *base, int dx, int dy,
 		    int32_t width, int32_t height, uint32_t flags,
@@ -1121,10 +1185,15 @@ shm_surface_prepare(struct toysurface *base, int dx, int dy,
 	rect.width = width;
 	rect.height = height;
 
+	if ((flags & SURFACE_HINT_REUSE_POOL) && !leaf->resize_pool)
+		shm_surface_leaf_ensure_slab(surface, leaf, &rect);
+
+	leaf->age = 0;
 	leaf->cairo_surface =
 		display_create_shm_surface(surface->display, &rect,
 					   surface->flags,
-					   leaf->resize_pool,
+					   leaf->resize_pool ?
+					   leaf->resize_pool : leaf->slab,
 					   &leaf->data);
 	if (!leaf->cairo_surface)
 		return NULL;
@@ -1141,10 +1210,12 @@ out:
 static void
 shm_surface_swap(struct toysurface *base,
 		 enum wl_output_transform buffer_transform, int32_t buffer_scale,
+		 const struct rectangle *damage, int n_damage,
 		 struct rectangle *server_allocation)
 {
 	struct shm_surface *surface = to_shm_surface(base);
 	struct shm_surface_leaf *leaf = surface->current;
+	int i;
 
 	server_allocation->width =
 		cairo_image_surface_get_width(leaf->cairo_surface);
@@ -1157,17 +1228,41 @@ shm_surface_swap(struct toysurface *base,
 
 	wl_surface_attach(surface->surface, leaf->data->buffer,
 			  surface->dx, surface->dy);
-	wl_surface_damage(surface->surface, 0, 0,
-			  server_allocation->width, server_allocation->height);
+	if (damage) {
+		for (i = 0; i < n_damage; i++)
+			wl_surface_damage(surface->surface,
+					  damage[i].x, damage[i].y,
+					  damage[i].width, damage[i].height);
+	} else {
+		wl_surface_damage(surface->surface, 0, 0,
+				  server_allocation->width,
+				  server_allocation->height);
+	}
 	wl_surface_commit(surface->surface);
 
 	DBG_OBJ(surface->surface, "leaf %d busy\n",
 		(int)(leaf - &surface->leaf[0]));
 
+	for (i = 0; i < MAX_LEAVES; i++)
+		if (surface->leaf[i].age)
+			surface->leaf[i].age++;
+
 	leaf->busy = 1;
+	leaf->age = 1;
 	surface->current = NULL;
 }
 
+static int
+shm_surface_get_buffer_age(struct toysurface *base)
+{
+	struct shm_surface *surface = to_shm_surface(base);
+
+	if (!surface->current)
+		return 0;
+
+	return surface->current->age;
+}
+
 static int
 shm_surface_acquire(struct toysurface *base, EGLContext ctx)
 {
@@ -1201,6 +1296,7 @@ shm_surface_create(struct display *display, struct wl_surface *wl_surface,
 	surface = xzalloc(sizeof *surface);
 	surface->base.prepare = shm_surface_prepare;
 	surface->base.swap = shm_surface_swap;
+	surface->base.get_buffer_age = shm_surface_get_buffer_age;
 	surface->base.acquire = shm_surface_acquire;
 	surface->base.release = shm_surface_release;
 	surface->base.destroy = shm_surface_destroy;
@@ -1390,6 +1486,48 @@ display_get_pointer_image(struct display *display, int pointer)
 	return cursor ? cursor->images[0] : NULL;
 }
 
+static void
+rectangle_union(struct rectangle *dest, const struct rectangle *r)
+{
+	int32_t x2, y2;
+
+	if (r->width <= 0 || r->height <= 0)
+		return;
+
+	if (dest->width <= 0 || dest->height <= 0) {
+		*dest = *r;
+		return;
+	}
+
+	x2 = MAX(dest->x + dest->width, r->x + r->width);
+	y2 = MAX(dest->y + dest->height, r->y + r->height);
+	dest->x = MIN(dest->x, r->x);
+	dest->y = MIN(dest->y, r->y);
+	dest->width = x2 - dest->x;
+	dest->height = y2 - dest->y;
+}
+
+/* The extents of the damage to be posted with the next swap, in
+ * surface coordinates. */
+static void
+surface_get_damage_extents(struct surface *surface,
+			   struct rectangle *extents)
+{
+	int i;
+
+	if (surface->damage_all) {
+		extents->x = 0;
+		extents->y = 0;
+		extents->width = surface->allocation.width;
+		extents->height = surface->allocation.height;
+		return;
+	}
+
+	memset(extents, 0, sizeof *extents);
+	for (i = 0; i < surface->n_damage; i++)
+		rectangle_union(extents, &surface->damage[i]);
+}
+
 static void
 surface_flush(struct surface *surface)
 {
@@ -1412,8 +1550,19 @@ surface_flush(struct surface *surface)
 
 	surface->toysurface->swap(surface->toysurface,
 				  surface->buffer_transform, surface->buffer_scale,
+				  surface->damage_all ? NULL : surface->damage,
+				  surface->n_damage,
 				  &surface->server_allocation);
 
+	memmove(&surface->damage_history[1], &surface->damage_history[0],
+		(SURFACE_DAMAGE_HISTORY - 1) * sizeof surface->damage_history[0]);
+	surface_get_damage_extents(surface, &surface->damage_history[0]);
+	if (surface->n_damage_history < SURFACE_DAMAGE_HISTORY)
+		surface->n_damage_history++;
+
+	surface->damage_all = 0;
+	surface->n_damage = 0;
+
 	cairo_surface_destroy(surface->cairo_surface);
 	surface->cairo_surface = NULL;
 }
@@ -1490,6 +1639,9 @@ window_create_main_surface(struct window *window)
 	if (window->preferred_format == WINDOW_PREFERRED_FORMAT_RGB565)
 		flags |= SURFACE_HINT_RGB565;
 
+	if (window->reuse_shm_pool)
+		flags |= SURFACE_HINT_REUSE_POOL;
+
 	surface_create_surface(surface, flags);
 }
 
@@ -2012,9 +2164,78 @@ widget_schedule_redraw(struct widget *widget)
 {
 	DBG_OBJ(widget->surface->surface, "widget %p\n", widget);
 	widget->surface->redraw_needed = 1;
+	widget->surface->damage_all = 1;
 	window_schedule_redraw_task(widget->window);
 }
 
+void
+widget_schedule_partial_redraw(struct widget *widget)
+{
+	DBG_OBJ(widget->surface->surface, "widget %p\n", widget);
+	widget->surface->redraw_needed = 1;
+	window_schedule_redraw_task(widget->window);
+}
+
+void
+widget_damage(struct widget *widget,
+	      int32_t x, int32_t y, int32_t width, int32_t height)
+{
+	struct surface *surface = widget->surface;
+	struct rectangle *r;
+	int32_t x2, y2;
+
+	if (surface->damage_all || width <= 0 || height <= 0)
+		return;
+
+	x -= surface->allocation.x;
+	y -= surface->allocation.y;
+
+	if (surface->n_damage < SURFACE_MAX_DAMAGE) {
+		r = &surface->damage[surface->n_damage++];
+		r->x = x;
+		r->y = y;
+		r->width = width;
+		r->height = height;
+		return;
+	}
+
+	/* Out of rectangles, grow the last one to cover this one too. */
+	r = &surface->damage[SURFACE_MAX_DAMAGE - 1];
+	x2 = MAX(r->x + r->width, x + width);
+	y2 = MAX(r->y + r->height, y + height);
+	r->x = MIN(r->x, x);
+	r->y = MIN(r->y, y);
+	r->width = x2 - r->x;
+	r->height = y2 - r->y;
+}
+
+int
+widget_get_repaint_extents(struct widget *widget, struct rectangle *extents)
+{
+	struct surface *surface = widget->surface;
+	int age, i;
+
+	if (surface->damage_all || !surface->toysurface ||
+	    !surface->cairo_surface)
+		return -1;
+
+	/* The buffer holds what was posted age swaps ago, so everything
+	 * damaged since then has to be drawn again along with the damage
+	 * of this frame. */
+	age = surface->toysurface->get_buffer_age(surface->toysurface);
+	if (age == 0 || age - 1 > surface->n_damage_history)
+		return -1;
+
+	surface_get_damage_extents(surface, extents);
+	for (i = 0; i < age - 1; i++)
+		rectangle_union(extents, &surface->damage_history[i]);
+
+	extents->x += surface->allocation.x;
+	extents->y += surface->allocation.y;
+
+	return 0;
+}
+
 void
 widget_set_use_cairo(struct widget *widget,
 		     int use_cairo)
@@ -2044,6 +2265,7 @@ tooltip_redraw_handler(struct widget *widget, void *data)
 	cairo_t *cr;
 	const int32_t r = 3;
 	struct tooltip *tooltip = data;
+	struct display *display = widget->window->display;
 	int32_t width, height;
 
 	cr = widget_cairo_create(widget);
@@ -2060,9 +2282,13 @@ tooltip_redraw_handler(struct widget *widget, void *data)
 	cairo_set_source_rgba(cr, 0.0, 0.0, 0.4, 0.8);
 	cairo_fill(cr);
 
+	if (!display->tooltip_glyphs)
+		display->tooltip_glyphs =
+			glyph_cache_create(cairo_get_scaled_font(cr));
+
 	cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
 	cairo_move_to(cr, 10, 16);
-	cairo_show_text(cr, tooltip->entry);
+	glyph_cache_show_text(display->tooltip_glyphs, cr, tooltip->entry, -1);
 	cairo_destroy(cr);
 }
 
@@ -2257,12 +2483,22 @@ frame_redraw_handler(struct widget *widget, void *data)
 	cairo_t *cr;
 	struct window_frame *frame = data;
 	struct window *window = widget->window;
+	struct rectangle extents;
 
 	if (window->fullscreen)
 		return;
 
 	cr = widget_cairo_create(widget);
 
+	/* Any change to the frame redraws the whole window, so on a
+	 * partial redraw only the parts of the buffer that are out of
+	 * date need the frame drawn again. */
+	if (widget_get_repaint_extents(widget, &extents) == 0) {
+		cairo_rectangle(cr, extents.x, extents.y,
+				extents.width, extents.height);
+		cairo_clip(cr);
+	}
+
 	frame_repaint(frame->frame, cr);
 
 	cairo_destroy(cr);
@@ -4491,6 +4727,9 @@ surface_redraw(struct surface *surface)
 	wl_callback_add_listener(surface->frame_cb, &listener, surface);
 	DBG_OBJ(surface->frame_cb, "new\n");
 
+	if (surface->window->redraw_needed)
+		surface->damage_all = 1;
+
 	surface->redraw_needed = 0;
 	DBG_OBJ(surface->surface, "-> widget_redraw\n");
 	widget_redraw(surface->widget);
@@ -4570,8 +4809,10 @@ window_schedule_redraw(struct window *window)
 
 	DBG_OBJ(window->main_surface->surface, "window %p\n", window);
 
-	wl_list_for_each(surface, &window->subsurface_list, link)
+	wl_list_for_each(surface, &window->subsurface_list, link) {
 		surface->redraw_needed = 1;
+		surface->damage_all = 1;
+	}
 
 	window_schedule_redraw_task(window);
 }
@@ -5121,6 +5362,7 @@ surface_create(struct window *window)
 	surface->window = window;
 	surface->surface = wl_compositor_create_surface(display->compositor);
 	surface->buffer_scale = 1;
+	surface->damage_all = 1;
 	wl_surface_add_listener(surface->surface, &surface_listener, window);
 
 	wl_list_insert(&window->subsurface_list, &surface->link);
@@ -5318,6 +5560,7 @@ menu_redraw_handler(struct widget *widget, void *data)
 {
 	cairo_t *cr;
 	struct menu *menu = data;
+	struct display *display = menu->window->display;
 	int32_t x, y, width, height, i;
 
 	cr = widget_cairo_create(widget);
@@ -5334,6 +5577,9 @@ menu_redraw_handler(struct widget *widget, void *data)
 			       CAIRO_FONT_SLANT_NORMAL,
 			       CAIRO_FONT_WEIGHT_NORMAL);
 	cairo_set_font_size(cr, 12);
+	if (!display->menu_glyphs)
+		display->menu_glyphs =
+			glyph_cache_create(cairo_get_scaled_font(cr));
 
 	for (i = 0; i < menu->count; i++) {
 		if (i == menu->current) {
@@ -5342,11 +5588,13 @@ menu_redraw_handler(struct widget *widget, void *data)
 			cairo_fill(cr);
 			cairo_set_source_rgb(cr, 0.0, 0.0, 0.0);
 			cairo_move_to(cr, x + 10, y + i * 20 + 16);
-			cairo_show_text(cr, menu->entries[i]);
+			glyph_cache_show_text(display->menu_glyphs, cr,
+					      menu->entries[i], -1);
 		} else {
 			cairo_set_source_rgb(cr, 0.0, 0.0, 0.0);
 			cairo_move_to(cr, x + 10, y + i * 20 + 16);
-			cairo_show_text(cr, menu->entries[i]);
+			glyph_cache_show_text(display->menu_glyphs, cr,
+					      menu->entries[i], -1);
 		}
 	}
 
@@ -5529,6 +5777,12 @@ window_set_preferred_format(struct window *window,
 	window->preferred_format = format;
 }
 
+void
+window_set_reuse_shm_pool(struct window *window, int reuse)
+{
+	window->reuse_shm_pool = reuse;
+}
+
 struct widget *
 window_add_subsurface(struct window *window, void *data,
 		      enum subsurface_mode default_mode)
@@ -6243,6 +6497,9 @@ display_destroy(struct display *display)
 	cairo_surface_destroy(display->dummy_surface);
 	free(display->dummy_surface_data);
 
+	glyph_cache_destroy(display->tooltip_glyphs);
+	glyph_cache_destroy(display->menu_glyphs);
+
 	display_destroy_outputs(display);
 	display_destroy_inputs(display);
 
@@ -137,6 +137,8 @@ display_release_window_surface(struct display *display,
 
 #define SURFACE_HINT_RGB565 0x100
 
+#define SURFACE_HINT_REUSE_POOL 0x200
+
 cairo_surface_t *
 display_create_surface(struct display *display,
 		       struct wl_surface *surface,
@@ -517,6 +519,9 @@ void
 window_set_preferred_format(struct window *window,
 			    enum preferred_format format);
 
+void
+window_set_reuse_shm_pool(struct window *window, int reuse);
+
 int
 widget_set_tooltip(struct widget *parent, char *entry, float x, float y);
 
@@ -607,6 +612,13 @@ widget_set_axis_handlers(struct widget *widget,
 void
 widget_schedule_redraw(struct widget *widget);
 void
+widget_schedule_partial_redraw(struct widget *widget);
+void
+widget_damage(struct widget *widget,
+	      int32_t x, int32_t y, int32_t width, int32_t height);
+int
+widget_get_repaint_extents(struct widget *widget, struct rectangle *extents);
+void
 widget_set_use_cairo(struct widget *widget, int use_cairo);
 
 struct widget *
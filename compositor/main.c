@@ -503,7 +503,10 @@ usage(int error_code)
 		"  --transform=TR\tThe output transformation, TR is one of:\n"
 		"\tnormal 90 180 270 flipped flipped-90 flipped-180 flipped-270\n"
 		"  --use-pixman\t\tUse the pixman (CPU) renderer (default: no rendering)\n"
+		"  --use-gl\t\tUse the GL renderer on surfaceless EGL (default: no rendering)\n"
 		"  --no-outputs\t\tDo not create any virtual outputs\n"
+		"  --refresh-rate=RATE\tRefresh rate of outputs in mHz (default: 60000)\n"
+		"  --virtual-clock\tSkip ahead to each vblank instead of waiting\n"
 		"\n");
 #endif
 
@@ -809,6 +812,29 @@ weston_compositor_init_config(struct weston_compositor *ec,
 	weston_log("Output repaint window is %d ms maximum.\n",
 		   ec->repaint_msec);
 
+	weston_config_section_get_int(s, "pixman-render-threads",
+				      &ec->pixman_render_threads, 0);
+
+	weston_config_section_get_int(s, "damage-max-rects",
+				      &ec->damage_max_rects,
+				      ec->damage_max_rects);
+	weston_config_section_get_int(s, "damage-coalesce-waste",
+				      &ec->damage_coalesce_waste, 0);
+	if (ec->damage_coalesce_waste < 0 ||
+	    ec->damage_coalesce_waste > 100) {
+		weston_log("Invalid damage-coalesce-waste value in config: "
+			   "%d\n", ec->damage_coalesce_waste);
+		ec->damage_coalesce_waste = 0;
+	}
+
+	weston_config_section_get_int(s, "recorder-keyframe-interval",
+				      &ec->recorder_keyframe_interval, 0);
+	if (ec->recorder_keyframe_interval < 0) {
+		weston_log("Invalid recorder-keyframe-interval value in "
+			   "config: %d\n", ec->recorder_keyframe_interval);
+		ec->recorder_keyframe_interval = 0;
+	}
+
 	return 0;
 }
 
@@ -1334,6 +1360,18 @@ headless_backend_output_configure(struct weston_output *output)
 		.scale = 1,
 		.transform = WL_OUTPUT_TRANSFORM_NORMAL
 	};
+	const struct weston_headless_output_api *api =
+		weston_headless_output_get_api(output->compositor);
+	struct weston_config *wc = wet_get_config(output->compositor);
+	struct weston_config_section *section;
+	int refresh;
+
+	section = weston_config_get_section(wc, "output", "name", output->name);
+	weston_config_section_get_int(section, "refresh-rate", &refresh, 0);
+
+	if (refresh > 0 && (!api || api->set_refresh_rate(output, refresh) < 0))
+		weston_log("Cannot set refresh rate %d mHz for output %s.\n",
+			   refresh, output->name);
 
 	return wet_configure_windowed_output_from_config(output, &defaults);
 }
@@ -1345,6 +1383,8 @@ load_headless_backend(struct weston_compositor *c,
 	const struct weston_windowed_output_api *api;
 	struct weston_headless_backend_config config = {{ 0, }};
 	int no_outputs = 0;
+	int virtual_clock = 0;
+	int use_gl = 0;
 	int ret = 0;
 	char *transform = NULL;
 
@@ -1356,12 +1396,18 @@ load_headless_backend(struct weston_compositor *c,
 		{ WESTON_OPTION_INTEGER, "width", 0, &parsed_options->width },
 		{ WESTON_OPTION_INTEGER, "height", 0, &parsed_options->height },
 		{ WESTON_OPTION_BOOLEAN, "use-pixman", 0, &config.use_pixman },
+		{ WESTON_OPTION_BOOLEAN, "use-gl", 0, &use_gl },
 		{ WESTON_OPTION_STRING, "transform", 0, &transform },
 		{ WESTON_OPTION_BOOLEAN, "no-outputs", 0, &no_outputs },
+		{ WESTON_OPTION_INTEGER, "refresh-rate", 0, &config.refresh },
+		{ WESTON_OPTION_BOOLEAN, "virtual-clock", 0, &virtual_clock },
 	};
 
 	parse_options(options, ARRAY_LENGTH(options), argc, argv);
 
+	config.virtual_clock = virtual_clock;
+	config.use_gl = use_gl;
+
 	if (transform) {
 		if (weston_parse_transform(transform, &parsed_options->transform) < 0) {
 			weston_log("Invalid transform \"%s\"\n", transform);
@@ -1836,6 +1882,7 @@ int main(int argc, char *argv[])
 	struct weston_seat *seat;
 	struct wet_compositor wet = { 0 };
 	int require_input;
+	int coalesce_input;
 	int32_t wait_for_debugger = 0;
 
 	const struct weston_option core_options[] = {
@@ -1943,6 +1990,10 @@ int main(int argc, char *argv[])
 				       &require_input, true);
 	wet.compositor->require_input = require_input;
 
+	weston_config_section_get_bool(section, "coalesce-input",
+				       &coalesce_input, false);
+	wet.compositor->coalesce_input = coalesce_input;
+
 	if (load_backend(wet.compositor, backend, &argc, argv, config) < 0) {
 		weston_log("fatal: failed to create compositor backend\n");
 		goto out;
@@ -1986,6 +2037,8 @@ int main(int argc, char *argv[])
 		goto out;
 	}
 
+	repaint_stats_create(wet.compositor);
+
 	if (!shell)
 		weston_config_section_get_string(section, "shell", &shell,
 						 "desktop-shell.so");
@@ -0,0 +1,189 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "compositor.h"
+#include "weston.h"
+#include "weston-repaint-stats-server-protocol.h"
+#include "shared/helpers.h"
+#include "shared/zalloc.h"
+
+struct repaint_stats {
+	struct weston_compositor *compositor;
+	struct wl_global *global;
+	struct wl_listener destroy_listener;
+};
+
+static void
+repaint_stats_report_destroy(struct wl_client *client,
+			     struct wl_resource *resource)
+{
+	wl_resource_destroy(resource);
+}
+
+static const struct weston_repaint_stats_report_interface
+report_implementation = {
+	repaint_stats_report_destroy,
+};
+
+static void
+send_report(struct wl_resource *report, struct weston_output *output)
+{
+	struct weston_output_repaint_stats *stats = &output->repaint_stats;
+	struct weston_histogram *h;
+	int n_stages = WESTON_REPAINT_STAT_COUNT;
+	int i;
+
+	/* Version 1 only knows the stages up to the damage area. */
+	if (wl_resource_get_version(report) < 2)
+		n_stages = WESTON_REPAINT_STAT_DAMAGE_AREA + 1;
+
+	weston_repaint_stats_report_send_counters(report,
+		stats->frames >> 32, stats->frames & 0xffffffff,
+		stats->missed_deadlines >> 32,
+		stats->missed_deadlines & 0xffffffff);
+
+	for (i = 0; i < n_stages; i++) {
+		h = &stats->histogram[i];
+		weston_repaint_stats_report_send_histogram(report, i,
+			MIN(h->count, UINT32_MAX), h->min, h->max,
+			weston_histogram_mean(h),
+			weston_histogram_percentile(h, 50.0),
+			weston_histogram_percentile(h, 90.0),
+			weston_histogram_percentile(h, 99.0),
+			weston_histogram_percentile(h, 99.9));
+	}
+
+	weston_repaint_stats_report_send_done(report);
+}
+
+static void
+repaint_stats_destroy_request(struct wl_client *client,
+			      struct wl_resource *resource)
+{
+	wl_resource_destroy(resource);
+}
+
+static void
+repaint_stats_get_output_stats(struct wl_client *client,
+			       struct wl_resource *resource,
+			       uint32_t id,
+			       struct wl_resource *output_resource)
+{
+	struct weston_head *head = weston_head_from_resource(output_resource);
+	struct wl_resource *report;
+
+	report = wl_resource_create(client,
+				    &weston_repaint_stats_report_interface,
+				    wl_resource_get_version(resource), id);
+	if (!report) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	wl_resource_set_implementation(report, &report_implementation,
+				       NULL, NULL);
+
+	/* An output that went away has no statistics, just end the
+	 * report. */
+	if (!head || !head->output) {
+		weston_repaint_stats_report_send_done(report);
+		return;
+	}
+
+	send_report(report, head->output);
+}
+
+static void
+repaint_stats_reset(struct wl_client *client,
+		    struct wl_resource *resource,
+		    struct wl_resource *output_resource)
+{
+	struct weston_head *head = weston_head_from_resource(output_resource);
+
+	if (head && head->output)
+		weston_output_reset_repaint_stats(head->output);
+}
+
+static const struct weston_repaint_stats_interface
+repaint_stats_implementation = {
+	repaint_stats_destroy_request,
+	repaint_stats_get_output_stats,
+	repaint_stats_reset,
+};
+
+static void
+bind_repaint_stats(struct wl_client *client,
+		   void *data, uint32_t version, uint32_t id)
+{
+	struct wl_resource *resource;
+
+	resource = wl_resource_create(client, &weston_repaint_stats_interface,
+				      version, id);
+	if (!resource) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	wl_resource_set_implementation(resource,
+				       &repaint_stats_implementation,
+				       data, NULL);
+}
+
+static void
+repaint_stats_compositor_destroy(struct wl_listener *listener, void *data)
+{
+	struct repaint_stats *stats =
+		container_of(listener, struct repaint_stats, destroy_listener);
+
+	wl_global_destroy(stats->global);
+	free(stats);
+}
+
+WL_EXPORT void
+repaint_stats_create(struct weston_compositor *compositor)
+{
+	struct repaint_stats *stats;
+
+	stats = zalloc(sizeof *stats);
+	if (stats == NULL)
+		return;
+
+	stats->compositor = compositor;
+	stats->global = wl_global_create(compositor->wl_display,
+					 &weston_repaint_stats_interface, 2,
+					 stats, bind_repaint_stats);
+	if (!stats->global) {
+		free(stats);
+		return;
+	}
+
+	stats->destroy_listener.notify = repaint_stats_compositor_destroy;
+	wl_signal_add(&compositor->destroy_signal, &stats->destroy_listener);
+}
@@ -37,16 +37,23 @@
 #include <linux/input.h>
 #include <errno.h>
 #include <ctype.h>
+#include <inttypes.h>
+#include <time.h>
 
 #include <wayland-client.h>
 
 #include "compositor.h"
 #include "weston.h"
+#include "screen-share.h"
 #include "shared/helpers.h"
 #include "shared/os-compatibility.h"
 #include "shared/timespec-util.h"
 #include "fullscreen-shell-unstable-v1-client-protocol.h"
 
+/* Number of past updates whose damage is kept to bring a reused buffer
+ * up to date. A buffer that is older gets a full copy. */
+#define SS_DAMAGE_HISTORY 4
+
 struct shared_output {
 	struct weston_output *output;
 	struct wl_listener output_destroyed;
@@ -73,12 +80,21 @@ struct shared_output {
 
 		struct wl_list buffers;
 		struct wl_list free_buffers;
+
+		/* Update counter, and the damage of the most recent
+		 * updates, newest first. */
+		uint32_t seq;
+		pixman_region32_t damage_history[SS_DAMAGE_HISTORY];
+		int n_damage_history;
 	} shm;
 
 	int cache_dirty;
 	pixman_image_t *cache_image;
+	pixman_region32_t cache_damage; /* since the last update */
 	uint32_t *tmp_data;
 	size_t tmp_data_size;
+
+	struct weston_screen_share_stats stats;
 };
 
 struct ss_seat {
@@ -104,7 +120,7 @@ struct ss_shm_buffer {
 	struct wl_buffer *buffer;
 	void *data;
 	size_t size;
-	pixman_region32_t damage;
+	uint32_t seq;	/* update last copied into it, 0 if none */
 
 	pixman_image_t *pm_image;
 };
@@ -114,6 +130,7 @@ struct screen_share {
 	char *command;
 };
 
+
 static void
 ss_seat_handle_pointer_enter(void *data, struct wl_pointer *pointer,
 			     uint32_t serial, struct wl_surface *surface,
@@ -398,8 +415,6 @@ ss_shm_buffer_destroy(struct ss_shm_buffer *buffer)
 	wl_buffer_destroy(buffer->buffer);
 	munmap(buffer->data, buffer->size);
 
-	pixman_region32_fini(&buffer->damage);
-
 	wl_list_remove(&buffer->link);
 	wl_list_remove(&buffer->free_link);
 	free(buffer);
@@ -428,6 +443,7 @@ shared_output_get_shm_buffer(struct shared_output *so)
 	struct wl_shm_pool *pool;
 	int width, height, stride;
 	int fd;
+	int i;
 	unsigned char *data;
 
 	width = so->output->width;
@@ -447,6 +463,11 @@ shared_output_get_shm_buffer(struct shared_output *so)
 		wl_list_for_each(sb, &so->shm.buffers, link)
 			sb->output = NULL;
 
+		/* Old damage is in the old size, new buffers start full. */
+		for (i = 0; i < so->shm.n_damage_history; i++)
+			pixman_region32_clear(&so->shm.damage_history[i]);
+		so->shm.n_damage_history = 0;
+
 		so->shm.width = width;
 		so->shm.height = height;
 	}
@@ -480,8 +501,6 @@ shared_output_get_shm_buffer(struct shared_output *so)
 	wl_list_init(&sb->free_link);
 	wl_list_insert(&so->shm.buffers, &sb->link);
 
-	pixman_region32_init_rect(&sb->damage, 0, 0, width, height);
-
 	sb->data = data;
 	sb->size = height * stride;
 
@@ -506,7 +525,9 @@ shared_output_get_shm_buffer(struct shared_output *so)
 	return sb;
 
 out_pixman_error:
-	pixman_region32_fini(&sb->damage);
+	wl_buffer_destroy(sb->buffer);
+	wl_list_remove(&sb->link);
+	free(sb);
 out_unmap:
 	munmap(data, height * stride);
 out_close:
@@ -616,6 +637,7 @@ shared_output_frame_callback(void *data, struct wl_callback *cb, uint32_t time)
 
 	wl_callback_destroy(cb);
 	so->parent.frame_cb = NULL;
+	so->stats.parent_frames++;
 
 	shared_output_update(so);
 }
@@ -624,30 +646,86 @@ static const struct wl_callback_listener shared_output_frame_listener = {
 	shared_output_frame_callback
 };
 
+/* Collect what sb misses compared to the cache image: the damage since
+ * the last update, plus the damage of every update since sb was last
+ * filled. Returns false if sb is too old, and needs a full copy. */
+static bool
+shared_output_buffer_damage(struct shared_output *so,
+			    struct ss_shm_buffer *sb,
+			    pixman_region32_t *damage)
+{
+	uint32_t age = so->shm.seq - sb->seq;
+	uint32_t i;
+
+	if (sb->seq == 0 || age > (uint32_t)so->shm.n_damage_history)
+		return false;
+
+	pixman_region32_copy(damage, &so->cache_damage);
+	for (i = 0; i < age; i++)
+		pixman_region32_union(damage, damage,
+				      &so->shm.damage_history[i]);
+
+	return true;
+}
+
 static void
-shared_output_update(struct shared_output *so)
+shared_output_push_damage_history(struct shared_output *so)
 {
-	struct ss_shm_buffer *sb;
+	pixman_region32_t *history = so->shm.damage_history;
+	int i;
+
+	if (so->shm.n_damage_history < SS_DAMAGE_HISTORY)
+		so->shm.n_damage_history++;
+
+	for (i = so->shm.n_damage_history - 1; i > 0; i--)
+		pixman_region32_copy(&history[i], &history[i - 1]);
+
+	pixman_region32_copy(&history[0], &so->cache_damage);
+	pixman_region32_clear(&so->cache_damage);
+}
+
+/* Copy the damaged rectangles of the cache image into sb, returns the
+ * number of bytes written. */
+static uint64_t
+shared_output_copy_damage(struct shared_output *so, struct ss_shm_buffer *sb,
+			  pixman_region32_t *damage)
+{
+	struct weston_output *output = so->output;
+	pixman_transform_t transform;
 	pixman_box32_t *r;
+	uint32_t *cache_data;
+	int cache_stride;
 	int i, nrects;
-	pixman_transform_t transform;
-
-	/* Only update if we need to */
-	if (!so->cache_dirty || so->parent.frame_cb)
-		return;
+	int width, height;
+	uint64_t bytes = 0;
+
+	r = pixman_region32_rectangles(damage, &nrects);
+
+	/* The cache already has the layout of the buffer, the rectangles
+	 * can be copied as they are. */
+	if (output->transform == WL_OUTPUT_TRANSFORM_NORMAL &&
+	    output->current_scale == 1) {
+		cache_data = pixman_image_get_data(so->cache_image);
+		cache_stride = pixman_image_get_stride(so->cache_image) / 4;
+
+		for (i = 0; i < nrects; i++) {
+			width = r[i].x2 - r[i].x1;
+			height = r[i].y2 - r[i].y1;
+
+			pixman_blt(cache_data, sb->data,
+				   cache_stride, so->shm.width,
+				   32, 32, r[i].x1, r[i].y1, r[i].x1, r[i].y1,
+				   width, height);
+			bytes += 4 * (uint64_t)width * height;
+		}
 
-	sb = shared_output_get_shm_buffer(so);
-	if (sb == NULL) {
-		shared_output_destroy(so);
-		return;
+		return bytes;
 	}
 
-	output_compute_transform(so->output, &transform);
+	output_compute_transform(output, &transform);
 	pixman_image_set_transform(so->cache_image, &transform);
 
-	pixman_image_set_clip_region32(sb->pm_image, &sb->damage);
-
-	if (so->output->current_scale == 1) {
+	if (output->current_scale == 1) {
 		pixman_image_set_filter(so->cache_image,
 					PIXMAN_FILTER_NEAREST, NULL, 0);
 	} else {
@@ -655,24 +733,67 @@ shared_output_update(struct shared_output *so)
 					PIXMAN_FILTER_BILINEAR, NULL, 0);
 	}
 
-	pixman_image_composite32(PIXMAN_OP_SRC,
-				 so->cache_image, /* src */
-				 NULL, /* mask */
-				 sb->pm_image, /* dest */
-				 0, 0, /* src_x, src_y */
-				 0, 0, /* mask_x, mask_y */
-				 0, 0, /* dest_x, dest_y */
-				 so->output->width, /* width */
-				 so->output->height /* height */);
+	for (i = 0; i < nrects; i++) {
+		width = r[i].x2 - r[i].x1;
+		height = r[i].y2 - r[i].y1;
 
-	pixman_image_set_transform(sb->pm_image, NULL);
-	pixman_image_set_clip_region32(sb->pm_image, NULL);
+		pixman_image_composite32(PIXMAN_OP_SRC,
+					 so->cache_image, /* src */
+					 NULL, /* mask */
+					 sb->pm_image, /* dest */
+					 r[i].x1, r[i].y1, /* src_x, src_y */
+					 0, 0, /* mask_x, mask_y */
+					 r[i].x1, r[i].y1, /* dest_x, dest_y */
+					 width, height);
+		bytes += 4 * (uint64_t)width * height;
+	}
 
-	r = pixman_region32_rectangles(&sb->damage, &nrects);
+	pixman_image_set_transform(so->cache_image, NULL);
+
+	return bytes;
+}
+
+static void
+shared_output_update(struct shared_output *so)
+{
+	struct ss_shm_buffer *sb;
+	pixman_region32_t damage;
+	pixman_region32_t *surface_damage;
+	pixman_box32_t *r;
+	int i, nrects;
+	struct timespec start, end;
+
+	/* Only update if we need to */
+	if (!so->cache_dirty || so->parent.frame_cb)
+		return;
+
+	sb = shared_output_get_shm_buffer(so);
+	if (sb == NULL) {
+		shared_output_destroy(so);
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	pixman_region32_init(&damage);
+	if (!shared_output_buffer_damage(so, sb, &damage))
+		pixman_region32_init_rect(&damage, 0, 0,
+					  so->shm.width, so->shm.height);
+	pixman_region32_intersect_rect(&damage, &damage, 0, 0,
+				       so->shm.width, so->shm.height);
+
+	so->stats.bytes += shared_output_copy_damage(so, sb, &damage);
+
+	/* The parent still shows the previous update, only the new damage
+	 * changed since then. A fresh buffer is all new to it though. */
+	surface_damage = sb->seq == 0 ? &damage : &so->cache_damage;
+	r = pixman_region32_rectangles(surface_damage, &nrects);
 	for (i = 0; i < nrects; ++i)
 		wl_surface_damage(so->parent.surface, r[i].x1, r[i].y1,
 				  r[i].x2 - r[i].x1, r[i].y2 - r[i].y1);
 
+	pixman_region32_fini(&damage);
+
 	wl_surface_attach(so->parent.surface, sb->buffer, 0, 0);
 
 	so->parent.frame_cb = wl_surface_frame(so->parent.surface);
@@ -680,12 +801,15 @@ shared_output_update(struct shared_output *so)
 				 &shared_output_frame_listener, so);
 
 	wl_surface_commit(so->parent.surface);
-	wl_callback_destroy(wl_display_sync(so->parent.display));
 	wl_display_flush(so->parent.display);
 
-	/* Clear the buffer damage */
-	pixman_region32_fini(&sb->damage);
-	pixman_region32_init(&sb->damage);
+	shared_output_push_damage_history(so);
+	sb->seq = ++so->shm.seq;
+	so->cache_dirty = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	so->stats.update_nsec += timespec_sub_to_nsec(&end, &start);
+	so->stats.frames++;
 }
 
 static void
@@ -806,7 +930,6 @@ shared_output_repainted(struct wl_listener *listener, void *data)
 	struct shared_output *so =
 		container_of(listener, struct shared_output, frame_listener);
 	pixman_region32_t damage;
-	struct ss_shm_buffer *sb;
 	int32_t x, y, width, height, stride;
 	int i, nrects, do_yflip;
 	pixman_box32_t *r;
@@ -818,9 +941,8 @@ shared_output_repainted(struct wl_listener *listener, void *data)
 				  &so->output->previous_damage);
 	pixman_region32_translate(&damage, -so->output->x, -so->output->y);
 
-	/* Apply damage to all buffers */
-	wl_list_for_each(sb, &so->shm.buffers, link)
-		pixman_region32_union(&sb->damage, &sb->damage, &damage);
+	/* Buffers catch up on it when they are next used */
+	pixman_region32_union(&so->cache_damage, &so->cache_damage, &damage);
 
 	/* Transform to buffer coordinates */
 	weston_transformed_region(so->output->width, so->output->height,
@@ -849,6 +971,10 @@ shared_output_repainted(struct wl_listener *listener, void *data)
 
 		pixman_region32_fini(&damage);
 		pixman_region32_init_rect(&damage, 0, 0, width, height);
+		pixman_region32_union_rect(&so->cache_damage,
+					   &so->cache_damage, 0, 0,
+					   so->output->width,
+					   so->output->height);
 	}
 
 	if (shared_output_ensure_tmp_data(so, &damage) < 0) {
@@ -874,6 +1000,13 @@ shared_output_repainted(struct wl_listener *listener, void *data)
 
 			pixman_blt(so->tmp_data, cache_data, -width, stride,
 				   32, 32, 0, 1 - height, x, y, width, height);
+		} else if (width == stride) {
+			/* Full rows are contiguous in the cache, read
+			 * them in place. */
+			so->output->compositor->renderer->read_pixels(
+				so->output, PIXMAN_a8r8g8b8,
+				cache_data + y * stride,
+				x, y, width, height);
 		} else {
 			so->output->compositor->renderer->read_pixels(
 				so->output, PIXMAN_a8r8g8b8, so->tmp_data,
@@ -898,6 +1031,7 @@ shared_output_create(struct weston_output *output, int parent_fd)
 	struct wl_event_loop *loop;
 	struct ss_seat *seat, *tmp;
 	int epoll_fd;
+	int i;
 
 	so = zalloc(sizeof *so);
 	if (so == NULL)
@@ -971,6 +1105,9 @@ shared_output_create(struct weston_output *output, int parent_fd)
 	/* Ok, everything's created.  We should be good to go */
 	wl_list_init(&so->shm.buffers);
 	wl_list_init(&so->shm.free_buffers);
+	for (i = 0; i < SS_DAMAGE_HISTORY; i++)
+		pixman_region32_init(&so->shm.damage_history[i]);
+	pixman_region32_init(&so->cache_damage);
 
 	so->output = output;
 	so->output_destroyed.notify = output_destroyed;
@@ -998,6 +1135,14 @@ static void
 shared_output_destroy(struct shared_output *so)
 {
 	struct ss_shm_buffer *buffer, *bnext;
+	int i;
+
+	if (so->stats.frames > 0)
+		weston_log("Screen share of %s: %" PRIu64 " updates, "
+			   "%.1f KiB copied and %.1f us spent per update\n",
+			   so->output->name, so->stats.frames,
+			   so->stats.bytes / 1024.0 / so->stats.frames,
+			   so->stats.update_nsec / 1000.0 / so->stats.frames);
 
 	so->output->disable_planes--;
 
@@ -1012,7 +1157,12 @@ shared_output_destroy(struct shared_output *so)
 	wl_list_remove(&so->output_destroyed.link);
 	wl_list_remove(&so->frame_listener.link);
 
-	pixman_image_unref(so->cache_image);
+	for (i = 0; i < SS_DAMAGE_HISTORY; i++)
+		pixman_region32_fini(&so->shm.damage_history[i]);
+	pixman_region32_fini(&so->cache_damage);
+
+	if (so->cache_image)
+		pixman_image_unref(so->cache_image);
 	free(so->tmp_data);
 
 	free(so);
@@ -1118,6 +1268,43 @@ share_output_binding(struct weston_keyboard *keyboard,
 	weston_output_share(output, ss->command);
 }
 
+static int
+screen_share_get_stats(struct weston_output *output,
+		       struct weston_screen_share_stats *stats)
+{
+	struct wl_listener *listener;
+	struct shared_output *so;
+
+	listener = wl_signal_get(&output->destroy_signal, output_destroyed);
+	if (!listener)
+		return -1;
+
+	so = container_of(listener, struct shared_output, output_destroyed);
+	*stats = so->stats;
+
+	return 0;
+}
+
+static const struct weston_screen_share_api screen_share_api = {
+	screen_share_get_stats,
+};
+
+static void
+share_first_output(void *data)
+{
+	struct screen_share *ss = data;
+	struct weston_output *output;
+
+	if (wl_list_empty(&ss->compositor->output_list)) {
+		weston_log("Screen share failed: no output to share\n");
+		return;
+	}
+
+	output = container_of(ss->compositor->output_list.next,
+			      struct weston_output, link);
+	weston_output_share(output, ss->command);
+}
+
 WL_EXPORT int
 wet_module_init(struct weston_compositor *compositor,
 		int *argc, char *argv[])
@@ -1125,6 +1312,8 @@ wet_module_init(struct weston_compositor *compositor,
 	struct screen_share *ss;
 	struct weston_config *config = wet_get_config(compositor);
 	struct weston_config_section *section;
+	struct wl_event_loop *loop;
+	int start_on_startup;
 
 	ss = zalloc(sizeof *ss);
 	if (ss == NULL)
@@ -1135,8 +1324,25 @@ wet_module_init(struct weston_compositor *compositor,
 
 	weston_config_section_get_string(section, "command", &ss->command, "");
 
+	if (weston_plugin_api_register(compositor, WESTON_SCREEN_SHARE_API_NAME,
+				       &screen_share_api,
+				       sizeof(screen_share_api)) < 0) {
+		weston_log("Failed to register the screen share API\n");
+		free(ss->command);
+		free(ss);
+		return -1;
+	}
+
 	weston_compositor_add_key_binding(compositor, KEY_S,
 				          MODIFIER_CTRL | MODIFIER_ALT,
 					  share_output_binding, ss);
+
+	weston_config_section_get_bool(section, "start-on-startup",
+				       &start_on_startup, 0);
+	if (start_on_startup) {
+		loop = wl_display_get_event_loop(compositor->wl_display);
+		wl_event_loop_add_idle(loop, share_first_output, ss);
+	}
+
 	return 0;
 }
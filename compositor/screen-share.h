@@ -0,0 +1,68 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef WESTON_SCREEN_SHARE_H
+#define WESTON_SCREEN_SHARE_H
+
+#include <stdint.h>
+
+#include "plugin-registry.h"
+
+struct weston_compositor;
+struct weston_output;
+
+#define WESTON_SCREEN_SHARE_API_NAME "weston_screen_share_api_v1"
+
+struct weston_screen_share_stats {
+	uint64_t frames;	/* updates posted to the parent */
+	uint64_t parent_frames;	/* frame callbacks from the parent */
+	uint64_t bytes;		/* copied into the parent's buffers */
+	uint64_t update_nsec;	/* spent posting updates */
+};
+
+struct weston_screen_share_api {
+	/** Get the statistics of a shared output.
+	 *
+	 * \param output The output.
+	 * \param stats  Filled in with the statistics since sharing
+	 *               started.
+	 *
+	 * Returns 0 on success, -1 if the output is not shared.
+	 */
+	int (*get_stats)(struct weston_output *output,
+			 struct weston_screen_share_stats *stats);
+};
+
+static inline const struct weston_screen_share_api *
+weston_screen_share_get_api(struct weston_compositor *compositor)
+{
+	const void *api;
+	api = weston_plugin_api_get(compositor, WESTON_SCREEN_SHARE_API_NAME,
+				    sizeof(struct weston_screen_share_api));
+
+	return (const struct weston_screen_share_api *)api;
+}
+
+#endif /* WESTON_SCREEN_SHARE_H */
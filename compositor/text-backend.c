@@ -679,9 +679,13 @@ input_method_context_grab_keyboard(struct wl_client *client,
 
 	context->keyboard = cr;
 
-	wl_keyboard_send_keymap(cr, WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1,
-				keyboard->xkb_info->keymap_fd,
-				keyboard->xkb_info->keymap_size);
+	if (weston_xkb_info_get_keymap_fd(keyboard->xkb_info) >= 0)
+		wl_keyboard_send_keymap(cr, WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1,
+					keyboard->xkb_info->keymap_fd,
+					keyboard->xkb_info->keymap_size);
+	else
+		weston_log("input method: no keymap file, not sending a "
+			   "keymap\n");
 
 	if (keyboard->grab != &keyboard->default_grab) {
 		weston_keyboard_end_grab(keyboard);
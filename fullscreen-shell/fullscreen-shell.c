@@ -569,8 +569,15 @@ fs_output_configure_for_mode(struct fs_output *fsout,
 	mode.flags = 0;
 	mode.refresh = fsout->pending.framerate;
 
-	ret = weston_output_mode_switch_to_temporary(fsout->output, &mode,
-					fsout->output->native_scale);
+	/* An output that cannot switch modes, like a headless one, can
+	 * still take a surface that matches its current mode. */
+	if (!fsout->output->switch_mode &&
+	    mode.width == fsout->output->current_mode->width &&
+	    mode.height == fsout->output->current_mode->height)
+		ret = 0;
+	else
+		ret = weston_output_mode_switch_to_temporary(fsout->output,
+					&mode, fsout->output->native_scale);
 
 	if (ret != 0) {
 		/* The mode switch failed.  Clear the pending and
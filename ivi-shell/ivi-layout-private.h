@@ -42,10 +42,13 @@ struct ivi_layout_view {
 
 	struct ivi_layout_surface *ivisurf;
 	struct ivi_layout_layer *on_layer;
+
+	uint32_t commit_serial;	/* last commit that updated it */
 };
 
 struct ivi_layout_surface {
 	struct wl_list link;	/* ivi_layout::surface_list */
+	struct wl_list dirty_link;	/* ivi_layout::dirty.surface_list */
 	struct wl_signal property_changed;
 	int32_t update_count;
 	uint32_t id_surface;
@@ -60,10 +63,13 @@ struct ivi_layout_surface {
 	} pending;
 
 	struct wl_list view_list;	/* ivi_layout_view::surf_link */
+	struct wl_list transition_list;	/* ivi_layout_transition::target_link */
 };
 
 struct ivi_layout_layer {
 	struct wl_list link;	/* ivi_layout::layer_list */
+	struct wl_list dirty_link;	/* ivi_layout::dirty.layer_list */
+	struct wl_list transition_list;	/* ivi_layout_transition::target_link */
 	struct wl_signal property_changed;
 	uint32_t id_layer;
 
@@ -95,6 +101,19 @@ struct ivi_layout {
 	struct wl_list screen_list;	/* ivi_layout_screen::link */
 	struct wl_list view_list;	/* ivi_layout_view::link */
 
+	/* id lookup, NULL once the compositor is destroyed */
+	struct hash_table *surface_ids;	/* id_surface -> ivi_layout_surface */
+	struct hash_table *layer_ids;	/* id_layer -> ivi_layout_layer */
+	struct wl_listener compositor_destroy_listener;
+
+	/* Surfaces and layers with changes for the next commit. */
+	struct {
+		struct wl_list surface_list;	/* ivi_layout_surface::dirty_link */
+		struct wl_list layer_list;	/* ivi_layout_layer::dirty_link */
+		bool scene;	/* layout_layer view list must be rebuilt */
+	} dirty;
+	uint32_t commit_serial;
+
 	struct {
 		struct wl_signal created;
 		struct wl_signal removed;
@@ -109,7 +128,7 @@ struct ivi_layout {
 	struct weston_layer layout_layer;
 
 	struct ivi_layout_transition_set *transitions;
-	struct wl_list pending_transition_list;	/* transition_node::link */
+	struct wl_list pending_transition_list;	/* ivi_layout_transition::link */
 };
 
 struct ivi_layout *get_instance(void);
@@ -117,8 +136,20 @@ struct ivi_layout *get_instance(void);
 struct ivi_layout_transition;
 
 struct ivi_layout_transition_set {
+	struct weston_compositor *compositor;
 	struct wl_event_source  *event_source;
-	struct wl_list          transition_list;
+	struct wl_list          transition_list;	/* ivi_layout_transition::link */
+
+	/* All transitions are evaluated in one pass, started by an output
+	 * frame, or by event_source when no output repaints. */
+	struct wl_event_source *frame_idle;
+	struct timespec last_pass;
+
+	struct {
+		uint64_t passes;
+		struct weston_histogram transitions;	/* per pass */
+		struct weston_histogram eval_time;	/* per pass, in us */
+	} stats;
 };
 
 typedef void (*ivi_layout_transition_destroy_user_func)(void *user_data);
@@ -126,6 +157,10 @@ typedef void (*ivi_layout_transition_destroy_user_func)(void *user_data);
 struct ivi_layout_transition_set *
 ivi_layout_transition_set_create(struct weston_compositor *ec);
 
+void
+ivi_layout_transition_output_frame(struct ivi_layout_transition_set *transitions,
+				   struct weston_output *output);
+
 void
 ivi_layout_transition_move_resize_view(struct ivi_layout_surface *surface,
 				       int32_t dest_x, int32_t dest_y,
@@ -160,6 +195,9 @@ is_surface_transition(struct ivi_layout_surface *surface);
 void
 ivi_layout_remove_all_surface_transitions(struct ivi_layout_surface *surface);
 
+void
+ivi_layout_remove_all_layer_transitions(struct ivi_layout_layer *layer);
+
 /**
  * methods of interaction between transition animation with ivi-layout
  */
@@ -31,10 +31,16 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <inttypes.h>
+#include <linux/input.h>
 
 #include "ivi-shell.h"
 #include "ivi-layout-export.h"
 #include "ivi-layout-private.h"
+#include "shared/timespec-util.h"
+
+/* Evaluation rate when no output repaints to pace the transitions. */
+#define TRANSITION_FALLBACK_FPS 30
 
 struct ivi_layout_transition;
 
@@ -42,46 +48,56 @@ typedef void (*ivi_layout_transition_frame_func)(
 			struct ivi_layout_transition *transition);
 typedef void (*ivi_layout_transition_destroy_func)(
 			struct ivi_layout_transition *transition);
-typedef int32_t (*ivi_layout_is_transition_func)(void *private_data, void *id);
 
 struct ivi_layout_transition {
 	enum ivi_layout_transition_type type;
 	void *private_data;
 	void *user_data;
 
+	/* ivi_layout_surface for VIEW_*, ivi_layout_layer for LAYER_* */
+	void *target;
+	struct wl_list target_link;	/* target's transition_list */
+
+	/* ivi_layout::pending_transition_list
+	 * ivi_layout_transition_set::transition_list
+	 */
+	struct wl_list link;
+
 	uint32_t time_start;
 	uint32_t time_duration;
 	uint32_t time_elapsed;
 	uint32_t  is_done;
-	ivi_layout_is_transition_func is_transition_func;
 	ivi_layout_transition_frame_func frame_func;
 	ivi_layout_transition_destroy_func destroy_func;
 };
 
-struct transition_node {
-	struct ivi_layout_transition *transition;
-
-	/* ivi_layout::pending_transition_list
-	 * ivi_layout_transition_set::transition_list
-	 */
-	struct wl_list link;
-};
-
 static void layout_transition_destroy(struct ivi_layout_transition *transition);
 
+static bool
+is_layer_transition_type(enum ivi_layout_transition_type type)
+{
+	return type == IVI_LAYOUT_TRANSITION_LAYER_FADE ||
+	       type == IVI_LAYOUT_TRANSITION_LAYER_MOVE;
+}
+
+/*
+ * Transitions are kept on a list in their target object, an object only
+ * ever has a few of them.
+ */
 static struct ivi_layout_transition *
 get_transition_from_type_and_id(enum ivi_layout_transition_type type,
 				void *id_data)
 {
-	struct ivi_layout *layout = get_instance();
-	struct transition_node *node;
 	struct ivi_layout_transition *tran;
+	struct wl_list *list;
 
-	wl_list_for_each(node, &layout->transitions->transition_list, link) {
-		tran = node->transition;
+	if (is_layer_transition_type(type))
+		list = &((struct ivi_layout_layer *)id_data)->transition_list;
+	else
+		list = &((struct ivi_layout_surface *)id_data)->transition_list;
 
-		if (tran->type == type &&
-		    tran->is_transition_func(tran->private_data, id_data))
+	wl_list_for_each(tran, list, target_link) {
+		if (tran->type == type)
 			return tran;
 	}
 
@@ -91,16 +107,11 @@ get_transition_from_type_and_id(enum ivi_layout_transition_type type,
 int32_t
 is_surface_transition(struct ivi_layout_surface *surface)
 {
-	struct ivi_layout *layout = get_instance();
-	struct transition_node *node;
 	struct ivi_layout_transition *tran;
 
-	wl_list_for_each(node, &layout->transitions->transition_list, link) {
-		tran = node->transition;
-
-		if ((tran->type == IVI_LAYOUT_TRANSITION_VIEW_MOVE_RESIZE ||
-		     tran->type == IVI_LAYOUT_TRANSITION_VIEW_RESIZE) &&
-		    tran->is_transition_func(tran->private_data, surface))
+	wl_list_for_each(tran, &surface->transition_list, target_link) {
+		if (tran->type == IVI_LAYOUT_TRANSITION_VIEW_MOVE_RESIZE ||
+		    tran->type == IVI_LAYOUT_TRANSITION_VIEW_RESIZE)
 			return 1;
 	}
 
@@ -110,17 +121,21 @@ is_surface_transition(struct ivi_layout_surface *surface)
 void
 ivi_layout_remove_all_surface_transitions(struct ivi_layout_surface *surface)
 {
-	struct ivi_layout *layout = get_instance();
-	struct transition_node *node;
-	struct transition_node *tmp;
 	struct ivi_layout_transition *tran;
+	struct ivi_layout_transition *tmp;
 
-	wl_list_for_each_safe(node, tmp, &layout->transitions->transition_list, link) {
-		tran = node->transition;
-		if (tran->is_transition_func(tran->private_data, surface)) {
-			layout_transition_destroy(tran);
-		}
-	};
+	wl_list_for_each_safe(tran, tmp, &surface->transition_list, target_link)
+		layout_transition_destroy(tran);
+}
+
+void
+ivi_layout_remove_all_layer_transitions(struct ivi_layout_layer *layer)
+{
+	struct ivi_layout_transition *tran;
+	struct ivi_layout_transition *tmp;
+
+	wl_list_for_each_safe(tran, tmp, &layer->transition_list, target_link)
+		layout_transition_destroy(tran);
 }
 
 static void
@@ -156,105 +171,173 @@ do_transition_frame(struct ivi_layout_transition *transition,
 		layout_transition_destroy(transition);
 }
 
-static int32_t
-layout_transition_frame(void *data)
+/*
+ * Advances every running transition to the same timestamp and applies
+ * the outcome with a single commit. The commit schedules the repaints,
+ * whose frames start the next pass.
+ */
+static void
+transition_set_evaluate(struct ivi_layout_transition_set *transitions)
 {
-	struct ivi_layout_transition_set *transitions = data;
-	uint32_t fps = 30;
-	struct timespec timestamp = {};
-	uint32_t msec = 0;
-	struct transition_node *node = NULL;
-	struct transition_node *next = NULL;
+	struct ivi_layout_transition *tran;
+	struct ivi_layout_transition *next;
+	struct timespec timestamp, end;
+	uint32_t msec;
+	uint32_t count = 0;
 
 	if (wl_list_empty(&transitions->transition_list)) {
 		wl_event_source_timer_update(transitions->event_source, 0);
-		return 1;
+		return;
 	}
 
-	wl_event_source_timer_update(transitions->event_source, 1000 / fps);
+	/* Postponed again by every pass, so it only fires without frames. */
+	wl_event_source_timer_update(transitions->event_source,
+				     1000 / TRANSITION_FALLBACK_FPS);
 
-	clock_gettime(CLOCK_MONOTONIC, &timestamp);/* FIXME */
-	msec = (1e+3 * timestamp.tv_sec + 1e-6 * timestamp.tv_nsec);
+	weston_compositor_read_presentation_clock(transitions->compositor,
+						  &timestamp);
+	transitions->last_pass = timestamp;
+	msec = timespec_to_msec(&timestamp);
 
-	wl_list_for_each_safe(node, next, &transitions->transition_list, link) {
-		do_transition_frame(node->transition, msec);
+	wl_list_for_each_safe(tran, next, &transitions->transition_list, link) {
+		do_transition_frame(tran, msec);
+		count++;
 	}
 
 	ivi_layout_commit_changes();
+
+	weston_compositor_read_presentation_clock(transitions->compositor,
+						  &end);
+	transitions->stats.passes++;
+	weston_histogram_add(&transitions->stats.transitions, count);
+	weston_histogram_add(&transitions->stats.eval_time,
+			     timespec_sub_to_nsec(&end, &timestamp) / 1000);
+}
+
+static int32_t
+layout_transition_frame(void *data)
+{
+	struct ivi_layout_transition_set *transitions = data;
+
+	transition_set_evaluate(transitions);
 	return 1;
 }
 
+static void
+layout_transition_frame_idle(void *data)
+{
+	struct ivi_layout_transition_set *transitions = data;
+
+	transitions->frame_idle = NULL;
+	transition_set_evaluate(transitions);
+}
+
+/*
+ * Called when an output repaints. The pass cannot run from inside the
+ * renderer, so it is deferred to an idle, which also merges the frames
+ * of outputs repainting together. Outputs with different refresh rates
+ * do not add passes beyond one per frame of the fastest one.
+ */
+void
+ivi_layout_transition_output_frame(struct ivi_layout_transition_set *transitions,
+				   struct weston_output *output)
+{
+	struct wl_event_loop *loop;
+	struct timespec now;
+	int64_t half_frame = 0;
+
+	if (transitions == NULL || transitions->frame_idle ||
+	    wl_list_empty(&transitions->transition_list))
+		return;
+
+	if (output->current_mode && output->current_mode->refresh > 0)
+		half_frame = 500000000000LL / output->current_mode->refresh;
+
+	weston_compositor_read_presentation_clock(transitions->compositor,
+						  &now);
+	if (timespec_sub_to_nsec(&now, &transitions->last_pass) < half_frame)
+		return;
+
+	loop = wl_display_get_event_loop(transitions->compositor->wl_display);
+	transitions->frame_idle =
+		wl_event_loop_add_idle(loop, layout_transition_frame_idle,
+				       transitions);
+}
+
+static void
+transition_stats_binding(struct weston_keyboard *keyboard,
+			 const struct timespec *time, uint32_t key, void *data)
+{
+	struct ivi_layout_transition_set *transitions = data;
+	const struct weston_histogram *count = &transitions->stats.transitions;
+	const struct weston_histogram *eval = &transitions->stats.eval_time;
+
+	weston_log("ivi-layout transitions: %" PRIu64 " passes\n",
+		   transitions->stats.passes);
+	weston_log_continue(STAMP_SPACE "transitions per pass: mean %u "
+			    "p90 %u max %u\n", weston_histogram_mean(count),
+			    weston_histogram_percentile(count, 90.0),
+			    count->max);
+	weston_log_continue(STAMP_SPACE "evaluation (us): mean %u p90 %u "
+			    "p99 %u max %u\n", weston_histogram_mean(eval),
+			    weston_histogram_percentile(eval, 90.0),
+			    weston_histogram_percentile(eval, 99.0),
+			    eval->max);
+
+	transitions->stats.passes = 0;
+	weston_histogram_reset(&transitions->stats.transitions);
+	weston_histogram_reset(&transitions->stats.eval_time);
+}
+
 struct ivi_layout_transition_set *
 ivi_layout_transition_set_create(struct weston_compositor *ec)
 {
 	struct ivi_layout_transition_set *transitions;
 	struct wl_event_loop *loop;
 
-	transitions = malloc(sizeof(*transitions));
+	transitions = zalloc(sizeof(*transitions));
 	if (transitions == NULL) {
 		weston_log("%s: memory allocation fails\n", __func__);
 		return NULL;
 	}
 
+	transitions->compositor = ec;
 	wl_list_init(&transitions->transition_list);
+	weston_histogram_reset(&transitions->stats.transitions);
+	weston_histogram_reset(&transitions->stats.eval_time);
 
 	loop = wl_display_get_event_loop(ec->wl_display);
 	transitions->event_source =
 		wl_event_loop_add_timer(loop, layout_transition_frame,
 					transitions);
 
+	weston_compositor_add_debug_binding(ec, KEY_A,
+					    transition_stats_binding,
+					    transitions);
+
 	return transitions;
 }
 
-static bool
+static void
 layout_transition_register(struct ivi_layout_transition *trans)
 {
 	struct ivi_layout *layout = get_instance();
-	struct transition_node *node;
-
-	node = malloc(sizeof(*node));
-	if (node == NULL) {
-		weston_log("%s: memory allocation fails\n", __func__);
-		return false;
-	}
+	struct wl_list *list;
 
-	node->transition = trans;
-	wl_list_insert(&layout->pending_transition_list, &node->link);
-	return true;
-}
+	if (is_layer_transition_type(trans->type))
+		list = &((struct ivi_layout_layer *)trans->target)->transition_list;
+	else
+		list = &((struct ivi_layout_surface *)trans->target)->transition_list;
 
-static void
-remove_transition(struct ivi_layout *layout,
-		  struct ivi_layout_transition *trans)
-{
-	struct transition_node *node;
-	struct transition_node *next;
-
-	wl_list_for_each_safe(node, next,
-			      &layout->transitions->transition_list, link) {
-		if (node->transition == trans) {
-			wl_list_remove(&node->link);
-			free(node);
-			return;
-		}
-	}
-
-	wl_list_for_each_safe(node, next,
-			      &layout->pending_transition_list, link) {
-		if (node->transition == trans) {
-			wl_list_remove(&node->link);
-			free(node);
-			return;
-		}
-	}
+	wl_list_insert(&layout->pending_transition_list, &trans->link);
+	wl_list_insert(list, &trans->target_link);
 }
 
 static void
 layout_transition_destroy(struct ivi_layout_transition *transition)
 {
-	struct ivi_layout *layout = get_instance();
-
-	remove_transition(layout, transition);
+	wl_list_remove(&transition->link);
+	wl_list_remove(&transition->target_link);
 	if (transition->destroy_func)
 		transition->destroy_func(transition);
 	free(transition);
@@ -277,7 +360,9 @@ create_layout_transition(void)
 
 	transition->is_done = 0;
 
-	transition->is_transition_func = NULL;
+	transition->target = NULL;
+	wl_list_init(&transition->target_link);
+	wl_list_init(&transition->link);
 	transition->private_data = NULL;
 	transition->user_data = NULL;
 
@@ -341,13 +426,6 @@ transition_move_resize_view_user_frame(struct ivi_layout_transition *transition)
 						     dest_width, dest_height);
 }
 
-static int32_t
-is_transition_move_resize_view_func(struct move_resize_view_data *data,
-				    struct ivi_layout_surface *view)
-{
-	return data->surface == view;
-}
-
 static struct ivi_layout_transition *
 create_move_resize_view_transition(
 			struct ivi_layout_surface *surface,
@@ -374,7 +452,7 @@ create_move_resize_view_transition(
 	}
 
 	transition->type = IVI_LAYOUT_TRANSITION_VIEW_MOVE_RESIZE;
-	transition->is_transition_func = (ivi_layout_is_transition_func)is_transition_move_resize_view_func;
+	transition->target = surface;
 
 	transition->frame_func = frame_func;
 	transition->destroy_func = destroy_func;
@@ -444,9 +522,8 @@ ivi_layout_transition_move_resize_view(struct ivi_layout_surface *surface,
 		transition_move_resize_view_destroy,
 		duration);
 
-	if (transition && layout_transition_register(transition))
-		return;
-	layout_transition_destroy(transition);
+	if (transition)
+		layout_transition_register(transition);
 }
 
 /* fade transition */
@@ -474,13 +551,6 @@ fade_view_user_frame(struct ivi_layout_transition *transition)
 	ivi_layout_surface_set_visibility(surface, true);
 }
 
-static int32_t
-is_transition_fade_view_func(struct fade_view_data *data,
-			     struct ivi_layout_surface *view)
-{
-	return data->surface == view;
-}
-
 static struct ivi_layout_transition *
 create_fade_view_transition(
 			struct ivi_layout_surface *surface,
@@ -505,7 +575,7 @@ create_fade_view_transition(
 	}
 
 	transition->type = IVI_LAYOUT_TRANSITION_VIEW_FADE;
-	transition->is_transition_func = (ivi_layout_is_transition_func)is_transition_fade_view_func;
+	transition->target = surface;
 
 	transition->user_data = user_data;
 	transition->private_data = data;
@@ -540,9 +610,12 @@ create_visibility_transition(struct ivi_layout_surface *surface,
 		destroy_func,
 		duration);
 
-	if (transition && layout_transition_register(transition))
+	if (transition == NULL) {
+		free(user_data);
 		return;
-	layout_transition_destroy(transition);
+	}
+
+	layout_transition_register(transition);
 }
 
 static void
@@ -706,13 +779,6 @@ transition_move_layer_destroy(struct ivi_layout_transition *transition)
 	transition->private_data = NULL;
 }
 
-static int32_t
-is_transition_move_layer_func(struct move_layer_data *data,
-			      struct ivi_layout_layer *layer)
-{
-	return data->layer == layer;
-}
-
 
 static struct ivi_layout_transition *
 create_move_layer_transition(
@@ -738,7 +804,7 @@ create_move_layer_transition(
 	}
 
 	transition->type = IVI_LAYOUT_TRANSITION_LAYER_MOVE;
-	transition->is_transition_func = (ivi_layout_is_transition_func)is_transition_move_layer_func;
+	transition->target = layer;
 
 	transition->frame_func = transition_move_layer_user_frame;
 	transition->destroy_func = transition_move_layer_destroy;
@@ -774,10 +840,8 @@ ivi_layout_transition_move_layer(struct ivi_layout_layer *layer,
 		NULL, NULL,
 		duration);
 
-	if (transition && layout_transition_register(transition))
-		return;
-
-	free(transition);
+	if (transition)
+		layout_transition_register(transition);
 }
 
 void
@@ -826,13 +890,6 @@ transition_fade_layer_user_frame(struct ivi_layout_transition *transition)
 	ivi_layout_layer_set_visibility(data->layer, is_visible);
 }
 
-static int32_t
-is_transition_fade_layer_func(struct fade_layer_data *data,
-			      struct ivi_layout_layer *layer)
-{
-	return data->layer == layer;
-}
-
 void
 ivi_layout_transition_fade_layer(
 			struct ivi_layout_layer *layer,
@@ -883,7 +940,7 @@ ivi_layout_transition_fade_layer(
 	}
 
 	transition->type = IVI_LAYOUT_TRANSITION_LAYER_FADE;
-	transition->is_transition_func = (ivi_layout_is_transition_func)is_transition_fade_layer_func;
+	transition->target = layer;
 
 	transition->private_data = data;
 	transition->user_data = user_data;
@@ -900,9 +957,6 @@ ivi_layout_transition_fade_layer(
 	data->end_alpha = end_alpha;
 	data->destroy_func = destroy_func;
 
-	if (!layout_transition_register(transition))
-		layout_transition_destroy(transition);
-
-	return;
+	layout_transition_register(transition);
 }
 
@@ -70,6 +70,7 @@
 
 #include "shared/helpers.h"
 #include "shared/os-compatibility.h"
+#include "shared/hash.h"
 
 #define max(a, b) ((a) > (b) ? (a) : (b))
 
@@ -80,6 +81,7 @@ struct ivi_layout_screen {
 
 	struct ivi_layout *layout;
 	struct weston_output *output;
+	struct wl_listener frame_listener;
 
 	struct {
 		struct wl_list layer_list;	/* ivi_layout_layer::pending.link */
@@ -108,34 +110,44 @@ get_instance(void)
 }
 
 /**
- * Internal API to add/remove an ivi_layer to/from ivi_screen.
+ * Internal API to look up ivi_surface/ivi_layer by id.
  */
 static struct ivi_layout_surface *
-get_surface(struct wl_list *surf_list, uint32_t id_surface)
+get_surface(struct ivi_layout *layout, uint32_t id_surface)
 {
-	struct ivi_layout_surface *ivisurf;
-
-	wl_list_for_each(ivisurf, surf_list, link) {
-		if (ivisurf->id_surface == id_surface) {
-			return ivisurf;
-		}
-	}
+	if (!layout->surface_ids)
+		return NULL;
 
-	return NULL;
+	return hash_table_lookup(layout->surface_ids, id_surface);
 }
 
 static struct ivi_layout_layer *
-get_layer(struct wl_list *layer_list, uint32_t id_layer)
+get_layer(struct ivi_layout *layout, uint32_t id_layer)
 {
-	struct ivi_layout_layer *ivilayer;
+	if (!layout->layer_ids)
+		return NULL;
 
-	wl_list_for_each(ivilayer, layer_list, link) {
-		if (ivilayer->id_layer == id_layer) {
-			return ivilayer;
-		}
-	}
+	return hash_table_lookup(layout->layer_ids, id_layer);
+}
 
-	return NULL;
+/**
+ * Internal API to queue an ivi_surface/ivi_layer for the next commit.
+ * Only queued objects are looked at by ivi_layout_commit_changes.
+ */
+static void
+surface_mark_dirty(struct ivi_layout_surface *ivisurf)
+{
+	if (wl_list_empty(&ivisurf->dirty_link))
+		wl_list_insert(ivisurf->layout->dirty.surface_list.prev,
+			       &ivisurf->dirty_link);
+}
+
+static void
+layer_mark_dirty(struct ivi_layout_layer *ivilayer)
+{
+	if (wl_list_empty(&ivilayer->dirty_link))
+		wl_list_insert(ivilayer->layout->dirty.layer_list.prev,
+			       &ivilayer->dirty_link);
 }
 
 static bool
@@ -238,6 +250,9 @@ ivi_layout_surface_destroy(struct ivi_layout_surface *ivisurf)
 	}
 
 	wl_list_remove(&ivisurf->link);
+	wl_list_remove(&ivisurf->dirty_link);
+	if (get_surface(layout, ivisurf->id_surface) == ivisurf)
+		hash_table_remove(layout->surface_ids, ivisurf->id_surface);
 
 	wl_list_for_each_safe(ivi_view, next, &ivisurf->view_list, surf_link) {
 		ivi_view_destroy(ivi_view);
@@ -250,6 +265,17 @@ ivi_layout_surface_destroy(struct ivi_layout_surface *ivisurf)
 	free(ivisurf);
 }
 
+static void
+screen_handle_output_frame(struct wl_listener *listener, void *data)
+{
+	struct ivi_layout_screen *iviscrn =
+		container_of(listener, struct ivi_layout_screen,
+			     frame_listener);
+
+	ivi_layout_transition_output_frame(iviscrn->layout->transitions,
+					   iviscrn->output);
+}
+
 /**
  * Internal API to initialize ivi_screens found from output_list of weston_compositor.
  * Called by ivi_layout_init_with_compositor.
@@ -276,6 +302,9 @@ create_screen(struct weston_compositor *ec)
 
 		wl_list_init(&iviscrn->order.layer_list);
 
+		iviscrn->frame_listener.notify = screen_handle_output_frame;
+		wl_signal_add(&output->frame_signal, &iviscrn->frame_listener);
+
 		wl_list_insert(&layout->screen_list, &iviscrn->link);
 	}
 }
@@ -586,45 +615,68 @@ update_prop(struct ivi_layout_view *ivi_view)
 	weston_view_schedule_repaint(ivi_view->view);
 }
 
+static void
+commit_view(struct ivi_layout *layout, struct ivi_layout_view *ivi_view)
+{
+	struct ivi_layout_surface *ivisurf = ivi_view->ivisurf;
+	struct ivi_layout_layer *ivilayer = ivi_view->on_layer;
+	struct ivi_layout_screen *iviscrn = ivilayer->on_screen;
+
+	/* Reachable from both its layer and its surface. */
+	if (ivi_view->commit_serial == layout->commit_serial)
+		return;
+	ivi_view->commit_serial = layout->commit_serial;
+
+	/*
+	 * If the view is not on the currently rendered scenegraph,
+	 * we do not need to update its properties.
+	 */
+	if (wl_list_empty(&ivi_view->order_link) || !iviscrn)
+		return;
+
+	/*
+	 * If the view's layer or surface is invisible, we do not need
+	 * to update its properties.
+	 */
+	if (!ivilayer->prop.visibility || !ivisurf->prop.visibility) {
+		/*
+		* If ivilayer or ivisurf of ivi_view is made invisible
+		* in this commit_changes call, we have to damage
+		* the weston_view below this ivi_view. Otherwise content
+		* of this ivi_view will stay visible.
+		*/
+		if ((ivilayer->prop.event_mask | ivisurf->prop.event_mask) &
+		    IVI_NOTIFICATION_VISIBILITY)
+			weston_view_damage_below(ivi_view->view);
+
+		return;
+	}
+
+	update_prop(ivi_view);
+}
+
+/*
+ * Only views of changed surfaces and layers can need new properties,
+ * everything else keeps the transformation of an earlier commit.
+ */
 static void
 commit_changes(struct ivi_layout *layout)
 {
-	struct ivi_layout_screen *iviscrn = NULL;
 	struct ivi_layout_layer *ivilayer = NULL;
 	struct ivi_layout_surface *ivisurf = NULL;
 	struct ivi_layout_view *ivi_view  = NULL;
 
-	wl_list_for_each(ivi_view, &layout->view_list, link) {
-		ivisurf = ivi_view->ivisurf;
-		ivilayer = ivi_view->on_layer;
-		iviscrn = ivilayer->on_screen;
-
-		/*
-		 * If the view is not on the currently rendered scenegraph,
-		 * we do not need to update its properties.
-		 */
-		if (wl_list_empty(&ivi_view->order_link) || !iviscrn)
-			continue;
+	layout->commit_serial++;
 
-		/*
-		 * If the view's layer or surface is invisible, we do not need
-		 * to update its properties.
-		 */
-		if (!ivilayer->prop.visibility || !ivisurf->prop.visibility) {
-			/*
-			* If ivilayer or ivisurf of ivi_view is made invisible
-			* in this commit_changes call, we have to damage
-			* the weston_view below this ivi_view. Otherwise content
-			* of this ivi_view will stay visible.
-			*/
-			if ((ivilayer->prop.event_mask | ivisurf->prop.event_mask) &
-			    IVI_NOTIFICATION_VISIBILITY)
-				weston_view_damage_below(ivi_view->view);
-
-			continue;
-		}
+	wl_list_for_each(ivilayer, &layout->dirty.layer_list, dirty_link) {
+		wl_list_for_each(ivi_view, &ivilayer->order.view_list,
+				 order_link)
+			commit_view(layout, ivi_view);
+	}
 
-		update_prop(ivi_view);
+	wl_list_for_each(ivisurf, &layout->dirty.surface_list, dirty_link) {
+		wl_list_for_each(ivi_view, &ivisurf->view_list, surf_link)
+			commit_view(layout, ivi_view);
 	}
 }
 
@@ -638,7 +690,7 @@ commit_surface_list(struct ivi_layout *layout)
 	int32_t dest_height = 0;
 	int32_t configured = 0;
 
-	wl_list_for_each(ivisurf, &layout->surface_list, link) {
+	wl_list_for_each(ivisurf, &layout->dirty.surface_list, dirty_link) {
 		if (ivisurf->pending.prop.transition_type == IVI_LAYOUT_TRANSITION_VIEW_DEFAULT) {
 			dest_x = ivisurf->prop.dest_x;
 			dest_y = ivisurf->prop.dest_y;
@@ -727,6 +779,9 @@ commit_surface_list(struct ivi_layout *layout)
 							     ivisurf->prop.dest_height);
 			}
 		}
+
+		if (ivisurf->prop.event_mask & IVI_NOTIFICATION_VISIBILITY)
+			layout->dirty.scene = true;
 	}
 }
 
@@ -737,7 +792,7 @@ commit_layer_list(struct ivi_layout *layout)
 	struct ivi_layout_layer   *ivilayer = NULL;
 	struct ivi_layout_view *next     = NULL;
 
-	wl_list_for_each(ivilayer, &layout->layer_list, link) {
+	wl_list_for_each(ivilayer, &layout->dirty.layer_list, dirty_link) {
 		if (ivilayer->pending.prop.transition_type == IVI_LAYOUT_TRANSITION_LAYER_MOVE) {
 			ivi_layout_transition_move_layer(ivilayer, ivilayer->pending.prop.dest_x, ivilayer->pending.prop.dest_y, ivilayer->pending.prop.transition_duration);
 		} else if (ivilayer->pending.prop.transition_type == IVI_LAYOUT_TRANSITION_LAYER_FADE) {
@@ -750,6 +805,9 @@ commit_layer_list(struct ivi_layout *layout)
 
 		ivilayer->prop = ivilayer->pending.prop;
 
+		if (ivilayer->prop.event_mask & IVI_NOTIFICATION_VISIBILITY)
+			layout->dirty.scene = true;
+
 		if (!ivilayer->order.dirty) {
 			continue;
 		}
@@ -759,6 +817,7 @@ commit_layer_list(struct ivi_layout *layout)
 			wl_list_remove(&ivi_view->order_link);
 			wl_list_init(&ivi_view->order_link);
 			ivi_view->ivisurf->prop.event_mask |= IVI_NOTIFICATION_REMOVE;
+			surface_mark_dirty(ivi_view->ivisurf);
 		}
 
 		assert(wl_list_empty(&ivilayer->order.view_list));
@@ -768,9 +827,11 @@ commit_layer_list(struct ivi_layout *layout)
 			wl_list_remove(&ivi_view->order_link);
 			wl_list_insert(&ivilayer->order.view_list, &ivi_view->order_link);
 			ivi_view->ivisurf->prop.event_mask |= IVI_NOTIFICATION_ADD;
+			surface_mark_dirty(ivi_view->ivisurf);
 		}
 
 		ivilayer->order.dirty = 0;
+		layout->dirty.scene = true;
 	}
 }
 
@@ -781,9 +842,7 @@ commit_screen_list(struct ivi_layout *layout)
 	struct ivi_layout_layer   *ivilayer = NULL;
 	struct ivi_layout_layer   *next     = NULL;
 	struct ivi_layout_view *ivi_view = NULL;
-
-	/* Clear view list of layout ivi_layer */
-	wl_list_init(&layout->layout_layer.view_list.link);
+	struct weston_view *view, *view_next;
 
 	wl_list_for_each(iviscrn, &layout->screen_list, link) {
 		if (iviscrn->order.dirty) {
@@ -793,6 +852,7 @@ commit_screen_list(struct ivi_layout *layout)
 				wl_list_remove(&ivilayer->order.link);
 				wl_list_init(&ivilayer->order.link);
 				ivilayer->prop.event_mask |= IVI_NOTIFICATION_REMOVE;
+				layer_mark_dirty(ivilayer);
 			}
 
 			assert(wl_list_empty(&iviscrn->order.layer_list));
@@ -806,11 +866,26 @@ commit_screen_list(struct ivi_layout *layout)
 					       &ivilayer->order.link);
 				ivilayer->on_screen = iviscrn;
 				ivilayer->prop.event_mask |= IVI_NOTIFICATION_ADD;
+				layer_mark_dirty(ivilayer);
 			}
 
 			iviscrn->order.dirty = 0;
+			layout->dirty.scene = true;
 		}
+	}
+
+	/* Nothing moved in or out of the scene, keep the view list. */
+	if (!layout->dirty.scene)
+		return;
+	layout->dirty.scene = false;
+
+	/* Clear view list of layout ivi_layer */
+	wl_list_for_each_safe(view, view_next,
+			      &layout->layout_layer.view_list.link,
+			      layer_link.link)
+		weston_layer_entry_remove(&view->layer_link);
 
+	wl_list_for_each(iviscrn, &layout->screen_list, link) {
 		wl_list_for_each(ivilayer, &iviscrn->order.layer_list, order.link) {
 			if (ivilayer->prop.visibility == false)
 				continue;
@@ -858,20 +933,55 @@ send_layer_prop(struct ivi_layout_layer *ivilayer)
 	ivilayer->pending.prop.event_mask = 0;
 }
 
+/*
+ * Emits the property events and empties the dirty lists. The lists are
+ * moved aside first, listeners may already queue up the next commit.
+ */
 static void
 send_prop(struct ivi_layout *layout)
 {
 	struct ivi_layout_layer   *ivilayer = NULL;
 	struct ivi_layout_surface *ivisurf  = NULL;
+	struct wl_list layers, surfaces;
+
+	wl_list_init(&layers);
+	wl_list_insert_list(&layers, &layout->dirty.layer_list);
+	wl_list_init(&layout->dirty.layer_list);
+
+	wl_list_init(&surfaces);
+	wl_list_insert_list(&surfaces, &layout->dirty.surface_list);
+	wl_list_init(&layout->dirty.surface_list);
+
+	while (!wl_list_empty(&layers)) {
+		ivilayer = container_of(layers.next,
+					struct ivi_layout_layer, dirty_link);
+		wl_list_remove(&ivilayer->dirty_link);
+		wl_list_init(&ivilayer->dirty_link);
 
-	wl_list_for_each_reverse(ivilayer, &layout->layer_list, link) {
 		if (ivilayer->prop.event_mask)
 			send_layer_prop(ivilayer);
+		ivilayer->prop.event_mask = 0;
 	}
 
-	wl_list_for_each_reverse(ivisurf, &layout->surface_list, link) {
+	while (!wl_list_empty(&surfaces)) {
+		ivisurf = container_of(surfaces.next,
+				       struct ivi_layout_surface, dirty_link);
+		wl_list_remove(&ivisurf->dirty_link);
+		wl_list_init(&ivisurf->dirty_link);
+
 		if (ivisurf->prop.event_mask)
 			send_surface_prop(ivisurf);
+		ivisurf->prop.event_mask = 0;
+
+		/*
+		 * A move/resize transition leaves the old destination in
+		 * prop, the next commit still has to pick up the pending one.
+		 */
+		if (ivisurf->prop.dest_x != ivisurf->pending.prop.dest_x ||
+		    ivisurf->prop.dest_y != ivisurf->pending.prop.dest_y ||
+		    ivisurf->prop.dest_width != ivisurf->pending.prop.dest_width ||
+		    ivisurf->prop.dest_height != ivisurf->pending.prop.dest_height)
+			surface_mark_dirty(ivisurf);
 	}
 }
 
@@ -983,30 +1093,16 @@ static struct ivi_layout_layer *
 ivi_layout_get_layer_from_id(uint32_t id_layer)
 {
 	struct ivi_layout *layout = get_instance();
-	struct ivi_layout_layer *ivilayer = NULL;
-
-	wl_list_for_each(ivilayer, &layout->layer_list, link) {
-		if (ivilayer->id_layer == id_layer) {
-			return ivilayer;
-		}
-	}
 
-	return NULL;
+	return get_layer(layout, id_layer);
 }
 
 struct ivi_layout_surface *
 ivi_layout_get_surface_from_id(uint32_t id_surface)
 {
 	struct ivi_layout *layout = get_instance();
-	struct ivi_layout_surface *ivisurf = NULL;
 
-	wl_list_for_each(ivisurf, &layout->surface_list, link) {
-		if (ivisurf->id_surface == id_surface) {
-			return ivisurf;
-		}
-	}
-
-	return NULL;
+	return get_surface(layout, id_surface);
 }
 
 static int32_t
@@ -1251,7 +1347,7 @@ ivi_layout_layer_create_with_dimension(uint32_t id_layer,
 	struct ivi_layout *layout = get_instance();
 	struct ivi_layout_layer *ivilayer = NULL;
 
-	ivilayer = get_layer(&layout->layer_list, id_layer);
+	ivilayer = get_layer(layout, id_layer);
 	if (ivilayer != NULL) {
 		weston_log("id_layer is already created\n");
 		++ivilayer->ref_count;
@@ -1277,6 +1373,14 @@ ivi_layout_layer_create_with_dimension(uint32_t id_layer,
 
 	wl_list_init(&ivilayer->order.view_list);
 	wl_list_init(&ivilayer->order.link);
+	wl_list_init(&ivilayer->dirty_link);
+	wl_list_init(&ivilayer->transition_list);
+
+	if (hash_table_insert(layout->layer_ids, id_layer, ivilayer) < 0) {
+		weston_log("fails to allocate memory\n");
+		free(ivilayer);
+		return NULL;
+	}
 
 	wl_list_insert(&layout->layer_list, &ivilayer->link);
 
@@ -1307,9 +1411,14 @@ ivi_layout_layer_destroy(struct ivi_layout_layer *ivilayer)
 
 	wl_signal_emit(&layout->layer_notification.removed, ivilayer);
 
+	ivi_layout_remove_all_layer_transitions(ivilayer);
+
 	wl_list_remove(&ivilayer->pending.link);
 	wl_list_remove(&ivilayer->order.link);
+	wl_list_remove(&ivilayer->dirty_link);
 	wl_list_remove(&ivilayer->link);
+	if (get_layer(layout, ivilayer->id_layer) == ivilayer)
+		hash_table_remove(layout->layer_ids, ivilayer->id_layer);
 
 	free(ivilayer);
 }
@@ -1326,6 +1435,7 @@ ivi_layout_layer_set_visibility(struct ivi_layout_layer *ivilayer,
 	}
 
 	prop = &ivilayer->pending.prop;
+	layer_mark_dirty(ivilayer);
 	prop->visibility = newVisibility;
 
 	if (ivilayer->prop.visibility != newVisibility)
@@ -1350,6 +1460,7 @@ ivi_layout_layer_set_opacity(struct ivi_layout_layer *ivilayer,
 	}
 
 	prop = &ivilayer->pending.prop;
+	layer_mark_dirty(ivilayer);
 	prop->opacity = opacity;
 
 	if (ivilayer->prop.opacity != opacity)
@@ -1373,6 +1484,7 @@ ivi_layout_layer_set_source_rectangle(struct ivi_layout_layer *ivilayer,
 	}
 
 	prop = &ivilayer->pending.prop;
+	layer_mark_dirty(ivilayer);
 	prop->source_x = x;
 	prop->source_y = y;
 	prop->source_width = width;
@@ -1401,6 +1513,7 @@ ivi_layout_layer_set_destination_rectangle(struct ivi_layout_layer *ivilayer,
 	}
 
 	prop = &ivilayer->pending.prop;
+	layer_mark_dirty(ivilayer);
 	prop->dest_x = x;
 	prop->dest_y = y;
 	prop->dest_width = width;
@@ -1443,6 +1556,7 @@ ivi_layout_layer_set_render_order(struct ivi_layout_layer *ivilayer,
 	}
 
 	ivilayer->order.dirty = 1;
+	layer_mark_dirty(ivilayer);
 
 	return IVI_SUCCEEDED;
 }
@@ -1459,6 +1573,7 @@ ivi_layout_surface_set_visibility(struct ivi_layout_surface *ivisurf,
 	}
 
 	prop = &ivisurf->pending.prop;
+	surface_mark_dirty(ivisurf);
 	prop->visibility = newVisibility;
 
 	if (ivisurf->prop.visibility != newVisibility)
@@ -1483,6 +1598,7 @@ ivi_layout_surface_set_opacity(struct ivi_layout_surface *ivisurf,
 	}
 
 	prop = &ivisurf->pending.prop;
+	surface_mark_dirty(ivisurf);
 	prop->opacity = opacity;
 
 	if (ivisurf->prop.opacity != opacity)
@@ -1506,6 +1622,7 @@ ivi_layout_surface_set_destination_rectangle(struct ivi_layout_surface *ivisurf,
 	}
 
 	prop = &ivisurf->pending.prop;
+	surface_mark_dirty(ivisurf);
 	prop->start_x = prop->dest_x;
 	prop->start_y = prop->dest_y;
 	prop->dest_x = x;
@@ -1691,6 +1808,7 @@ ivi_layout_layer_add_surface(struct ivi_layout_layer *ivilayer,
 	wl_list_insert(&ivilayer->pending.view_list, &ivi_view->pending_link);
 
 	ivilayer->order.dirty = 1;
+	layer_mark_dirty(ivilayer);
 
 	return IVI_SUCCEEDED;
 }
@@ -1712,6 +1830,7 @@ ivi_layout_layer_remove_surface(struct ivi_layout_layer *ivilayer,
 		wl_list_init(&ivi_view->pending_link);
 
 		ivilayer->order.dirty = 1;
+		layer_mark_dirty(ivilayer);
 	}
 }
 
@@ -1728,6 +1847,7 @@ ivi_layout_surface_set_source_rectangle(struct ivi_layout_surface *ivisurf,
 	}
 
 	prop = &ivisurf->pending.prop;
+	surface_mark_dirty(ivisurf);
 	prop->source_x = x;
 	prop->source_y = y;
 	prop->source_width = width;
@@ -1772,6 +1892,7 @@ ivi_layout_layer_set_transition(struct ivi_layout_layer *ivilayer,
 
 	ivilayer->pending.prop.transition_type = type;
 	ivilayer->pending.prop.transition_duration = duration;
+	layer_mark_dirty(ivilayer);
 
 	return 0;
 }
@@ -1789,6 +1910,7 @@ ivi_layout_layer_set_fade_info(struct ivi_layout_layer* ivilayer,
 	ivilayer->pending.prop.is_fade_in = is_fade_in;
 	ivilayer->pending.prop.start_alpha = start_alpha;
 	ivilayer->pending.prop.end_alpha = end_alpha;
+	layer_mark_dirty(ivilayer);
 
 	return 0;
 }
@@ -1805,6 +1927,7 @@ ivi_layout_surface_set_transition_duration(struct ivi_layout_surface *ivisurf,
 	}
 
 	prop = &ivisurf->pending.prop;
+	surface_mark_dirty(ivisurf);
 	prop->transition_duration = duration*10;
 	return 0;
 }
@@ -1822,6 +1945,7 @@ ivi_layout_surface_set_transition(struct ivi_layout_surface *ivisurf,
 	}
 
 	prop = &ivisurf->pending.prop;
+	surface_mark_dirty(ivisurf);
 	prop->transition_type = type;
 	prop->transition_duration = duration;
 	return 0;
@@ -1856,11 +1980,29 @@ ivi_layout_surface_configure(struct ivi_layout_surface *ivisurf,
 {
 	struct ivi_layout *layout = get_instance();
 
+	/* the view transform depends on the surface size */
+	surface_mark_dirty(ivisurf);
+
 	/* emit callback which is set by ivi-layout api user */
 	wl_signal_emit(&layout->surface_notification.configure_changed,
 		       ivisurf);
 }
 
+/**
+ * Called when content is committed to a surface that is not mapped,
+ * e.g. after the client attached a NULL buffer. Views only go back into
+ * the scene when the view list is rebuilt, so force that on the next
+ * commit_changes.
+ */
+void
+ivi_layout_surface_map(struct ivi_layout_surface *ivisurf)
+{
+	struct ivi_layout *layout = get_instance();
+
+	surface_mark_dirty(ivisurf);
+	layout->dirty.scene = true;
+}
+
 struct ivi_layout_surface*
 ivi_layout_surface_create(struct weston_surface *wl_surface,
 			  uint32_t id_surface)
@@ -1873,12 +2015,14 @@ ivi_layout_surface_create(struct weston_surface *wl_surface,
 		return NULL;
 	}
 
-	ivisurf = get_surface(&layout->surface_list, id_surface);
+	ivisurf = get_surface(layout, id_surface);
 	if (ivisurf != NULL) {
 		if (ivisurf->surface != NULL) {
 			weston_log("id_surface(%d) is already created\n", id_surface);
 			return NULL;
 		}
+		/* The new surface takes over the id. */
+		hash_table_remove(layout->surface_ids, id_surface);
 	}
 
 	ivisurf = calloc(1, sizeof *ivisurf);
@@ -1901,6 +2045,14 @@ ivi_layout_surface_create(struct weston_surface *wl_surface,
 	ivisurf->pending.prop = ivisurf->prop;
 
 	wl_list_init(&ivisurf->view_list);
+	wl_list_init(&ivisurf->dirty_link);
+	wl_list_init(&ivisurf->transition_list);
+
+	if (hash_table_insert(layout->surface_ids, id_surface, ivisurf) < 0) {
+		weston_log("fails to allocate memory\n");
+		free(ivisurf);
+		return NULL;
+	}
 
 	wl_list_insert(&layout->surface_list, &ivisurf->link);
 
@@ -1911,7 +2063,24 @@ ivi_layout_surface_create(struct weston_surface *wl_surface,
 
 static struct ivi_layout_interface ivi_layout_interface;
 
-void
+/* Clients, and with them the surfaces, can outlive the compositor, so
+ * the id lookups are guarded against the tables being gone. */
+static void
+layout_handle_compositor_destroy(struct wl_listener *listener, void *data)
+{
+	struct ivi_layout *layout =
+		container_of(listener, struct ivi_layout,
+			     compositor_destroy_listener);
+
+	wl_list_remove(&layout->compositor_destroy_listener.link);
+
+	hash_table_destroy(layout->surface_ids);
+	hash_table_destroy(layout->layer_ids);
+	layout->surface_ids = NULL;
+	layout->layer_ids = NULL;
+}
+
+int
 ivi_layout_init_with_compositor(struct weston_compositor *ec)
 {
 	struct ivi_layout *layout = get_instance();
@@ -1923,6 +2092,26 @@ ivi_layout_init_with_compositor(struct weston_compositor *ec)
 	wl_list_init(&layout->screen_list);
 	wl_list_init(&layout->view_list);
 
+	layout->surface_ids = hash_table_create();
+	layout->layer_ids = hash_table_create();
+	if (!layout->surface_ids || !layout->layer_ids) {
+		weston_log("fails to allocate memory\n");
+		if (layout->surface_ids)
+			hash_table_destroy(layout->surface_ids);
+		if (layout->layer_ids)
+			hash_table_destroy(layout->layer_ids);
+		layout->surface_ids = NULL;
+		layout->layer_ids = NULL;
+		return -1;
+	}
+	layout->compositor_destroy_listener.notify =
+		layout_handle_compositor_destroy;
+	wl_signal_add(&ec->destroy_signal,
+		      &layout->compositor_destroy_listener);
+
+	wl_list_init(&layout->dirty.surface_list);
+	wl_list_init(&layout->dirty.layer_list);
+
 	wl_signal_init(&layout->layer_notification.created);
 	wl_signal_init(&layout->layer_notification.removed);
 
@@ -1943,6 +2132,8 @@ ivi_layout_init_with_compositor(struct weston_compositor *ec)
 	weston_plugin_api_register(ec, IVI_LAYOUT_API_NAME,
 				   &ivi_layout_interface,
 				   sizeof(struct ivi_layout_interface));
+
+	return 0;
 }
 
 static struct ivi_layout_interface ivi_layout_interface = {
@@ -129,6 +129,9 @@ ivi_shell_surface_committed(struct weston_surface *surface,
 	if (surface->width == 0 || surface->height == 0)
 		return;
 
+	if (!weston_surface_is_mapped(surface))
+		ivi_layout_surface_map(ivisurf->layout_surface);
+
 	if (ivisurf->width != surface->width ||
 	    ivisurf->height != surface->height) {
 		ivisurf->width  = surface->width;
@@ -492,7 +495,9 @@ wet_shell_init(struct weston_compositor *compositor,
 			     shell, bind_ivi_application) == NULL)
 		goto out;
 
-	ivi_layout_init_with_compositor(compositor);
+	if (ivi_layout_init_with_compositor(compositor) < 0)
+		goto out;
+
 	shell_add_bindings(compositor, shell);
 
 	retval = 0;
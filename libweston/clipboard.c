@@ -28,22 +28,35 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
 #include <linux/input.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/uio.h>
+#include <sys/sendfile.h>
 
 #include "compositor.h"
 #include "shared/helpers.h"
+#include "shared/os-compatibility.h"
+#include "shared/timespec-util.h"
+
+/* The pipe from the selection owner grows up to this while it keeps
+ * filling up, so big pastes need fewer wakeups. */
+#define CLIPBOARD_PIPE_MAX (1024 * 1024)
 
 struct clipboard_source {
 	struct weston_data_source base;
-	struct wl_array contents;
+	int contents_fd;	/* memfd with the contents read so far */
+	size_t size;
 	struct clipboard *clipboard;
 	struct wl_event_source *event_source;
+	struct wl_list client_list;	/* clipboard_client::link */
+	struct timespec start;
 	uint32_t serial;
 	int refcount;
 	int fd;
+	int pipe_size;
 };
 
 struct clipboard {
@@ -53,8 +66,62 @@ struct clipboard {
 	struct clipboard_source *source;
 };
 
+struct clipboard_client {
+	struct wl_event_source *event_source;
+	struct wl_list link;
+	off_t offset;
+	struct clipboard_source *source;
+	struct timespec start;
+	int fd;
+	bool paused;
+};
+
 static void clipboard_client_create(struct clipboard_source *source, int fd);
 
+static void
+clipboard_log_transfer(const char *what, size_t size,
+		       const struct timespec *start)
+{
+	struct timespec now;
+	int64_t nsec;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	nsec = timespec_sub_to_nsec(&now, start);
+
+	weston_log("clipboard: %s %zu bytes in %.1f ms (%.1f MiB/s)\n",
+		   what, size, nsec / 1e6,
+		   nsec > 0 ? size * 1e9 / nsec / (1024 * 1024) : 0.0);
+}
+
+/* Clients that caught up with the contents wait for more to arrive. */
+static void
+clipboard_source_wake_clients(struct clipboard_source *source)
+{
+	struct clipboard_client *client;
+
+	wl_list_for_each(client, &source->client_list, link) {
+		if (!client->paused)
+			continue;
+
+		wl_event_source_fd_update(client->event_source,
+					  WL_EVENT_WRITABLE);
+		client->paused = false;
+	}
+}
+
+static void
+clipboard_source_stop_reading(struct clipboard_source *source)
+{
+	if (!source->event_source)
+		return;
+
+	wl_event_source_remove(source->event_source);
+	close(source->fd);
+	source->event_source = NULL;
+
+	clipboard_source_wake_clients(source);
+}
+
 static void
 clipboard_source_unref(struct clipboard_source *source)
 {
@@ -73,35 +140,59 @@ clipboard_source_unref(struct clipboard_source *source)
 	s = source->base.mime_types.data;
 	free(*s);
 	wl_array_release(&source->base.mime_types);
-	wl_array_release(&source->contents);
+	close(source->contents_fd);
 	free(source);
 }
 
+/* Moves the pending data from the selection owner's pipe straight into
+ * the contents file, without copying it through user space. */
+static ssize_t
+clipboard_source_read(struct clipboard_source *source, int fd)
+{
+	char buffer[16 * 1024];
+	loff_t offset = source->size;
+	ssize_t len;
+
+	len = splice(fd, NULL, source->contents_fd, &offset,
+		     CLIPBOARD_PIPE_MAX, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (len >= 0 || errno != EINVAL)
+		return len;
+
+	/* The contents file does not support splice. */
+	len = read(fd, buffer, sizeof buffer);
+	if (len > 0 && pwrite(source->contents_fd, buffer, len, offset) != len) {
+		errno = EIO;
+		return -1;
+	}
+
+	return len;
+}
+
 static int
 clipboard_source_data(int fd, uint32_t mask, void *data)
 {
 	struct clipboard_source *source = data;
 	struct clipboard *clipboard = source->clipboard;
-	char *p;
-	int len, size;
+	ssize_t len;
 
-	if (source->contents.alloc - source->contents.size < 1024) {
-		wl_array_add(&source->contents, 1024);
-		source->contents.size -= 1024;
-	}
-
-	p = source->contents.data + source->contents.size;
-	size = source->contents.alloc - source->contents.size;
-	len = read(fd, p, size);
+	len = clipboard_source_read(source, fd);
 	if (len == 0) {
-		wl_event_source_remove(source->event_source);
-		close(fd);
-		source->event_source = NULL;
+		os_seal_file(source->contents_fd);
+		clipboard_log_transfer("read", source->size, &source->start);
+		clipboard_source_stop_reading(source);
 	} else if (len < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return 1;
+
+		clipboard_source_stop_reading(source);
 		clipboard_source_unref(source);
 		clipboard->source = NULL;
 	} else {
-		source->contents.size += len;
+		source->size += len;
+		if (source->pipe_size > 0 && len >= source->pipe_size)
+			source->pipe_size = os_pipe_grow(fd, CLIPBOARD_PIPE_MAX);
+
+		clipboard_source_wake_clients(source);
 	}
 
 	return 1;
@@ -146,8 +237,15 @@ clipboard_source_create(struct clipboard *clipboard,
 	if (source == NULL)
 		return NULL;
 
-	wl_array_init(&source->contents);
+	source->contents_fd = os_create_sealable_file("weston-clipboard", 0);
+	if (source->contents_fd < 0) {
+		weston_log("clipboard: cannot create a file for the "
+			   "selection contents: %m\n");
+		goto err_contents;
+	}
+
 	wl_array_init(&source->base.mime_types);
+	wl_list_init(&source->client_list);
 	source->base.resource = NULL;
 	source->base.accept = clipboard_source_accept;
 	source->base.send = clipboard_source_send;
@@ -157,6 +255,8 @@ clipboard_source_create(struct clipboard *clipboard,
 	source->clipboard = clipboard;
 	source->serial = serial;
 	source->fd = fd;
+	source->pipe_size = os_pipe_grow(fd, CLIPBOARD_PIPE_MAX);
+	clock_gettime(CLOCK_MONOTONIC, &source->start);
 
 	s = wl_array_add(&source->base.mime_types, sizeof *s);
 	if (s == NULL)
@@ -177,38 +277,80 @@ clipboard_source_create(struct clipboard *clipboard,
  err_strdup:
 	wl_array_release(&source->base.mime_types);
  err_add:
+	close(source->contents_fd);
+ err_contents:
 	free(source);
 
 	return NULL;
 }
 
-struct clipboard_client {
-	struct wl_event_source *event_source;
-	size_t offset;
-	struct clipboard_source *source;
-};
+static void
+clipboard_client_destroy(struct clipboard_client *client)
+{
+	close(client->fd);
+	wl_event_source_remove(client->event_source);
+	wl_list_remove(&client->link);
+	clipboard_source_unref(client->source);
+	free(client);
+}
+
+/* Sends what the clipboard holds past the client's offset, from the
+ * contents file straight into the client's fd. */
+static ssize_t
+clipboard_client_write(struct clipboard_client *client)
+{
+	struct clipboard_source *source = client->source;
+	char buffer[16 * 1024];
+	size_t size = source->size - client->offset;
+	ssize_t len;
+
+	len = sendfile(client->fd, source->contents_fd, &client->offset, size);
+	if (len >= 0 || errno != EINVAL)
+		return len;
+
+	/* The contents file does not support sendfile. */
+	len = pread(source->contents_fd, buffer, MIN(size, sizeof buffer),
+		    client->offset);
+	if (len <= 0) {
+		errno = EIO;
+		return -1;
+	}
+
+	len = write(client->fd, buffer, len);
+	if (len > 0)
+		client->offset += len;
+
+	return len;
+}
 
 static int
 clipboard_client_data(int fd, uint32_t mask, void *data)
 {
 	struct clipboard_client *client = data;
-	char *p;
-	size_t size;
-	int len;
+	struct clipboard_source *source = client->source;
+	ssize_t len;
+
+	if ((size_t) client->offset < source->size) {
+		len = clipboard_client_write(client);
+		if (len == 0 ||
+		    (len < 0 && errno != EAGAIN && errno != EINTR)) {
+			clipboard_client_destroy(client);
+			return 1;
+		}
+	}
 
-	size = client->source->contents.size;
-	p = client->source->contents.data;
-	len = write(fd, p + client->offset, size - client->offset);
-	if (len > 0)
-		client->offset += len;
+	if ((size_t) client->offset < source->size)
+		return 1;
 
-	if (client->offset == size || len <= 0) {
-		close(fd);
-		wl_event_source_remove(client->event_source);
-		clipboard_source_unref(client->source);
-		free(client);
+	if (source->event_source) {
+		wl_event_source_fd_update(client->event_source, 0);
+		client->paused = true;
+		return 1;
 	}
 
+	clipboard_log_transfer("sent", client->offset, &client->start);
+	clipboard_client_destroy(client);
+
 	return 1;
 }
 
@@ -219,16 +361,32 @@ clipboard_client_create(struct clipboard_source *source, int fd)
 	struct clipboard_client *client;
 	struct wl_event_loop *loop =
 		wl_display_get_event_loop(seat->compositor->wl_display);
+	int flags;
 
 	client = zalloc(sizeof *client);
-	if (client == NULL)
+	if (client == NULL) {
+		close(fd);
 		return;
+	}
+
+	flags = fcntl(fd, F_GETFL);
+	if (flags != -1)
+		fcntl(fd, F_SETFL, flags | O_NONBLOCK);
 
 	client->source = source;
-	source->refcount++;
+	client->fd = fd;
+	clock_gettime(CLOCK_MONOTONIC, &client->start);
 	client->event_source =
 		wl_event_loop_add_fd(loop, fd, WL_EVENT_WRITABLE,
 				     clipboard_client_data, client);
+	if (client->event_source == NULL) {
+		close(fd);
+		free(client);
+		return;
+	}
+
+	source->refcount++;
+	wl_list_insert(&source->client_list, &client->link);
 }
 
 static void
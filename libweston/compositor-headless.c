@@ -36,9 +36,14 @@
 #include "compositor.h"
 #include "compositor-headless.h"
 #include "shared/helpers.h"
+#include "shared/timespec-util.h"
 #include "pixman-renderer.h"
 #include "presentation-time-server-protocol.h"
 #include "windowed-output-api.h"
+#include "gl-renderer.h"
+#include "weston-egl-ext.h"
+
+#define DEFAULT_REFRESH_RATE 60000 /* mHz */
 
 struct headless_backend {
 	struct weston_backend base;
@@ -46,6 +51,10 @@ struct headless_backend {
 
 	struct weston_seat fake_seat;
 	bool use_pixman;
+	bool use_gl;
+	struct gl_renderer_interface *glri;
+	int refresh;
+	bool virtual_clock;
 };
 
 struct headless_head {
@@ -56,7 +65,10 @@ struct headless_output {
 	struct weston_output base;
 
 	struct weston_mode mode;
+	int refresh;				/* mHz */
+	struct timespec vblank;			/* last or pending vblank */
 	struct wl_event_source *finish_frame_timer;
+	struct wl_event_source *finish_frame_idle;
 	uint32_t *image_buf;
 	pixman_image_t *image;
 };
@@ -79,27 +91,73 @@ to_headless_backend(struct weston_compositor *base)
 	return container_of(base->backend, struct headless_backend, base);
 }
 
+/* Vblanks of an output happen on a fixed grid of refresh periods,
+ * starting from its first frame. Move output->vblank to the last vblank
+ * at or before now, or to the first one after now if next is set, and
+ * count the vblanks passed on the way in the output's MSC.
+ */
 static void
-headless_output_start_repaint_loop(struct weston_output *output)
+headless_output_update_vblank(struct headless_output *output,
+			      const struct timespec *now, bool next)
 {
-	struct timespec ts;
+	int64_t period = millihz_to_nsec(output->refresh);
+	int64_t elapsed;
+	int64_t n;
+
+	if (timespec_is_zero(&output->vblank))
+		output->vblank = *now;
+
+	elapsed = timespec_sub_to_nsec(now, &output->vblank);
+	n = elapsed > 0 ? elapsed / period : 0;
+	if (next)
+		n++;
 
-	weston_compositor_read_presentation_clock(output->compositor, &ts);
-	weston_output_finish_frame(output, &ts, WP_PRESENTATION_FEEDBACK_INVALID);
+	timespec_add_nsec(&output->vblank, &output->vblank, n * period);
+	output->base.msc += n;
+}
+
+static void
+headless_output_start_repaint_loop(struct weston_output *output_base)
+{
+	struct headless_output *output = to_headless_output(output_base);
+	struct timespec now;
+
+	weston_compositor_read_presentation_clock(output->base.compositor,
+						  &now);
+	headless_output_update_vblank(output, &now, false);
+
+	weston_output_finish_frame(&output->base, &output->vblank,
+				   WP_PRESENTATION_FEEDBACK_INVALID);
+}
+
+static void
+headless_output_finish_frame(struct headless_output *output)
+{
+	weston_compositor_advance_presentation_clock(output->base.compositor,
+						     &output->vblank);
+	weston_output_finish_frame(&output->base, &output->vblank,
+				   WP_PRESENTATION_FEEDBACK_KIND_VSYNC);
 }
 
 static int
 finish_frame_handler(void *data)
 {
 	struct headless_output *output = data;
-	struct timespec ts;
 
-	weston_compositor_read_presentation_clock(output->base.compositor, &ts);
-	weston_output_finish_frame(&output->base, &ts, 0);
+	headless_output_finish_frame(output);
 
 	return 1;
 }
 
+static void
+finish_frame_idle_handler(void *data)
+{
+	struct headless_output *output = data;
+
+	output->finish_frame_idle = NULL;
+	headless_output_finish_frame(output);
+}
+
 static int
 headless_output_repaint(struct weston_output *output_base,
 		       pixman_region32_t *damage,
@@ -107,13 +165,32 @@ headless_output_repaint(struct weston_output *output_base,
 {
 	struct headless_output *output = to_headless_output(output_base);
 	struct weston_compositor *ec = output->base.compositor;
+	struct headless_backend *b = to_headless_backend(ec);
+	struct wl_event_loop *loop;
+	struct timespec now;
+	int64_t msec;
 
 	ec->renderer->repaint_output(&output->base, damage);
 
 	pixman_region32_subtract(&ec->primary_plane.damage,
 				 &ec->primary_plane.damage, damage);
 
-	wl_event_source_timer_update(output->finish_frame_timer, 16);
+	weston_compositor_read_presentation_clock(ec, &now);
+	headless_output_update_vblank(output, &now, true);
+
+	/* With a virtual clock the vblank is reached without waiting. */
+	if (b->virtual_clock) {
+		loop = wl_display_get_event_loop(ec->wl_display);
+		output->finish_frame_idle =
+			wl_event_loop_add_idle(loop, finish_frame_idle_handler,
+					       output);
+		return 0;
+	}
+
+	msec = (timespec_sub_to_nsec(&output->vblank, &now) + 999999) /
+	       1000000;
+	wl_event_source_timer_update(output->finish_frame_timer,
+				     MAX(msec, 1));
 
 	return 0;
 }
@@ -128,11 +205,17 @@ headless_output_disable(struct weston_output *base)
 		return 0;
 
 	wl_event_source_remove(output->finish_frame_timer);
+	if (output->finish_frame_idle) {
+		wl_event_source_remove(output->finish_frame_idle);
+		output->finish_frame_idle = NULL;
+	}
 
 	if (b->use_pixman) {
 		pixman_renderer_output_destroy(&output->base);
 		pixman_image_unref(output->image);
 		free(output->image_buf);
+	} else if (b->use_gl) {
+		b->glri->output_destroy(&output->base);
 	}
 
 	return 0;
@@ -178,6 +261,15 @@ headless_output_enable(struct weston_output *base)
 
 		pixman_renderer_output_set_buffer(&output->base,
 						  output->image);
+	} else if (b->use_gl) {
+		if (b->glri->output_pbuffer_create(&output->base,
+					output->base.current_mode->width,
+					output->base.current_mode->height,
+					b->glri->pbuffer_attribs,
+					NULL, 0) < 0) {
+			weston_log("failed to create gl renderer output state\n");
+			goto err_malloc;
+		}
 	}
 
 	return 0;
@@ -220,7 +312,7 @@ headless_output_set_size(struct weston_output *base,
 		WL_OUTPUT_MODE_CURRENT | WL_OUTPUT_MODE_PREFERRED;
 	output->mode.width = output_width;
 	output->mode.height = output_height;
-	output->mode.refresh = 60000;
+	output->mode.refresh = output->refresh;
 	wl_list_insert(&output->base.mode_list, &output->mode.link);
 
 	output->base.current_mode = &output->mode;
@@ -248,6 +340,7 @@ headless_output_create(struct weston_compositor *compositor, const char *name)
 		return NULL;
 
 	weston_output_init(&output->base, compositor, name);
+	output->refresh = to_headless_backend(compositor)->refresh;
 
 	output->base.destroy = headless_output_destroy;
 	output->base.disable = headless_output_disable;
@@ -306,11 +399,47 @@ headless_destroy(struct weston_compositor *ec)
 	free(b);
 }
 
+static int
+headless_output_set_refresh_rate(struct weston_output *base, int refresh)
+{
+	struct headless_output *output = to_headless_output(base);
+
+	if (refresh <= 0 || output->base.enabled)
+		return -1;
+
+	output->refresh = refresh;
+	output->mode.refresh = refresh;
+
+	return 0;
+}
+
 static const struct weston_windowed_output_api api = {
 	headless_output_set_size,
 	headless_head_create,
 };
 
+static const struct weston_headless_output_api headless_api = {
+	headless_output_set_refresh_rate,
+};
+
+/* Without a display to render to, the GL renderer runs on the surfaceless
+ * platform of Mesa, which works with software rasterizers such as llvmpipe
+ * as well as with GPU render nodes. Outputs render to pbuffers.
+ */
+static int
+headless_gl_renderer_init(struct headless_backend *b)
+{
+	b->glri = weston_load_module("gl-renderer.so",
+				     "gl_renderer_interface");
+	if (!b->glri)
+		return -1;
+
+	return b->glri->display_create(b->compositor,
+				       EGL_PLATFORM_SURFACELESS_MESA,
+				       NULL, NULL,
+				       b->glri->pbuffer_attribs, NULL, 0);
+}
+
 static struct headless_backend *
 headless_backend_create(struct weston_compositor *compositor,
 			struct weston_headless_backend_config *config)
@@ -325,19 +454,42 @@ headless_backend_create(struct weston_compositor *compositor,
 	b->compositor = compositor;
 	compositor->backend = &b->base;
 
-	if (weston_compositor_set_presentation_clock_software(compositor) < 0)
+	b->refresh = config->refresh > 0 ? config->refresh :
+					   DEFAULT_REFRESH_RATE;
+	b->virtual_clock = config->virtual_clock;
+
+	if (b->virtual_clock)
+		ret = weston_compositor_set_presentation_clock_virtual(
+								compositor);
+	else
+		ret = weston_compositor_set_presentation_clock_software(
+								compositor);
+	if (ret < 0)
 		goto err_free;
 
 	b->base.destroy = headless_destroy;
 	b->base.create_output = headless_output_create;
 
+	if (config->use_pixman && config->use_gl) {
+		weston_log("Error: the pixman and GL renderers are mutually "
+			   "exclusive.\n");
+		goto err_input;
+	}
+
 	b->use_pixman = config->use_pixman;
+	b->use_gl = config->use_gl;
 	if (b->use_pixman) {
 		pixman_renderer_init(compositor);
-	}
-
-	if (!b->use_pixman && noop_renderer_init(compositor) < 0)
+	} else if (b->use_gl) {
+		if (headless_gl_renderer_init(b) < 0) {
+			weston_log("Failed to initialize the GL renderer.\n");
+			goto err_input;
+		}
+	} else if (noop_renderer_init(compositor) < 0) {
 		goto err_input;
+	}
+	weston_log("Using %s renderer\n", b->use_pixman ? "pixman" :
+		   b->use_gl ? "gl" : "noop");
 
 	ret = weston_plugin_api_register(compositor, WESTON_WINDOWED_OUTPUT_API_NAME,
 					 &api, sizeof(api));
@@ -347,6 +499,15 @@ headless_backend_create(struct weston_compositor *compositor,
 		goto err_input;
 	}
 
+	ret = weston_plugin_api_register(compositor,
+					 WESTON_HEADLESS_OUTPUT_API_NAME,
+					 &headless_api, sizeof(headless_api));
+
+	if (ret < 0) {
+		weston_log("Failed to register headless output API.\n");
+		goto err_input;
+	}
+
 	return b;
 
 err_input:
@@ -33,14 +33,50 @@ extern "C" {
 #include <stdint.h>
 
 #include "compositor.h"
+#include "plugin-registry.h"
 
-#define WESTON_HEADLESS_BACKEND_CONFIG_VERSION 2
+#define WESTON_HEADLESS_BACKEND_CONFIG_VERSION 4
+
+#define WESTON_HEADLESS_OUTPUT_API_NAME "weston_headless_output_api_v1"
+
+struct weston_headless_output_api {
+	/** Set the refresh rate of an output, in mHz.
+	 *
+	 * Must be called before the output is enabled. Outputs start with
+	 * the refresh rate given in the backend configuration.
+	 *
+	 * Returns 0 on success, -1 on failure.
+	 */
+	int (*set_refresh_rate)(struct weston_output *output, int refresh);
+};
+
+static inline const struct weston_headless_output_api *
+weston_headless_output_get_api(struct weston_compositor *compositor)
+{
+	const void *api;
+	api = weston_plugin_api_get(compositor, WESTON_HEADLESS_OUTPUT_API_NAME,
+				    sizeof(struct weston_headless_output_api));
+
+	return (const struct weston_headless_output_api *)api;
+}
 
 struct weston_headless_backend_config {
 	struct weston_backend_config base;
 
 	/** Whether to use the pixman renderer instead of the OpenGL ES renderer. */
 	int use_pixman;
+
+	/** Default refresh rate of outputs in mHz, 0 for 60 Hz. */
+	int refresh;
+
+	/** Use a virtual presentation clock that jumps to the next vblank
+	 *  instead of waiting for it, so the repaint loop runs
+	 *  deterministically and as fast as possible. */
+	bool virtual_clock;
+
+	/** Render with the OpenGL ES renderer into offscreen buffers,
+	 *  without any display hardware. */
+	bool use_gl;
 };
 
 #ifdef  __cplusplus
@@ -214,7 +214,7 @@ x11_backend_get_keymap(struct x11_backend *b)
 	copy_prop_value(options);
 #undef copy_prop_value
 
-	ret = xkb_keymap_new_from_names(b->compositor->xkb_context, &names, 0);
+	ret = weston_compositor_get_keymap(b->compositor, &names);
 
 	free(reply);
 	return ret;
@@ -33,6 +33,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <stdarg.h>
 #include <assert.h>
@@ -53,6 +54,7 @@
 #include <errno.h>
 
 #include "timeline.h"
+#include "damage-coalesce.h"
 
 #include "compositor.h"
 #include "viewporter-server-protocol.h"
@@ -66,6 +68,7 @@
 #include "plugin-registry.h"
 
 #define DEFAULT_REPAINT_WINDOW 7 /* milliseconds */
+#define DEFAULT_DAMAGE_MAX_RECTS 64
 
 static void
 weston_output_update_matrix(struct weston_output *output);
@@ -77,6 +80,22 @@ weston_output_transform_scale_init(struct weston_output *output,
 static void
 weston_compositor_build_view_list(struct weston_compositor *compositor);
 
+/** Mark the compositor's view list as stale
+ *
+ * Anything that changes which views end up in compositor->view_list, or
+ * their order, must call this: layer membership and stacking, the
+ * sub-surface order, and sub-surface mapping. Pure geometry changes do not
+ * need it, see weston_compositor_update_view_list().
+ */
+static void
+weston_compositor_view_list_dirty(struct weston_compositor *compositor)
+{
+	compositor->view_list_needs_rebuild = true;
+}
+
+static void
+weston_compositor_view_grid_dirty(struct weston_compositor *compositor);
+
 static char *
 weston_output_create_heads_string(struct weston_output *output);
 
@@ -1344,6 +1363,7 @@ weston_view_update_transform(struct weston_view *view)
 	view->transform.dirty = 0;
 
 	weston_view_damage_below(view);
+	weston_compositor_view_grid_dirty(view->surface->compositor);
 
 	pixman_region32_fini(&view->transform.boundingbox);
 	pixman_region32_fini(&view->transform.opaque);
@@ -1802,40 +1822,256 @@ weston_compositor_get_time(struct timespec *time)
 	clock_gettime(CLOCK_REALTIME, time);
 }
 
+/* A uniform grid over the bounding boxes of compositor->view_list, used to
+ * accelerate weston_compositor_pick_view(). Every cell lists, in view list
+ * order, the views whose bounding box overlaps the cell, so a pick only has
+ * to test the views in one cell.
+ *
+ * Bounding boxes change in weston_view_update_transform(), which is where
+ * weston_view_geometry_dirty() eventually lands, and membership changes
+ * with the view list. Both mark the grid dirty and it is rebuilt on the
+ * next pick, so a burst of pointer motion between two repaints pays for
+ * one rebuild at most.
+ */
+struct weston_view_grid {
+	bool dirty;
+	bool valid;		/* false: fall back to scanning view_list */
+	int32_t x1, y1;		/* global coordinates of the first cell */
+	int cell_shift;		/* log2 of the cell size in pixels */
+	int width, height;	/* in cells */
+
+	int *cell_start;	/* width * height + 1 entries into views */
+	int cell_alloc;
+	struct weston_view **views;
+	int views_alloc;
+};
+
+#define VIEW_GRID_MIN_CELL_SHIFT 6
+#define VIEW_GRID_MAX_CELLS 4096
+
+static void
+weston_compositor_view_grid_dirty(struct weston_compositor *compositor)
+{
+	if (compositor->view_grid)
+		compositor->view_grid->dirty = true;
+}
+
+static void
+view_grid_destroy(struct weston_view_grid *grid)
+{
+	if (!grid)
+		return;
+
+	free(grid->cell_start);
+	free(grid->views);
+	free(grid);
+}
+
+static void
+view_grid_cell_range(const struct weston_view_grid *grid,
+		     const pixman_box32_t *box,
+		     int *cx1, int *cy1, int *cx2, int *cy2)
+{
+	*cx1 = ((int64_t) box->x1 - grid->x1) >> grid->cell_shift;
+	*cy1 = ((int64_t) box->y1 - grid->y1) >> grid->cell_shift;
+	*cx2 = ((int64_t) box->x2 - 1 - grid->x1) >> grid->cell_shift;
+	*cy2 = ((int64_t) box->y2 - 1 - grid->y1) >> grid->cell_shift;
+}
+
+static int
+view_grid_reserve(void **array, int *alloc, int count, size_t size)
+{
+	void *tmp;
+
+	if (count <= *alloc)
+		return 0;
+
+	tmp = realloc(*array, count * size);
+	if (!tmp)
+		return -1;
+
+	*array = tmp;
+	*alloc = count;
+
+	return 0;
+}
+
+static void
+view_grid_build(struct weston_view_grid *grid, struct wl_list *view_list)
+{
+	struct weston_view *view;
+	pixman_box32_t *box;
+	int64_t x1 = INT32_MAX, y1 = INT32_MAX;
+	int64_t x2 = INT32_MIN, y2 = INT32_MIN;
+	int cx1, cy1, cx2, cy2, cx, cy;
+	int n_cells, c;
+
+	grid->dirty = false;
+	grid->valid = false;
+
+	wl_list_for_each(view, view_list, link) {
+		if (!pixman_region32_not_empty(&view->transform.boundingbox))
+			continue;
+
+		box = pixman_region32_extents(&view->transform.boundingbox);
+		x1 = MIN(x1, box->x1);
+		y1 = MIN(y1, box->y1);
+		x2 = MAX(x2, box->x2);
+		y2 = MAX(y2, box->y2);
+	}
+
+	if (x1 >= x2 || y1 >= y2) {
+		grid->width = grid->height = 0;
+		grid->valid = true;
+		return;
+	}
+
+	grid->x1 = x1;
+	grid->y1 = y1;
+	grid->cell_shift = VIEW_GRID_MIN_CELL_SHIFT;
+	while ((((x2 - x1 - 1) >> grid->cell_shift) + 1) *
+	       (((y2 - y1 - 1) >> grid->cell_shift) + 1) > VIEW_GRID_MAX_CELLS)
+		grid->cell_shift++;
+
+	grid->width = ((x2 - x1 - 1) >> grid->cell_shift) + 1;
+	grid->height = ((y2 - y1 - 1) >> grid->cell_shift) + 1;
+	n_cells = grid->width * grid->height;
+
+	if (view_grid_reserve((void **) &grid->cell_start, &grid->cell_alloc,
+			      n_cells + 1, sizeof *grid->cell_start) < 0)
+		return;
+
+	/* Counting sort: count the views per cell, turn the counts into
+	 * start offsets, then fill in view list order. */
+	memset(grid->cell_start, 0, (n_cells + 1) * sizeof *grid->cell_start);
+
+	wl_list_for_each(view, view_list, link) {
+		if (!pixman_region32_not_empty(&view->transform.boundingbox))
+			continue;
+
+		box = pixman_region32_extents(&view->transform.boundingbox);
+		view_grid_cell_range(grid, box, &cx1, &cy1, &cx2, &cy2);
+		for (cy = cy1; cy <= cy2; cy++)
+			for (cx = cx1; cx <= cx2; cx++)
+				grid->cell_start[cy * grid->width + cx + 1]++;
+	}
+
+	for (c = 0; c < n_cells; c++)
+		grid->cell_start[c + 1] += grid->cell_start[c];
+
+	if (view_grid_reserve((void **) &grid->views, &grid->views_alloc,
+			      grid->cell_start[n_cells],
+			      sizeof *grid->views) < 0)
+		return;
+
+	wl_list_for_each(view, view_list, link) {
+		if (!pixman_region32_not_empty(&view->transform.boundingbox))
+			continue;
+
+		box = pixman_region32_extents(&view->transform.boundingbox);
+		view_grid_cell_range(grid, box, &cx1, &cy1, &cx2, &cy2);
+		for (cy = cy1; cy <= cy2; cy++) {
+			for (cx = cx1; cx <= cx2; cx++) {
+				c = cy * grid->width + cx;
+				grid->views[grid->cell_start[c]++] = view;
+			}
+		}
+	}
+
+	/* Filling advanced every start to the start of the next cell. */
+	for (c = n_cells; c > 0; c--)
+		grid->cell_start[c] = grid->cell_start[c - 1];
+	grid->cell_start[0] = 0;
+
+	grid->valid = true;
+}
+
+static struct weston_view_grid *
+weston_compositor_get_view_grid(struct weston_compositor *compositor)
+{
+	struct weston_view_grid *grid = compositor->view_grid;
+
+	if (!grid) {
+		grid = zalloc(sizeof *grid);
+		if (!grid)
+			return NULL;
+
+		grid->dirty = true;
+		compositor->view_grid = grid;
+	}
+
+	if (grid->dirty)
+		view_grid_build(grid, &compositor->view_list);
+
+	return grid->valid ? grid : NULL;
+}
+
+static bool
+view_pick_point(struct weston_view *view,
+		wl_fixed_t x, wl_fixed_t y, int ix, int iy,
+		wl_fixed_t *vx, wl_fixed_t *vy)
+{
+	wl_fixed_t view_x, view_y;
+	int view_ix, view_iy;
+
+	if (!pixman_region32_contains_point(&view->transform.boundingbox,
+					    ix, iy, NULL))
+		return false;
+
+	weston_view_from_global_fixed(view, x, y, &view_x, &view_y);
+	view_ix = wl_fixed_to_int(view_x);
+	view_iy = wl_fixed_to_int(view_y);
+
+	if (!pixman_region32_contains_point(&view->surface->input,
+					    view_ix, view_iy, NULL))
+		return false;
+
+	if (view->geometry.scissor_enabled &&
+	    !pixman_region32_contains_point(&view->geometry.scissor,
+					    view_ix, view_iy, NULL))
+		return false;
+
+	*vx = view_x;
+	*vy = view_y;
+
+	return true;
+}
+
 WL_EXPORT struct weston_view *
 weston_compositor_pick_view(struct weston_compositor *compositor,
 			    wl_fixed_t x, wl_fixed_t y,
 			    wl_fixed_t *vx, wl_fixed_t *vy)
 {
+	struct weston_view_grid *grid;
 	struct weston_view *view;
-	wl_fixed_t view_x, view_y;
-	int view_ix, view_iy;
+	int64_t cx, cy;
 	int ix = wl_fixed_to_int(x);
 	int iy = wl_fixed_to_int(y);
+	int c, i;
 
-	wl_list_for_each(view, &compositor->view_list, link) {
-		if (!pixman_region32_contains_point(
-				&view->transform.boundingbox, ix, iy, NULL))
-			continue;
-
-		weston_view_from_global_fixed(view, x, y, &view_x, &view_y);
-		view_ix = wl_fixed_to_int(view_x);
-		view_iy = wl_fixed_to_int(view_y);
-
-		if (!pixman_region32_contains_point(&view->surface->input,
-						    view_ix, view_iy, NULL))
-			continue;
+	grid = weston_compositor_get_view_grid(compositor);
+	if (!grid) {
+		wl_list_for_each(view, &compositor->view_list, link) {
+			if (view_pick_point(view, x, y, ix, iy, vx, vy))
+				return view;
+		}
+		goto out;
+	}
 
-		if (view->geometry.scissor_enabled &&
-		    !pixman_region32_contains_point(&view->geometry.scissor,
-						    view_ix, view_iy, NULL))
-			continue;
+	cx = ((int64_t) ix - grid->x1) >> grid->cell_shift;
+	cy = ((int64_t) iy - grid->y1) >> grid->cell_shift;
+	if (ix < grid->x1 || iy < grid->y1 ||
+	    cx >= grid->width || cy >= grid->height)
+		goto out;
 
-		*vx = view_x;
-		*vy = view_y;
-		return view;
+	c = cy * grid->width + cx;
+	for (i = grid->cell_start[c]; i < grid->cell_start[c + 1]; i++) {
+		view = grid->views[i];
+		if (view_pick_point(view, x, y, ix, iy, vx, vy))
+			return view;
 	}
 
+out:
 	*vx = wl_fixed_from_int(-1000000);
 	*vy = wl_fixed_from_int(-1000000);
 	return NULL;
@@ -1868,6 +2104,8 @@ weston_view_unmap(struct weston_view *view)
 	weston_layer_entry_remove(&view->layer_link);
 	wl_list_remove(&view->link);
 	wl_list_init(&view->link);
+	weston_compositor_view_list_dirty(view->surface->compositor);
+	weston_compositor_view_grid_dirty(view->surface->compositor);
 	view->output_mask = 0;
 	weston_surface_assign_output(view->surface);
 
@@ -1895,6 +2133,7 @@ weston_surface_unmap(struct weston_surface *surface)
 	struct weston_view *view;
 
 	surface->is_mapped = false;
+	weston_compositor_view_list_dirty(surface->compositor);
 	wl_list_for_each(view, &surface->views, surface_link)
 		weston_view_unmap(view);
 	surface->output = NULL;
@@ -1924,6 +2163,7 @@ weston_view_destroy(struct weston_view *view)
 
 	wl_list_remove(&view->link);
 	weston_layer_entry_remove(&view->layer_link);
+	weston_compositor_view_grid_dirty(view->surface->compositor);
 
 	pixman_region32_fini(&view->clip);
 	pixman_region32_fini(&view->geometry.scissor);
@@ -2124,6 +2364,7 @@ static void
 view_accumulate_damage(struct weston_view *view,
 		       pixman_region32_t *opaque)
 {
+	struct weston_compositor *ec = view->surface->compositor;
 	pixman_region32_t damage;
 
 	pixman_region32_init(&damage);
@@ -2140,6 +2381,8 @@ view_accumulate_damage(struct weston_view *view,
 
 	pixman_region32_intersect(&damage, &damage,
 				  &view->transform.boundingbox);
+	damage_coalesce(&damage, ec->damage_max_rects,
+			ec->damage_coalesce_waste);
 	pixman_region32_subtract(&damage, &damage, opaque);
 	pixman_region32_union(&view->plane->damage,
 			      &view->plane->damage, &damage);
@@ -2171,6 +2414,9 @@ compositor_accumulate_damage(struct weston_compositor *ec)
 
 		pixman_region32_union(&clip, &clip, &opaque);
 		pixman_region32_fini(&opaque);
+
+		damage_coalesce(&plane->damage, ec->damage_max_rects,
+				ec->damage_coalesce_waste);
 	}
 
 	pixman_region32_fini(&clip);
@@ -2313,6 +2559,9 @@ weston_compositor_build_view_list(struct weston_compositor *compositor)
 	struct weston_view *view;
 	struct weston_layer *layer;
 
+	compositor->view_list_needs_rebuild = false;
+	weston_compositor_view_grid_dirty(compositor);
+
 	wl_list_for_each(layer, &compositor->layer_list, link)
 		wl_list_for_each(view, &layer->view_list.link, layer_link.link)
 			surface_stash_subsurface_views(view->surface);
@@ -2329,6 +2578,27 @@ weston_compositor_build_view_list(struct weston_compositor *compositor)
 			surface_free_unused_subsurface_views(view->surface);
 }
 
+/* Bring compositor->view_list up to date for a repaint.
+ *
+ * The list is only rebuilt from the layers when something marked it
+ * dirty, so with several outputs repainting in the same cycle only the
+ * first one pays for the rebuild. Otherwise just update the transforms,
+ * which is a no-op for views whose geometry did not change.
+ */
+static void
+weston_compositor_update_view_list(struct weston_compositor *compositor)
+{
+	struct weston_view *view;
+
+	if (compositor->view_list_needs_rebuild) {
+		weston_compositor_build_view_list(compositor);
+		return;
+	}
+
+	wl_list_for_each(view, &compositor->view_list, link)
+		weston_view_update_transform(view);
+}
+
 static void
 weston_output_take_feedback_list(struct weston_output *output,
 				 struct weston_surface *surface)
@@ -2354,6 +2624,51 @@ weston_output_take_feedback_list(struct weston_output *output,
 	wl_list_init(&surface->feedback_list);
 }
 
+/** Adds a sample to a repaint statistics histogram of an output
+ *
+ * \param output The weston_output object.
+ * \param stat The statistic to sample.
+ * \param value The sample, clamped to 32 bits.
+ *
+ * Renderers use this to report their per-frame counters.
+ */
+WL_EXPORT void
+weston_output_repaint_stat_add(struct weston_output *output,
+			       enum weston_repaint_stat stat, uint64_t value)
+{
+	if (value > UINT32_MAX)
+		value = UINT32_MAX;
+
+	weston_histogram_add(&output->repaint_stats.histogram[stat], value);
+}
+
+static void
+output_repaint_stat_add_time(struct weston_output *output,
+			     enum weston_repaint_stat stat,
+			     const struct timespec *begin,
+			     const struct timespec *end)
+{
+	int64_t nsec = timespec_sub_to_nsec(end, begin);
+
+	weston_output_repaint_stat_add(output, stat,
+				       nsec > 0 ? nsec / 1000 : 0);
+}
+
+static uint64_t
+region_area(pixman_region32_t *region)
+{
+	pixman_box32_t *boxes;
+	uint64_t area = 0;
+	int n, i;
+
+	boxes = pixman_region32_rectangles(region, &n);
+	for (i = 0; i < n; i++)
+		area += (uint64_t)(boxes[i].x2 - boxes[i].x1) *
+			(boxes[i].y2 - boxes[i].y1);
+
+	return area;
+}
+
 static int
 weston_output_repaint(struct weston_output *output, void *repaint_data)
 {
@@ -2363,6 +2678,7 @@ weston_output_repaint(struct weston_output *output, void *repaint_data)
 	struct weston_frame_callback *cb, *cnext;
 	struct wl_list frame_callback_list;
 	pixman_region32_t output_damage;
+	struct timespec start, t0, t1;
 	int r;
 	uint32_t frame_time_msec;
 
@@ -2370,9 +2686,11 @@ weston_output_repaint(struct weston_output *output, void *repaint_data)
 		return 0;
 
 	TL_POINT("core_repaint_begin", TLP_OUTPUT(output), TLP_END);
+	weston_compositor_read_presentation_clock(ec, &start);
 
-	/* Rebuild the surface list and update surface transforms up front. */
-	weston_compositor_build_view_list(ec);
+	/* Rebuild the surface list if needed and update surface transforms
+	 * up front. */
+	weston_compositor_update_view_list(ec);
 
 	if (output->assign_planes && !output->disable_planes) {
 		output->assign_planes(output, repaint_data);
@@ -2397,18 +2715,29 @@ weston_output_repaint(struct weston_output *output, void *repaint_data)
 		}
 	}
 
+	weston_compositor_read_presentation_clock(ec, &t0);
 	compositor_accumulate_damage(ec);
+	weston_compositor_read_presentation_clock(ec, &t1);
+	output_repaint_stat_add_time(output,
+				     WESTON_REPAINT_STAT_ACCUMULATE_DAMAGE,
+				     &t0, &t1);
 
 	pixman_region32_init(&output_damage);
 	pixman_region32_intersect(&output_damage,
 				  &ec->primary_plane.damage, &output->region);
 	pixman_region32_subtract(&output_damage,
 				 &output_damage, &ec->primary_plane.clip);
+	weston_output_repaint_stat_add(output, WESTON_REPAINT_STAT_DAMAGE_AREA,
+				       region_area(&output_damage));
 
 	if (output->dirty)
 		weston_output_update_matrix(output);
 
+	weston_compositor_read_presentation_clock(ec, &t0);
 	r = output->repaint(output, &output_damage, repaint_data);
+	weston_compositor_read_presentation_clock(ec, &t1);
+	output_repaint_stat_add_time(output, WESTON_REPAINT_STAT_OUTPUT_REPAINT,
+				     &t0, &t1);
 
 	pixman_region32_fini(&output_damage);
 
@@ -2432,6 +2761,15 @@ weston_output_repaint(struct weston_output *output, void *repaint_data)
 
 	TL_POINT("core_repaint_posted", TLP_OUTPUT(output), TLP_END);
 
+	if (r == 0) {
+		weston_compositor_read_presentation_clock(ec, &t1);
+		output_repaint_stat_add_time(output,
+					     WESTON_REPAINT_STAT_START_TO_POSTED,
+					     &start, &t1);
+		output->repaint_stats.posted = t1;
+		output->repaint_stats.frames++;
+	}
+
 	return r;
 }
 
@@ -2479,6 +2817,13 @@ weston_output_maybe_repaint(struct weston_output *output, struct timespec *now,
 	if (ret != 0)
 		goto err;
 
+	/* The repaint deadline is the vblank we aimed for, repaint_msec
+	 * after the scheduled repaint. Posting later than that costs a
+	 * whole refresh cycle. */
+	if (timespec_sub_to_msec(now, &output->next_repaint) >
+	    compositor->repaint_msec)
+		output->repaint_stats.missed_deadlines++;
+
 	return ret;
 
 err:
@@ -2492,6 +2837,7 @@ output_repaint_timer_arm(struct weston_compositor *compositor)
 	struct weston_output *output;
 	bool any_should_repaint = false;
 	struct timespec now;
+	struct timespec next = { 0 };
 	int64_t msec_to_next = INT64_MAX;
 
 	weston_compositor_read_presentation_clock(compositor, &now);
@@ -2504,8 +2850,10 @@ output_repaint_timer_arm(struct weston_compositor *compositor)
 
 		msec_to_this = timespec_sub_to_msec(&output->next_repaint,
 						    &now);
-		if (!any_should_repaint || msec_to_this < msec_to_next)
+		if (!any_should_repaint || msec_to_this < msec_to_next) {
 			msec_to_next = msec_to_this;
+			next = output->next_repaint;
+		}
 
 		any_should_repaint = true;
 	}
@@ -2513,6 +2861,13 @@ output_repaint_timer_arm(struct weston_compositor *compositor)
 	if (!any_should_repaint)
 		return;
 
+	/* A virtual clock does not wait, it jumps to the next repaint. */
+	if (compositor->presentation_clock_virtual &&
+	    timespec_sub_to_nsec(&next, &now) > 0) {
+		weston_compositor_advance_presentation_clock(compositor, &next);
+		msec_to_next = 0;
+	}
+
 	/* Even if we should repaint immediately, add the minimum 1 ms delay.
 	 * This is a workaround to allow coalescing multiple output repaints
 	 * particularly from weston_output_finish_frame()
@@ -2576,6 +2931,14 @@ weston_output_finish_frame(struct weston_output *output,
 
 	weston_compositor_read_presentation_clock(compositor, &now);
 
+	if (!timespec_is_zero(&output->repaint_stats.posted)) {
+		output_repaint_stat_add_time(output,
+					     WESTON_REPAINT_STAT_POSTED_TO_FINISH,
+					     &output->repaint_stats.posted,
+					     &now);
+		output->repaint_stats.posted = (struct timespec) { 0 };
+	}
+
 	/* If we haven't been supplied any timestamp at all, we don't have a
 	 * timebase to work against, so any delay just wastes time. Push a
 	 * repaint as soon as possible so we can get on with it. */
@@ -2646,11 +3009,15 @@ weston_layer_entry_insert(struct weston_layer_entry *list,
 {
 	wl_list_insert(&list->link, &entry->link);
 	entry->layer = list->layer;
+	weston_compositor_view_list_dirty(list->layer->compositor);
 }
 
 WL_EXPORT void
 weston_layer_entry_remove(struct weston_layer_entry *entry)
 {
+	if (entry->layer)
+		weston_compositor_view_list_dirty(entry->layer->compositor);
+
 	wl_list_remove(&entry->link);
 	wl_list_init(&entry->link);
 	entry->layer = NULL;
@@ -2688,6 +3055,7 @@ weston_layer_set_position(struct weston_layer *layer,
 	struct weston_layer *below;
 
 	wl_list_remove(&layer->link);
+	weston_compositor_view_list_dirty(layer->compositor);
 
 	/* layer_list is ordered from top to bottom, the last layer being the
 	 * background with the smallest position value */
@@ -2712,6 +3080,7 @@ weston_layer_unset_position(struct weston_layer *layer)
 {
 	wl_list_remove(&layer->link);
 	wl_list_init(&layer->link);
+	weston_compositor_view_list_dirty(layer->compositor);
 }
 
 WL_EXPORT void
@@ -2936,8 +3305,10 @@ weston_surface_commit_subsurface_order(struct weston_surface *surface)
 		wl_list_remove(&sub->parent_link);
 		wl_list_insert(&surface->subsurface_list, &sub->parent_link);
 
-		if (sub->reordered)
+		if (sub->reordered) {
+			weston_compositor_view_list_dirty(surface->compositor);
 			weston_surface_damage_subsurfaces(sub);
+		}
 	}
 }
 
@@ -3604,6 +3975,7 @@ subsurface_committed(struct weston_surface *surface, int32_t dx, int32_t dy)
 
 	if (!weston_surface_is_mapped(surface)) {
 		surface->is_mapped = true;
+		weston_compositor_view_list_dirty(surface->compositor);
 
 		/* Cannot call weston_view_update_transform(),
 		 * because that would call it also for the parent surface,
@@ -3941,6 +4313,7 @@ subsurface_set_desync(struct wl_client *client, struct wl_resource *resource)
 static void
 weston_subsurface_unlink_parent(struct weston_subsurface *sub)
 {
+	weston_compositor_view_list_dirty(sub->surface->compositor);
 	wl_list_remove(&sub->parent_link);
 	wl_list_remove(&sub->parent_link_pending);
 	wl_list_remove(&sub->parent_destroy_listener.link);
@@ -4004,6 +4377,7 @@ weston_subsurface_link_parent(struct weston_subsurface *sub,
 	wl_signal_add(&parent->destroy_signal,
 		      &sub->parent_destroy_listener);
 
+	weston_compositor_view_list_dirty(parent->compositor);
 	wl_list_insert(&parent->subsurface_list, &sub->parent_link);
 	wl_list_insert(&parent->subsurface_list_pending,
 		       &sub->parent_link_pending);
@@ -5696,6 +6070,7 @@ weston_output_enable(struct weston_output *output)
 	wl_signal_init(&output->destroy_signal);
 	wl_list_init(&output->animation_list);
 	wl_list_init(&output->feedback_list);
+	weston_output_reset_repaint_stats(output);
 
 	/* Enable the output (set up the crtc or create a
 	 * window representing the output, set up the
@@ -5765,6 +6140,26 @@ weston_output_disable(struct weston_output *output)
 	output->destroying = 0;
 }
 
+/** Clears the repaint statistics of an output
+ *
+ * \param output The weston_output object.
+ *
+ * Zeroes the frame counters and empties all histograms in
+ * weston_output::repaint_stats. A repaint that is in flight is still
+ * accounted for when it finishes.
+ */
+WL_EXPORT void
+weston_output_reset_repaint_stats(struct weston_output *output)
+{
+	struct weston_output_repaint_stats *stats = &output->repaint_stats;
+	int i;
+
+	stats->frames = 0;
+	stats->missed_deadlines = 0;
+	for (i = 0; i < WESTON_REPAINT_STAT_COUNT; i++)
+		weston_histogram_reset(&stats->histogram[i]);
+}
+
 /** Forces a synchronous call to heads_changed hook
  *
  * \param compositor The compositor instance
@@ -6288,6 +6683,48 @@ timeline_key_binding_handler(struct weston_keyboard *keyboard,
 		weston_timeline_open(compositor);
 }
 
+static const char * const repaint_stat_names[] = {
+	[WESTON_REPAINT_STAT_ACCUMULATE_DAMAGE] = "accumulate damage (us)",
+	[WESTON_REPAINT_STAT_OUTPUT_REPAINT] = "output repaint (us)",
+	[WESTON_REPAINT_STAT_START_TO_POSTED] = "start to posted (us)",
+	[WESTON_REPAINT_STAT_POSTED_TO_FINISH] = "posted to finish (us)",
+	[WESTON_REPAINT_STAT_DAMAGE_AREA] = "damage area (px)",
+	[WESTON_REPAINT_STAT_DRAW_CALLS] = "draw calls",
+	[WESTON_REPAINT_STAT_STATE_CHANGES] = "state changes",
+};
+
+static void
+repaint_stats_key_binding_handler(struct weston_keyboard *keyboard,
+				  const struct timespec *time, uint32_t key,
+				  void *data)
+{
+	struct weston_compositor *compositor = data;
+	struct weston_output *output;
+	struct weston_histogram *h;
+	int i;
+
+	wl_list_for_each(output, &compositor->output_list, link) {
+		weston_log("Repaint statistics for output '%s': "
+			   "%" PRIu64 " frames, %" PRIu64 " missed deadlines\n",
+			   output->name, output->repaint_stats.frames,
+			   output->repaint_stats.missed_deadlines);
+
+		for (i = 0; i < WESTON_REPAINT_STAT_COUNT; i++) {
+			h = &output->repaint_stats.histogram[i];
+			weston_log_continue(STAMP_SPACE
+				"%-24s min %u mean %u p50 %u p90 %u p99 %u "
+				"max %u\n", repaint_stat_names[i], h->min,
+				weston_histogram_mean(h),
+				weston_histogram_percentile(h, 50.0),
+				weston_histogram_percentile(h, 90.0),
+				weston_histogram_percentile(h, 99.0),
+				h->max);
+		}
+
+		weston_output_reset_repaint_stats(output);
+	}
+}
+
 /** Create the compositor.
  *
  * This functions creates and initializes a compositor instance.
@@ -6331,6 +6768,7 @@ weston_compositor_create(struct wl_display *display, void *user_data)
 
 	ec->output_id_pool = 0;
 	ec->repaint_msec = DEFAULT_REPAINT_WINDOW;
+	ec->damage_max_rects = DEFAULT_DAMAGE_MAX_RECTS;
 
 	ec->activate_serial = 1;
 
@@ -6357,6 +6795,7 @@ weston_compositor_create(struct wl_display *display, void *user_data)
 	wl_list_init(&ec->plane_list);
 	wl_list_init(&ec->layer_list);
 	wl_list_init(&ec->seat_list);
+	wl_list_init(&ec->xkb_info_cache);
 	wl_list_init(&ec->pending_output_list);
 	wl_list_init(&ec->output_list);
 	wl_list_init(&ec->head_list);
@@ -6391,6 +6830,9 @@ weston_compositor_create(struct wl_display *display, void *user_data)
 
 	weston_compositor_add_debug_binding(ec, KEY_T,
 					    timeline_key_binding_handler, ec);
+	weston_compositor_add_debug_binding(ec, KEY_P,
+					    repaint_stats_key_binding_handler,
+					    ec);
 
 	return ec;
 
@@ -6494,6 +6936,51 @@ weston_compositor_set_presentation_clock_software(
 	return -1;
 }
 
+/** Use a virtual presentation clock
+ *
+ * \param compositor The compositor instance.
+ * \return 0 on success, -1 on failure.
+ *
+ * The virtual clock starts at the current CLOCK_MONOTONIC time, which is
+ * also the clock id advertised to clients, but afterwards it only moves
+ * when weston_compositor_advance_presentation_clock() is called. The
+ * repaint scheduler advances it straight to the next repaint instead of
+ * waiting, so a backend that does the same for its vblanks runs the
+ * repaint loop deterministically and faster than real time.
+ */
+WL_EXPORT int
+weston_compositor_set_presentation_clock_virtual(
+					struct weston_compositor *compositor)
+{
+	if (weston_compositor_set_presentation_clock(compositor,
+						     CLOCK_MONOTONIC) < 0)
+		return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &compositor->presentation_clock_now);
+	compositor->presentation_clock_virtual = true;
+
+	return 0;
+}
+
+/** Move a virtual presentation clock forward
+ *
+ * \param compositor The compositor instance.
+ * \param ts The new time.
+ *
+ * Does nothing if the clock is not virtual or \p ts is in its past.
+ */
+WL_EXPORT void
+weston_compositor_advance_presentation_clock(
+					struct weston_compositor *compositor,
+					const struct timespec *ts)
+{
+	if (!compositor->presentation_clock_virtual)
+		return;
+
+	if (timespec_sub_to_nsec(ts, &compositor->presentation_clock_now) > 0)
+		compositor->presentation_clock_now = *ts;
+}
+
 /** Read the current time from the Presentation clock
  *
  * \param compositor
@@ -6514,6 +7001,11 @@ weston_compositor_read_presentation_clock(
 	static bool warned;
 	int ret;
 
+	if (compositor->presentation_clock_virtual) {
+		*ts = compositor->presentation_clock_now;
+		return;
+	}
+
 	ret = clock_gettime(compositor->presentation_clock, ts);
 	if (ret < 0) {
 		ts->tv_sec = 0;
@@ -6643,6 +7135,8 @@ weston_compositor_destroy(struct weston_compositor *compositor)
 	if (compositor->heads_changed_source)
 		wl_event_source_remove(compositor->heads_changed_source);
 
+	view_grid_destroy(compositor->view_grid);
+
 	free(compositor);
 }
 
@@ -45,6 +45,7 @@ extern "C" {
 #include "config-parser.h"
 #include "zalloc.h"
 #include "timeline-object.h"
+#include "histogram.h"
 
 struct weston_geometry {
 	int32_t x, y;
@@ -177,6 +178,32 @@ struct weston_head {
 	bool connected;			/**< is physically connected */
 };
 
+/** Repaint stages and per-frame quantities tracked for each output */
+enum weston_repaint_stat {
+	/** compositor_accumulate_damage(), in microseconds */
+	WESTON_REPAINT_STAT_ACCUMULATE_DAMAGE = 0,
+	/** weston_output::repaint, i.e. renderer and flip, in microseconds */
+	WESTON_REPAINT_STAT_OUTPUT_REPAINT,
+	/** weston_output_repaint() start until posted, in microseconds */
+	WESTON_REPAINT_STAT_START_TO_POSTED,
+	/** posted until weston_output_finish_frame(), in microseconds */
+	WESTON_REPAINT_STAT_POSTED_TO_FINISH,
+	/** repainted area of the primary plane, in pixels */
+	WESTON_REPAINT_STAT_DAMAGE_AREA,
+	/** renderer draw calls for the views of the primary plane */
+	WESTON_REPAINT_STAT_DRAW_CALLS,
+	/** renderer state changes (shader, uniform, texture, blend) */
+	WESTON_REPAINT_STAT_STATE_CHANGES,
+	WESTON_REPAINT_STAT_COUNT
+};
+
+struct weston_output_repaint_stats {
+	uint64_t frames;		/**< repaints posted */
+	uint64_t missed_deadlines;	/**< posted after the target vblank */
+	struct timespec posted;		/**< last post, zero once finished */
+	struct weston_histogram histogram[WESTON_REPAINT_STAT_COUNT];
+};
+
 struct weston_output {
 	uint32_t id;
 	char *name;
@@ -265,6 +292,7 @@ struct weston_output {
 			  uint16_t *b);
 
 	struct weston_timeline_object timeline;
+	struct weston_output_repaint_stats repaint_stats;
 
 	bool enabled; /**< is in the output_list, not pending list */
 	int scale;
@@ -605,9 +633,8 @@ weston_touch_start_drag(struct weston_touch *touch,
 
 struct weston_xkb_info {
 	struct xkb_keymap *keymap;
-	int keymap_fd;
+	int keymap_fd;		/* -1 until first sent to a client */
 	size_t keymap_size;
-	char *keymap_area;
 	int32_t ref_count;
 	xkb_mod_index_t shift_mod;
 	xkb_mod_index_t caps_mod;
@@ -620,6 +647,11 @@ struct weston_xkb_info {
 	xkb_led_index_t num_led;
 	xkb_led_index_t caps_led;
 	xkb_led_index_t scroll_led;
+
+	/* In weston_compositor::xkb_info_cache, with the rule names the
+	 * keymap was compiled from */
+	struct wl_list link;
+	struct xkb_rule_names names;
 };
 
 struct weston_keyboard {
@@ -692,6 +724,22 @@ struct weston_seat {
 
 	struct input_method *input_method;
 	char *seat_name;
+
+	/* Motion held back while an input batch is open, see
+	 * weston_seat_set_input_coalescing(). */
+	struct {
+		bool enabled;
+		bool flushing;
+		bool motion_pending;
+		struct timespec motion_time;
+		struct weston_pointer_motion_event motion;
+		bool pointer_frame_pending;
+		struct wl_array touch_motion; /* struct weston_touch_motion */
+		bool touch_frame_pending;
+
+		uint64_t merged_motion;	/* pointer motion events merged */
+		uint64_t merged_touch;	/* touch motion events merged */
+	} coalesce;
 };
 
 enum {
@@ -967,8 +1015,11 @@ struct weston_compositor {
 	struct wl_list output_list;
 	struct wl_list head_list;	/* struct weston_head::compositor_link */
 	struct wl_list seat_list;
+	int input_batch_depth;
 	struct wl_list layer_list;	/* struct weston_layer::link */
 	struct wl_list view_list;	/* struct weston_view::link */
+	bool view_list_needs_rebuild;
+	struct weston_view_grid *view_grid; /* pick acceleration, internal */
 	struct wl_list plane_list;
 	struct wl_list key_binding_list;
 	struct wl_list modifier_binding_list;
@@ -1004,6 +1055,8 @@ struct weston_compositor {
 	struct xkb_rule_names xkb_names;
 	struct xkb_context *xkb_context;
 	struct weston_xkb_info *xkb_info;
+	struct wl_list xkb_info_cache; /* weston_xkb_info::link */
+	int xkb_info_cache_size;
 
 	int32_t kb_repeat_rate;
 	int32_t kb_repeat_delay;
@@ -1011,8 +1064,27 @@ struct weston_compositor {
 	bool vt_switching;
 
 	clockid_t presentation_clock;
+	/* A virtual presentation clock only moves when it is advanced,
+	 * see weston_compositor_set_presentation_clock_virtual(). */
+	bool presentation_clock_virtual;
+	struct timespec presentation_clock_now;
 	int32_t repaint_msec;
 
+	/* Threads used by the pixman renderer, 0 or 1: single-threaded.
+	 * Must be set before the renderer is initialized. */
+	int32_t pixman_render_threads;
+
+	/* Damage regions with more boxes than damage_max_rects are merged
+	 * into at most that many boxes, 0 disables the limit. Regions that
+	 * fill all but damage_coalesce_waste percent of their extents are
+	 * replaced by the extents, 0 disables that. */
+	int32_t damage_max_rects;
+	int32_t damage_coalesce_waste;
+
+	/* Interval in ms between the keyframes the recorder stores in the
+	 * seek index next to a capture, 0 records no index. */
+	int32_t recorder_keyframe_interval;
+
 	unsigned int activate_serial;
 
 	struct wl_global *pointer_constraints;
@@ -1025,6 +1097,9 @@ struct weston_compositor {
 	/* Whether to let the compositor run without any input device. */
 	bool require_input;
 
+	/* Whether new seats start with input coalescing enabled. */
+	bool coalesce_input;
+
 	/* Signal for a backend to inform a frontend about possible changes
 	 * in head status.
 	 */
@@ -1495,6 +1570,11 @@ notify_touch_frame(struct weston_seat *seat);
 void
 notify_touch_cancel(struct weston_seat *seat);
 
+void
+weston_compositor_begin_input_batch(struct weston_compositor *compositor);
+void
+weston_compositor_end_input_batch(struct weston_compositor *compositor);
+
 void
 weston_layer_entry_insert(struct weston_layer_entry *list,
 			  struct weston_layer_entry *entry);
@@ -1788,6 +1868,13 @@ weston_compositor_set_presentation_clock(struct weston_compositor *compositor,
 int
 weston_compositor_set_presentation_clock_software(
 					struct weston_compositor *compositor);
+int
+weston_compositor_set_presentation_clock_virtual(
+					struct weston_compositor *compositor);
+void
+weston_compositor_advance_presentation_clock(
+					struct weston_compositor *compositor,
+					const struct timespec *ts);
 void
 weston_compositor_read_presentation_clock(
 			const struct weston_compositor *compositor,
@@ -1841,9 +1928,18 @@ weston_seat_init_touch(struct weston_seat *seat);
 void
 weston_seat_release_touch(struct weston_seat *seat);
 void
+weston_seat_set_input_coalescing(struct weston_seat *seat, bool enabled);
+void
+weston_seat_flush_input(struct weston_seat *seat);
+void
 weston_seat_repick(struct weston_seat *seat);
 void
 weston_seat_update_keymap(struct weston_seat *seat, struct xkb_keymap *keymap);
+struct xkb_keymap *
+weston_compositor_get_keymap(struct weston_compositor *ec,
+			     const struct xkb_rule_names *names);
+int
+weston_xkb_info_get_keymap_fd(struct weston_xkb_info *xkb_info);
 
 void
 weston_seat_release(struct weston_seat *seat);
@@ -2131,6 +2227,13 @@ weston_output_enable(struct weston_output *output);
 void
 weston_output_disable(struct weston_output *output);
 
+void
+weston_output_reset_repaint_stats(struct weston_output *output);
+
+void
+weston_output_repaint_stat_add(struct weston_output *output,
+			       enum weston_repaint_stat stat, uint64_t value);
+
 void
 weston_compositor_flush_heads_changed(struct weston_compositor *compositor);
 
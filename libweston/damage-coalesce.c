@@ -0,0 +1,139 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "damage-coalesce.h"
+
+static uint64_t
+box_area(const pixman_box32_t *box)
+{
+	return (uint64_t)(box->x2 - box->x1) * (box->y2 - box->y1);
+}
+
+static void
+box_union(pixman_box32_t *dst, const pixman_box32_t *box)
+{
+	if (box->x1 < dst->x1)
+		dst->x1 = box->x1;
+	if (box->y1 < dst->y1)
+		dst->y1 = box->y1;
+	if (box->x2 > dst->x2)
+		dst->x2 = box->x2;
+	if (box->y2 > dst->y2)
+		dst->y2 = box->y2;
+}
+
+/* Group whole bands of the region into at most max_rects horizontal
+ * strips holding about the same number of boxes each, and replace every
+ * strip by its bounding box. Bands never straddle strips, so the strips
+ * do not overlap and the result has at most max_rects boxes.
+ */
+static void
+coalesce_into_strips(pixman_region32_t *region, pixman_box32_t *boxes,
+		     int n, int max_rects)
+{
+	pixman_box32_t *strips;
+	pixman_box32_t extents;
+	int per_strip = (n + max_rects - 1) / max_rects;
+	int n_strips = 0;
+	int in_strip = 0;
+	int i;
+
+	strips = malloc(max_rects * sizeof *strips);
+	if (!strips) {
+		extents = *pixman_region32_extents(region);
+		pixman_region32_fini(region);
+		pixman_region32_init_with_extents(region, &extents);
+		return;
+	}
+
+	strips[0] = boxes[0];
+	for (i = 0; i < n; i++) {
+		if (in_strip >= per_strip && boxes[i].y1 != boxes[i - 1].y1 &&
+		    n_strips < max_rects - 1) {
+			strips[++n_strips] = boxes[i];
+			in_strip = 0;
+		}
+
+		box_union(&strips[n_strips], &boxes[i]);
+		in_strip++;
+	}
+
+	pixman_region32_fini(region);
+	pixman_region32_init_rects(region, strips, n_strips + 1);
+	free(strips);
+}
+
+/** Bound the complexity of a damage region
+ *
+ * \param region The region to simplify in place.
+ * \param max_rects Largest number of boxes to keep, 0 for no limit.
+ * \param max_waste Percentage of the extents that may be added to the
+ * region to collapse it into a single box, 0 to never do that.
+ * \return True if the region was changed.
+ *
+ * The result always contains the original region. A region with more
+ * than max_rects boxes is merged into at most max_rects disjoint boxes.
+ * Otherwise, if the region covers all but max_waste percent of its
+ * extents, it is replaced by its extents.
+ */
+bool
+damage_coalesce(pixman_region32_t *region, int max_rects, int max_waste)
+{
+	pixman_box32_t *boxes;
+	pixman_box32_t extents;
+	uint64_t area = 0;
+	uint64_t extents_area;
+	int n, i;
+
+	boxes = pixman_region32_rectangles(region, &n);
+	if (n <= 1)
+		return false;
+
+	if (max_rects > 0 && n > max_rects) {
+		coalesce_into_strips(region, boxes, n, max_rects);
+		return true;
+	}
+
+	if (max_waste <= 0)
+		return false;
+
+	for (i = 0; i < n; i++)
+		area += box_area(&boxes[i]);
+
+	extents = *pixman_region32_extents(region);
+	extents_area = box_area(&extents);
+	if ((extents_area - area) * 100 > extents_area * max_waste)
+		return false;
+
+	pixman_region32_fini(region);
+	pixman_region32_init_with_extents(region, &extents);
+
+	return true;
+}
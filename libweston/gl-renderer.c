@@ -74,10 +74,41 @@ struct gl_shader {
 	GLint alpha_uniform;
 	GLint color_uniform;
 	const char *vertex_source, *fragment_source;
+
+	/* Uniform values last set by draw_batches(), only valid while
+	 * uniform_serial matches the one of the renderer. */
+	uint32_t uniform_serial;
+	GLfloat alpha;
+	GLfloat color[4];
 };
 
+/* GL state needed to draw a part of a view. Views are drawn in batches:
+ * consecutive draws with equal state become one glDrawElements(). */
+struct gl_draw_state {
+	struct gl_shader *shader;
+	GLenum target;
+	GLuint textures[3];
+	int num_textures;
+	GLint filter;
+	GLfloat color[4];
+	GLfloat alpha;
+	bool blend;
+};
+
+struct gl_batch {
+	struct gl_draw_state state;
+	int first;	/* in gl_renderer::indices */
+	int count;
+};
+
+/* Vertices per batch flush, so that indices fit in GL_UNSIGNED_SHORT. */
+#define BATCH_MAX_VERTICES 65536
+
 #define BUFFER_DAMAGE_COUNT 2
 
+/* Initial size of the wl_shm upload staging buffer. */
+#define UPLOAD_PBO_SIZE (4 * 1024 * 1024)
+
 enum gl_border_status {
 	BORDER_STATUS_CLEAN = 0,
 	BORDER_TOP_DIRTY = 1 << GL_RENDERER_BORDER_TOP,
@@ -210,6 +241,19 @@ struct gl_renderer {
 	struct wl_array vertices;
 	struct wl_array vtxcnt;
 
+	/* Pending batches of the output being repainted, drawing from
+	 * vertices through indices. */
+	struct wl_array indices;
+	struct wl_array batches;
+	GLuint batch_vbo;
+	GLuint batch_ibo;
+	uint32_t uniform_serial;
+	GLuint bound_textures[3];
+	GLint bound_filters[3];
+	int blend;
+	uint32_t draw_calls;
+	uint32_t state_changes;
+
 	PFNGLEGLIMAGETARGETTEXTURE2DOESPROC image_target_texture_2d;
 	PFNEGLCREATEIMAGEKHRPROC create_image;
 	PFNEGLDESTROYIMAGEKHRPROC destroy_image;
@@ -218,6 +262,14 @@ struct gl_renderer {
 
 	int has_unpack_subimage;
 
+	/* Staging buffer for wl_shm texture uploads, orphaned when full. */
+	int has_pbo;
+	PFNGLMAPBUFFERRANGEEXTPROC map_buffer_range;
+	PFNGLUNMAPBUFFEROESPROC unmap_buffer;
+	GLuint upload_pbo;
+	size_t upload_pbo_size;
+	size_t upload_pbo_used;
+
 	PFNEGLBINDWAYLANDDISPLAYWL bind_display;
 	PFNEGLUNBINDWAYLANDDISPLAYWL unbind_display;
 	PFNEGLQUERYWAYLANDBUFFERWL query_buffer;
@@ -734,20 +786,109 @@ texture_region(struct weston_view *ev, pixman_region32_t *region,
 		}
 	}
 
+	/* Only keep the vertices actually emitted, the array accumulates
+	 * the vertices of all batches until they are drawn. */
+	gr->vertices.size = (char *) v - (char *) gr->vertices.data;
+
 	if (used_band_compression)
 		free(rects);
 	return nvtx;
 }
 
 static void
-triangle_fan_debug(struct weston_view *view, int first, int count)
+use_shader(struct gl_renderer *gr, struct gl_shader *shader);
+
+static bool
+draw_state_equal(const struct gl_draw_state *a, const struct gl_draw_state *b)
 {
-	struct weston_compositor *compositor = view->surface->compositor;
-	struct gl_renderer *gr = get_renderer(compositor);
 	int i;
-	GLushort *buffer;
-	GLushort *index;
-	int nelems;
+
+	if (a->shader != b->shader ||
+	    a->target != b->target ||
+	    a->num_textures != b->num_textures ||
+	    a->filter != b->filter ||
+	    a->alpha != b->alpha ||
+	    a->blend != b->blend ||
+	    memcmp(a->color, b->color, sizeof a->color) != 0)
+		return false;
+
+	for (i = 0; i < a->num_textures; i++)
+		if (a->textures[i] != b->textures[i])
+			return false;
+
+	return true;
+}
+
+/* Sets up the GL state for a batch, skipping what is already set. Every
+ * change is counted for the repaint statistics. */
+static void
+apply_draw_state(struct gl_renderer *gr, struct gl_output_state *go,
+		 const struct gl_draw_state *state)
+{
+	struct gl_shader *shader = state->shader;
+	int i;
+
+	if (gr->current_shader != shader) {
+		use_shader(gr, shader);
+		gr->state_changes++;
+	}
+
+	if (shader->uniform_serial != gr->uniform_serial) {
+		glUniformMatrix4fv(shader->proj_uniform,
+				   1, GL_FALSE, go->output_matrix.d);
+		for (i = 0; i < 3; i++)
+			glUniform1i(shader->tex_uniforms[i], i);
+		glUniform4fv(shader->color_uniform, 1, state->color);
+		glUniform1f(shader->alpha_uniform, state->alpha);
+		memcpy(shader->color, state->color, sizeof shader->color);
+		shader->alpha = state->alpha;
+		shader->uniform_serial = gr->uniform_serial;
+		gr->state_changes++;
+	} else {
+		if (memcmp(shader->color, state->color,
+			   sizeof shader->color) != 0) {
+			glUniform4fv(shader->color_uniform, 1, state->color);
+			memcpy(shader->color, state->color,
+			       sizeof shader->color);
+			gr->state_changes++;
+		}
+		if (shader->alpha != state->alpha) {
+			glUniform1f(shader->alpha_uniform, state->alpha);
+			shader->alpha = state->alpha;
+			gr->state_changes++;
+		}
+	}
+
+	for (i = 0; i < state->num_textures; i++) {
+		if (gr->bound_textures[i] == state->textures[i] &&
+		    gr->bound_filters[i] == state->filter)
+			continue;
+
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(state->target, state->textures[i]);
+		glTexParameteri(state->target, GL_TEXTURE_MIN_FILTER,
+				state->filter);
+		glTexParameteri(state->target, GL_TEXTURE_MAG_FILTER,
+				state->filter);
+		gr->bound_textures[i] = state->textures[i];
+		gr->bound_filters[i] = state->filter;
+		gr->state_changes++;
+	}
+
+	if (gr->blend != state->blend) {
+		if (state->blend)
+			glEnable(GL_BLEND);
+		else
+			glDisable(GL_BLEND);
+		gr->blend = state->blend;
+		gr->state_changes++;
+	}
+}
+
+static void
+batch_debug(struct gl_renderer *gr, struct gl_output_state *go,
+	    struct gl_batch *batch)
+{
 	static int color_idx = 0;
 	static const GLfloat color[][4] = {
 			{ 1.0, 0.0, 0.0, 1.0 },
@@ -755,39 +896,153 @@ triangle_fan_debug(struct weston_view *view, int first, int count)
 			{ 0.0, 0.0, 1.0, 1.0 },
 			{ 1.0, 1.0, 1.0, 1.0 },
 	};
+	struct gl_draw_state state = {
+		.shader = &gr->solid_shader,
+		.alpha = 1.0,
+		.blend = gr->blend,
+	};
+	GLushort *triangles = gr->indices.data;
+	GLushort *buffer, *index;
+	int i;
 
-	nelems = (count - 1 + count - 2) * 2;
+	/* Outline every triangle. The triangles of a fan share edges, so
+	 * this draws the same spokes as the fans did before batching. */
+	buffer = malloc(batch->count * 2 * sizeof *buffer);
+	if (!buffer)
+		return;
 
-	buffer = malloc(sizeof(GLushort) * nelems);
 	index = buffer;
+	for (i = batch->first; i < batch->first + batch->count; i += 3) {
+		*index++ = triangles[i];
+		*index++ = triangles[i + 1];
+		*index++ = triangles[i + 1];
+		*index++ = triangles[i + 2];
+		*index++ = triangles[i + 2];
+		*index++ = triangles[i];
+	}
+
+	memcpy(state.color, color[color_idx++ % ARRAY_LENGTH(color)],
+	       sizeof state.color);
+	apply_draw_state(gr, go, &state);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glDrawElements(GL_LINES, batch->count * 2, GL_UNSIGNED_SHORT, buffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gr->batch_ibo);
+	free(buffer);
+}
 
-	for (i = 1; i < count; i++) {
-		*index++ = first;
-		*index++ = first + i;
+/* Draws the pending batches from the first nvertices vertices and drops
+ * them. Vertices past those belong to a batch still being recorded and
+ * are moved to the front. */
+static void
+draw_batches(struct gl_renderer *gr, struct weston_output *output,
+	     int nvertices)
+{
+	struct gl_output_state *go = get_output_state(output);
+	struct gl_batch *batch;
+	size_t used = nvertices * 4 * sizeof(GLfloat);
+
+	if (gr->indices.size > 0) {
+		if (!gr->batch_vbo) {
+			glGenBuffers(1, &gr->batch_vbo);
+			glGenBuffers(1, &gr->batch_ibo);
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, gr->batch_vbo);
+		glBufferData(GL_ARRAY_BUFFER, used, gr->vertices.data,
+			     GL_STREAM_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gr->batch_ibo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, gr->indices.size,
+			     gr->indices.data, GL_STREAM_DRAW);
+
+		/* position: */
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE,
+				      4 * sizeof(GLfloat), (void *) 0);
+		glEnableVertexAttribArray(0);
+
+		/* texcoord: */
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE,
+				      4 * sizeof(GLfloat),
+				      (void *) (2 * sizeof(GLfloat)));
+		glEnableVertexAttribArray(1);
+
+		/* Textures and uniforms may have been touched outside of
+		 * the batches since the last draw, start from scratch. */
+		gr->uniform_serial++;
+		memset(gr->bound_textures, 0, sizeof gr->bound_textures);
+		gr->blend = -1;
+		glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+		wl_array_for_each(batch, &gr->batches) {
+			if (batch->count == 0)
+				continue;
+
+			apply_draw_state(gr, go, &batch->state);
+			glDrawElements(GL_TRIANGLES, batch->count,
+				       GL_UNSIGNED_SHORT,
+				       (void *) (batch->first *
+						 sizeof(GLushort)));
+			gr->draw_calls++;
+
+			if (gr->fan_debug)
+				batch_debug(gr, go, batch);
+		}
+
+		glDisableVertexAttribArray(1);
+		glDisableVertexAttribArray(0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
 	}
 
-	for (i = 2; i < count; i++) {
-		*index++ = first + i - 1;
-		*index++ = first + i;
+	if (gr->vertices.size > used)
+		memmove(gr->vertices.data, (char *) gr->vertices.data + used,
+			gr->vertices.size - used);
+	gr->vertices.size -= used;
+	gr->indices.size = 0;
+	gr->batches.size = 0;
+}
+
+/* Returns the batch to append the indices of a draw with the given state
+ * to, extending the last batch if its state is the same. */
+static struct gl_batch *
+get_batch(struct gl_renderer *gr, const struct gl_draw_state *state)
+{
+	struct gl_batch *batch = NULL;
+
+	if (gr->batches.size > 0) {
+		batch = (struct gl_batch *) ((char *) gr->batches.data +
+					     gr->batches.size) - 1;
+		if (draw_state_equal(&batch->state, state))
+			return batch;
+		if (batch->count > 0)
+			batch = NULL;
 	}
 
-	glUseProgram(gr->solid_shader.program);
-	glUniform4fv(gr->solid_shader.color_uniform, 1,
-			color[color_idx++ % ARRAY_LENGTH(color)]);
-	glDrawElements(GL_LINES, nelems, GL_UNSIGNED_SHORT, buffer);
-	glUseProgram(gr->current_shader->program);
-	free(buffer);
+	if (!batch) {
+		batch = wl_array_add(&gr->batches, sizeof *batch);
+		if (!batch)
+			return NULL;
+	}
+
+	batch->state = *state;
+	batch->first = gr->indices.size / sizeof(GLushort);
+	batch->count = 0;
+
+	return batch;
 }
 
 static void
-repaint_region(struct weston_view *ev, pixman_region32_t *region,
-		pixman_region32_t *surf_region)
+repaint_region(struct weston_view *ev, struct weston_output *output,
+	       pixman_region32_t *region, pixman_region32_t *surf_region,
+	       const struct gl_draw_state *state)
 {
 	struct weston_compositor *ec = ev->surface->compositor;
 	struct gl_renderer *gr = get_renderer(ec);
-	GLfloat *v;
+	struct gl_batch *batch;
 	unsigned int *vtxcnt;
+	GLushort *index;
 	int i, first, nfans;
+	unsigned int k;
 
 	/* The final region to be painted is the intersection of
 	 * 'region' and 'surf_region'. However, 'region' is in the global
@@ -797,30 +1052,34 @@ repaint_region(struct weston_view *ev, pixman_region32_t *region,
 	 * polygon for each pair, and store it as a triangle fan if
 	 * it has a non-zero area (at least 3 vertices, actually).
 	 */
+	first = gr->vertices.size / (4 * sizeof(GLfloat));
 	nfans = texture_region(ev, region, surf_region);
-
-	v = gr->vertices.data;
 	vtxcnt = gr->vtxcnt.data;
 
-	/* position: */
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof *v, &v[0]);
-	glEnableVertexAttribArray(0);
+	/* Split the fans into indexed triangles, so that they can be
+	 * drawn together with those of other regions. */
+	batch = get_batch(gr, state);
+	for (i = 0; i < nfans; i++) {
+		if (first + vtxcnt[i] > BATCH_MAX_VERTICES) {
+			draw_batches(gr, output, first);
+			first = 0;
+			batch = get_batch(gr, state);
+		}
 
-	/* texcoord: */
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof *v, &v[2]);
-	glEnableVertexAttribArray(1);
+		index = wl_array_add(&gr->indices,
+				     (vtxcnt[i] - 2) * 3 * sizeof *index);
+		if (!batch || !index)
+			break;
 
-	for (i = 0, first = 0; i < nfans; i++) {
-		glDrawArrays(GL_TRIANGLE_FAN, first, vtxcnt[i]);
-		if (gr->fan_debug)
-			triangle_fan_debug(ev, first, vtxcnt[i]);
+		for (k = 2; k < vtxcnt[i]; k++) {
+			*index++ = first;
+			*index++ = first + k - 1;
+			*index++ = first + k;
+		}
+		batch->count += (vtxcnt[i] - 2) * 3;
 		first += vtxcnt[i];
 	}
 
-	glDisableVertexAttribArray(1);
-	glDisableVertexAttribArray(0);
-
-	gr->vertices.size = 0;
 	gr->vtxcnt.size = 0;
 }
 
@@ -871,24 +1130,6 @@ use_shader(struct gl_renderer *gr, struct gl_shader *shader)
 	gr->current_shader = shader;
 }
 
-static void
-shader_uniforms(struct gl_shader *shader,
-		struct weston_view *view,
-		struct weston_output *output)
-{
-	int i;
-	struct gl_surface_state *gs = get_surface_state(view->surface);
-	struct gl_output_state *go = get_output_state(output);
-
-	glUniformMatrix4fv(shader->proj_uniform,
-			   1, GL_FALSE, go->output_matrix.d);
-	glUniform4fv(shader->color_uniform, 1, gs->color);
-	glUniform1f(shader->alpha_uniform, view->alpha);
-
-	for (i = 0; i < gs->num_textures; i++)
-		glUniform1i(shader->tex_uniforms[i], i);
-}
-
 static void
 draw_view(struct weston_view *ev, struct weston_output *output,
 	  pixman_region32_t *damage) /* in global coordinates */
@@ -902,7 +1143,7 @@ draw_view(struct weston_view *ev, struct weston_output *output,
 	pixman_region32_t surface_opaque;
 	/* non-opaque region in surface coordinates: */
 	pixman_region32_t surface_blend;
-	GLint filter;
+	struct gl_draw_state state;
 	int i;
 
 	/* In case of a runtime switch of renderers, we may not have received
@@ -919,28 +1160,19 @@ draw_view(struct weston_view *ev, struct weston_output *output,
 	if (!pixman_region32_not_empty(&repaint))
 		goto out;
 
-	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
-
-	if (gr->fan_debug) {
-		use_shader(gr, &gr->solid_shader);
-		shader_uniforms(&gr->solid_shader, ev, output);
-	}
-
-	use_shader(gr, gs->shader);
-	shader_uniforms(gs->shader, ev, output);
+	state.shader = gs->shader;
+	state.target = gs->target;
+	state.num_textures = gs->num_textures;
+	for (i = 0; i < gs->num_textures; i++)
+		state.textures[i] = gs->textures[i];
+	memcpy(state.color, gs->color, sizeof state.color);
+	state.alpha = ev->alpha;
 
 	if (ev->transform.enabled || output->zoom.active ||
 	    output->current_scale != ev->surface->buffer_viewport.buffer.scale)
-		filter = GL_LINEAR;
+		state.filter = GL_LINEAR;
 	else
-		filter = GL_NEAREST;
-
-	for (i = 0; i < gs->num_textures; i++) {
-		glActiveTexture(GL_TEXTURE0 + i);
-		glBindTexture(gs->target, gs->textures[i]);
-		glTexParameteri(gs->target, GL_TEXTURE_MIN_FILTER, filter);
-		glTexParameteri(gs->target, GL_TEXTURE_MAG_FILTER, filter);
-	}
+		state.filter = GL_NEAREST;
 
 	/* blended region is whole surface minus opaque region: */
 	pixman_region32_init_rect(&surface_blend, 0, 0,
@@ -967,22 +1199,17 @@ draw_view(struct weston_view *ev, struct weston_output *output,
 			 * that forces texture alpha = 1.0.
 			 * Xwayland surfaces need this.
 			 */
-			use_shader(gr, &gr->texture_shader_rgbx);
-			shader_uniforms(&gr->texture_shader_rgbx, ev, output);
+			state.shader = &gr->texture_shader_rgbx;
 		}
 
-		if (ev->alpha < 1.0)
-			glEnable(GL_BLEND);
-		else
-			glDisable(GL_BLEND);
-
-		repaint_region(ev, &repaint, &surface_opaque);
+		state.blend = ev->alpha < 1.0;
+		repaint_region(ev, output, &repaint, &surface_opaque, &state);
 	}
 
 	if (pixman_region32_not_empty(&surface_blend)) {
-		use_shader(gr, gs->shader);
-		glEnable(GL_BLEND);
-		repaint_region(ev, &repaint, &surface_blend);
+		state.shader = gs->shader;
+		state.blend = true;
+		repaint_region(ev, output, &repaint, &surface_blend, &state);
 	}
 
 	pixman_region32_fini(&surface_blend);
@@ -996,11 +1223,14 @@ static void
 repaint_views(struct weston_output *output, pixman_region32_t *damage)
 {
 	struct weston_compositor *compositor = output->compositor;
+	struct gl_renderer *gr = get_renderer(compositor);
 	struct weston_view *view;
 
 	wl_list_for_each_reverse(view, &compositor->view_list, link)
 		if (view->plane == &compositor->primary_plane)
 			draw_view(view, output, damage);
+
+	draw_batches(gr, output, gr->vertices.size / (4 * sizeof(GLfloat)));
 }
 
 static void
@@ -1275,6 +1505,9 @@ gl_renderer_repaint_output(struct weston_output *output,
 			    2.0 / output->current_mode->width,
 			    -2.0 / output->current_mode->height, 1);
 
+	gr->draw_calls = 0;
+	gr->state_changes = 0;
+
 	/* if debugging, redraw everything outside the damage to clean up
 	 * debug lines from the previous draw on this buffer:
 	 */
@@ -1303,6 +1536,12 @@ gl_renderer_repaint_output(struct weston_output *output,
 	pixman_region32_fini(&total_damage);
 	pixman_region32_fini(&buffer_damage);
 
+	weston_output_repaint_stat_add(output, WESTON_REPAINT_STAT_DRAW_CALLS,
+				       gr->draw_calls);
+	weston_output_repaint_stat_add(output,
+				       WESTON_REPAINT_STAT_STATE_CHANGES,
+				       gr->state_changes);
+
 	draw_output_borders(output, border_damage);
 
 	pixman_region32_copy(&output->previous_damage, output_damage);
@@ -1410,6 +1649,135 @@ static GLenum gl_format_from_internal(GLenum internal_format)
 	}
 }
 
+static int
+gl_format_texel_size(GLenum format, GLenum type)
+{
+	switch (format) {
+	case GL_BGRA_EXT:
+		return 4;
+	case GL_RGB:
+		return type == GL_UNSIGNED_SHORT_5_6_5 ? 2 : 3;
+	case GL_RG8_EXT:
+	case GL_LUMINANCE_ALPHA:
+		return 2;
+	default:
+		return 1;
+	}
+}
+
+/* Reserve size bytes in the upload buffer, which must be bound to
+ * GL_PIXEL_UNPACK_BUFFER, and map them for writing. The reserved range
+ * has not been written since the buffer storage was last orphaned, so
+ * the mapping need not wait for earlier uploads to finish. */
+static void *
+upload_pbo_map(struct gl_renderer *gr, size_t size, size_t *offset)
+{
+	if (gr->upload_pbo_used + size > gr->upload_pbo_size) {
+		if (size > gr->upload_pbo_size)
+			gr->upload_pbo_size = MAX(size, UPLOAD_PBO_SIZE);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, gr->upload_pbo_size,
+			     NULL, GL_STREAM_DRAW);
+		gr->upload_pbo_used = 0;
+	}
+
+	*offset = gr->upload_pbo_used;
+	/* Keep the next offset aligned for any texel size. */
+	gr->upload_pbo_used += (size + 15) & ~(size_t)15;
+
+	return gr->map_buffer_range(GL_PIXEL_UNPACK_BUFFER, *offset, size,
+				    GL_MAP_WRITE_BIT_EXT |
+				    GL_MAP_INVALIDATE_RANGE_BIT_EXT |
+				    GL_MAP_UNSYNCHRONIZED_BIT_EXT);
+}
+
+static int
+upload_rect_pbo(struct gl_renderer *gr, struct gl_surface_state *gs,
+		uint8_t *data, pixman_box32_t r)
+{
+	int texel, x, y, width, height, row, j, k;
+	size_t src_stride, dst_stride, offset;
+	uint8_t *src, *dst;
+
+	for (j = 0; j < gs->num_textures; j++) {
+		x = r.x1 / gs->hsub[j];
+		y = r.y1 / gs->vsub[j];
+		width = (r.x2 - r.x1) / gs->hsub[j];
+		height = (r.y2 - r.y1) / gs->vsub[j];
+		if (width <= 0 || height <= 0)
+			continue;
+
+		texel = gl_format_texel_size(gs->gl_format[j],
+					     gs->gl_pixel_type);
+		row = width * texel;
+		src_stride = (size_t)(gs->pitch / gs->hsub[j]) * texel;
+		/* Rows are packed at the default GL_UNPACK_ALIGNMENT. */
+		dst_stride = (row + 3) & ~3;
+
+		dst = upload_pbo_map(gr, dst_stride * height, &offset);
+		if (!dst)
+			return -1;
+
+		src = data + gs->offset[j] + y * src_stride + x * texel;
+		for (k = 0; k < height; k++)
+			memcpy(dst + k * dst_stride, src + k * src_stride, row);
+
+		if (!gr->unmap_buffer(GL_PIXEL_UNPACK_BUFFER))
+			return -1;
+
+		glBindTexture(GL_TEXTURE_2D, gs->textures[j]);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height,
+				gl_format_from_internal(gs->gl_format[j]),
+				gs->gl_pixel_type,
+				(void *)(uintptr_t)offset);
+	}
+
+	return 0;
+}
+
+/* Copy the damaged rows into the staging buffer and let the driver
+ * update the textures from there, instead of making it copy from client
+ * memory during glTexSubImage2D(). The rectangles of each band of the
+ * damage region are merged into one upload: a wider copy is cheaper than
+ * another round trip through the driver. The client buffer is no longer
+ * referenced once this returns. */
+static int
+upload_damage_pbo(struct gl_renderer *gr, struct weston_surface *surface,
+		  struct gl_surface_state *gs, uint8_t *data)
+{
+	pixman_box32_t *rectangles;
+	pixman_box32_t band;
+	int i, n, ret = 0;
+
+	if (!gr->upload_pbo)
+		glGenBuffers(1, &gr->upload_pbo);
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gr->upload_pbo);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, 0);
+	glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, 0);
+
+	rectangles = pixman_region32_rectangles(&gs->texture_damage, &n);
+	for (i = 0; i < n && ret == 0; i++) {
+		band = rectangles[i];
+		while (i + 1 < n && rectangles[i + 1].y1 == band.y1)
+			band.x2 = rectangles[++i].x2;
+
+		ret = upload_rect_pbo(gr, gs, data,
+				      weston_surface_to_buffer_rect(surface,
+								    band));
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (ret < 0) {
+		weston_log("failed to map the texture upload buffer, "
+			   "falling back to direct uploads\n");
+		gr->has_pbo = 0;
+	}
+
+	return ret;
+}
+
 static void
 gl_renderer_flush_damage(struct weston_surface *surface)
 {
@@ -1488,8 +1856,13 @@ gl_renderer_flush_damage(struct weston_surface *surface)
 		goto done;
 	}
 
-	rectangles = pixman_region32_rectangles(&gs->texture_damage, &n);
 	wl_shm_buffer_begin_access(buffer->shm_buffer);
+	if (gr->has_pbo && upload_damage_pbo(gr, surface, gs, data) == 0) {
+		wl_shm_buffer_end_access(buffer->shm_buffer);
+		goto done;
+	}
+
+	rectangles = pixman_region32_rectangles(&gs->texture_damage, &n);
 	for (i = 0; i < n; i++) {
 		pixman_box32_t r;
 
@@ -1502,7 +1875,7 @@ gl_renderer_flush_damage(struct weston_surface *surface)
 			glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT,
 				      r.x1 / gs->hsub[j]);
 			glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT,
-				      r.y1 / gs->hsub[j]);
+				      r.y1 / gs->vsub[j]);
 			glTexSubImage2D(GL_TEXTURE_2D, 0,
 					r.x1 / gs->hsub[j],
 					r.y1 / gs->vsub[j],
@@ -3064,6 +3437,54 @@ gl_renderer_output_window_create(struct weston_output *output,
 	return ret;
 }
 
+static int
+gl_renderer_output_pbuffer_create(struct weston_output *output,
+				  int width, int height,
+				  const EGLint *config_attribs,
+				  const EGLint *visual_id,
+				  int n_ids)
+{
+	struct gl_renderer *gr = get_renderer(output->compositor);
+	EGLConfig pbuffer_config;
+	EGLSurface egl_surface;
+	int ret;
+	const EGLint pbuffer_attribs[] = {
+		EGL_WIDTH, width,
+		EGL_HEIGHT, height,
+		EGL_NONE
+	};
+
+	if (egl_choose_config(gr, config_attribs, visual_id,
+			      n_ids, &pbuffer_config) == -1) {
+		weston_log("failed to choose EGL config for PbufferSurface\n");
+		return -1;
+	}
+
+	if (pbuffer_config != gr->egl_config &&
+	    !gr->has_configless_context) {
+		weston_log("attempted to use a different EGL config for an "
+			   "output but EGL_KHR_no_config_context or "
+			   "EGL_MESA_configless_context is not supported\n");
+		return -1;
+	}
+
+	log_egl_config_info(gr->egl_display, pbuffer_config);
+
+	egl_surface = eglCreatePbufferSurface(gr->egl_display, pbuffer_config,
+					      pbuffer_attribs);
+	if (egl_surface == EGL_NO_SURFACE) {
+		weston_log("failed to create egl surface\n");
+		gl_renderer_print_egl_error_state();
+		return -1;
+	}
+
+	ret = gl_renderer_output_create(output, egl_surface);
+	if (ret < 0)
+		weston_platform_destroy_egl_surface(gr->egl_display, egl_surface);
+
+	return ret;
+}
+
 static void
 gl_renderer_output_destroy(struct weston_output *output)
 {
@@ -3105,6 +3526,13 @@ gl_renderer_destroy(struct weston_compositor *ec)
 
 	wl_signal_emit(&gr->destroy_signal, gr);
 
+	if (gr->upload_pbo)
+		glDeleteBuffers(1, &gr->upload_pbo);
+	if (gr->batch_vbo) {
+		glDeleteBuffers(1, &gr->batch_vbo);
+		glDeleteBuffers(1, &gr->batch_ibo);
+	}
+
 	if (gr->has_bind_display)
 		gr->unbind_display(gr->egl_display, ec->wl_display);
 
@@ -3128,6 +3556,8 @@ gl_renderer_destroy(struct weston_compositor *ec)
 
 	wl_array_release(&gr->vertices);
 	wl_array_release(&gr->vtxcnt);
+	wl_array_release(&gr->indices);
+	wl_array_release(&gr->batches);
 
 	if (gr->fragment_binding)
 		weston_binding_destroy(gr->fragment_binding);
@@ -3282,6 +3712,16 @@ static const EGLint gl_renderer_alpha_attribs[] = {
 	EGL_NONE
 };
 
+static const EGLint gl_renderer_pbuffer_attribs[] = {
+	EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+	EGL_RED_SIZE, 1,
+	EGL_GREEN_SIZE, 1,
+	EGL_BLUE_SIZE, 1,
+	EGL_ALPHA_SIZE, 0,
+	EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+	EGL_NONE
+};
+
 
 /** Checks whether a platform EGL client extension is supported
  *
@@ -3355,6 +3795,8 @@ platform_to_extension(EGLenum platform)
 		return "wayland";
 	case EGL_PLATFORM_X11_KHR:
 		return "x11";
+	case EGL_PLATFORM_SURFACELESS_MESA:
+		return "surfaceless";
 	default:
 		assert(0 && "bad EGL platform enum");
 	}
@@ -3378,23 +3820,13 @@ static int
 gl_renderer_create_pbuffer_surface(struct gl_renderer *gr) {
 	EGLConfig pbuffer_config;
 
-	static const EGLint pbuffer_config_attribs[] = {
-		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
-		EGL_RED_SIZE, 1,
-		EGL_GREEN_SIZE, 1,
-		EGL_BLUE_SIZE, 1,
-		EGL_ALPHA_SIZE, 0,
-		EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
-		EGL_NONE
-	};
-
 	static const EGLint pbuffer_attribs[] = {
 		EGL_WIDTH, 10,
 		EGL_HEIGHT, 10,
 		EGL_NONE
 	};
 
-	if (egl_choose_config(gr, pbuffer_config_attribs, NULL, 0, &pbuffer_config) < 0) {
+	if (egl_choose_config(gr, gl_renderer_pbuffer_attribs, NULL, 0, &pbuffer_config) < 0) {
 		weston_log("failed to choose EGL config for PbufferSurface\n");
 		return -1;
 	}
@@ -3460,6 +3892,14 @@ gl_renderer_display_create(struct weston_compositor *ec, EGLenum platform,
 		}
 	}
 
+	/* The default display may be any platform, e.g. one picked from
+	 * $WAYLAND_DISPLAY or $DISPLAY, so it can't stand in for surfaceless. */
+	if (!gr->egl_display &&
+	    platform == EGL_PLATFORM_SURFACELESS_MESA) {
+		weston_log("failed to create a surfaceless EGL display\n");
+		goto fail;
+	}
+
 	if (!gr->egl_display) {
 		weston_log("warning: either no EGL_EXT_platform_base "
 			   "support or specific platform support; "
@@ -3738,6 +4178,15 @@ gl_renderer_setup(struct weston_compositor *ec, EGLSurface egl_surface)
 	    weston_check_egl_extension(extensions, "GL_EXT_unpack_subimage"))
 		gr->has_unpack_subimage = 1;
 
+	if (gr->gl_version >= GR_GL_VERSION(3, 0)) {
+		gr->map_buffer_range =
+			(void *) eglGetProcAddress("glMapBufferRange");
+		gr->unmap_buffer =
+			(void *) eglGetProcAddress("glUnmapBuffer");
+		if (gr->map_buffer_range && gr->unmap_buffer)
+			gr->has_pbo = 1;
+	}
+
 	if (gr->gl_version >= GR_GL_VERSION(3, 0) ||
 	    weston_check_egl_extension(extensions, "GL_EXT_texture_rg"))
 		gr->has_gl_texture_rg = 1;
@@ -3768,6 +4217,8 @@ gl_renderer_setup(struct weston_compositor *ec, EGLSurface egl_surface)
 		ec->read_format == PIXMAN_a8r8g8b8 ? "BGRA" : "RGBA");
 	weston_log_continue(STAMP_SPACE "wl_shm sub-image to texture: %s\n",
 			    gr->has_unpack_subimage ? "yes" : "no");
+	weston_log_continue(STAMP_SPACE "wl_shm upload through PBO: %s\n",
+			    gr->has_pbo ? "yes" : "no");
 	weston_log_continue(STAMP_SPACE "EGL Wayland extension: %s\n",
 			    gr->has_bind_display ? "yes" : "no");
 
@@ -3778,10 +4229,12 @@ gl_renderer_setup(struct weston_compositor *ec, EGLSurface egl_surface)
 WL_EXPORT struct gl_renderer_interface gl_renderer_interface = {
 	.opaque_attribs = gl_renderer_opaque_attribs,
 	.alpha_attribs = gl_renderer_alpha_attribs,
+	.pbuffer_attribs = gl_renderer_pbuffer_attribs,
 
 	.display_create = gl_renderer_display_create,
 	.display = gl_renderer_display,
 	.output_window_create = gl_renderer_output_window_create,
+	.output_pbuffer_create = gl_renderer_output_pbuffer_create,
 	.output_destroy = gl_renderer_output_destroy,
 	.output_surface = gl_renderer_output_surface,
 	.output_set_border = gl_renderer_output_set_border,
@@ -59,6 +59,7 @@ enum gl_renderer_border_side {
 struct gl_renderer_interface {
 	const EGLint *opaque_attribs;
 	const EGLint *alpha_attribs;
+	const EGLint *pbuffer_attribs;
 
 	int (*display_create)(struct weston_compositor *ec,
 			      EGLenum platform,
@@ -77,6 +78,16 @@ struct gl_renderer_interface {
 				    const EGLint *visual_id,
 				    const int n_ids);
 
+	/* Creates an offscreen output of the given size in pixels, for
+	 * backends that do not display anything, such as headless. The
+	 * config attributes must select pbuffer capable configs.
+	 */
+	int (*output_pbuffer_create)(struct weston_output *output,
+				     int width, int height,
+				     const EGLint *config_attribs,
+				     const EGLint *visual_id,
+				     const int n_ids);
+
 	void (*output_destroy)(struct weston_output *output);
 
 	EGLSurface (*output_surface)(struct weston_output *output);
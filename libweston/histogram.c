@@ -0,0 +1,138 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <stdint.h>
+#include <wayland-util.h>
+
+#include "histogram.h"
+
+#define SUB_BUCKETS (1u << WESTON_HISTOGRAM_SUB_BITS)
+
+static unsigned int
+bucket_index(uint32_t value)
+{
+	unsigned int msb;
+
+	if (value < 2 * SUB_BUCKETS)
+		return value;
+
+	msb = 31 - __builtin_clz(value);
+
+	return ((msb - WESTON_HISTOGRAM_SUB_BITS + 1)
+		<< WESTON_HISTOGRAM_SUB_BITS) +
+	       ((value >> (msb - WESTON_HISTOGRAM_SUB_BITS)) &
+		(SUB_BUCKETS - 1));
+}
+
+/* The largest value that falls into the given bucket. */
+static uint32_t
+bucket_upper_bound(unsigned int index)
+{
+	unsigned int msb;
+	uint32_t sub;
+
+	if (index < 2 * SUB_BUCKETS)
+		return index;
+
+	msb = (index >> WESTON_HISTOGRAM_SUB_BITS) +
+	      WESTON_HISTOGRAM_SUB_BITS - 1;
+	sub = index & (SUB_BUCKETS - 1);
+
+	return (((uint64_t)(SUB_BUCKETS + sub + 1)) <<
+		(msb - WESTON_HISTOGRAM_SUB_BITS)) - 1;
+}
+
+WL_EXPORT void
+weston_histogram_reset(struct weston_histogram *histogram)
+{
+	memset(histogram, 0, sizeof *histogram);
+}
+
+WL_EXPORT void
+weston_histogram_add(struct weston_histogram *histogram, uint32_t value)
+{
+	if (histogram->count == 0 || value < histogram->min)
+		histogram->min = value;
+	if (value > histogram->max)
+		histogram->max = value;
+
+	histogram->count++;
+	histogram->sum += value;
+	histogram->buckets[bucket_index(value)]++;
+}
+
+WL_EXPORT uint32_t
+weston_histogram_mean(const struct weston_histogram *histogram)
+{
+	if (histogram->count == 0)
+		return 0;
+
+	return histogram->sum / histogram->count;
+}
+
+/** Get a percentile from a histogram
+ *
+ * \param histogram The histogram.
+ * \param percentile The percentile to look up, from 0 to 100.
+ * \return The upper bound of the bucket holding the percentile, clamped
+ * to the recorded range, or 0 for an empty histogram.
+ */
+WL_EXPORT uint32_t
+weston_histogram_percentile(const struct weston_histogram *histogram,
+			    double percentile)
+{
+	uint64_t rank, seen = 0;
+	uint32_t value;
+	unsigned int i;
+
+	if (histogram->count == 0)
+		return 0;
+
+	if (percentile <= 0.0)
+		return histogram->min;
+
+	rank = (uint64_t)(percentile / 100.0 * histogram->count + 0.5);
+	if (rank == 0)
+		rank = 1;
+	if (rank > histogram->count)
+		rank = histogram->count;
+
+	for (i = 0; i < WESTON_HISTOGRAM_BUCKETS; i++) {
+		seen += histogram->buckets[i];
+		if (seen >= rank)
+			break;
+	}
+
+	value = bucket_upper_bound(i);
+	if (value > histogram->max)
+		value = histogram->max;
+	if (value < histogram->min)
+		value = histogram->min;
+
+	return value;
+}
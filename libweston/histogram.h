@@ -0,0 +1,73 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef WESTON_HISTOGRAM_H
+#define WESTON_HISTOGRAM_H
+
+#include <stdint.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/* Every power of two range is split into 2^WESTON_HISTOGRAM_SUB_BITS
+ * linear buckets, so any recorded value is known to within 12.5% while
+ * the whole uint32_t range fits in a fixed number of buckets.
+ */
+#define WESTON_HISTOGRAM_SUB_BITS 3
+#define WESTON_HISTOGRAM_BUCKETS \
+	((32 - WESTON_HISTOGRAM_SUB_BITS + 1) << WESTON_HISTOGRAM_SUB_BITS)
+
+/** Log-linear histogram of unsigned samples
+ *
+ * Adding a sample is constant time and never allocates, so these can be
+ * fed from the repaint path.
+ */
+struct weston_histogram {
+	uint64_t count;
+	uint64_t sum;
+	uint32_t min;
+	uint32_t max;
+	uint32_t buckets[WESTON_HISTOGRAM_BUCKETS];
+};
+
+void
+weston_histogram_reset(struct weston_histogram *histogram);
+
+void
+weston_histogram_add(struct weston_histogram *histogram, uint32_t value);
+
+uint32_t
+weston_histogram_mean(const struct weston_histogram *histogram);
+
+uint32_t
+weston_histogram_percentile(const struct weston_histogram *histogram,
+			    double percentile);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -1704,6 +1704,193 @@ weston_pointer_handle_output_destroy(struct wl_listener *listener, void *data)
 	weston_pointer_move_to(pointer, fx, fy);
 }
 
+/* A touch point moved while coalescing, queued until the batch ends. */
+struct weston_touch_motion {
+	int touch_id;
+	struct timespec time;
+	double x;
+	double y;
+};
+
+static bool
+seat_is_coalescing(struct weston_seat *seat)
+{
+	return seat->coalesce.enabled && !seat->coalesce.flushing &&
+	       seat->compositor->input_batch_depth > 0;
+}
+
+static void
+seat_coalesce_motion(struct weston_seat *seat, const struct timespec *time,
+		     struct weston_pointer_motion_event *event)
+{
+	struct weston_pointer_motion_event *pending = &seat->coalesce.motion;
+
+	/* Only merge events of the same kind, so that absolute and
+	 * relative devices on one seat keep their relative order. */
+	if (seat->coalesce.motion_pending && pending->mask != event->mask)
+		weston_seat_flush_input(seat);
+
+	if (!seat->coalesce.motion_pending) {
+		*pending = *event;
+		seat->coalesce.motion_time = *time;
+		seat->coalesce.motion_pending = true;
+		return;
+	}
+
+	/* Relative deltas are summed rather than dropped, clients bound
+	 * to relative-pointer see the same total motion. */
+	if (event->mask & WESTON_POINTER_MOTION_ABS) {
+		pending->x = event->x;
+		pending->y = event->y;
+	}
+	if (event->mask & WESTON_POINTER_MOTION_REL) {
+		pending->dx += event->dx;
+		pending->dy += event->dy;
+	}
+	if (event->mask & WESTON_POINTER_MOTION_REL_UNACCEL) {
+		pending->dx_unaccel += event->dx_unaccel;
+		pending->dy_unaccel += event->dy_unaccel;
+	}
+	pending->time = event->time;
+	seat->coalesce.motion_time = *time;
+	seat->coalesce.merged_motion++;
+}
+
+static void
+seat_coalesce_touch_motion(struct weston_seat *seat,
+			   const struct timespec *time,
+			   int touch_id, double x, double y)
+{
+	struct weston_touch_motion *motion;
+
+	wl_array_for_each(motion, &seat->coalesce.touch_motion) {
+		if (motion->touch_id != touch_id)
+			continue;
+
+		motion->time = *time;
+		motion->x = x;
+		motion->y = y;
+		seat->coalesce.merged_touch++;
+		return;
+	}
+
+	motion = wl_array_add(&seat->coalesce.touch_motion, sizeof *motion);
+	if (!motion) {
+		/* Out of memory, fall back to sending it right away. */
+		weston_seat_flush_input(seat);
+		seat->coalesce.flushing = true;
+		notify_touch(seat, time, touch_id, x, y, WL_TOUCH_MOTION);
+		seat->coalesce.flushing = false;
+		return;
+	}
+
+	motion->touch_id = touch_id;
+	motion->time = *time;
+	motion->x = x;
+	motion->y = y;
+}
+
+/** Deliver motion held back by input coalescing
+ *
+ * \param seat The seat
+ *
+ * Sends the merged pointer motion and per touch point motion queued on
+ * \a seat, each followed by the frame event that was held back with it.
+ * Called for every seat when the outermost input batch ends, and before
+ * any event that must not overtake pending motion, such as a button
+ * press or a touch point going down.
+ */
+WL_EXPORT void
+weston_seat_flush_input(struct weston_seat *seat)
+{
+	struct weston_touch_motion *motion;
+
+	if (seat->coalesce.flushing)
+		return;
+
+	seat->coalesce.flushing = true;
+
+	if (seat->coalesce.motion_pending) {
+		seat->coalesce.motion_pending = false;
+		notify_motion(seat, &seat->coalesce.motion_time,
+			      &seat->coalesce.motion);
+	}
+	if (seat->coalesce.pointer_frame_pending) {
+		seat->coalesce.pointer_frame_pending = false;
+		notify_pointer_frame(seat);
+	}
+
+	wl_array_for_each(motion, &seat->coalesce.touch_motion)
+		notify_touch(seat, &motion->time, motion->touch_id,
+			     motion->x, motion->y, WL_TOUCH_MOTION);
+	seat->coalesce.touch_motion.size = 0;
+
+	if (seat->coalesce.touch_frame_pending) {
+		seat->coalesce.touch_frame_pending = false;
+		notify_touch_frame(seat);
+	}
+
+	seat->coalesce.flushing = false;
+}
+
+/** Enable or disable input coalescing on a seat
+ *
+ * \param seat The seat
+ * \param enabled Whether to coalesce
+ *
+ * While enabled, pointer and touch motion that arrives between
+ * weston_compositor_begin_input_batch() and
+ * weston_compositor_end_input_batch() is merged into one motion event
+ * per pointer and per touch point, so grabs, focus picking and clients
+ * run once per batch instead of once per device event. Relative deltas
+ * are accumulated. The number of merged events is kept in
+ * seat->coalesce.merged_motion and seat->coalesce.merged_touch.
+ *
+ * New seats follow weston_compositor::coalesce_input.
+ */
+WL_EXPORT void
+weston_seat_set_input_coalescing(struct weston_seat *seat, bool enabled)
+{
+	if (!enabled)
+		weston_seat_flush_input(seat);
+
+	seat->coalesce.enabled = enabled;
+}
+
+/** Open an input batch
+ *
+ * \param compositor The compositor
+ *
+ * Backends call this before dispatching a group of device events that
+ * were read together, and weston_compositor_end_input_batch() afterwards.
+ * Batches nest, motion is flushed when the outermost batch ends.
+ */
+WL_EXPORT void
+weston_compositor_begin_input_batch(struct weston_compositor *compositor)
+{
+	compositor->input_batch_depth++;
+}
+
+/** Close an input batch
+ *
+ * \param compositor The compositor
+ *
+ * \sa weston_compositor_begin_input_batch
+ */
+WL_EXPORT void
+weston_compositor_end_input_batch(struct weston_compositor *compositor)
+{
+	struct weston_seat *seat;
+
+	assert(compositor->input_batch_depth > 0);
+
+	if (--compositor->input_batch_depth > 0)
+		return;
+
+	wl_list_for_each(seat, &compositor->seat_list, link)
+		weston_seat_flush_input(seat);
+}
+
 WL_EXPORT void
 notify_motion(struct weston_seat *seat,
 	      const struct timespec *time,
@@ -1712,6 +1899,11 @@ notify_motion(struct weston_seat *seat,
 	struct weston_compositor *ec = seat->compositor;
 	struct weston_pointer *pointer = weston_seat_get_pointer(seat);
 
+	if (seat_is_coalescing(seat)) {
+		seat_coalesce_motion(seat, time, event);
+		return;
+	}
+
 	weston_compositor_wake(ec);
 	pointer->grab->interface->motion(pointer->grab, time, event);
 }
@@ -1756,19 +1948,13 @@ WL_EXPORT void
 notify_motion_absolute(struct weston_seat *seat, const struct timespec *time,
 		       double x, double y)
 {
-	struct weston_compositor *ec = seat->compositor;
-	struct weston_pointer *pointer = weston_seat_get_pointer(seat);
-	struct weston_pointer_motion_event event = { 0 };
-
-	weston_compositor_wake(ec);
-
-	event = (struct weston_pointer_motion_event) {
+	struct weston_pointer_motion_event event = {
 		.mask = WESTON_POINTER_MOTION_ABS,
 		.x = x,
 		.y = y,
 	};
 
-	pointer->grab->interface->motion(pointer->grab, time, &event);
+	notify_motion(seat, time, &event);
 }
 
 static unsigned int
@@ -1807,6 +1993,8 @@ notify_button(struct weston_seat *seat, const struct timespec *time,
 	struct weston_compositor *compositor = seat->compositor;
 	struct weston_pointer *pointer = weston_seat_get_pointer(seat);
 
+	weston_seat_flush_input(seat);
+
 	if (state == WL_POINTER_BUTTON_STATE_PRESSED) {
 		weston_compositor_idle_inhibit(compositor);
 		if (pointer->button_count == 0) {
@@ -1838,6 +2026,8 @@ notify_axis(struct weston_seat *seat, const struct timespec *time,
 	struct weston_compositor *compositor = seat->compositor;
 	struct weston_pointer *pointer = weston_seat_get_pointer(seat);
 
+	weston_seat_flush_input(seat);
+
 	weston_compositor_wake(compositor);
 
 	if (weston_compositor_run_axis_binding(compositor, pointer,
@@ -1853,6 +2043,8 @@ notify_axis_source(struct weston_seat *seat, uint32_t source)
 	struct weston_compositor *compositor = seat->compositor;
 	struct weston_pointer *pointer = weston_seat_get_pointer(seat);
 
+	weston_seat_flush_input(seat);
+
 	weston_compositor_wake(compositor);
 
 	pointer->grab->interface->axis_source(pointer->grab, source);
@@ -1864,6 +2056,12 @@ notify_pointer_frame(struct weston_seat *seat)
 	struct weston_compositor *compositor = seat->compositor;
 	struct weston_pointer *pointer = weston_seat_get_pointer(seat);
 
+	/* Held back until the merged motion it terminates is sent. */
+	if (seat_is_coalescing(seat) && seat->coalesce.motion_pending) {
+		seat->coalesce.pointer_frame_pending = true;
+		return;
+	}
+
 	weston_compositor_wake(compositor);
 
 	pointer->grab->interface->frame(pointer->grab);
@@ -2010,6 +2208,12 @@ update_modifier_state(struct weston_seat *seat, uint32_t serial, uint32_t key,
 static void
 send_keymap(struct wl_resource *resource, struct weston_xkb_info *xkb_info)
 {
+	if (weston_xkb_info_get_keymap_fd(xkb_info) < 0) {
+		weston_log("error: no keymap file, not sending a keymap "
+			   "to the client\n");
+		return;
+	}
+
 	wl_keyboard_send_keymap(resource,
 				WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1,
 				xkb_info->keymap_fd,
@@ -2027,7 +2231,7 @@ send_modifiers(struct wl_resource *resource, uint32_t serial, struct weston_keyb
 }
 
 static struct weston_xkb_info *
-weston_xkb_info_create(struct xkb_keymap *keymap);
+weston_xkb_info_get(struct weston_compositor *ec, struct xkb_keymap *keymap);
 
 static void
 update_keymap(struct weston_seat *seat)
@@ -2039,7 +2243,8 @@ update_keymap(struct weston_seat *seat)
 	xkb_mod_mask_t latched_mods;
 	xkb_mod_mask_t locked_mods;
 
-	xkb_info = weston_xkb_info_create(keyboard->pending_keymap);
+	xkb_info = weston_xkb_info_get(seat->compositor,
+				       keyboard->pending_keymap);
 
 	xkb_keymap_unref(keyboard->pending_keymap);
 	keyboard->pending_keymap = NULL;
@@ -2098,6 +2303,9 @@ notify_key(struct weston_seat *seat, const struct timespec *time, uint32_t key,
 	struct weston_keyboard_grab *grab = keyboard->grab;
 	uint32_t *k, *end;
 
+	/* Key bindings may act on the pointer position. */
+	weston_seat_flush_input(seat);
+
 	if (state == WL_KEYBOARD_KEY_STATE_PRESSED) {
 		weston_compositor_idle_inhibit(compositor);
 	} else {
@@ -2152,6 +2360,8 @@ notify_pointer_focus(struct weston_seat *seat, struct weston_output *output,
 {
 	struct weston_pointer *pointer = weston_seat_get_pointer(seat);
 
+	weston_seat_flush_input(seat);
+
 	if (output) {
 		weston_pointer_move_to(pointer,
 				       wl_fixed_from_double(x),
@@ -2291,6 +2501,14 @@ notify_touch(struct weston_seat *seat, const struct timespec *time,
 	wl_fixed_t x = wl_fixed_from_double(double_x);
 	wl_fixed_t y = wl_fixed_from_double(double_y);
 
+	if (touch_type == WL_TOUCH_MOTION && seat_is_coalescing(seat)) {
+		seat_coalesce_touch_motion(seat, time, touch_id,
+					   double_x, double_y);
+		return;
+	}
+
+	weston_seat_flush_input(seat);
+
 	/* Update grab's global coordinates. */
 	if (touch_id == touch->grab_touch_id && touch_type != WL_TOUCH_UP) {
 		touch->grab_x = x;
@@ -2364,6 +2582,11 @@ notify_touch_frame(struct weston_seat *seat)
 	struct weston_touch *touch = weston_seat_get_touch(seat);
 	struct weston_touch_grab *grab = touch->grab;
 
+	if (seat_is_coalescing(seat) && seat->coalesce.touch_motion.size > 0) {
+		seat->coalesce.touch_frame_pending = true;
+		return;
+	}
+
 	grab->interface->frame(grab);
 }
 
@@ -2373,6 +2596,8 @@ notify_touch_cancel(struct weston_seat *seat)
 	struct weston_touch *touch = weston_seat_get_touch(seat);
 	struct weston_touch_grab *grab = touch->grab;
 
+	weston_seat_flush_input(seat);
+
 	grab->interface->cancel(grab);
 }
 
@@ -2637,9 +2862,7 @@ seat_get_keyboard(struct wl_client *client, struct wl_resource *resource,
 					     seat->compositor->kb_repeat_delay);
 	}
 
-	wl_keyboard_send_keymap(cr, WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1,
-				keyboard->xkb_info->keymap_fd,
-				keyboard->xkb_info->keymap_size);
+	send_keymap(cr, keyboard->xkb_info);
 
 	if (should_send_modifiers_to_client(seat, client)) {
 		send_modifiers_to_resource(keyboard,
@@ -2865,6 +3088,72 @@ weston_compositor_set_xkb_rule_names(struct weston_compositor *ec,
 	return 0;
 }
 
+static bool
+xkb_rule_name_equal(const char *a, const char *b)
+{
+	if (!a || !b)
+		return a == b;
+
+	return strcmp(a, b) == 0;
+}
+
+static bool
+xkb_rule_names_equal(const struct xkb_rule_names *a,
+		     const struct xkb_rule_names *b)
+{
+	return xkb_rule_name_equal(a->rules, b->rules) &&
+	       xkb_rule_name_equal(a->model, b->model) &&
+	       xkb_rule_name_equal(a->layout, b->layout) &&
+	       xkb_rule_name_equal(a->variant, b->variant) &&
+	       xkb_rule_name_equal(a->options, b->options);
+}
+
+static void
+xkb_rule_names_fini(struct xkb_rule_names *names)
+{
+	free((char *) names->rules);
+	free((char *) names->model);
+	free((char *) names->layout);
+	free((char *) names->variant);
+	free((char *) names->options);
+	memset(names, 0, sizeof *names);
+}
+
+static char *
+strdup_or_null(const char *str, bool *failed)
+{
+	char *copy;
+
+	if (!str)
+		return NULL;
+
+	copy = strdup(str);
+	if (!copy)
+		*failed = true;
+
+	return copy;
+}
+
+static int
+xkb_rule_names_copy(struct xkb_rule_names *dest,
+		    const struct xkb_rule_names *src)
+{
+	bool failed = false;
+
+	dest->rules = strdup_or_null(src->rules, &failed);
+	dest->model = strdup_or_null(src->model, &failed);
+	dest->layout = strdup_or_null(src->layout, &failed);
+	dest->variant = strdup_or_null(src->variant, &failed);
+	dest->options = strdup_or_null(src->options, &failed);
+
+	if (failed) {
+		xkb_rule_names_fini(dest);
+		return -1;
+	}
+
+	return 0;
+}
+
 static void
 weston_xkb_info_destroy(struct weston_xkb_info *xkb_info)
 {
@@ -2873,13 +3162,16 @@ weston_xkb_info_destroy(struct weston_xkb_info *xkb_info)
 
 	xkb_keymap_unref(xkb_info->keymap);
 
-	if (xkb_info->keymap_area)
-		munmap(xkb_info->keymap_area, xkb_info->keymap_size);
 	if (xkb_info->keymap_fd >= 0)
 		close(xkb_info->keymap_fd);
+	wl_list_remove(&xkb_info->link);
+	xkb_rule_names_fini(&xkb_info->names);
 	free(xkb_info);
 }
 
+static void
+xkb_info_cache_evict(struct weston_compositor *ec);
+
 void
 weston_compositor_xkb_destroy(struct weston_compositor *ec)
 {
@@ -2891,6 +3183,8 @@ weston_compositor_xkb_destroy(struct weston_compositor *ec)
 
 	if (ec->xkb_info)
 		weston_xkb_info_destroy(ec->xkb_info);
+	while (!wl_list_empty(&ec->xkb_info_cache))
+		xkb_info_cache_evict(ec);
 	xkb_context_unref(ec->xkb_context);
 }
 
@@ -2903,8 +3197,8 @@ weston_xkb_info_create(struct xkb_keymap *keymap)
 
 	xkb_info->keymap = xkb_keymap_ref(keymap);
 	xkb_info->ref_count = 1;
-
-	char *keymap_str;
+	xkb_info->keymap_fd = -1;
+	wl_list_init(&xkb_info->link);
 
 	xkb_info->shift_mod = xkb_keymap_mod_get_index(xkb_info->keymap,
 						       XKB_MOD_NAME_SHIFT);
@@ -2930,42 +3224,106 @@ weston_xkb_info_create(struct xkb_keymap *keymap)
 	xkb_info->scroll_led = xkb_keymap_led_get_index(xkb_info->keymap,
 							XKB_LED_NAME_SCROLL);
 
+	return xkb_info;
+}
+
+/* Look up the xkb_info of a keymap handed out by
+ * weston_compositor_get_keymap(), or create a new one. */
+static struct weston_xkb_info *
+weston_xkb_info_get(struct weston_compositor *ec, struct xkb_keymap *keymap)
+{
+	struct weston_xkb_info *xkb_info;
+
+	wl_list_for_each(xkb_info, &ec->xkb_info_cache, link) {
+		if (xkb_info->keymap == keymap) {
+			xkb_info->ref_count++;
+			return xkb_info;
+		}
+	}
+
+	return weston_xkb_info_create(keymap);
+}
+
+/* The keymap is only turned into a file for clients once the first
+ * client asks for it. The file is sealed where possible, so the same
+ * one goes to every client. */
+WL_EXPORT int
+weston_xkb_info_get_keymap_fd(struct weston_xkb_info *xkb_info)
+{
+	char *keymap_str;
+
+	if (xkb_info->keymap_fd >= 0)
+		return xkb_info->keymap_fd;
+
 	keymap_str = xkb_keymap_get_as_string(xkb_info->keymap,
 					      XKB_KEYMAP_FORMAT_TEXT_V1);
 	if (keymap_str == NULL) {
 		weston_log("failed to get string version of keymap\n");
-		goto err_keymap;
+		return -1;
 	}
 	xkb_info->keymap_size = strlen(keymap_str) + 1;
 
-	xkb_info->keymap_fd = os_create_anonymous_file(xkb_info->keymap_size);
-	if (xkb_info->keymap_fd < 0) {
+	xkb_info->keymap_fd = os_create_sealed_file(keymap_str,
+						    xkb_info->keymap_size);
+	if (xkb_info->keymap_fd < 0)
 		weston_log("creating a keymap file for %lu bytes failed: %m\n",
 			(unsigned long) xkb_info->keymap_size);
-		goto err_keymap_str;
+	free(keymap_str);
+
+	return xkb_info->keymap_fd;
+}
+
+/* Keymaps compiled from rule names are kept, along with the file they
+ * are sent to clients in, so that seats with the same layout and
+ * switching back to a recent layout cost nothing. */
+#define XKB_INFO_CACHE_SIZE 8
+
+static void
+xkb_info_cache_evict(struct weston_compositor *ec)
+{
+	struct weston_xkb_info *xkb_info;
+
+	xkb_info = container_of(ec->xkb_info_cache.prev,
+				struct weston_xkb_info, link);
+	wl_list_remove(&xkb_info->link);
+	wl_list_init(&xkb_info->link);
+	ec->xkb_info_cache_size--;
+	weston_xkb_info_destroy(xkb_info);
+}
+
+WL_EXPORT struct xkb_keymap *
+weston_compositor_get_keymap(struct weston_compositor *ec,
+			     const struct xkb_rule_names *names)
+{
+	struct weston_xkb_info *xkb_info;
+	struct xkb_keymap *keymap;
+
+	wl_list_for_each(xkb_info, &ec->xkb_info_cache, link) {
+		if (xkb_rule_names_equal(&xkb_info->names, names)) {
+			wl_list_remove(&xkb_info->link);
+			wl_list_insert(&ec->xkb_info_cache, &xkb_info->link);
+			return xkb_keymap_ref(xkb_info->keymap);
+		}
 	}
 
-	xkb_info->keymap_area = mmap(NULL, xkb_info->keymap_size,
-				     PROT_READ | PROT_WRITE,
-				     MAP_SHARED, xkb_info->keymap_fd, 0);
-	if (xkb_info->keymap_area == MAP_FAILED) {
-		weston_log("failed to mmap() %lu bytes\n",
-			(unsigned long) xkb_info->keymap_size);
-		goto err_dev_zero;
+	keymap = xkb_keymap_new_from_names(ec->xkb_context, names, 0);
+	if (keymap == NULL)
+		return NULL;
+
+	xkb_info = weston_xkb_info_create(keymap);
+	if (xkb_info == NULL)
+		return keymap;
+
+	if (xkb_rule_names_copy(&xkb_info->names, names) < 0) {
+		weston_xkb_info_destroy(xkb_info);
+		return keymap;
 	}
-	strcpy(xkb_info->keymap_area, keymap_str);
-	free(keymap_str);
 
-	return xkb_info;
+	wl_list_insert(&ec->xkb_info_cache, &xkb_info->link);
+	if (++ec->xkb_info_cache_size > XKB_INFO_CACHE_SIZE)
+		xkb_info_cache_evict(ec);
 
-err_dev_zero:
-	close(xkb_info->keymap_fd);
-err_keymap_str:
-	free(keymap_str);
-err_keymap:
-	xkb_keymap_unref(xkb_info->keymap);
-	free(xkb_info);
-	return NULL;
+	return keymap;
 }
 
 static int
@@ -2976,9 +3334,7 @@ weston_compositor_build_global_keymap(struct weston_compositor *ec)
 	if (ec->xkb_info != NULL)
 		return 0;
 
-	keymap = xkb_keymap_new_from_names(ec->xkb_context,
-					   &ec->xkb_names,
-					   0);
+	keymap = weston_compositor_get_keymap(ec, &ec->xkb_names);
 	if (keymap == NULL) {
 		weston_log("failed to compile global XKB keymap\n");
 		weston_log("  tried rules %s, model %s, layout %s, variant %s, "
@@ -2989,7 +3345,7 @@ weston_compositor_build_global_keymap(struct weston_compositor *ec)
 		return -1;
 	}
 
-	ec->xkb_info = weston_xkb_info_create(keymap);
+	ec->xkb_info = weston_xkb_info_get(ec, keymap);
 	xkb_keymap_unref(keymap);
 	if (ec->xkb_info == NULL)
 		return -1;
@@ -3031,7 +3387,8 @@ weston_seat_init_keyboard(struct weston_seat *seat, struct xkb_keymap *keymap)
 	}
 
 	if (keymap != NULL) {
-		keyboard->xkb_info = weston_xkb_info_create(keymap);
+		keyboard->xkb_info = weston_xkb_info_get(seat->compositor,
+							 keymap);
 		if (keyboard->xkb_info == NULL)
 			goto err;
 	} else {
@@ -3125,6 +3482,8 @@ weston_seat_release_pointer(struct weston_seat *seat)
 {
 	struct weston_pointer *pointer = seat->pointer_state;
 
+	weston_seat_flush_input(seat);
+
 	seat->pointer_device_count--;
 	if (seat->pointer_device_count == 0) {
 		weston_pointer_clear_focus(pointer);
@@ -3169,6 +3528,8 @@ weston_seat_init_touch(struct weston_seat *seat)
 WL_EXPORT void
 weston_seat_release_touch(struct weston_seat *seat)
 {
+	weston_seat_flush_input(seat);
+
 	seat->touch_device_count--;
 	if (seat->touch_device_count == 0) {
 		weston_touch_set_focus(seat->touch_state, NULL);
@@ -3197,6 +3558,8 @@ weston_seat_init(struct weston_seat *seat, struct weston_compositor *ec,
 	seat->compositor = ec;
 	seat->modifier_state = 0;
 	seat->seat_name = strdup(seat_name);
+	wl_array_init(&seat->coalesce.touch_motion);
+	seat->coalesce.enabled = ec->coalesce_input;
 
 	wl_list_insert(ec->seat_list.prev, &seat->link);
 
@@ -3234,6 +3597,7 @@ weston_seat_release(struct weston_seat *seat)
 		weston_touch_destroy(seat->touch_state);
 
 	free (seat->seat_name);
+	wl_array_release(&seat->coalesce.touch_motion);
 
 	wl_global_destroy(seat->global);
 
@@ -205,10 +205,16 @@ process_events(struct udev_input *input)
 {
 	struct libinput_event *event;
 
+	/* Everything libinput read in one go forms one input batch, motion
+	 * on seats with coalescing enabled is merged until the end of it. */
+	weston_compositor_begin_input_batch(input->compositor);
+
 	while ((event = libinput_get_event(input->libinput))) {
 		process_event(event);
 		libinput_event_destroy(event);
 	}
+
+	weston_compositor_end_input_batch(input->compositor);
 }
 
 static int
@@ -0,0 +1,181 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ * Copyright © 2015 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <assert.h>
+#include <math.h>
+
+#include "pixman-composite.h"
+#include "shared/helpers.h"
+
+/** Find the destination pixels a source box can contribute to
+ *
+ * \param transform The destination to source transformation.
+ * \param src_box The box in source image coordinates.
+ * \param dest_width Width of the destination image.
+ * \param dest_height Height of the destination image.
+ * \param dest_box The resulting box, clamped to the destination image.
+ * \return False if the box cannot be mapped, and the whole destination
+ * must be used instead.
+ *
+ * The source box is grown by one pixel on every side to account for the
+ * bilinear filter footprint, and the result by one pixel for rounding, so
+ * no destination pixel that samples the box can fall outside of the
+ * returned box.
+ */
+bool
+source_box_to_dest_box(const pixman_transform_t *transform,
+		       const pixman_box32_t *src_box,
+		       int32_t dest_width, int32_t dest_height,
+		       pixman_box32_t *dest_box)
+{
+	pixman_transform_t inverse;
+	pixman_vector_t v;
+	double x1 = HUGE_VAL, y1 = HUGE_VAL;
+	double x2 = -HUGE_VAL, y2 = -HUGE_VAL;
+	double x, y;
+	int i;
+
+	if (!pixman_transform_invert(&inverse, transform))
+		return false;
+
+	for (i = 0; i < 4; i++) {
+		x = (i & 1) ? src_box->x2 + 1 : src_box->x1 - 1;
+		y = (i & 2) ? src_box->y2 + 1 : src_box->y1 - 1;
+
+		v.vector[0] = pixman_double_to_fixed(x);
+		v.vector[1] = pixman_double_to_fixed(y);
+		v.vector[2] = pixman_fixed_1;
+		if (!pixman_transform_point(&inverse, &v))
+			return false;
+
+		x = pixman_fixed_to_double(v.vector[0]);
+		y = pixman_fixed_to_double(v.vector[1]);
+		x1 = MIN(x1, x);
+		y1 = MIN(y1, y);
+		x2 = MAX(x2, x);
+		y2 = MAX(y2, y);
+	}
+
+	dest_box->x1 = MAX(floor(x1) - 1, 0);
+	dest_box->y1 = MAX(floor(y1) - 1, 0);
+	dest_box->x2 = MIN(ceil(x2) + 1, dest_width);
+	dest_box->y2 = MIN(ceil(y2) + 1, dest_height);
+
+	return true;
+}
+
+/** Composite a source image through a source clip region
+ *
+ * \return The number of boxes that had to be composited over the whole
+ * destination, i.e. the amount of overdraw.
+ *
+ * Every box of src_clip is composited through its own image, which makes
+ * sampling outside of the box produce (0,0,0,0). Each box is only
+ * composited into the destination rectangle it maps to, so the cost is
+ * proportional to the painted area rather than to the number of boxes
+ * times the destination size.
+ */
+int
+composite_clipped(pixman_image_t *src,
+		  pixman_image_t *mask,
+		  pixman_image_t *dest,
+		  const pixman_transform_t *transform,
+		  pixman_filter_t filter,
+		  pixman_region32_t *src_clip)
+{
+	int n_box;
+	pixman_box32_t *boxes;
+	pixman_box32_t dest_box;
+	int32_t dest_width;
+	int32_t dest_height;
+	int src_stride;
+	int bitspp;
+	pixman_format_code_t src_format;
+	void *src_data;
+	int overdraw = 0;
+	int i;
+
+	/* Hardcoded to use PIXMAN_OP_OVER, because sampling outside of
+	 * a Pixman image produces (0,0,0,0) instead of discarding the
+	 * fragment.
+	 */
+
+	dest_width = pixman_image_get_width(dest);
+	dest_height = pixman_image_get_height(dest);
+	src_format = pixman_image_get_format(src);
+	src_stride = pixman_image_get_stride(src);
+	bitspp = PIXMAN_FORMAT_BPP(src_format);
+	src_data = pixman_image_get_data(src);
+
+	assert(src_format);
+
+	boxes = pixman_region32_rectangles(src_clip, &n_box);
+	for (i = 0; i < n_box; i++) {
+		uint8_t *ptr = src_data;
+		pixman_image_t *boximg;
+		pixman_transform_t adj = *transform;
+
+		if (!source_box_to_dest_box(transform, &boxes[i],
+					    dest_width, dest_height,
+					    &dest_box)) {
+			dest_box.x1 = 0;
+			dest_box.y1 = 0;
+			dest_box.x2 = dest_width;
+			dest_box.y2 = dest_height;
+			overdraw++;
+		}
+
+		if (dest_box.x1 >= dest_box.x2 || dest_box.y1 >= dest_box.y2)
+			continue;
+
+		ptr += boxes[i].y1 * src_stride;
+		ptr += boxes[i].x1 * bitspp / 8;
+		boximg = pixman_image_create_bits_no_clear(src_format,
+					boxes[i].x2 - boxes[i].x1,
+					boxes[i].y2 - boxes[i].y1,
+					(uint32_t *)ptr, src_stride);
+
+		pixman_transform_translate(&adj, NULL,
+					   pixman_int_to_fixed(-boxes[i].x1),
+					   pixman_int_to_fixed(-boxes[i].y1));
+		pixman_image_set_transform(boximg, &adj);
+
+		pixman_image_set_filter(boximg, filter, NULL, 0);
+		pixman_image_composite32(PIXMAN_OP_OVER, boximg, mask, dest,
+					 dest_box.x1, dest_box.y1, /* src_x, src_y */
+					 dest_box.x1, dest_box.y1, /* mask_x, mask_y */
+					 dest_box.x1, dest_box.y1, /* dest_x, dest_y */
+					 dest_box.x2 - dest_box.x1,
+					 dest_box.y2 - dest_box.y1);
+
+		pixman_image_unref(boximg);
+	}
+
+	return n_box > 1 ? overdraw : 0;
+}
@@ -31,8 +31,10 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "pixman-renderer.h"
+#include "pixman-composite.h"
 #include "shared/helpers.h"
 
 #include <linux/input.h>
@@ -48,6 +50,8 @@ struct pixman_surface_state {
 	struct weston_surface *surface;
 
 	pixman_image_t *image;
+	bool image_is_solid;
+	pixman_color_t solid_color;
 	struct weston_buffer_reference buffer_ref;
 
 	struct wl_listener buffer_destroy_listener;
@@ -55,6 +59,42 @@ struct pixman_surface_state {
 	struct wl_listener renderer_destroy_listener;
 };
 
+#define PIXMAN_RENDER_MAX_THREADS 64
+
+/* Where a repaint_surfaces() pass paints to.
+ *
+ * Single-threaded repaint paints straight into the output image. With
+ * render threads, the target is split into horizontal bands and every band
+ * gets its own context. pixman images carry mutable clip, transform and
+ * filter state, so each band then works on private images wrapping the
+ * shared pixel data.
+ */
+struct pixman_paint_context {
+	pixman_image_t *target;
+	pixman_region32_t *band;	/* output coordinates, NULL: no limit */
+	bool private_images;
+};
+
+struct pixman_render_pool {
+	pthread_t threads[PIXMAN_RENDER_MAX_THREADS];
+	int n_threads;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+	bool quit;
+
+	/* The repaint in progress, protected by mutex */
+	uint32_t generation;
+	struct weston_output *output;
+	pixman_region32_t *damage;
+	pixman_image_t *target;
+	int band_y1, band_height;
+	int n_bands;
+	int next_band;
+	int bands_done;
+};
+
 struct pixman_renderer {
 	struct weston_renderer base;
 
@@ -62,9 +102,15 @@ struct pixman_renderer {
 	pixman_image_t *debug_color;
 	struct weston_binding *debug_binding;
 
+	struct pixman_render_pool *pool;
+
 	struct wl_signal destroy_signal;
 };
 
+static const pixman_color_t debug_red = {
+	0x3fff, 0x0000, 0x0000, 0x3fff
+};
+
 static inline struct pixman_output_state *
 get_output_state(struct weston_output *output)
 {
@@ -247,80 +293,54 @@ composite_whole(pixman_op_t op,
 }
 
 static void
-composite_clipped(pixman_image_t *src,
-		  pixman_image_t *mask,
-		  pixman_image_t *dest,
-		  const pixman_transform_t *transform,
-		  pixman_filter_t filter,
-		  pixman_region32_t *src_clip)
-{
-	int n_box;
-	pixman_box32_t *boxes;
-	int32_t dest_width;
-	int32_t dest_height;
-	int src_stride;
-	int bitspp;
-	pixman_format_code_t src_format;
-	void *src_data;
-	int i;
-
-	/* Hardcoded to use PIXMAN_OP_OVER, because sampling outside of
-	 * a Pixman image produces (0,0,0,0) instead of discarding the
-	 * fragment.
-	 */
-
-	dest_width = pixman_image_get_width(dest);
-	dest_height = pixman_image_get_height(dest);
-	src_format = pixman_image_get_format(src);
-	src_stride = pixman_image_get_stride(src);
-	bitspp = PIXMAN_FORMAT_BPP(src_format);
-	src_data = pixman_image_get_data(src);
-
-	assert(src_format);
-
-	/* This would be massive overdraw, except when n_box is 1. */
-	boxes = pixman_region32_rectangles(src_clip, &n_box);
-	for (i = 0; i < n_box; i++) {
-		uint8_t *ptr = src_data;
-		pixman_image_t *boximg;
-		pixman_transform_t adj = *transform;
-
-		ptr += boxes[i].y1 * src_stride;
-		ptr += boxes[i].x1 * bitspp / 8;
-		boximg = pixman_image_create_bits_no_clear(src_format,
-					boxes[i].x2 - boxes[i].x1,
-					boxes[i].y2 - boxes[i].y1,
-					(uint32_t *)ptr, src_stride);
-
-		pixman_transform_translate(&adj, NULL,
-					   pixman_int_to_fixed(-boxes[i].x1),
-					   pixman_int_to_fixed(-boxes[i].y1));
-		pixman_image_set_transform(boximg, &adj);
-
-		pixman_image_set_filter(boximg, filter, NULL, 0);
-		pixman_image_composite32(PIXMAN_OP_OVER, boximg, mask, dest,
-					 0, 0, /* src_x, src_y */
-					 0, 0, /* mask_x, mask_y */
-					 0, 0, /* dest_x, dest_y */
-					 dest_width, dest_height);
-
-		pixman_image_unref(boximg);
-	}
+composite_clipped_warn(pixman_image_t *src,
+		       pixman_image_t *mask,
+		       pixman_image_t *dest,
+		       const pixman_transform_t *transform,
+		       pixman_filter_t filter,
+		       pixman_region32_t *src_clip)
+{
+	static bool warned = false;
+	int overdraw;
 
-	if (n_box > 1) {
-		static bool warned = false;
+	overdraw = composite_clipped(src, mask, dest, transform, filter,
+				     src_clip);
 
+	if (overdraw > 1) {
 		if (!warned)
 			weston_log("Pixman-renderer warning: %dx overdraw\n",
-				   n_box);
+				   overdraw);
 		warned = true;
 	}
 }
 
+/* Get an image of the surface contents to composite from. With private
+ * images, the returned image only shares the pixel data with ps->image.
+ */
+static pixman_image_t *
+surface_state_get_source_image(struct pixman_surface_state *ps,
+			       bool private_image)
+{
+	pixman_image_t *image = ps->image;
+
+	if (!private_image)
+		return pixman_image_ref(image);
+
+	if (ps->image_is_solid)
+		return pixman_image_create_solid_fill(&ps->solid_color);
+
+	return pixman_image_create_bits_no_clear(pixman_image_get_format(image),
+						 pixman_image_get_width(image),
+						 pixman_image_get_height(image),
+						 pixman_image_get_data(image),
+						 pixman_image_get_stride(image));
+}
+
 /** Paint an intersected region
  *
  * \param ev The view to be painted.
  * \param output The output being painted.
+ * \param ctx The paint target.
  * \param repaint_output The region to be painted in output coordinates.
  * \param source_clip The region of the source image to use, in source image
  *                    coordinates. If NULL, use the whole source image.
@@ -328,6 +348,7 @@ composite_clipped(pixman_image_t *src,
  */
 static void
 repaint_region(struct weston_view *ev, struct weston_output *output,
+	       struct pixman_paint_context *ctx,
 	       pixman_region32_t *repaint_output,
 	       pixman_region32_t *source_clip,
 	       pixman_op_t pixman_op)
@@ -335,21 +356,30 @@ repaint_region(struct weston_view *ev, struct weston_output *output,
 	struct pixman_renderer *pr =
 		(struct pixman_renderer *) output->compositor->renderer;
 	struct pixman_surface_state *ps = get_surface_state(ev->surface);
-	struct pixman_output_state *po = get_output_state(output);
 	struct weston_buffer_viewport *vp = &ev->surface->buffer_viewport;
-	pixman_image_t *target_image;
+	pixman_image_t *target_image = ctx->target;
+	pixman_image_t *src_image;
+	pixman_image_t *debug_image;
+	pixman_region32_t band_clip;
 	pixman_transform_t transform;
 	pixman_filter_t filter;
 	pixman_image_t *mask_image;
 	pixman_color_t mask = { 0, };
 
-	if (po->shadow_image)
-		target_image = po->shadow_image;
-	else
-		target_image = po->hw_buffer;
-
- 	/* Clip rendering to the damaged output region */
-	pixman_image_set_clip_region32(target_image, repaint_output);
+	/* Clip rendering to the damaged output region */
+	if (ctx->band) {
+		pixman_region32_init(&band_clip);
+		pixman_region32_intersect(&band_clip, repaint_output,
+					  ctx->band);
+		if (!pixman_region32_not_empty(&band_clip)) {
+			pixman_region32_fini(&band_clip);
+			return;
+		}
+		pixman_image_set_clip_region32(target_image, &band_clip);
+		pixman_region32_fini(&band_clip);
+	} else {
+		pixman_image_set_clip_region32(target_image, repaint_output);
+	}
 
 	pixman_renderer_compute_transform(&transform, ev, output);
 
@@ -368,22 +398,34 @@ repaint_region(struct weston_view *ev, struct weston_output *output,
 		mask_image = NULL;
 	}
 
-	if (source_clip)
-		composite_clipped(ps->image, mask_image, target_image,
-				  &transform, filter, source_clip);
+	src_image = surface_state_get_source_image(ps, ctx->private_images);
+
+	if (!src_image)
+		weston_log("Pixman renderer: out of memory\n");
+	else if (source_clip)
+		composite_clipped_warn(src_image, mask_image, target_image,
+				       &transform, filter, source_clip);
 	else
-		composite_whole(pixman_op, ps->image, mask_image,
+		composite_whole(pixman_op, src_image, mask_image,
 				target_image, &transform, filter);
 
+	if (src_image)
+		pixman_image_unref(src_image);
+
 	if (mask_image)
 		pixman_image_unref(mask_image);
 
 	if (ps->buffer_ref.buffer)
 		wl_shm_buffer_end_access(ps->buffer_ref.buffer->shm_buffer);
 
-	if (pr->repaint_debug)
+	if (pr->repaint_debug) {
+		if (ctx->private_images)
+			debug_image = pixman_image_create_solid_fill(&debug_red);
+		else
+			debug_image = pixman_image_ref(pr->debug_color);
+
 		pixman_image_composite32(PIXMAN_OP_OVER,
-					 pr->debug_color, /* src */
+					 debug_image, /* src */
 					 NULL /* mask */,
 					 target_image, /* dest */
 					 0, 0, /* src_x, src_y */
@@ -392,11 +434,15 @@ repaint_region(struct weston_view *ev, struct weston_output *output,
 					 pixman_image_get_width (target_image), /* width */
 					 pixman_image_get_height (target_image) /* height */);
 
+		pixman_image_unref(debug_image);
+	}
+
 	pixman_image_set_clip_region32(target_image, NULL);
 }
 
 static void
 draw_view_translated(struct weston_view *view, struct weston_output *output,
+		     struct pixman_paint_context *ctx,
 		     pixman_region32_t *repaint_global)
 {
 	struct weston_surface *surface = view->surface;
@@ -424,8 +470,8 @@ draw_view_translated(struct weston_view *view, struct weston_output *output,
 							  view);
 			region_global_to_output(output, &repaint_output);
 
-			repaint_region(view, output, &repaint_output, NULL,
-				       PIXMAN_OP_SRC);
+			repaint_region(view, output, ctx, &repaint_output,
+				       NULL, PIXMAN_OP_SRC);
 		}
 	}
 
@@ -435,7 +481,7 @@ draw_view_translated(struct weston_view *view, struct weston_output *output,
 						  &surface_blend, view);
 		region_global_to_output(output, &repaint_output);
 
-		repaint_region(view, output, &repaint_output, NULL,
+		repaint_region(view, output, ctx, &repaint_output, NULL,
 			       PIXMAN_OP_OVER);
 	}
 
@@ -446,6 +492,7 @@ draw_view_translated(struct weston_view *view, struct weston_output *output,
 static void
 draw_view_source_clipped(struct weston_view *view,
 			 struct weston_output *output,
+			 struct pixman_paint_context *ctx,
 			 pixman_region32_t *repaint_global)
 {
 	struct weston_surface *surface = view->surface;
@@ -471,7 +518,7 @@ draw_view_source_clipped(struct weston_view *view,
 	pixman_region32_copy(&repaint_output, repaint_global);
 	region_global_to_output(output, &repaint_output);
 
-	repaint_region(view, output, &repaint_output, &buffer_region,
+	repaint_region(view, output, ctx, &repaint_output, &buffer_region,
 		       PIXMAN_OP_OVER);
 
 	pixman_region32_fini(&repaint_output);
@@ -481,6 +528,7 @@ draw_view_source_clipped(struct weston_view *view,
 
 static void
 draw_view(struct weston_view *ev, struct weston_output *output,
+	  struct pixman_paint_context *ctx,
 	  pixman_region32_t *damage) /* in global coordinates */
 {
 	struct pixman_surface_state *ps = get_surface_state(ev->surface);
@@ -507,7 +555,7 @@ draw_view(struct weston_view *ev, struct weston_output *output,
 		 * Also the boundingbox is accurate rather than an
 		 * approximation.
 		 */
-		draw_view_translated(ev, output, &repaint);
+		draw_view_translated(ev, output, ctx, &repaint);
 	} else {
 		/* The complex case: the view transformation does not allow
 		 * converting opaque etc. regions into global coordinate space.
@@ -516,21 +564,228 @@ draw_view(struct weston_view *ev, struct weston_output *output,
 		 * to be used whole. Source clipping does not work with
 		 * PIXMAN_OP_SRC.
 		 */
-		draw_view_source_clipped(ev, output, &repaint);
+		draw_view_source_clipped(ev, output, ctx, &repaint);
 	}
 
 out:
 	pixman_region32_fini(&repaint);
 }
+
 static void
-repaint_surfaces(struct weston_output *output, pixman_region32_t *damage)
+repaint_surfaces_with_context(struct weston_output *output,
+			      struct pixman_paint_context *ctx,
+			      pixman_region32_t *damage)
 {
 	struct weston_compositor *compositor = output->compositor;
 	struct weston_view *view;
 
 	wl_list_for_each_reverse(view, &compositor->view_list, link)
 		if (view->plane == &compositor->primary_plane)
-			draw_view(view, output, damage);
+			draw_view(view, output, ctx, damage);
+}
+
+/* Paint one band of the repaint in progress. Called with pool->mutex
+ * unlocked, from the compositor thread or a worker.
+ */
+static void
+render_pool_paint_band(struct pixman_render_pool *pool, int band)
+{
+	struct pixman_paint_context ctx;
+	pixman_region32_t band_region;
+	pixman_image_t *target = pool->target;
+	int y1 = pool->band_y1 + band * pool->band_height;
+
+	pixman_region32_init_rect(&band_region,
+				  0, y1,
+				  pixman_image_get_width(target),
+				  pool->band_height);
+
+	ctx.target =
+		pixman_image_create_bits_no_clear(pixman_image_get_format(target),
+						  pixman_image_get_width(target),
+						  pixman_image_get_height(target),
+						  pixman_image_get_data(target),
+						  pixman_image_get_stride(target));
+	ctx.band = &band_region;
+	ctx.private_images = true;
+
+	if (ctx.target) {
+		repaint_surfaces_with_context(pool->output, &ctx,
+					      pool->damage);
+		pixman_image_unref(ctx.target);
+	}
+
+	pixman_region32_fini(&band_region);
+}
+
+/* Take bands of the current repaint until none is left. Called and
+ * returns with pool->mutex locked.
+ */
+static void
+render_pool_run_bands(struct pixman_render_pool *pool)
+{
+	int band;
+
+	while (pool->next_band < pool->n_bands) {
+		band = pool->next_band++;
+
+		pthread_mutex_unlock(&pool->mutex);
+		render_pool_paint_band(pool, band);
+		pthread_mutex_lock(&pool->mutex);
+
+		if (++pool->bands_done == pool->n_bands)
+			pthread_cond_signal(&pool->done_cond);
+	}
+}
+
+static void *
+render_pool_worker(void *data)
+{
+	struct pixman_render_pool *pool = data;
+	uint32_t generation = 0;
+
+	pthread_mutex_lock(&pool->mutex);
+	while (!pool->quit) {
+		if (pool->generation == generation) {
+			pthread_cond_wait(&pool->work_cond, &pool->mutex);
+			continue;
+		}
+
+		generation = pool->generation;
+		render_pool_run_bands(pool);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+static void
+render_pool_destroy(struct pixman_render_pool *pool)
+{
+	int i;
+
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->quit = true;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (i = 0; i < pool->n_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->work_cond);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool);
+}
+
+/* Create a pool for rendering with n_threads threads in total, including
+ * the compositor thread, which takes bands too.
+ */
+static struct pixman_render_pool *
+render_pool_create(int n_threads)
+{
+	struct pixman_render_pool *pool;
+
+	pool = zalloc(sizeof *pool);
+	if (!pool)
+		return NULL;
+
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->work_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+
+	while (pool->n_threads < n_threads - 1) {
+		if (pthread_create(&pool->threads[pool->n_threads], NULL,
+				   render_pool_worker, pool) != 0)
+			break;
+		pool->n_threads++;
+	}
+
+	if (pool->n_threads == 0) {
+		render_pool_destroy(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+/* Split the damaged rows of the target into one band per thread and paint
+ * them in parallel. Every band composites the whole view stack clipped to
+ * its rows, and pixman computes each pixel from its destination
+ * coordinates alone, so the result matches the single-threaded path
+ * exactly.
+ */
+static void
+render_pool_repaint(struct pixman_render_pool *pool,
+		    struct weston_output *output,
+		    pixman_image_t *target,
+		    pixman_region32_t *damage)
+{
+	pixman_region32_t output_damage;
+	pixman_box32_t *extents;
+	int height, n_bands;
+
+	pixman_region32_init(&output_damage);
+	pixman_region32_copy(&output_damage, damage);
+	region_global_to_output(output, &output_damage);
+	extents = pixman_region32_extents(&output_damage);
+	height = extents->y2 - extents->y1;
+	n_bands = MIN(pool->n_threads + 1, height);
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->output = output;
+	pool->damage = damage;
+	pool->target = target;
+	pool->band_y1 = extents->y1;
+	pool->band_height = n_bands > 0 ? (height + n_bands - 1) / n_bands : 0;
+	pool->n_bands = n_bands;
+	pool->next_band = 0;
+	pool->bands_done = 0;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->work_cond);
+
+	render_pool_run_bands(pool);
+	while (pool->bands_done < pool->n_bands)
+		pthread_cond_wait(&pool->done_cond, &pool->mutex);
+
+	pool->output = NULL;
+	pool->damage = NULL;
+	pool->target = NULL;
+	pthread_mutex_unlock(&pool->mutex);
+
+	pixman_region32_fini(&output_damage);
+}
+
+static void
+repaint_surfaces(struct weston_output *output, pixman_region32_t *damage)
+{
+	struct weston_compositor *compositor = output->compositor;
+	struct pixman_renderer *pr = get_renderer(compositor);
+	struct pixman_output_state *po = get_output_state(output);
+	struct pixman_paint_context ctx;
+	struct weston_view *view;
+
+	if (po->shadow_image)
+		ctx.target = po->shadow_image;
+	else
+		ctx.target = po->hw_buffer;
+
+	if (!pr->pool || !pixman_region32_not_empty(damage)) {
+		ctx.band = NULL;
+		ctx.private_images = false;
+		repaint_surfaces_with_context(output, &ctx, damage);
+		return;
+	}
+
+	/* Render threads must not create surface state, do it up front. */
+	wl_list_for_each(view, &compositor->view_list, link)
+		if (view->plane == &compositor->primary_plane)
+			get_surface_state(view->surface);
+
+	render_pool_repaint(pr->pool, output, ctx.target, damage);
 }
 
 static void
@@ -635,6 +890,7 @@ pixman_renderer_attach(struct weston_surface *es, struct weston_buffer *buffer)
 		pixman_image_unref(ps->image);
 		ps->image = NULL;
 	}
+	ps->image_is_solid = false;
 
 	if (!buffer)
 		return;
@@ -766,6 +1022,8 @@ pixman_renderer_surface_set_color(struct weston_surface *es,
 	}
 
 	ps->image = pixman_image_create_solid_fill(&color);
+	ps->image_is_solid = true;
+	ps->solid_color = color;
 }
 
 static void
@@ -775,6 +1033,7 @@ pixman_renderer_destroy(struct weston_compositor *ec)
 
 	wl_signal_emit(&pr->destroy_signal, pr);
 	weston_binding_destroy(pr->debug_binding);
+	render_pool_destroy(pr->pool);
 	free(pr);
 
 	ec->renderer = NULL;
@@ -837,11 +1096,7 @@ debug_binding(struct weston_keyboard *keyboard, const struct timespec *time,
 	pr->repaint_debug ^= 1;
 
 	if (pr->repaint_debug) {
-		pixman_color_t red = {
-			0x3fff, 0x0000, 0x0000, 0x3fff
-		};
-
-		pr->debug_color = pixman_image_create_solid_fill(&red);
+		pr->debug_color = pixman_image_create_solid_fill(&debug_red);
 	} else {
 		pixman_image_unref(pr->debug_color);
 		weston_compositor_damage_all(ec);
@@ -882,6 +1137,18 @@ pixman_renderer_init(struct weston_compositor *ec)
 
 	wl_signal_init(&renderer->destroy_signal);
 
+	if (ec->pixman_render_threads > 1) {
+		renderer->pool = render_pool_create(
+			MIN(ec->pixman_render_threads,
+			    PIXMAN_RENDER_MAX_THREADS));
+		if (renderer->pool)
+			weston_log("Pixman renderer: using %d render threads\n",
+				   renderer->pool->n_threads + 1);
+		else
+			weston_log("Pixman renderer: failed to start render "
+				   "threads, rendering single-threaded\n");
+	}
+
 	return 0;
 }
 
@@ -27,16 +27,20 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 #include <linux/input.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/uio.h>
+#include <pthread.h>
 
 #include "compositor.h"
 #include "shared/helpers.h"
 #include "shared/timespec-util.h"
+#include "wcap-encode.h"
 
 #include "wcap/wcap-decode.h"
 
@@ -209,45 +213,222 @@ weston_screenshooter_shoot(struct weston_output *output,
 	return 0;
 }
 
+/* Frames read back but not yet encoded. When the encoder falls behind by
+ * this many frames, new frames are dropped.
+ */
+#define RECORDER_QUEUE_LENGTH 4
+
+struct recorder_frame {
+	uint32_t msecs;
+	pixman_box32_t *rects;
+	int n_rects;
+	int rects_alloc;
+	uint32_t *pixels;	/* the rectangles as read back, one by one */
+	size_t pixels_alloc;
+};
+
+/* Reading pixels back has to happen on the compositor thread, while the
+ * delta encoding and the writes to the file happen on a worker thread,
+ * fed through a bounded queue of frames. The previous frame that deltas
+ * are computed against belongs to the worker.
+ */
 struct weston_recorder {
 	struct weston_output *output;
-	uint32_t *frame, *rect;
-	uint32_t *tmpbuf;
-	uint32_t total;
+	uint32_t *frame;
+	uint32_t *outbuf;
+	int width, height;
+	int do_yflip;
 	int fd;
+	int index_fd;
+	uint32_t keyframe_interval;
+	uint32_t keyframe_msecs;
+	uint32_t *black_row;
 	struct wl_listener frame_listener;
-	int count, destroying;
+	int destroying;
+
+	pthread_t worker;
+	pthread_mutex_t mutex;
+	pthread_cond_t queue_cond;
+	struct recorder_frame queue[RECORDER_QUEUE_LENGTH];
+	int queue_head, queue_count;
+	bool quit;
+
+	/* Damage of dropped frames, added to the next queued frame. */
+	pixman_region32_t missed_damage;
+	bool dropping;
+
+	/* Written by the worker, read after joining it. */
+	uint64_t total;
+	uint32_t encoded;
+
+	int count, dropped;
 };
 
-static uint32_t *
-output_run(uint32_t *p, uint32_t delta, int run)
+/* Store the frame the decoder has after the last encoded frame in the
+ * index, encoded as one rectangle against black.
+ */
+static void
+recorder_write_keyframe(struct weston_recorder *recorder, uint32_t msecs)
 {
-	int i;
+	static const uint32_t pad;
+	struct wcap_keyframe key;
+	struct wcap_run run;
+	struct iovec v[3];
+	uint32_t *p, *row;
+	int j;
+
+	p = recorder->outbuf;
+	run.length = 0;
+	for (j = 0; j < recorder->height; j++) {
+		row = recorder->frame +
+		      recorder->width * (recorder->height - j - 1);
+		memset(recorder->black_row, 0,
+		       recorder->width * sizeof *recorder->black_row);
+		p = wcap_encode_span(p, &run, recorder->black_row, row,
+				     recorder->width);
+	}
+	p = wcap_encode_flush(p, &run);
+
+	key.msecs = msecs;
+	key.frame = recorder->encoded - 1;
+	key.offset = recorder->total;
+	key.size = p - recorder->outbuf;
+	key.reserved = 0;
+
+	v[0].iov_base = &key;
+	v[0].iov_len = sizeof key;
+	v[1].iov_base = recorder->outbuf;
+	v[1].iov_len = key.size * sizeof *p;
+	v[2].iov_base = (void *) &pad;
+	v[2].iov_len = (key.size & 1) * sizeof pad;
+
+	if (writev(recorder->index_fd, v, 3) < 0) {
+		close(recorder->index_fd);
+		recorder->index_fd = -1;
+	}
 
-	while (run > 0) {
-		if (run <= 0xe0) {
-			*p++ = delta | ((run - 1) << 24);
-			break;
+	recorder->keyframe_msecs = msecs;
+}
+
+static void
+recorder_encode_frame(struct weston_recorder *recorder,
+		      struct recorder_frame *frame)
+{
+	struct {
+		uint32_t msecs;
+		uint32_t nrects;
+	} header;
+	struct iovec v[3];
+	struct wcap_run run;
+	pixman_box32_t *r;
+	uint32_t *p, *s, *d, *pixels;
+	int i, j, width, height;
+	ssize_t ret;
+
+	p = recorder->outbuf;
+	pixels = frame->pixels;
+
+	for (i = 0; i < frame->n_rects; i++) {
+		r = &frame->rects[i];
+		width = r->x2 - r->x1;
+		height = r->y2 - r->y1;
+
+		/* Rows are stored bottom up. */
+		run.length = 0;
+		for (j = 0; j < height; j++) {
+			if (recorder->do_yflip)
+				s = pixels + width * j;
+			else
+				s = pixels + width * (height - j - 1);
+			d = recorder->frame + recorder->width * (r->y2 - j - 1) +
+			    r->x1;
+
+			p = wcap_encode_span(p, &run, d, s, width);
 		}
+		p = wcap_encode_flush(p, &run);
 
-		i = 24 - __builtin_clz(run);
-		*p++ = delta | ((i + 0xe0) << 24);
-		run -= 1 << (7 + i);
+		pixels += width * height;
 	}
 
-	return p;
+	header.msecs = frame->msecs;
+	header.nrects = frame->n_rects;
+	v[0].iov_base = &header;
+	v[0].iov_len = sizeof header;
+	v[1].iov_base = frame->rects;
+	v[1].iov_len = frame->n_rects * sizeof *frame->rects;
+	v[2].iov_base = recorder->outbuf;
+	v[2].iov_len = (p - recorder->outbuf) * sizeof *p;
+
+	ret = writev(recorder->fd, v, 3);
+	if (ret > 0)
+		recorder->total += ret;
+
+	if (recorder->encoded++ == 0)
+		recorder->keyframe_msecs = frame->msecs;
+	else if (recorder->index_fd >= 0 &&
+		 frame->msecs - recorder->keyframe_msecs >=
+		 recorder->keyframe_interval)
+		recorder_write_keyframe(recorder, frame->msecs);
 }
 
-static uint32_t
-component_delta(uint32_t next, uint32_t prev)
+static void *
+recorder_worker(void *data)
 {
-	unsigned char dr, dg, db;
+	struct weston_recorder *recorder = data;
+	struct recorder_frame *frame;
+
+	pthread_mutex_lock(&recorder->mutex);
+	for (;;) {
+		if (recorder->queue_count == 0) {
+			if (recorder->quit)
+				break;
+			pthread_cond_wait(&recorder->queue_cond,
+					  &recorder->mutex);
+			continue;
+		}
 
-	dr = (next >> 16) - (prev >> 16);
-	dg = (next >>  8) - (prev >>  8);
-	db = (next >>  0) - (prev >>  0);
+		/* The frame stays in the queue while it is encoded, so the
+		 * compositor thread does not reuse it. */
+		frame = &recorder->queue[recorder->queue_head];
+		pthread_mutex_unlock(&recorder->mutex);
+
+		recorder_encode_frame(recorder, frame);
+
+		pthread_mutex_lock(&recorder->mutex);
+		recorder->queue_head = (recorder->queue_head + 1) %
+				       RECORDER_QUEUE_LENGTH;
+		recorder->queue_count--;
+	}
+	pthread_mutex_unlock(&recorder->mutex);
 
-	return (dr << 16) | (dg << 8) | (db << 0);
+	return NULL;
+}
+
+/* Make room for the damage rectangles and their pixels in a free frame. */
+static int
+recorder_frame_reserve(struct recorder_frame *frame, int n_rects,
+		       size_t n_pixels)
+{
+	pixman_box32_t *rects;
+	uint32_t *pixels;
+
+	if (n_rects > frame->rects_alloc) {
+		rects = realloc(frame->rects, n_rects * sizeof *rects);
+		if (!rects)
+			return -1;
+		frame->rects = rects;
+		frame->rects_alloc = n_rects;
+	}
+
+	if (n_pixels > frame->pixels_alloc) {
+		pixels = realloc(frame->pixels, n_pixels * sizeof *pixels);
+		if (!pixels)
+			return -1;
+		frame->pixels = pixels;
+		frame->pixels_alloc = n_pixels;
+	}
+
+	return 0;
 }
 
 static void
@@ -260,25 +441,13 @@ weston_recorder_frame_notify(struct wl_listener *listener, void *data)
 		container_of(listener, struct weston_recorder, frame_listener);
 	struct weston_output *output = data;
 	struct weston_compositor *compositor = output->compositor;
-	uint32_t msecs = timespec_to_msec(&output->frame_time);
+	struct recorder_frame *frame = NULL;
 	pixman_box32_t *r;
 	pixman_region32_t damage, transformed_damage;
-	int i, j, k, n, width, height, run, stride;
-	uint32_t delta, prev, *d, *s, *p, next;
-	struct {
-		uint32_t msecs;
-		uint32_t nrects;
-	} header;
-	struct iovec v[2];
-	int do_yflip;
+	uint32_t *pixels;
+	size_t n_pixels = 0;
+	int i, n, width, height;
 	int y_orig;
-	uint32_t *outbuf;
-
-	do_yflip = !!(compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP);
-	if (do_yflip)
-		outbuf = recorder->rect;
-	else
-		outbuf = recorder->tmpbuf;
 
 	pixman_region32_init(&damage);
 	pixman_region32_init(&transformed_damage);
@@ -290,75 +459,68 @@ weston_recorder_frame_notify(struct wl_listener *listener, void *data)
 				 &damage, &transformed_damage);
 	pixman_region32_fini(&damage);
 
+	pixman_region32_union(&transformed_damage, &transformed_damage,
+			      &recorder->missed_damage);
+
 	r = pixman_region32_rectangles(&transformed_damage, &n);
-	if (n == 0) {
-		pixman_region32_fini(&transformed_damage);
-		return;
+	if (n == 0)
+		goto out;
+
+	for (i = 0; i < n; i++)
+		n_pixels += (size_t)(r[i].x2 - r[i].x1) * (r[i].y2 - r[i].y1);
+
+	pthread_mutex_lock(&recorder->mutex);
+	if (recorder->queue_count < RECORDER_QUEUE_LENGTH)
+		frame = &recorder->queue[(recorder->queue_head +
+					  recorder->queue_count) %
+					 RECORDER_QUEUE_LENGTH];
+	pthread_mutex_unlock(&recorder->mutex);
+
+	/* The decoder only sees damaged rectangles, so the damage of a
+	 * dropped frame has to be recorded with the next one. */
+	if (!frame || recorder_frame_reserve(frame, n, n_pixels) < 0) {
+		if (!recorder->dropping)
+			weston_log("recorder on output %s falls behind, "
+				   "dropping frames\n", output->name);
+		recorder->dropping = true;
+		recorder->dropped++;
+		pixman_region32_copy(&recorder->missed_damage,
+				     &transformed_damage);
+		goto out;
 	}
+	recorder->dropping = false;
+	pixman_region32_clear(&recorder->missed_damage);
 
-	header.msecs = msecs;
-	header.nrects = n;
-	v[0].iov_base = &header;
-	v[0].iov_len = sizeof header;
-	v[1].iov_base = r;
-	v[1].iov_len = n * sizeof *r;
-	recorder->total += writev(recorder->fd, v, 2);
-	stride = output->current_mode->width;
+	frame->msecs = timespec_to_msec(&output->frame_time);
+	frame->n_rects = n;
+	memcpy(frame->rects, r, n * sizeof *r);
 
+	pixels = frame->pixels;
 	for (i = 0; i < n; i++) {
 		width = r[i].x2 - r[i].x1;
 		height = r[i].y2 - r[i].y1;
 
-		if (do_yflip)
+		if (recorder->do_yflip)
 			y_orig = output->current_mode->height - r[i].y2;
 		else
 			y_orig = r[i].y1;
 
 		compositor->renderer->read_pixels(output,
-				compositor->read_format, recorder->rect,
+				compositor->read_format, pixels,
 				r[i].x1, y_orig, width, height);
 
-		p = outbuf;
-		run = prev = 0; /* quiet gcc */
-		for (j = 0; j < height; j++) {
-			if (do_yflip)
-				s = recorder->rect + width * j;
-			else
-				s = recorder->rect + width * (height - j - 1);
-			y_orig = r[i].y2 - j - 1;
-			d = recorder->frame + stride * y_orig + r[i].x1;
-
-			for (k = 0; k < width; k++) {
-				next = *s++;
-				delta = component_delta(next, *d);
-				*d++ = next;
-				if (run == 0 || delta == prev) {
-					run++;
-				} else {
-					p = output_run(p, prev, run);
-					run = 1;
-				}
-				prev = delta;
-			}
-		}
-
-		p = output_run(p, prev, run);
+		pixels += width * height;
+	}
 
-		recorder->total += write(recorder->fd,
-					 outbuf, (p - outbuf) * 4);
+	pthread_mutex_lock(&recorder->mutex);
+	recorder->queue_count++;
+	pthread_cond_signal(&recorder->queue_cond);
+	pthread_mutex_unlock(&recorder->mutex);
 
-#if 0
-		fprintf(stderr,
-			"%dx%d at %d,%d rle from %d to %d bytes (%f) total %dM\n",
-			width, height, r[i].x1, r[i].y1,
-			width * height * 4, (int) (p - outbuf) * 4,
-			(float) (p - outbuf) / (width * height),
-			recorder->total / 1024 / 1024);
-#endif
-	}
+	recorder->count++;
 
+out:
 	pixman_region32_fini(&transformed_damage);
-	recorder->count++;
 
 	if (recorder->destroying)
 		weston_recorder_destroy(recorder);
@@ -367,25 +529,70 @@ weston_recorder_frame_notify(struct wl_listener *listener, void *data)
 static void
 weston_recorder_free(struct weston_recorder *recorder)
 {
+	int i;
+
 	if (recorder == NULL)
 		return;
 
-	free(recorder->tmpbuf);
-	free(recorder->rect);
+	for (i = 0; i < RECORDER_QUEUE_LENGTH; i++) {
+		free(recorder->queue[i].rects);
+		free(recorder->queue[i].pixels);
+	}
+	pixman_region32_fini(&recorder->missed_damage);
+	free(recorder->black_row);
+	free(recorder->outbuf);
 	free(recorder->frame);
 	free(recorder);
 }
 
+/* Keyframes go to a seek index next to the capture. The capture is still
+ * recorded when the index can not be written.
+ */
+static void
+recorder_open_index(struct weston_recorder *recorder, const char *filename,
+		    int32_t interval)
+{
+	struct wcap_index_header header;
+	char *name;
+
+	recorder->black_row = malloc(recorder->width *
+				     sizeof *recorder->black_row);
+	if (!recorder->black_row ||
+	    asprintf(&name, "%s.idx", filename) < 0) {
+		weston_log("%s: out of memory\n", __func__);
+		return;
+	}
+
+	recorder->index_fd = open(name, O_WRONLY | O_CREAT | O_TRUNC |
+				  O_CLOEXEC, 0644);
+	if (recorder->index_fd < 0) {
+		weston_log("problem opening index file %s: %m\n", name);
+		free(name);
+		return;
+	}
+	free(name);
+
+	header.magic = WCAP_INDEX_MAGIC;
+	header.width = recorder->width;
+	header.height = recorder->height;
+	header.reserved = 0;
+	if (write(recorder->index_fd, &header, sizeof header) !=
+	    sizeof header) {
+		close(recorder->index_fd);
+		recorder->index_fd = -1;
+		return;
+	}
+
+	recorder->keyframe_interval = interval;
+}
+
 static struct weston_recorder *
 weston_recorder_create(struct weston_output *output, const char *filename)
 {
 	struct weston_compositor *compositor = output->compositor;
 	struct weston_recorder *recorder;
-	int stride, size;
+	int size;
 	struct { uint32_t magic, format, width, height; } header;
-	int do_yflip;
-
-	do_yflip = !!(compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP);
 
 	recorder = zalloc(sizeof *recorder);
 	if (recorder == NULL) {
@@ -393,25 +600,25 @@ weston_recorder_create(struct weston_output *output, const char *filename)
 		return NULL;
 	}
 
-	stride = output->current_mode->width;
-	size = stride * 4 * output->current_mode->height;
+	pixman_region32_init(&recorder->missed_damage);
+	recorder->index_fd = -1;
+	recorder->do_yflip =
+		!!(compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP);
+	recorder->width = output->current_mode->width;
+	recorder->height = output->current_mode->height;
+
+	/* Damage rectangles do not overlap and a pixel never encodes to
+	 * more than one word, so a frame fits in the size of the output. */
+	size = recorder->width * 4 * recorder->height;
 	recorder->frame = zalloc(size);
-	recorder->rect = malloc(size);
+	recorder->outbuf = malloc(size);
 	recorder->output = output;
 
-	if ((recorder->frame == NULL) || (recorder->rect == NULL)) {
+	if ((recorder->frame == NULL) || (recorder->outbuf == NULL)) {
 		weston_log("%s: out of memory\n", __func__);
 		goto err_recorder;
 	}
 
-	if (!do_yflip) {
-		recorder->tmpbuf = malloc(size);
-		if (recorder->tmpbuf == NULL) {
-			weston_log("%s: out of memory\n", __func__);
-			goto err_recorder;
-		}
-	}
-
 	header.magic = WCAP_HEADER_MAGIC;
 
 	switch (compositor->read_format) {
@@ -435,10 +642,30 @@ weston_recorder_create(struct weston_output *output, const char *filename)
 		goto err_recorder;
 	}
 
-	header.width = output->current_mode->width;
-	header.height = output->current_mode->height;
+	header.width = recorder->width;
+	header.height = recorder->height;
 	recorder->total += write(recorder->fd, &header, sizeof header);
 
+	if (compositor->recorder_keyframe_interval > 0)
+		recorder_open_index(recorder, filename,
+				    compositor->recorder_keyframe_interval);
+
+	pthread_mutex_init(&recorder->mutex, NULL);
+	pthread_cond_init(&recorder->queue_cond, NULL);
+	if (pthread_create(&recorder->worker, NULL,
+			   recorder_worker, recorder) != 0) {
+		weston_log("failed to start the recorder thread\n");
+		pthread_cond_destroy(&recorder->queue_cond);
+		pthread_mutex_destroy(&recorder->mutex);
+		if (recorder->index_fd >= 0)
+			close(recorder->index_fd);
+		close(recorder->fd);
+		goto err_recorder;
+	}
+
+	weston_log("recorder using the %s encoder\n",
+		   wcap_encode_impl_name());
+
 	recorder->frame_listener.notify = weston_recorder_frame_notify;
 	wl_signal_add(&output->frame_signal, &recorder->frame_listener);
 	output->disable_planes++;
@@ -455,6 +682,23 @@ static void
 weston_recorder_destroy(struct weston_recorder *recorder)
 {
 	wl_list_remove(&recorder->frame_listener.link);
+
+	/* The worker encodes the queued frames before it quits. */
+	pthread_mutex_lock(&recorder->mutex);
+	recorder->quit = true;
+	pthread_cond_signal(&recorder->queue_cond);
+	pthread_mutex_unlock(&recorder->mutex);
+	pthread_join(recorder->worker, NULL);
+	pthread_cond_destroy(&recorder->queue_cond);
+	pthread_mutex_destroy(&recorder->mutex);
+
+	weston_log("stopping recorder, total file size %" PRIu64 "M, "
+		   "%d frames, %d dropped\n",
+		   recorder->total / (1024 * 1024), recorder->count,
+		   recorder->dropped);
+
+	if (recorder->index_fd >= 0)
+		close(recorder->index_fd);
 	close(recorder->fd);
 	recorder->output->disable_planes--;
 	weston_recorder_free(recorder);
@@ -481,9 +725,6 @@ weston_recorder_start(struct weston_output *output, const char *filename)
 WL_EXPORT void
 weston_recorder_stop(struct weston_recorder *recorder)
 {
-	weston_log("stopping recorder, total file size %dM, %d frames\n",
-		   recorder->total / (1024 * 1024), recorder->count);
-
 	recorder->destroying = 1;
 	weston_output_schedule_repaint(recorder->output);
 }
@@ -0,0 +1,96 @@
+/*
+ * Copyright © 2014 Pekka Paalanen <pq@iki.fi>
+ * Copyright © 2014 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef WESTON_TIMELINE_BINARY_H
+#define WESTON_TIMELINE_BINARY_H
+
+#include <stdint.h>
+
+/*
+ * Binary timeline log format.
+ *
+ * The file starts with a struct weston_timeline_file_header, followed by
+ * fixed-size struct weston_timeline_record entries in host byte order.
+ * Point records refer to names and objects by id; a NAME, OUTPUT or
+ * SURFACE record always precedes the first point that refers to it.
+ * weston-timeline-convert turns a log into JSON or Chrome trace events.
+ */
+
+#define WESTON_TIMELINE_MAGIC "WTLB"
+#define WESTON_TIMELINE_VERSION 1
+#define WESTON_TIMELINE_MAX_ARGS 4
+
+struct weston_timeline_file_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t clock_id;
+};
+
+enum weston_timeline_record_type {
+	WESTON_TIMELINE_RECORD_POINT = 1,	/* u.point */
+	WESTON_TIMELINE_RECORD_NAME,		/* u.name */
+	WESTON_TIMELINE_RECORD_OUTPUT,		/* u.object */
+	WESTON_TIMELINE_RECORD_SURFACE,		/* u.object */
+	WESTON_TIMELINE_RECORD_DROPPED,		/* u.dropped */
+};
+
+struct weston_timeline_arg {
+	uint32_t type;		/* enum timeline_type */
+	uint32_t id;		/* object id for TLT_OUTPUT and TLT_SURFACE */
+	int64_t tv_sec;		/* timestamp for TLT_VBLANK and TLT_GPU */
+	int64_t tv_nsec;
+};
+
+struct weston_timeline_record {
+	uint32_t type;		/* enum weston_timeline_record_type */
+	uint32_t n_args;
+	union {
+		struct {
+			int64_t tv_sec;
+			int64_t tv_nsec;
+			/* In the compositor ring the const char * passed
+			 * to TL_POINT(), in the file a name record id. */
+			uint64_t name;
+			struct weston_timeline_arg args[WESTON_TIMELINE_MAX_ARGS];
+		} point;
+		struct {
+			uint32_t id;
+			char str[116];
+		} name;
+		struct {
+			uint32_t id;
+			uint32_t main_surface;	/* 0 if none */
+			char desc[112];		/* empty if none */
+		} object;
+		struct {
+			uint64_t count;		/* points lost since last */
+		} dropped;
+		uint8_t pad[120];
+	} u;
+};
+
+#endif /* WESTON_TIMELINE_BINARY_H */
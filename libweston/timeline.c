@@ -27,30 +27,186 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
 #include <errno.h>
 #include <string.h>
+#include <stdint.h>
 #include <time.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "timeline.h"
+#include "timeline-binary.h"
 #include "compositor.h"
 #include "file-util.h"
 
+/* Records are produced by the compositor thread only and consumed by the
+ * writer thread only, so the ring needs no lock: head is written by the
+ * producer and tail by the consumer, each published with release
+ * semantics. Must be a power of two.
+ */
+#define TIMELINE_RING_SIZE 16384
+#define TIMELINE_WRITER_PERIOD_MS 10
+
 struct timeline_log {
 	clock_t clk_id;
 	FILE *file;
 	unsigned series;
 	struct wl_listener compositor_destroy_listener;
+
+	struct weston_timeline_record *ring;
+	uint32_t head;		/* next record to produce */
+	uint32_t tail;		/* next record to consume */
+	uint64_t dropped;	/* written by the producer only */
+
+	pthread_t writer;
+	int quit;
+
+	/* Writer thread state */
+	const char **names;	/* index + 1 is the name record id */
+	unsigned n_names;
+	unsigned names_alloc;
+	uint64_t dropped_written;
 };
 
 WL_EXPORT int weston_timeline_enabled_;
 static struct timeline_log timeline_ = { CLOCK_MONOTONIC, NULL, 0 };
 
+static struct weston_timeline_record *
+timeline_ring_reserve(void)
+{
+	uint32_t tail = __atomic_load_n(&timeline_.tail, __ATOMIC_ACQUIRE);
+
+	if (timeline_.head - tail >= TIMELINE_RING_SIZE) {
+		__atomic_add_fetch(&timeline_.dropped, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	return &timeline_.ring[timeline_.head & (TIMELINE_RING_SIZE - 1)];
+}
+
+static void
+timeline_ring_commit(void)
+{
+	__atomic_store_n(&timeline_.head, timeline_.head + 1,
+			 __ATOMIC_RELEASE);
+}
+
+static uint32_t
+timeline_name_id(const char *name)
+{
+	const char **names;
+	unsigned i;
+
+	/* Names are string literals, so comparing pointers is enough to
+	 * find them again. There are only a few dozen of them. */
+	for (i = 0; i < timeline_.n_names; i++)
+		if (timeline_.names[i] == name)
+			return i + 1;
+
+	if (timeline_.n_names == timeline_.names_alloc) {
+		names = realloc(timeline_.names,
+				(timeline_.names_alloc + 32) * sizeof *names);
+		if (!names)
+			return 0;
+		timeline_.names = names;
+		timeline_.names_alloc += 32;
+	}
+
+	timeline_.names[timeline_.n_names++] = name;
+
+	return timeline_.n_names;
+}
+
+static void
+timeline_write_record(struct weston_timeline_record *rec)
+{
+	struct weston_timeline_record out;
+	const char *name;
+	unsigned n_names = timeline_.n_names;
+	uint32_t id;
+
+	if (rec->type == WESTON_TIMELINE_RECORD_POINT) {
+		name = (const char *)(uintptr_t) rec->u.point.name;
+		id = timeline_name_id(name);
+		if (id > n_names) {
+			memset(&out, 0, sizeof out);
+			out.type = WESTON_TIMELINE_RECORD_NAME;
+			out.u.name.id = id;
+			snprintf(out.u.name.str, sizeof out.u.name.str,
+				 "%s", name);
+			fwrite(&out, sizeof out, 1, timeline_.file);
+		}
+		rec->u.point.name = id;
+	}
+
+	fwrite(rec, sizeof *rec, 1, timeline_.file);
+}
+
+static void
+timeline_write_dropped(void)
+{
+	struct weston_timeline_record out;
+	uint64_t dropped;
+
+	dropped = __atomic_load_n(&timeline_.dropped, __ATOMIC_RELAXED);
+	if (dropped == timeline_.dropped_written)
+		return;
+
+	memset(&out, 0, sizeof out);
+	out.type = WESTON_TIMELINE_RECORD_DROPPED;
+	out.u.dropped.count = dropped - timeline_.dropped_written;
+	fwrite(&out, sizeof out, 1, timeline_.file);
+
+	timeline_.dropped_written = dropped;
+}
+
+static void *
+timeline_writer_thread(void *data)
+{
+	struct timespec period = {
+		0, TIMELINE_WRITER_PERIOD_MS * 1000000L
+	};
+	uint32_t head, tail;
+	int quit;
+
+	tail = timeline_.tail;
+	do {
+		quit = __atomic_load_n(&timeline_.quit, __ATOMIC_ACQUIRE);
+		head = __atomic_load_n(&timeline_.head, __ATOMIC_ACQUIRE);
+
+		timeline_write_dropped();
+
+		if (tail == head) {
+			if (!quit)
+				nanosleep(&period, NULL);
+			continue;
+		}
+
+		while (tail != head) {
+			timeline_write_record(
+				&timeline_.ring[tail & (TIMELINE_RING_SIZE - 1)]);
+			tail++;
+			__atomic_store_n(&timeline_.tail, tail,
+					 __ATOMIC_RELEASE);
+		}
+		fflush(timeline_.file);
+	} while (!quit || tail != head);
+
+	return NULL;
+}
+
 static int
 weston_timeline_do_open(void)
 {
 	const char *prefix = "weston-timeline-";
-	const char *suffix = ".log";
+	const char *suffix = ".bin";
+	struct weston_timeline_file_header header = {
+		.version = WESTON_TIMELINE_VERSION,
+		.record_size = sizeof(struct weston_timeline_record),
+		.clock_id = timeline_.clk_id,
+	};
 	char fname[1000];
 
 	timeline_.file = file_create_dated(NULL, prefix, suffix,
@@ -71,9 +227,38 @@ weston_timeline_do_open(void)
 		return -1;
 	}
 
+	memcpy(header.magic, WESTON_TIMELINE_MAGIC, sizeof header.magic);
+	fwrite(&header, sizeof header, 1, timeline_.file);
+
+	timeline_.ring = calloc(TIMELINE_RING_SIZE, sizeof *timeline_.ring);
+	if (!timeline_.ring)
+		goto err_file;
+
+	timeline_.head = 0;
+	timeline_.tail = 0;
+	timeline_.dropped = 0;
+	timeline_.dropped_written = 0;
+	timeline_.n_names = 0;
+	timeline_.quit = 0;
+
+	if (pthread_create(&timeline_.writer, NULL,
+			   timeline_writer_thread, NULL) != 0) {
+		weston_log("Cannot start the timeline writer thread.\n");
+		goto err_ring;
+	}
+
 	weston_log("Opened timeline file '%s'\n", fname);
 
 	return 0;
+
+err_ring:
+	free(timeline_.ring);
+	timeline_.ring = NULL;
+err_file:
+	fclose(timeline_.file);
+	timeline_.file = NULL;
+
+	return -1;
 }
 
 static void
@@ -111,17 +296,26 @@ weston_timeline_close(void)
 
 	wl_list_remove(&timeline_.compositor_destroy_listener.link);
 
+	/* The writer drains the ring before it exits. */
+	__atomic_store_n(&timeline_.quit, 1, __ATOMIC_RELEASE);
+	pthread_join(timeline_.writer, NULL);
+
+	if (timeline_.dropped)
+		weston_log("Timeline dropped %llu points, the writer could "
+			   "not keep up.\n",
+			   (unsigned long long) timeline_.dropped);
+
+	free(timeline_.names);
+	timeline_.names = NULL;
+	timeline_.names_alloc = 0;
+	free(timeline_.ring);
+	timeline_.ring = NULL;
+
 	fclose(timeline_.file);
 	timeline_.file = NULL;
 	weston_log("Timeline log file closed.\n");
 }
 
-struct timeline_emit_context {
-	FILE *cur;
-	FILE *out;
-	unsigned series;
-};
-
 static unsigned
 timeline_new_id(void)
 {
@@ -134,11 +328,10 @@ timeline_new_id(void)
 }
 
 static int
-check_series(struct timeline_emit_context *ctx,
-	     struct weston_timeline_object *to)
+check_series(struct weston_timeline_object *to)
 {
-	if (to->series == 0 || to->series != ctx->series) {
-		to->series = ctx->series;
+	if (to->series == 0 || to->series != timeline_.series) {
+		to->series = timeline_.series;
 		to->id = timeline_new_id();
 		return 1;
 	}
@@ -151,107 +344,77 @@ check_series(struct timeline_emit_context *ctx,
 	return 0;
 }
 
-static void
-fprint_quoted_string(FILE *fp, const char *str)
+/* Object descriptions are queued only when an object is first seen in a
+ * series, or refreshed. That is rare, so formatting them here is fine.
+ * If the ring is full, this returns -1 and the description is retried on
+ * the next point.
+ */
+static int
+emit_object(struct weston_timeline_object *to, uint32_t type, uint32_t id,
+	    uint32_t main_surface, const char *desc)
 {
-	if (!str) {
-		fprintf(fp, "null");
-		return;
+	struct weston_timeline_record *rec;
+
+	rec = timeline_ring_reserve();
+	if (!rec) {
+		to->force_refresh = 1;
+		return -1;
 	}
 
-	fprintf(fp, "\"%s\"", str);
+	rec->type = type;
+	rec->n_args = 0;
+	rec->u.object.id = id;
+	rec->u.object.main_surface = main_surface;
+	snprintf(rec->u.object.desc, sizeof rec->u.object.desc, "%s",
+		 desc ? desc : "");
+
+	timeline_ring_commit();
+
+	return 0;
 }
 
-static int
-emit_weston_output(struct timeline_emit_context *ctx, void *obj)
+/* The check functions return the object id, or 0 if the object record
+ * could not be queued, in which case no point may refer to it yet. */
+static uint32_t
+check_weston_output(struct weston_output *o)
 {
-	struct weston_output *o = obj;
-
-	if (check_series(ctx, &o->timeline)) {
-		fprintf(ctx->out, "{ \"id\":%u, "
-			"\"type\":\"weston_output\", \"name\":",
-			o->timeline.id);
-		fprint_quoted_string(ctx->out, o->name);
-		fprintf(ctx->out, " }\n");
-	}
+	if (check_series(&o->timeline) &&
+	    emit_object(&o->timeline, WESTON_TIMELINE_RECORD_OUTPUT,
+			o->timeline.id, 0, o->name) < 0)
+		return 0;
 
-	fprintf(ctx->cur, "\"wo\":%u", o->timeline.id);
-
-	return 1;
+	return o->timeline.id;
 }
 
-static void
-check_weston_surface_description(struct timeline_emit_context *ctx,
-				 struct weston_surface *s)
+static uint32_t
+check_weston_surface(struct weston_surface *s)
 {
 	struct weston_surface *mains;
+	uint32_t main_id = 0;
 	char d[512];
-	char mainstr[32];
 
-	if (!check_series(ctx, &s->timeline))
-		return;
+	if (!check_series(&s->timeline))
+		return s->timeline.id;
 
 	mains = weston_surface_get_main_surface(s);
 	if (mains != s) {
-		check_weston_surface_description(ctx, mains);
-		if (snprintf(mainstr, sizeof(mainstr),
-			     ", \"main_surface\":%u", mains->timeline.id) < 0)
-			mainstr[0] = '\0';
-	} else {
-		mainstr[0] = '\0';
+		main_id = check_weston_surface(mains);
+		if (main_id == 0) {
+			s->timeline.force_refresh = 1;
+			return 0;
+		}
 	}
 
 	if (!s->get_label || s->get_label(s, d, sizeof(d)) < 0)
 		d[0] = '\0';
 
-	fprintf(ctx->out, "{ \"id\":%u, "
-		"\"type\":\"weston_surface\", \"desc\":", s->timeline.id);
-	fprint_quoted_string(ctx->out, d[0] ? d : NULL);
-	fprintf(ctx->out, "%s }\n", mainstr);
-}
+	if (emit_object(&s->timeline, WESTON_TIMELINE_RECORD_SURFACE,
+			s->timeline.id, main_id, d) < 0)
+		return 0;
 
-static int
-emit_weston_surface(struct timeline_emit_context *ctx, void *obj)
-{
-	struct weston_surface *s = obj;
-
-	check_weston_surface_description(ctx, s);
-	fprintf(ctx->cur, "\"ws\":%u", s->timeline.id);
-
-	return 1;
+	return s->timeline.id;
 }
 
-static int
-emit_vblank_timestamp(struct timeline_emit_context *ctx, void *obj)
-{
-	struct timespec *ts = obj;
-
-	fprintf(ctx->cur, "\"vblank\":[%" PRId64 ", %ld]",
-		(int64_t)ts->tv_sec, ts->tv_nsec);
-
-	return 1;
-}
-
-static int
-emit_gpu_timestamp(struct timeline_emit_context *ctx, void *obj)
-{
-	struct timespec *ts = obj;
-
-	fprintf(ctx->cur, "\"gpu\":[%" PRId64 ", %ld]",
-		(int64_t)ts->tv_sec, ts->tv_nsec);
-
-	return 1;
-}
-
-typedef int (*type_func)(struct timeline_emit_context *ctx, void *obj);
-
-static const type_func type_dispatch[] = {
-	[TLT_OUTPUT] = emit_weston_output,
-	[TLT_SURFACE] = emit_weston_surface,
-	[TLT_VBLANK] = emit_vblank_timestamp,
-	[TLT_GPU] = emit_gpu_timestamp,
-};
-
 WL_EXPORT void
 weston_timeline_point(const char *name, ...)
 {
@@ -259,24 +422,15 @@ weston_timeline_point(const char *name, ...)
 	struct timespec ts;
 	enum timeline_type otype;
 	void *obj;
-	char buf[512];
-	struct timeline_emit_context ctx;
+	struct weston_timeline_arg args[WESTON_TIMELINE_MAX_ARGS];
+	struct weston_timeline_record *rec;
+	const struct timespec *t;
+	unsigned n_args = 0;
+	int complete = 1;
 
 	clock_gettime(timeline_.clk_id, &ts);
 
-	ctx.out = timeline_.file;
-	ctx.cur = fmemopen(buf, sizeof(buf), "w");
-	ctx.series = timeline_.series;
-
-	if (!ctx.cur) {
-		weston_log("Timeline error in fmemopen, closing.\n");
-		weston_timeline_close();
-		return;
-	}
-
-	fprintf(ctx.cur, "{ \"T\":[%" PRId64 ", %ld], \"N\":\"%s\"",
-		(int64_t)ts.tv_sec, ts.tv_nsec, name);
-
+	/* Object descriptions must be queued before the point itself. */
 	va_start(argp, name);
 	while (1) {
 		otype = va_arg(argp, enum timeline_type);
@@ -284,21 +438,54 @@ weston_timeline_point(const char *name, ...)
 			break;
 
 		obj = va_arg(argp, void *);
-		if (type_dispatch[otype]) {
-			fprintf(ctx.cur, ", ");
-			type_dispatch[otype](&ctx, obj);
+		if (n_args == WESTON_TIMELINE_MAX_ARGS)
+			continue;
+
+		args[n_args].type = otype;
+		args[n_args].id = 0;
+		args[n_args].tv_sec = 0;
+		args[n_args].tv_nsec = 0;
+
+		switch (otype) {
+		case TLT_OUTPUT:
+			args[n_args].id = check_weston_output(obj);
+			if (args[n_args].id == 0)
+				complete = 0;
+			break;
+		case TLT_SURFACE:
+			args[n_args].id = check_weston_surface(obj);
+			if (args[n_args].id == 0)
+				complete = 0;
+			break;
+		case TLT_VBLANK:
+		case TLT_GPU:
+			t = obj;
+			args[n_args].tv_sec = t->tv_sec;
+			args[n_args].tv_nsec = t->tv_nsec;
+			break;
+		default:
+			continue;
 		}
+		n_args++;
 	}
 	va_end(argp);
 
-	fprintf(ctx.cur, " }\n");
-	fflush(ctx.cur);
-	if (ferror(ctx.cur)) {
-		weston_log("Timeline error in constructing entry, closing.\n");
-		weston_timeline_close();
-	} else {
-		fprintf(ctx.out, "%s", buf);
+	/* A point must not precede the record of an object it refers to. */
+	if (!complete) {
+		__atomic_add_fetch(&timeline_.dropped, 1, __ATOMIC_RELAXED);
+		return;
 	}
 
-	fclose(ctx.cur);
+	rec = timeline_ring_reserve();
+	if (!rec)
+		return;
+
+	rec->type = WESTON_TIMELINE_RECORD_POINT;
+	rec->n_args = n_args;
+	rec->u.point.tv_sec = ts.tv_sec;
+	rec->u.point.tv_nsec = ts.tv_nsec;
+	rec->u.point.name = (uintptr_t) name;
+	memcpy(rec->u.point.args, args, n_args * sizeof args[0]);
+
+	timeline_ring_commit();
 }
@@ -61,6 +61,9 @@ enum timeline_type {
 		weston_timeline_point(__VA_ARGS__); \
 } while (0)
 
+/* The point name is stored by pointer and resolved by the timeline writer
+ * thread later, so it must have static storage, e.g. a string literal.
+ */
 void
 weston_timeline_point(const char *name, ...);
 
@@ -0,0 +1,257 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * WCAP frame encoder. Every rectangle of a frame is stored as the
+ * per-channel difference to the previous frame, run length encoded across
+ * rows. The vector paths compute the differences several pixels at a
+ * time and extend the current run without looking at individual pixels
+ * when they all continue it, which is the common case for the unchanged
+ * parts of a damaged rectangle.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <pthread.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_WCAP_AVX2 1
+#endif
+
+#include "wcap-encode.h"
+
+/* Only the color channels are encoded, the top byte holds run lengths. */
+#define DELTA_MASK 0x00ffffff
+
+static uint32_t *
+output_run(uint32_t *p, uint32_t delta, int run)
+{
+	int i;
+
+	while (run > 0) {
+		if (run <= 0xe0) {
+			*p++ = delta | ((run - 1) << 24);
+			break;
+		}
+
+		i = 24 - __builtin_clz(run);
+		*p++ = delta | ((i + 0xe0) << 24);
+		run -= 1 << (7 + i);
+	}
+
+	return p;
+}
+
+static uint32_t
+component_delta(uint32_t next, uint32_t prev)
+{
+	unsigned char dr, dg, db;
+
+	dr = (next >> 16) - (prev >> 16);
+	dg = (next >>  8) - (prev >>  8);
+	db = (next >>  0) - (prev >>  0);
+
+	return (dr << 16) | (dg << 8) | (db << 0);
+}
+
+static inline uint32_t *
+push_delta(uint32_t *p, struct wcap_run *run, uint32_t delta)
+{
+	if (run->length == 0 || delta == run->delta) {
+		run->length++;
+	} else {
+		p = output_run(p, run->delta, run->length);
+		run->length = 1;
+	}
+	run->delta = delta;
+
+	return p;
+}
+
+/** Encode a span of pixels against the previous frame
+ *
+ * \param p Where to write the encoded words.
+ * \param run The run of the rectangle being encoded.
+ * \param ref The span in the previous frame, updated to src.
+ * \param src The new pixels.
+ * \param n The number of pixels.
+ * \return The end of the encoded words.
+ *
+ * Writes at most one word per pixel.
+ */
+uint32_t *
+wcap_encode_span_c(uint32_t *p, struct wcap_run *run,
+		   uint32_t *ref, const uint32_t *src, int n)
+{
+	uint32_t next;
+	int k;
+
+	for (k = 0; k < n; k++) {
+		next = src[k];
+		p = push_delta(p, run, component_delta(next, ref[k]));
+		ref[k] = next;
+	}
+
+	return p;
+}
+
+#if defined(__SSE2__)
+static uint32_t *
+encode_span_sse2(uint32_t *p, struct wcap_run *run,
+		 uint32_t *ref, const uint32_t *src, int n)
+{
+	const __m128i mask = _mm_set1_epi32(DELTA_MASK);
+	__m128i next, prev, delta;
+	uint32_t d[4];
+	int i, k;
+
+	for (k = 0; k + 4 <= n; k += 4) {
+		next = _mm_loadu_si128((const __m128i *)(src + k));
+		prev = _mm_loadu_si128((const __m128i *)(ref + k));
+		_mm_storeu_si128((__m128i *)(ref + k), next);
+
+		/* Bytewise subtraction wraps per channel like
+		 * component_delta() does. */
+		delta = _mm_and_si128(_mm_sub_epi8(next, prev), mask);
+
+		if (run->length > 0 &&
+		    _mm_movemask_epi8(_mm_cmpeq_epi32(delta,
+			    _mm_set1_epi32(run->delta))) == 0xffff) {
+			run->length += 4;
+			continue;
+		}
+
+		_mm_storeu_si128((__m128i *)d, delta);
+		for (i = 0; i < 4; i++)
+			p = push_delta(p, run, d[i]);
+	}
+
+	return wcap_encode_span_c(p, run, ref + k, src + k, n - k);
+}
+#endif
+
+#ifdef HAVE_WCAP_AVX2
+__attribute__((target("avx2")))
+static uint32_t *
+encode_span_avx2(uint32_t *p, struct wcap_run *run,
+		 uint32_t *ref, const uint32_t *src, int n)
+{
+	const __m256i mask = _mm256_set1_epi32(DELTA_MASK);
+	__m256i next, prev, delta;
+	uint32_t d[8];
+	int i, k;
+
+	for (k = 0; k + 8 <= n; k += 8) {
+		next = _mm256_loadu_si256((const __m256i *)(src + k));
+		prev = _mm256_loadu_si256((const __m256i *)(ref + k));
+		_mm256_storeu_si256((__m256i *)(ref + k), next);
+
+		delta = _mm256_and_si256(_mm256_sub_epi8(next, prev), mask);
+
+		if (run->length > 0 &&
+		    _mm256_movemask_epi8(_mm256_cmpeq_epi32(delta,
+			    _mm256_set1_epi32(run->delta))) == -1) {
+			run->length += 8;
+			continue;
+		}
+
+		_mm256_storeu_si256((__m256i *)d, delta);
+		for (i = 0; i < 8; i++)
+			p = push_delta(p, run, d[i]);
+	}
+
+	return wcap_encode_span_c(p, run, ref + k, src + k, n - k);
+}
+#endif
+
+struct encode_impl {
+	const char *name;
+	uint32_t *(*encode_span)(uint32_t *p, struct wcap_run *run,
+				 uint32_t *ref, const uint32_t *src, int n);
+};
+
+static const struct encode_impl *impl;
+static pthread_once_t impl_once = PTHREAD_ONCE_INIT;
+
+static void
+select_impl(void)
+{
+	static const struct encode_impl impls[] = {
+#ifdef HAVE_WCAP_AVX2
+		{ "avx2", encode_span_avx2 },
+#endif
+#if defined(__SSE2__)
+		{ "sse2", encode_span_sse2 },
+#endif
+		{ "c", wcap_encode_span_c },
+	};
+	unsigned i = 0;
+
+#ifdef HAVE_WCAP_AVX2
+	__builtin_cpu_init();
+	if (!__builtin_cpu_supports("avx2"))
+		i++;
+#endif
+
+	impl = &impls[i];
+}
+
+/** Encode a span with the fastest encoder the CPU supports
+ *
+ * Same as wcap_encode_span_c(), with the same output.
+ */
+uint32_t *
+wcap_encode_span(uint32_t *p, struct wcap_run *run,
+		 uint32_t *ref, const uint32_t *src, int n)
+{
+	pthread_once(&impl_once, select_impl);
+
+	return impl->encode_span(p, run, ref, src, n);
+}
+
+/** Write out the pending run at the end of a rectangle */
+uint32_t *
+wcap_encode_flush(uint32_t *p, struct wcap_run *run)
+{
+	p = output_run(p, run->delta, run->length);
+	run->length = 0;
+
+	return p;
+}
+
+/** The name of the encoder wcap_encode_span() uses */
+const char *
+wcap_encode_impl_name(void)
+{
+	pthread_once(&impl_once, select_impl);
+
+	return impl->name;
+}
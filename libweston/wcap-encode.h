@@ -0,0 +1,51 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _WESTON_WCAP_ENCODE_H
+#define _WESTON_WCAP_ENCODE_H
+
+#include <stdint.h>
+
+/* Run length state of a WCAP rectangle, which continues across rows. */
+struct wcap_run {
+	uint32_t delta;
+	int length;
+};
+
+uint32_t *
+wcap_encode_span(uint32_t *p, struct wcap_run *run,
+		 uint32_t *ref, const uint32_t *src, int n);
+
+uint32_t *
+wcap_encode_span_c(uint32_t *p, struct wcap_run *run,
+		   uint32_t *ref, const uint32_t *src, int n);
+
+uint32_t *
+wcap_encode_flush(uint32_t *p, struct wcap_run *run);
+
+const char *
+wcap_encode_impl_name(void);
+
+#endif
@@ -57,6 +57,7 @@ struct theme {
 	int margin;
 	int width;
 	int titlebar_height;
+	struct glyph_cache *title_glyphs;
 };
 
 struct theme *
@@ -73,6 +74,14 @@ enum {
 void
 theme_set_background_source(struct theme *t, cairo_t *cr, uint32_t flags);
 void
+theme_render_frame_background(struct theme *t,
+			      cairo_t *cr, int width, int height,
+			      int titlebar, uint32_t flags);
+void
+theme_render_frame_title(struct theme *t,
+			 cairo_t *cr, int width, const char *title,
+			 cairo_rectangle_int_t *title_rect, uint32_t flags);
+void
 theme_render_frame(struct theme *t,
 		   cairo_t *cr, int width, int height,
 		   const char *title, cairo_rectangle_int_t *title_rect,
@@ -230,4 +239,16 @@ frame_double_touch_up(struct frame *frame, void *data, int32_t id);
 void
 frame_repaint(struct frame *frame, cairo_t *cr);
 
+/* The pieces of frame_repaint(), for callers that composite the frame
+ * background and title themselves. */
+uint32_t
+frame_theme_flags(struct frame *frame);
+
+void
+frame_title_rect(struct frame *frame, int32_t *x, int32_t *y,
+		 int32_t *width, int32_t *height);
+
+void
+frame_repaint_buttons(struct frame *frame, cairo_t *cr);
+
 #endif
@@ -0,0 +1,430 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Glyph masks are rasterized once per code point into A8 atlas pages,
+ * and text is then drawn by compositing those masks with the current
+ * source. The masks are at device resolution, so the cache is only used
+ * while the transformation is a plain integer scale, with a change of
+ * scale starting over. Any other transformation goes through
+ * cairo_show_text().
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "shared/helpers.h"
+#include "shared/zalloc.h"
+#include "glyph-cache.h"
+
+#define GLYPH_CACHE_BUCKETS 256
+#define ATLAS_PAGE_SIZE 512
+
+struct glyph {
+	uint32_t codepoint;
+	struct glyph *next;
+	cairo_surface_t *mask;		/* NULL if there is nothing to draw */
+	int x, y;			/* mask offset from the origin */
+	double advance;			/* in device pixels */
+	int oversize;			/* too large for the atlas */
+};
+
+struct atlas_page {
+	cairo_surface_t *surface;
+	int shelf_x, shelf_y, shelf_height;
+	struct atlas_page *next;
+};
+
+struct glyph_cache {
+	cairo_font_face_t *face;
+	cairo_matrix_t font_matrix;
+	cairo_font_options_t *options;
+
+	/* The font at the current device scale, with an identity CTM */
+	int scale;
+	cairo_scaled_font_t *font;
+
+	struct glyph *buckets[GLYPH_CACHE_BUCKETS];
+	struct atlas_page *pages;
+
+	struct glyph_cache_stats stats;
+};
+
+static int
+utf8_decode(const char *text, int length, uint32_t *codepoint)
+{
+	const unsigned char *s = (const unsigned char *) text;
+	uint32_t c;
+	int n, i;
+
+	if (s[0] < 0x80) {
+		*codepoint = s[0];
+		return 1;
+	} else if ((s[0] & 0xe0) == 0xc0) {
+		c = s[0] & 0x1f;
+		n = 2;
+	} else if ((s[0] & 0xf0) == 0xe0) {
+		c = s[0] & 0x0f;
+		n = 3;
+	} else if ((s[0] & 0xf8) == 0xf0) {
+		c = s[0] & 0x07;
+		n = 4;
+	} else {
+		*codepoint = 0xfffd;
+		return 1;
+	}
+
+	if (n > length) {
+		*codepoint = 0xfffd;
+		return length;
+	}
+
+	for (i = 1; i < n; i++) {
+		if ((s[i] & 0xc0) != 0x80) {
+			*codepoint = 0xfffd;
+			return i;
+		}
+		c = (c << 6) | (s[i] & 0x3f);
+	}
+
+	*codepoint = c;
+
+	return n;
+}
+
+static void
+glyph_cache_clear(struct glyph_cache *cache)
+{
+	struct glyph *glyph, *next;
+	struct atlas_page *page, *next_page;
+	int i;
+
+	for (i = 0; i < GLYPH_CACHE_BUCKETS; i++) {
+		for (glyph = cache->buckets[i]; glyph; glyph = next) {
+			next = glyph->next;
+			if (glyph->mask)
+				cairo_surface_destroy(glyph->mask);
+			free(glyph);
+		}
+		cache->buckets[i] = NULL;
+	}
+
+	for (page = cache->pages; page; page = next_page) {
+		next_page = page->next;
+		cairo_surface_destroy(page->surface);
+		free(page);
+	}
+	cache->pages = NULL;
+
+	if (cache->font)
+		cairo_scaled_font_destroy(cache->font);
+	cache->font = NULL;
+
+	cache->stats.glyphs = 0;
+	cache->stats.atlas_bytes = 0;
+}
+
+static void
+glyph_cache_set_scale(struct glyph_cache *cache, int scale)
+{
+	cairo_matrix_t font_matrix, ctm;
+
+	glyph_cache_clear(cache);
+
+	font_matrix = cache->font_matrix;
+	cairo_matrix_scale(&font_matrix, scale, scale);
+	cairo_matrix_init_identity(&ctm);
+	cache->font = cairo_scaled_font_create(cache->face, &font_matrix,
+					       &ctm, cache->options);
+	if (cairo_scaled_font_status(cache->font) != CAIRO_STATUS_SUCCESS) {
+		cairo_scaled_font_destroy(cache->font);
+		cache->font = NULL;
+	}
+
+	cache->scale = scale;
+}
+
+struct glyph_cache *
+glyph_cache_create(cairo_scaled_font_t *font)
+{
+	struct glyph_cache *cache;
+
+	cache = zalloc(sizeof *cache);
+	if (!cache)
+		return NULL;
+
+	cache->face =
+		cairo_font_face_reference(cairo_scaled_font_get_font_face(font));
+	cairo_scaled_font_get_font_matrix(font, &cache->font_matrix);
+	cache->options = cairo_font_options_create();
+	cairo_scaled_font_get_font_options(font, cache->options);
+
+	return cache;
+}
+
+void
+glyph_cache_destroy(struct glyph_cache *cache)
+{
+	if (!cache)
+		return;
+
+	glyph_cache_clear(cache);
+	cairo_font_options_destroy(cache->options);
+	cairo_font_face_destroy(cache->face);
+	free(cache);
+}
+
+/* Shelf packing: glyphs go left to right into the current shelf, and a
+ * new shelf starts below the tallest glyph of the previous one. */
+static struct atlas_page *
+atlas_alloc(struct glyph_cache *cache, int width, int height,
+	    int *x, int *y)
+{
+	struct atlas_page *page = cache->pages;
+
+	if (width > ATLAS_PAGE_SIZE || height > ATLAS_PAGE_SIZE)
+		return NULL;
+
+	if (page && page->shelf_x + width > ATLAS_PAGE_SIZE) {
+		page->shelf_x = 0;
+		page->shelf_y += page->shelf_height;
+		page->shelf_height = 0;
+	}
+
+	if (!page || page->shelf_y + height > ATLAS_PAGE_SIZE) {
+		page = zalloc(sizeof *page);
+		if (!page)
+			return NULL;
+		page->surface = cairo_image_surface_create(CAIRO_FORMAT_A8,
+							   ATLAS_PAGE_SIZE,
+							   ATLAS_PAGE_SIZE);
+		if (cairo_surface_status(page->surface) !=
+		    CAIRO_STATUS_SUCCESS) {
+			cairo_surface_destroy(page->surface);
+			free(page);
+			return NULL;
+		}
+		page->next = cache->pages;
+		cache->pages = page;
+		cache->stats.atlas_bytes +=
+			cairo_image_surface_get_stride(page->surface) *
+			ATLAS_PAGE_SIZE;
+	}
+
+	*x = page->shelf_x;
+	*y = page->shelf_y;
+	page->shelf_x += width;
+	page->shelf_height = MAX(page->shelf_height, height);
+
+	return page;
+}
+
+static void
+glyph_rasterize(struct glyph_cache *cache, struct glyph *glyph,
+		const char *text, int length)
+{
+	cairo_glyph_t *glyphs = NULL;
+	cairo_text_extents_t extents;
+	struct atlas_page *page;
+	int num_glyphs = 0;
+	int x0, y0, width, height, x, y;
+	cairo_t *cr;
+
+	if (cairo_scaled_font_text_to_glyphs(cache->font, 0, 0,
+					     text, length,
+					     &glyphs, &num_glyphs,
+					     NULL, NULL, NULL) !=
+	    CAIRO_STATUS_SUCCESS)
+		return;
+
+	cairo_scaled_font_glyph_extents(cache->font, glyphs, num_glyphs,
+					&extents);
+	glyph->advance = extents.x_advance;
+
+	if (extents.width <= 0 || extents.height <= 0)
+		goto out;
+
+	/* A pixel of padding all around, for antialiasing. */
+	x0 = floor(extents.x_bearing) - 1;
+	y0 = floor(extents.y_bearing) - 1;
+	width = ceil(extents.x_bearing + extents.width) + 1 - x0;
+	height = ceil(extents.y_bearing + extents.height) + 1 - y0;
+
+	page = atlas_alloc(cache, width, height, &x, &y);
+	if (!page) {
+		glyph->oversize = 1;
+		goto out;
+	}
+
+	cr = cairo_create(page->surface);
+	cairo_rectangle(cr, x, y, width, height);
+	cairo_clip(cr);
+	cairo_translate(cr, x - x0, y - y0);
+	cairo_set_scaled_font(cr, cache->font);
+	cairo_show_glyphs(cr, glyphs, num_glyphs);
+	cairo_destroy(cr);
+
+	glyph->mask = cairo_surface_create_for_rectangle(page->surface,
+							 x, y, width, height);
+	glyph->x = x0;
+	glyph->y = y0;
+
+out:
+	cairo_glyph_free(glyphs);
+}
+
+static struct glyph *
+glyph_cache_lookup(struct glyph_cache *cache, uint32_t codepoint,
+		   const char *text, int length)
+{
+	struct glyph **bucket, *glyph;
+
+	bucket = &cache->buckets[codepoint % GLYPH_CACHE_BUCKETS];
+	for (glyph = *bucket; glyph; glyph = glyph->next) {
+		if (glyph->codepoint == codepoint) {
+			cache->stats.hits++;
+			return glyph;
+		}
+	}
+
+	cache->stats.misses++;
+
+	glyph = zalloc(sizeof *glyph);
+	if (!glyph)
+		return NULL;
+
+	glyph->codepoint = codepoint;
+	glyph_rasterize(cache, glyph, text, length);
+	glyph->next = *bucket;
+	*bucket = glyph;
+	cache->stats.glyphs++;
+
+	return glyph;
+}
+
+static void
+show_text_uncached(struct glyph_cache *cache, cairo_t *cr,
+		   const char *text, int length)
+{
+	char *str;
+
+	str = strndup(text, length);
+	if (!str)
+		return;
+
+	cairo_save(cr);
+	if (cache) {
+		cairo_set_font_face(cr, cache->face);
+		cairo_set_font_matrix(cr, &cache->font_matrix);
+		cairo_set_font_options(cr, cache->options);
+	}
+	cairo_show_text(cr, str);
+	cairo_restore(cr);
+
+	free(str);
+}
+
+/** Draw text with the cached glyphs
+ *
+ * \param cache The glyph cache of the font to draw with, or NULL to
+ * draw with the current font of cr.
+ * \param cr The cairo context, with the source to fill the glyphs with.
+ * \param text UTF-8 text.
+ * \param length Length of text in bytes, or -1 if it is nul-terminated.
+ *
+ * Like cairo_show_text(), the text starts at the current point, which
+ * then moves past the end of the text.
+ */
+void
+glyph_cache_show_text(struct glyph_cache *cache, cairo_t *cr,
+		      const char *text, int length)
+{
+	cairo_matrix_t m;
+	struct glyph *glyph;
+	uint32_t codepoint;
+	char *str;
+	double x = 0, y = 0;
+	int scale, i, n;
+
+	if (length < 0)
+		length = strlen(text);
+
+	cairo_get_matrix(cr, &m);
+	scale = m.xx;
+	if (!cache || m.xy != 0 || m.yx != 0 || m.xx != m.yy ||
+	    m.xx != scale || scale < 1) {
+		show_text_uncached(cache, cr, text, length);
+		return;
+	}
+
+	if (scale != cache->scale)
+		glyph_cache_set_scale(cache, scale);
+	if (!cache->font) {
+		show_text_uncached(cache, cr, text, length);
+		return;
+	}
+
+	if (cairo_has_current_point(cr))
+		cairo_get_current_point(cr, &x, &y);
+	cairo_user_to_device(cr, &x, &y);
+
+	cairo_save(cr);
+	cairo_identity_matrix(cr);
+
+	for (i = 0; i < length && text[i]; i += n) {
+		n = utf8_decode(text + i, length - i, &codepoint);
+		glyph = glyph_cache_lookup(cache, codepoint, text + i, n);
+		if (!glyph)
+			continue;
+
+		if (glyph->mask) {
+			cairo_mask_surface(cr, glyph->mask,
+					   round(x) + glyph->x,
+					   round(y) + glyph->y);
+		} else if (glyph->oversize && (str = strndup(text + i, n))) {
+			cairo_set_scaled_font(cr, cache->font);
+			cairo_move_to(cr, round(x), round(y));
+			cairo_show_text(cr, str);
+			free(str);
+		}
+
+		x += glyph->advance;
+	}
+
+	cairo_restore(cr);
+
+	cairo_device_to_user(cr, &x, &y);
+	cairo_move_to(cr, x, y);
+}
+
+void
+glyph_cache_get_stats(struct glyph_cache *cache,
+		      struct glyph_cache_stats *stats)
+{
+	*stats = cache->stats;
+}
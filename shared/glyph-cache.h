@@ -0,0 +1,56 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _GLYPH_CACHE_H
+#define _GLYPH_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <cairo.h>
+
+struct glyph_cache;
+
+struct glyph_cache_stats {
+	uint64_t hits;
+	uint64_t misses;
+	uint32_t glyphs;
+	size_t atlas_bytes;
+};
+
+struct glyph_cache *
+glyph_cache_create(cairo_scaled_font_t *font);
+
+void
+glyph_cache_destroy(struct glyph_cache *cache);
+
+void
+glyph_cache_show_text(struct glyph_cache *cache, cairo_t *cr,
+		      const char *text, int length);
+
+void
+glyph_cache_get_stats(struct glyph_cache *cache,
+		      struct glyph_cache_stats *stats);
+
+#endif
@@ -31,6 +31,7 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/epoll.h>
+#include <sys/mman.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -178,6 +179,11 @@ os_create_anonymous_file(off_t size)
 		return -1;
 
 #ifdef HAVE_POSIX_FALLOCATE
+	/* posix_fallocate() fails with EINVAL for an empty range, and a
+	 * new file is empty already. */
+	if (size == 0)
+		return fd;
+
 	do {
 		ret = posix_fallocate(fd, 0, size);
 	} while (ret == EINTR);
@@ -199,6 +205,106 @@ os_create_anonymous_file(off_t size)
 	return fd;
 }
 
+/*
+ * Create an anonymous file holding a copy of the given data, and return
+ * the file descriptor for it. The file descriptor is set CLOEXEC.
+ *
+ * Where memfd sealing is available, the file is sealed so that it can
+ * neither be written to nor resized by anyone, and it is safe to hand
+ * the same file to any number of untrusted processes. Otherwise this
+ * falls back to os_create_anonymous_file() without the guarantee.
+ */
+int
+os_create_sealed_file(const void *data, size_t size)
+{
+	const char *p = data;
+	off_t offset = 0;
+	ssize_t len;
+	int fd;
+
+	fd = os_create_sealable_file("weston-sealed", size);
+	if (fd < 0)
+		return -1;
+
+	while ((size_t) offset < size) {
+		len = pwrite(fd, p + offset, size - offset, offset);
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len <= 0) {
+			close(fd);
+			return -1;
+		}
+		offset += len;
+	}
+
+	os_seal_file(fd);
+
+	return fd;
+}
+
+/*
+ * Create an anonymous file of the given size that can be filled
+ * incrementally and sealed with os_seal_file() once complete. The file
+ * descriptor is set CLOEXEC. Falls back to os_create_anonymous_file()
+ * where memfd is not available.
+ */
+int
+os_create_sealable_file(const char *name, off_t size)
+{
+	int fd = -1;
+	int ret;
+
+#ifdef HAVE_MEMFD_CREATE
+	fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#endif
+	if (fd < 0)
+		return os_create_anonymous_file(size);
+
+	do {
+		ret = ftruncate(fd, size);
+	} while (ret < 0 && errno == EINTR);
+	if (ret < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+void
+os_seal_file(int fd)
+{
+#ifdef F_ADD_SEALS
+	/* Fails with EINVAL for files that do not support sealing. */
+	fcntl(fd, F_ADD_SEALS,
+	      F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+#endif
+}
+
+/*
+ * Double the kernel buffer of a pipe, up to max bytes, so that a busy
+ * transfer needs fewer wakeups. Returns the resulting buffer size, or
+ * -1 if it cannot be queried.
+ */
+int
+os_pipe_grow(int fd, int max)
+{
+#ifdef F_SETPIPE_SZ
+	int size, ret;
+
+	size = fcntl(fd, F_GETPIPE_SZ);
+	if (size < 0 || size >= max)
+		return size;
+
+	/* May fail beyond /proc/sys/fs/pipe-max-size, keep what we have. */
+	ret = fcntl(fd, F_SETPIPE_SZ, size * 2 < max ? size * 2 : max);
+
+	return ret < 0 ? size : ret;
+#else
+	return -1;
+#endif
+}
+
 #ifndef HAVE_STRCHRNUL
 char *
 strchrnul(const char *s, int c)
@@ -52,6 +52,18 @@ os_epoll_create_cloexec(void);
 int
 os_create_anonymous_file(off_t size);
 
+int
+os_create_sealed_file(const void *data, size_t size);
+
+int
+os_create_sealable_file(const char *name, off_t size);
+
+void
+os_seal_file(int fd);
+
+int
+os_pipe_grow(int fd, int max);
+
 #ifndef HAVE_STRCHRNUL
 char *
 strchrnul(const char *s, int c);
@@ -0,0 +1,244 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Clipboard manager throughput benchmark. A data source that stands in
+ * for a Wayland client offers a 100 MiB selection and goes away, the
+ * clipboard manager takes the selection over, and a reader drains it
+ * again. Writer and reader run on their own threads, like the clients
+ * would, while the compositor loop moves the data in between. The
+ * contents are checked on the way out.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "compositor.h"
+#include "compositor/weston.h"
+#include "shared/helpers.h"
+#include "shared/timespec-util.h"
+
+#define PAYLOAD_SIZE (100 * 1024 * 1024)
+
+static const char mime_type[] = "text/plain;charset=utf-8";
+
+struct bench {
+	struct weston_compositor *compositor;
+	struct weston_seat seat;
+	struct weston_data_source owner;
+
+	pthread_t writer;
+	pthread_t reader;
+	int writer_fd;
+	int reader_fd;
+	size_t received;
+	bool corrupt;
+
+	int done_fd[2];
+	struct wl_event_source *done_source;
+	struct timespec start;
+};
+
+static struct bench bench_state;
+
+static inline char
+payload_byte(size_t offset)
+{
+	return offset % 251;
+}
+
+static void *
+writer_thread(void *data)
+{
+	struct bench *bench = data;
+	char buffer[64 * 1024];
+	size_t offset = 0, i;
+	ssize_t len;
+
+	while (offset < PAYLOAD_SIZE) {
+		for (i = 0; i < sizeof buffer; i++)
+			buffer[i] = payload_byte(offset + i);
+
+		len = write(bench->writer_fd, buffer,
+			    MIN(sizeof buffer, PAYLOAD_SIZE - offset));
+		assert(len > 0);
+		offset += len;
+	}
+
+	close(bench->writer_fd);
+
+	return NULL;
+}
+
+static void *
+reader_thread(void *data)
+{
+	struct bench *bench = data;
+	char buffer[64 * 1024];
+	ssize_t len, i;
+	char done = 1;
+	int ret;
+
+	while ((len = read(bench->reader_fd, buffer, sizeof buffer)) > 0) {
+		for (i = 0; i < len; i++)
+			if (buffer[i] != payload_byte(bench->received + i))
+				bench->corrupt = true;
+		bench->received += len;
+	}
+
+	close(bench->reader_fd);
+	ret = write(bench->done_fd[1], &done, 1);
+	assert(ret == 1);
+
+	return NULL;
+}
+
+static void
+owner_accept(struct weston_data_source *source,
+	     uint32_t serial, const char *mime_type)
+{
+}
+
+static void
+owner_send(struct weston_data_source *source,
+	   const char *mime_type, int32_t fd)
+{
+	struct bench *bench = container_of(source, struct bench, owner);
+	int ret;
+
+	bench->writer_fd = fd;
+	ret = pthread_create(&bench->writer, NULL, writer_thread, bench);
+	assert(ret == 0);
+}
+
+static void
+owner_cancel(struct weston_data_source *source)
+{
+}
+
+static int
+bench_done(int fd, uint32_t mask, void *data)
+{
+	struct bench *bench = data;
+	struct timespec now;
+	int64_t nsec;
+	char done;
+	int ret;
+
+	ret = read(fd, &done, 1);
+	assert(ret == 1);
+	pthread_join(bench->writer, NULL);
+	pthread_join(bench->reader, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	nsec = timespec_sub_to_nsec(&now, &bench->start);
+	fprintf(stderr, "clipboard: %d MiB in %.1f ms, %.1f MiB/s\n",
+		PAYLOAD_SIZE / (1024 * 1024), nsec / 1e6,
+		PAYLOAD_SIZE * 1e9 / nsec / (1024 * 1024));
+
+	assert(bench->received == PAYLOAD_SIZE);
+	assert(!bench->corrupt);
+
+	wl_event_source_remove(bench->done_source);
+	close(bench->done_fd[0]);
+	close(bench->done_fd[1]);
+	wl_array_release(&bench->owner.mime_types);
+	weston_seat_release(&bench->seat);
+
+	wl_display_terminate(bench->compositor->wl_display);
+
+	return 1;
+}
+
+static void
+bench_start(void *data)
+{
+	struct bench *bench = data;
+	struct wl_display *display = bench->compositor->wl_display;
+	struct wl_event_loop *loop = wl_display_get_event_loop(display);
+	struct weston_data_source *source;
+	const char **p;
+	int fds[2];
+	int ret;
+
+	weston_seat_init(&bench->seat, bench->compositor, "clipboard-test");
+
+	ret = pipe2(bench->done_fd, O_CLOEXEC);
+	assert(ret == 0);
+	bench->done_source = wl_event_loop_add_fd(loop, bench->done_fd[0],
+						  WL_EVENT_READABLE,
+						  bench_done, bench);
+	assert(bench->done_source);
+
+	wl_signal_init(&bench->owner.destroy_signal);
+	wl_array_init(&bench->owner.mime_types);
+	p = wl_array_add(&bench->owner.mime_types, sizeof *p);
+	assert(p);
+	*p = mime_type;
+	bench->owner.accept = owner_accept;
+	bench->owner.send = owner_send;
+	bench->owner.cancel = owner_cancel;
+
+	clock_gettime(CLOCK_MONOTONIC, &bench->start);
+
+	/* The clipboard manager starts reading from the owner right
+	 * away, and takes the selection over once the owner is gone. */
+	weston_seat_set_selection(&bench->seat, &bench->owner,
+				  wl_display_next_serial(display));
+	wl_signal_emit(&bench->owner.destroy_signal, &bench->owner);
+
+	source = bench->seat.selection_data_source;
+	assert(source && source != &bench->owner);
+
+	/* Paste while the copy is still in flight. */
+	ret = pipe2(fds, O_CLOEXEC);
+	assert(ret == 0);
+	bench->reader_fd = fds[0];
+	ret = pthread_create(&bench->reader, NULL, reader_thread, bench);
+	assert(ret == 0);
+	source->send(source, mime_type, fds[1]);
+}
+
+WL_EXPORT int
+wet_module_init(struct weston_compositor *compositor,
+		int *argc, char *argv[])
+{
+	struct wl_event_loop *loop;
+
+	bench_state.compositor = compositor;
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+	wl_event_loop_add_idle(loop, bench_start, &bench_state);
+
+	return 0;
+}
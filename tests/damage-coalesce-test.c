@@ -0,0 +1,239 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "weston-test-runner.h"
+
+#include "shared/helpers.h"
+#include "damage-coalesce.h"
+
+#define OUTPUT_WIDTH 1920
+#define OUTPUT_HEIGHT 1080
+#define MAX_RECTS 64
+#define BENCH_ROUNDS 200
+
+typedef void (*damage_func)(pixman_region32_t *region);
+
+/* A terminal redrawing every other character cell. */
+static void
+damage_terminal(pixman_region32_t *region)
+{
+	int row, col;
+
+	for (row = 0; row < 60; row++)
+		for (col = row & 1; col < 160; col += 2)
+			pixman_region32_union_rect(region, region,
+						   col * 8, row * 16, 8, 16);
+}
+
+/* Like weston-simple-damage with many small moving sprites. */
+static void
+damage_sprites(pixman_region32_t *region)
+{
+	uint32_t seed = 1;
+	int i;
+
+	for (i = 0; i < 1000; i++) {
+		seed = seed * 1103515245 + 12345;
+		pixman_region32_union_rect(region, region,
+					   (seed >> 8) % (OUTPUT_WIDTH - 12),
+					   (seed >> 20) % (OUTPUT_HEIGHT - 12),
+					   12, 12);
+	}
+}
+
+/* Isolated single pixels, the worst case for box count. */
+static void
+damage_pixels(pixman_region32_t *region)
+{
+	uint32_t seed = 7;
+	int i;
+
+	for (i = 0; i < 4000; i++) {
+		seed = seed * 1103515245 + 12345;
+		pixman_region32_union_rect(region, region,
+					   (seed >> 4) % OUTPUT_WIDTH,
+					   (seed >> 16) % OUTPUT_HEIGHT, 1, 1);
+	}
+}
+
+struct pattern {
+	const char *name;
+	damage_func damage;
+};
+
+static const struct pattern patterns[] = {
+	{ "terminal", damage_terminal },
+	{ "sprites", damage_sprites },
+	{ "pixels", damage_pixels },
+};
+
+static uint64_t
+region_area(pixman_region32_t *region)
+{
+	pixman_box32_t *boxes;
+	uint64_t area = 0;
+	int n, i;
+
+	boxes = pixman_region32_rectangles(region, &n);
+	for (i = 0; i < n; i++)
+		area += (uint64_t)(boxes[i].x2 - boxes[i].x1) *
+			(boxes[i].y2 - boxes[i].y1);
+
+	return area;
+}
+
+static double
+elapsed_ms(const struct timespec *a, const struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) * 1e3 + (b->tv_nsec - a->tv_nsec) / 1e6;
+}
+
+/* The region operations a repaint does on accumulated damage. */
+static double
+bench_region_ops(pixman_region32_t *damage)
+{
+	pixman_region32_t output, opaque, tmp;
+	struct timespec t0, t1;
+	int i;
+
+	pixman_region32_init_rect(&output, 0, 0, OUTPUT_WIDTH, OUTPUT_HEIGHT);
+	pixman_region32_init_rect(&opaque, 200, 100, 640, 480);
+	pixman_region32_init(&tmp);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		pixman_region32_intersect(&tmp, damage, &output);
+		pixman_region32_subtract(&tmp, &tmp, &opaque);
+		pixman_region32_translate(&tmp, 10, 10);
+		pixman_region32_union(&tmp, &tmp, damage);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	pixman_region32_fini(&tmp);
+	pixman_region32_fini(&opaque);
+	pixman_region32_fini(&output);
+
+	return elapsed_ms(&t0, &t1) / BENCH_ROUNDS;
+}
+
+static void
+assert_contains(pixman_region32_t *outer, pixman_region32_t *inner)
+{
+	pixman_region32_t rest;
+
+	pixman_region32_init(&rest);
+	pixman_region32_subtract(&rest, inner, outer);
+	assert(!pixman_region32_not_empty(&rest));
+	pixman_region32_fini(&rest);
+}
+
+TEST_P(coalesce_bounds_box_count, patterns)
+{
+	const struct pattern *p = data;
+	pixman_region32_t damage, coalesced;
+	int n_before, n_after;
+	double before_ms, after_ms;
+	uint64_t area;
+
+	pixman_region32_init(&damage);
+	p->damage(&damage);
+	pixman_region32_rectangles(&damage, &n_before);
+	assert(n_before > MAX_RECTS);
+
+	pixman_region32_init(&coalesced);
+	pixman_region32_copy(&coalesced, &damage);
+	assert(damage_coalesce(&coalesced, MAX_RECTS, 0));
+	pixman_region32_rectangles(&coalesced, &n_after);
+
+	assert(n_after <= MAX_RECTS);
+	assert_contains(&coalesced, &damage);
+
+	/* Coalescing again is a no-op. */
+	assert(!damage_coalesce(&coalesced, MAX_RECTS, 0));
+
+	area = region_area(&damage);
+	before_ms = bench_region_ops(&damage);
+	after_ms = bench_region_ops(&coalesced);
+
+	fprintf(stderr, "%-8s %5d boxes: %8.3f ms, coalesced %2d boxes: "
+		"%8.3f ms, area %.2fx\n", p->name, n_before, before_ms,
+		n_after, after_ms, (double)region_area(&coalesced) / area);
+
+	pixman_region32_fini(&coalesced);
+	pixman_region32_fini(&damage);
+}
+
+TEST(coalesce_small_regions_untouched)
+{
+	pixman_region32_t damage;
+	int n;
+
+	pixman_region32_init_rect(&damage, 0, 0, 10, 10);
+	pixman_region32_union_rect(&damage, &damage, 100, 100, 10, 10);
+
+	assert(!damage_coalesce(&damage, MAX_RECTS, 0));
+	assert(!damage_coalesce(&damage, 0, 0));
+	pixman_region32_rectangles(&damage, &n);
+	assert(n == 2);
+
+	pixman_region32_fini(&damage);
+}
+
+TEST(coalesce_wasted_area)
+{
+	pixman_region32_t damage;
+	pixman_box32_t *extents;
+	int n;
+
+	/* An L shape leaving 1% of its extents undamaged. */
+	pixman_region32_init_rect(&damage, 0, 0, 100, 99);
+	pixman_region32_union_rect(&damage, &damage, 0, 99, 10, 1);
+
+	assert(!damage_coalesce(&damage, MAX_RECTS, 0));
+
+	/* Not collapsed when that wastes more than allowed. */
+	pixman_region32_union_rect(&damage, &damage, 0, 100, 10, 100);
+	assert(!damage_coalesce(&damage, MAX_RECTS, 10));
+
+	pixman_region32_fini(&damage);
+	pixman_region32_init_rect(&damage, 0, 0, 100, 99);
+	pixman_region32_union_rect(&damage, &damage, 0, 99, 10, 1);
+	assert(damage_coalesce(&damage, MAX_RECTS, 1));
+
+	pixman_region32_rectangles(&damage, &n);
+	extents = pixman_region32_extents(&damage);
+	assert(n == 1);
+	assert(extents->x1 == 0 && extents->y1 == 0);
+	assert(extents->x2 == 100 && extents->y2 == 100);
+
+	pixman_region32_fini(&damage);
+}
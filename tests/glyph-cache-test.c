@@ -0,0 +1,206 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <cairo.h>
+
+#include "weston-test-runner.h"
+
+#include "shared/helpers.h"
+#include "shared/glyph-cache.h"
+
+#define WIDTH 128
+#define HEIGHT 64
+
+struct ink {
+	int x1, y1, x2, y2;
+};
+
+static cairo_t *
+create_context(cairo_surface_t **surface)
+{
+	cairo_t *cr;
+
+	*surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+					      WIDTH, HEIGHT);
+	cr = cairo_create(*surface);
+	cairo_select_font_face(cr, "mono",
+			       CAIRO_FONT_SLANT_NORMAL,
+			       CAIRO_FONT_WEIGHT_NORMAL);
+	cairo_set_font_size(cr, 20);
+	cairo_set_source_rgb(cr, 1, 1, 1);
+
+	return cr;
+}
+
+/* Bounding box of the pixels that were drawn to, in device pixels. */
+static int
+get_ink(cairo_surface_t *surface, struct ink *ink)
+{
+	uint32_t *data;
+	int stride, x, y;
+
+	cairo_surface_flush(surface);
+	data = (uint32_t *) cairo_image_surface_get_data(surface);
+	stride = cairo_image_surface_get_stride(surface) / 4;
+
+	ink->x1 = ink->y1 = INT32_MAX;
+	ink->x2 = ink->y2 = -1;
+	for (y = 0; y < HEIGHT; y++) {
+		for (x = 0; x < WIDTH; x++) {
+			if (!data[y * stride + x])
+				continue;
+			ink->x1 = MIN(ink->x1, x);
+			ink->y1 = MIN(ink->y1, y);
+			ink->x2 = MAX(ink->x2, x + 1);
+			ink->y2 = MAX(ink->y2, y + 1);
+		}
+	}
+
+	return ink->x2 >= 0;
+}
+
+TEST(glyph_cache_hits)
+{
+	struct glyph_cache_stats stats;
+	struct glyph_cache *cache;
+	cairo_surface_t *surface;
+	cairo_text_extents_t extents;
+	double x, y;
+	cairo_t *cr;
+
+	cr = create_context(&surface);
+	cache = glyph_cache_create(cairo_get_scaled_font(cr));
+	assert(cache);
+
+	cairo_move_to(cr, 4, 32);
+	glyph_cache_show_text(cache, cr, "abcabc", -1);
+	glyph_cache_get_stats(cache, &stats);
+	assert(stats.misses == 3);
+	assert(stats.hits == 3);
+	assert(stats.glyphs == 3);
+
+	/* The current point moves like with cairo_show_text(). */
+	cairo_text_extents(cr, "abcabc", &extents);
+	cairo_get_current_point(cr, &x, &y);
+	assert(fabs(x - (4 + extents.x_advance)) < 1.0);
+	assert(y == 32);
+
+	/* Only the first bytes of the text. */
+	glyph_cache_show_text(cache, cr, "abcd", 3);
+	glyph_cache_get_stats(cache, &stats);
+	assert(stats.misses == 3);
+	assert(stats.hits == 6);
+
+	fprintf(stderr, "%u glyphs, %zu bytes of atlas\n",
+		stats.glyphs, stats.atlas_bytes);
+
+	glyph_cache_destroy(cache);
+	cairo_destroy(cr);
+	cairo_surface_destroy(surface);
+}
+
+TEST(glyph_cache_matches_show_text)
+{
+	struct glyph_cache *cache;
+	cairo_surface_t *surface, *reference;
+	struct ink ink, ref_ink;
+	cairo_t *cr;
+	int scale;
+
+	for (scale = 1; scale <= 2; scale++) {
+		cr = create_context(&reference);
+		cairo_scale(cr, scale, scale);
+		cairo_move_to(cr, 4, 24);
+		cairo_show_text(cr, "Mg");
+		cairo_destroy(cr);
+
+		cr = create_context(&surface);
+		cache = glyph_cache_create(cairo_get_scaled_font(cr));
+		cairo_scale(cr, scale, scale);
+		cairo_move_to(cr, 4, 24);
+		glyph_cache_show_text(cache, cr, "Mg", -1);
+		cairo_destroy(cr);
+		glyph_cache_destroy(cache);
+
+		/* No fonts to draw with, nothing to compare. */
+		if (!get_ink(reference, &ref_ink)) {
+			assert(!get_ink(surface, &ink));
+		} else {
+			assert(get_ink(surface, &ink));
+			assert(abs(ink.x1 - ref_ink.x1) <= 1);
+			assert(abs(ink.y1 - ref_ink.y1) <= 1);
+			assert(abs(ink.x2 - ref_ink.x2) <= 1);
+			assert(abs(ink.y2 - ref_ink.y2) <= 1);
+		}
+
+		cairo_surface_destroy(surface);
+		cairo_surface_destroy(reference);
+	}
+}
+
+TEST(glyph_cache_rotated_is_uncached)
+{
+	struct glyph_cache_stats stats;
+	struct glyph_cache *cache;
+	cairo_surface_t *surface;
+	struct ink ink, ref_ink;
+	cairo_t *cr;
+
+	cr = create_context(&surface);
+	cache = glyph_cache_create(cairo_get_scaled_font(cr));
+	cairo_translate(cr, 32, 32);
+	cairo_rotate(cr, M_PI / 2);
+	cairo_move_to(cr, 0, 0);
+	glyph_cache_show_text(cache, cr, "M", -1);
+	cairo_destroy(cr);
+
+	glyph_cache_get_stats(cache, &stats);
+	assert(stats.hits == 0 && stats.misses == 0);
+	assert(stats.atlas_bytes == 0);
+	glyph_cache_destroy(cache);
+
+	/* Drawn all the same. */
+	get_ink(surface, &ink);
+	cairo_surface_destroy(surface);
+
+	cr = create_context(&surface);
+	cairo_translate(cr, 32, 32);
+	cairo_rotate(cr, M_PI / 2);
+	cairo_move_to(cr, 0, 0);
+	cairo_show_text(cr, "M");
+	cairo_destroy(cr);
+	get_ink(surface, &ref_ink);
+	cairo_surface_destroy(surface);
+
+	assert(ink.x1 == ref_ink.x1 && ink.y1 == ref_ink.y1);
+	assert(ink.x2 == ref_ink.x2 && ink.y2 == ref_ink.y2);
+}
@@ -0,0 +1,291 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Feeds bursts of pointer and touch motion into a seat with input
+ * coalescing enabled and checks what reaches the grabs: one motion per
+ * batch with the relative deltas summed, frames held back with the
+ * motion, and nothing merged across a button press.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <linux/input.h>
+
+#include "compositor.h"
+#include "compositor/weston.h"
+#include "shared/helpers.h"
+
+struct recorder {
+	int motions;
+	int frames;
+	int buttons;
+	struct weston_pointer_motion_event last;
+	double sum_dx;
+	double sum_dy_unaccel;
+
+	int touch_motions[2];
+	int touch_frames;
+	wl_fixed_t touch_x[2];
+};
+
+static struct recorder recorder;
+static struct weston_pointer_grab pointer_grab;
+static struct weston_touch_grab touch_grab;
+
+static void
+pointer_focus(struct weston_pointer_grab *grab)
+{
+}
+
+static void
+pointer_motion(struct weston_pointer_grab *grab,
+	       const struct timespec *time,
+	       struct weston_pointer_motion_event *event)
+{
+	recorder.motions++;
+	recorder.last = *event;
+	recorder.sum_dx += event->dx;
+	recorder.sum_dy_unaccel += event->dy_unaccel;
+}
+
+static void
+pointer_button(struct weston_pointer_grab *grab,
+	       const struct timespec *time, uint32_t button, uint32_t state)
+{
+	recorder.buttons++;
+}
+
+static void
+pointer_axis(struct weston_pointer_grab *grab,
+	     const struct timespec *time,
+	     struct weston_pointer_axis_event *event)
+{
+}
+
+static void
+pointer_axis_source(struct weston_pointer_grab *grab, uint32_t source)
+{
+}
+
+static void
+pointer_frame(struct weston_pointer_grab *grab)
+{
+	recorder.frames++;
+}
+
+static void
+pointer_cancel(struct weston_pointer_grab *grab)
+{
+}
+
+static const struct weston_pointer_grab_interface pointer_grab_interface = {
+	pointer_focus,
+	pointer_motion,
+	pointer_button,
+	pointer_axis,
+	pointer_axis_source,
+	pointer_frame,
+	pointer_cancel,
+};
+
+static void
+touch_down(struct weston_touch_grab *grab, const struct timespec *time,
+	   int touch_id, wl_fixed_t x, wl_fixed_t y)
+{
+}
+
+static void
+touch_up(struct weston_touch_grab *grab, const struct timespec *time,
+	 int touch_id)
+{
+}
+
+static void
+touch_motion(struct weston_touch_grab *grab, const struct timespec *time,
+	     int touch_id, wl_fixed_t x, wl_fixed_t y)
+{
+	assert(touch_id >= 0 && touch_id < 2);
+	recorder.touch_motions[touch_id]++;
+	recorder.touch_x[touch_id] = x;
+}
+
+static void
+touch_frame(struct weston_touch_grab *grab)
+{
+	recorder.touch_frames++;
+}
+
+static void
+touch_cancel(struct weston_touch_grab *grab)
+{
+}
+
+static const struct weston_touch_grab_interface touch_grab_interface = {
+	touch_down,
+	touch_up,
+	touch_motion,
+	touch_frame,
+	touch_cancel,
+};
+
+static void
+send_relative_motion(struct weston_seat *seat, int i)
+{
+	struct weston_pointer_motion_event event = {
+		.mask = WESTON_POINTER_MOTION_REL |
+			WESTON_POINTER_MOTION_REL_UNACCEL,
+		.dx = 1.5,
+		.dy = -0.5,
+		.dx_unaccel = 1.0,
+		.dy_unaccel = 0.25,
+	};
+	struct timespec time = { .tv_sec = 1, .tv_nsec = i * 1000000 };
+
+	notify_motion(seat, &time, &event);
+	notify_pointer_frame(seat);
+}
+
+static void
+test_pointer(struct weston_compositor *compositor, struct weston_seat *seat)
+{
+	struct timespec time = { 0 };
+	int i;
+
+	/* Outside of a batch nothing is held back. */
+	send_relative_motion(seat, 0);
+	assert(recorder.motions == 1 && recorder.frames == 1);
+
+	memset(&recorder, 0, sizeof recorder);
+	weston_compositor_begin_input_batch(compositor);
+	for (i = 0; i < 8; i++)
+		send_relative_motion(seat, i);
+	assert(recorder.motions == 0 && recorder.frames == 0);
+	weston_compositor_end_input_batch(compositor);
+
+	assert(recorder.motions == 1);
+	assert(recorder.frames == 1);
+	assert(recorder.last.dx == 8 * 1.5 && recorder.last.dy == 8 * -0.5);
+	assert(recorder.last.dx_unaccel == 8.0);
+	assert(recorder.last.dy_unaccel == 8 * 0.25);
+	assert(seat->coalesce.merged_motion == 7);
+
+	/* A button press must see the motion that came before it. */
+	memset(&recorder, 0, sizeof recorder);
+	weston_compositor_begin_input_batch(compositor);
+	send_relative_motion(seat, 0);
+	send_relative_motion(seat, 1);
+	notify_button(seat, &time, BTN_LEFT, WL_POINTER_BUTTON_STATE_PRESSED);
+	assert(recorder.motions == 1 && recorder.buttons == 1);
+	notify_pointer_frame(seat);
+	send_relative_motion(seat, 2);
+	notify_button(seat, &time, BTN_LEFT, WL_POINTER_BUTTON_STATE_RELEASED);
+	notify_pointer_frame(seat);
+	weston_compositor_end_input_batch(compositor);
+
+	assert(recorder.motions == 2);
+	assert(recorder.buttons == 2);
+	assert(recorder.frames == 4);
+	assert(recorder.sum_dx == 3 * 1.5);
+	assert(recorder.sum_dy_unaccel == 3 * 0.25);
+
+	fprintf(stderr, "pointer: %" PRIu64 " motion events merged\n",
+		seat->coalesce.merged_motion);
+}
+
+static void
+test_touch(struct weston_compositor *compositor, struct weston_seat *seat)
+{
+	struct timespec time = { 0 };
+	int i;
+
+	memset(&recorder, 0, sizeof recorder);
+	weston_compositor_begin_input_batch(compositor);
+	for (i = 0; i < 5; i++) {
+		notify_touch(seat, &time, 0, i, 0, WL_TOUCH_MOTION);
+		notify_touch(seat, &time, 1, 100 + i, 0, WL_TOUCH_MOTION);
+		notify_touch_frame(seat);
+	}
+	assert(recorder.touch_frames == 0);
+	weston_compositor_end_input_batch(compositor);
+
+	assert(recorder.touch_motions[0] == 1);
+	assert(recorder.touch_motions[1] == 1);
+	assert(recorder.touch_x[0] == wl_fixed_from_int(4));
+	assert(recorder.touch_x[1] == wl_fixed_from_int(104));
+	assert(recorder.touch_frames == 1);
+	assert(seat->coalesce.merged_touch == 8);
+}
+
+static void
+input_coalesce(void *data)
+{
+	struct weston_compositor *compositor = data;
+	struct weston_surface *surface;
+	struct weston_view *view;
+	struct weston_seat seat;
+
+	weston_seat_init(&seat, compositor, "coalesce-test");
+	weston_seat_init_pointer(&seat);
+	weston_seat_init_touch(&seat);
+	weston_seat_set_input_coalescing(&seat, true);
+
+	pointer_grab.interface = &pointer_grab_interface;
+	touch_grab.interface = &touch_grab_interface;
+	weston_pointer_start_grab(seat.pointer_state, &pointer_grab);
+	weston_touch_start_grab(seat.touch_state, &touch_grab);
+
+	/* Touch motion is only delivered to a focused touch. */
+	surface = weston_surface_create(compositor);
+	assert(surface);
+	view = weston_view_create(surface);
+	assert(view);
+	seat.touch_state->focus = view;
+
+	test_pointer(compositor, &seat);
+	test_touch(compositor, &seat);
+
+	seat.touch_state->focus = NULL;
+	weston_surface_destroy(surface);
+	weston_seat_release(&seat);
+
+	wl_display_terminate(compositor->wl_display);
+}
+
+WL_EXPORT int
+wet_module_init(struct weston_compositor *compositor,
+		int *argc, char *argv[])
+{
+	struct wl_event_loop *loop;
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+	wl_event_loop_add_idle(loop, input_coalesce, compositor);
+
+	return 0;
+}
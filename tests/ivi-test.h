@@ -39,4 +39,7 @@
 #define IVI_TEST_SURFACE_COUNT (3)
 #define IVI_TEST_LAYER_COUNT (3)
 
+#define IVI_TEST_BENCH_SURFACE_COUNT (200)
+#define IVI_TEST_BENCH_LAYER_COUNT (100)
+
 #endif /* IVI_TEST_H */
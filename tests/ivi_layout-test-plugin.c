@@ -28,10 +28,12 @@
 #include "config.h"
 
 #include <stdint.h>
+#include <inttypes.h>
 #include <unistd.h>
 #include <signal.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
 
 #include "compositor.h"
 #include "compositor/weston.h"
@@ -39,6 +41,7 @@
 #include "ivi-test.h"
 #include "ivi-shell/ivi-layout-export.h"
 #include "shared/helpers.h"
+#include "shared/timespec-util.h"
 
 struct test_context;
 
@@ -83,9 +86,15 @@ struct test_launcher {
 
 struct test_context {
 	const struct ivi_layout_interface *layout_interface;
+	struct weston_compositor *compositor;
 	struct wl_resource *runner_resource;
 	uint32_t user_flags;
 
+	/* see runner_poll() */
+	struct wl_event_source *poll_source;
+	bool (*poll_func)(struct test_context *);
+	uint32_t poll_elapsed;
+
 	struct wl_listener surface_property_changed;
 	struct wl_listener surface_created;
 	struct wl_listener surface_removed;
@@ -100,7 +109,13 @@ destroy_runner(struct wl_resource *resource)
 	assert(static_context.runner_resource == NULL ||
 	       static_context.runner_resource == resource);
 
+	if (static_context.poll_source) {
+		wl_event_source_remove(static_context.poll_source);
+		static_context.poll_source = NULL;
+	}
+
 	static_context.layout_interface = NULL;
+	static_context.compositor = NULL;
 	static_context.runner_resource = NULL;
 }
 
@@ -122,6 +137,7 @@ runner_run_handler(struct wl_client *client, struct wl_resource *resource,
 
 	launcher = wl_resource_get_user_data(resource);
 	static_context.layout_interface = launcher->layout_interface;
+	static_context.compositor = launcher->compositor;
 	static_context.runner_resource = resource;
 
 	t = find_runner_test(test_name);
@@ -139,7 +155,9 @@ runner_run_handler(struct wl_client *client, struct wl_resource *resource,
 
 	t->run(&static_context);
 
-	weston_test_runner_send_finished(resource);
+	/* A polling test sends "finished" itself. */
+	if (!static_context.poll_source)
+		weston_test_runner_send_finished(resource);
 }
 
 static const struct weston_test_runner_interface runner_implementation = {
@@ -290,6 +308,58 @@ runner_assert_fail(const char *cond, const char *file, int line,
 	}							\
 } while (0)
 
+#define RUNNER_POLL_INTERVAL_MS 10
+#define RUNNER_POLL_TIMEOUT_MS 2000
+
+static int
+runner_poll_timer(void *data)
+{
+	struct test_context *ctx = data;
+
+	if (!ctx->poll_func(ctx)) {
+		ctx->poll_elapsed += RUNNER_POLL_INTERVAL_MS;
+		if (ctx->poll_elapsed < RUNNER_POLL_TIMEOUT_MS) {
+			wl_event_source_timer_update(ctx->poll_source,
+						     RUNNER_POLL_INTERVAL_MS);
+			return 0;
+		}
+
+		runner_assert_fail("poll timed out", __FILE__, __LINE__,
+				   __func__, ctx);
+	}
+
+	wl_event_source_remove(ctx->poll_source);
+	ctx->poll_source = NULL;
+
+	if (ctx->poll_elapsed < RUNNER_POLL_TIMEOUT_MS)
+		weston_test_runner_send_finished(ctx->runner_resource);
+
+	return 0;
+}
+
+/*
+ * For a RUNNER_TEST() that waits for the compositor to make progress on
+ * its own, e.g. for transitions driven by output frames. The "finished"
+ * event is held back until func returns true, which is checked every
+ * RUNNER_POLL_INTERVAL_MS. The test fails after RUNNER_POLL_TIMEOUT_MS.
+ */
+static void
+runner_poll(struct test_context *ctx, bool (*func)(struct test_context *))
+{
+	struct wl_event_loop *loop;
+
+	assert(!ctx->poll_source);
+
+	loop = wl_display_get_event_loop(ctx->compositor->wl_display);
+	ctx->poll_func = func;
+	ctx->poll_elapsed = 0;
+	ctx->poll_source = wl_event_loop_add_timer(loop, runner_poll_timer,
+						   ctx);
+	runner_assert_or_return(ctx->poll_source != NULL);
+	wl_event_source_timer_update(ctx->poll_source,
+				     RUNNER_POLL_INTERVAL_MS);
+}
+
 
 /*************************** tests **********************************/
 
@@ -1070,3 +1140,244 @@ RUNNER_TEST(surface_bad_properties_changed_notification)
 	runner_assert(lyt->surface_add_listener(
 		      ivisurf, NULL) == IVI_FAILED);
 }
+
+/*
+ * Spreads IVI_TEST_BENCH_SURFACE_COUNT surfaces over many layers on the
+ * first output, then commits a single changed destination rectangle at a
+ * time. With dirty tracking the cost of such a commit must not depend on
+ * how many other surfaces and layers exist.
+ */
+RUNNER_TEST(commit_benchmark)
+{
+	const struct ivi_layout_interface *lyt = ctx->layout_interface;
+	struct ivi_layout_layer *ivilayers[IVI_TEST_BENCH_LAYER_COUNT] = {};
+	struct ivi_layout_surface *ivisurfs[IVI_TEST_BENCH_SURFACE_COUNT];
+	const struct ivi_layout_surface_properties *prop;
+	struct weston_compositor *compositor;
+	struct weston_output *output;
+	struct ivi_layout_surface *ivisurf;
+	struct timespec start, end;
+	uint32_t i, n;
+
+	for (i = 0; i < IVI_TEST_BENCH_SURFACE_COUNT; i++) {
+		ivisurfs[i] = lyt->get_surface_from_id(IVI_TEST_SURFACE_ID(i));
+		runner_assert_or_return(ivisurfs[i] != NULL);
+	}
+
+	compositor = lyt->surface_get_weston_surface(ivisurfs[0])->compositor;
+	runner_assert_or_return(!wl_list_empty(&compositor->output_list));
+	output = container_of(compositor->output_list.next,
+			      struct weston_output, link);
+
+	for (i = 0; i < IVI_TEST_BENCH_LAYER_COUNT; i++) {
+		ivilayers[i] = lyt->layer_create_with_dimension(
+				IVI_TEST_LAYER_ID(i), 200, 300);
+		runner_assert_or_return(ivilayers[i] != NULL);
+		lyt->layer_set_destination_rectangle(ivilayers[i],
+						     0, 0, 200, 300);
+		lyt->layer_set_source_rectangle(ivilayers[i], 0, 0, 200, 300);
+		lyt->layer_set_visibility(ivilayers[i], true);
+		lyt->screen_add_layer(output, ivilayers[i]);
+	}
+
+	for (i = 0; i < IVI_TEST_BENCH_SURFACE_COUNT; i++) {
+		lyt->layer_add_surface(ivilayers[i % IVI_TEST_BENCH_LAYER_COUNT],
+				       ivisurfs[i]);
+		lyt->surface_set_source_rectangle(ivisurfs[i], 0, 0, 20, 30);
+		lyt->surface_set_destination_rectangle(ivisurfs[i],
+						       0, 0, 20, 30);
+		lyt->surface_set_visibility(ivisurfs[i], true);
+	}
+
+	lyt->commit_changes();
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (n = 0; n < 100; n++) {
+		for (i = 0; i < IVI_TEST_BENCH_SURFACE_COUNT; i++) {
+			ivisurf = lyt->get_surface_from_id(
+					IVI_TEST_SURFACE_ID(i));
+			runner_assert_or_return(ivisurf == ivisurfs[i]);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	weston_log("ivi-layout: %d id lookups took %" PRId64 " us\n",
+		   100 * IVI_TEST_BENCH_SURFACE_COUNT,
+		   timespec_sub_to_nsec(&end, &start) / 1000);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (n = 0; n < 100; n++) {
+		ivisurf = ivisurfs[n % IVI_TEST_BENCH_SURFACE_COUNT];
+		lyt->surface_set_destination_rectangle(ivisurf,
+						       n, n, 20, 30);
+		lyt->commit_changes();
+
+		prop = lyt->get_properties_of_surface(ivisurf);
+		runner_assert_or_return(prop->dest_x == (int32_t)n);
+		runner_assert_or_return(prop->dest_y == (int32_t)n);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	weston_log("ivi-layout: 100 commits of one change with %d surfaces on "
+		   "%d layers took %" PRId64 " us\n",
+		   IVI_TEST_BENCH_SURFACE_COUNT, IVI_TEST_BENCH_LAYER_COUNT,
+		   timespec_sub_to_nsec(&end, &start) / 1000);
+
+	for (i = 0; i < IVI_TEST_BENCH_LAYER_COUNT; i++)
+		lyt->layer_destroy(ivilayers[i]);
+
+	lyt->commit_changes();
+}
+
+/*
+ * Fades several layers at once. The layers are on an output, so its
+ * frames drive the transition scheduler, and all of the transitions
+ * must reach their end.
+ */
+RUNNER_TEST(transition_fade_layers_p1)
+{
+	const struct ivi_layout_interface *lyt = ctx->layout_interface;
+	struct ivi_layout_layer *ivilayer;
+	struct weston_output *output;
+	uint32_t i;
+
+	runner_assert_or_return(!wl_list_empty(&ctx->compositor->output_list));
+	output = container_of(ctx->compositor->output_list.next,
+			      struct weston_output, link);
+
+	for (i = 0; i < IVI_TEST_LAYER_COUNT; i++) {
+		ivilayer = lyt->layer_create_with_dimension(
+				IVI_TEST_LAYER_ID(i), 200, 300);
+		runner_assert_or_return(ivilayer != NULL);
+
+		lyt->layer_set_destination_rectangle(ivilayer, 0, 0, 200, 300);
+		lyt->layer_set_source_rectangle(ivilayer, 0, 0, 200, 300);
+		lyt->screen_add_layer(output, ivilayer);
+
+		lyt->layer_set_opacity(ivilayer, wl_fixed_from_double(0.0));
+		lyt->layer_set_transition(ivilayer,
+					  IVI_LAYOUT_TRANSITION_LAYER_FADE,
+					  50 * (i + 1));
+		lyt->layer_set_fade_info(ivilayer, 1, 0.0, 1.0);
+	}
+
+	lyt->commit_changes();
+}
+
+static bool
+transition_fade_layers_done(struct test_context *ctx)
+{
+	const struct ivi_layout_interface *lyt = ctx->layout_interface;
+	const struct ivi_layout_layer_properties *prop;
+	struct ivi_layout_layer *ivilayer;
+	uint32_t i;
+
+	for (i = 0; i < IVI_TEST_LAYER_COUNT; i++) {
+		ivilayer = lyt->get_layer_from_id(IVI_TEST_LAYER_ID(i));
+		if (!ivilayer)
+			return true;
+
+		prop = lyt->get_properties_of_layer(ivilayer);
+		if (prop->opacity != wl_fixed_from_double(1.0))
+			return false;
+	}
+
+	return true;
+}
+
+RUNNER_TEST(transition_fade_layers_p2)
+{
+	runner_poll(ctx, transition_fade_layers_done);
+}
+
+RUNNER_TEST(transition_fade_layers_p3)
+{
+	const struct ivi_layout_interface *lyt = ctx->layout_interface;
+	const struct ivi_layout_layer_properties *prop;
+	struct ivi_layout_layer *ivilayer;
+	uint32_t i;
+
+	for (i = 0; i < IVI_TEST_LAYER_COUNT; i++) {
+		ivilayer = lyt->get_layer_from_id(IVI_TEST_LAYER_ID(i));
+		runner_assert_or_return(ivilayer != NULL);
+
+		prop = lyt->get_properties_of_layer(ivilayer);
+		runner_assert(prop->opacity == wl_fixed_from_double(1.0));
+		runner_assert(prop->visibility == true);
+
+		lyt->layer_destroy(ivilayer);
+	}
+
+	lyt->commit_changes();
+}
+
+/*
+ * A surface the client unmaps by attaching a NULL buffer must be put
+ * back into the scene once it has content again and the controller
+ * commits, even though no layout property changed in between.
+ */
+RUNNER_TEST(surface_remap_p1)
+{
+	const struct ivi_layout_interface *lyt = ctx->layout_interface;
+	struct ivi_layout_layer *ivilayer;
+	struct ivi_layout_surface *ivisurf;
+	struct weston_compositor *compositor;
+	struct weston_output *output;
+
+	ivisurf = lyt->get_surface_from_id(IVI_TEST_SURFACE_ID(0));
+	runner_assert_or_return(ivisurf != NULL);
+
+	compositor = lyt->surface_get_weston_surface(ivisurf)->compositor;
+	runner_assert_or_return(!wl_list_empty(&compositor->output_list));
+	output = container_of(compositor->output_list.next,
+			      struct weston_output, link);
+
+	ivilayer = lyt->layer_create_with_dimension(IVI_TEST_LAYER_ID(0),
+						    200, 300);
+	runner_assert_or_return(ivilayer != NULL);
+	lyt->layer_set_destination_rectangle(ivilayer, 0, 0, 200, 300);
+	lyt->layer_set_source_rectangle(ivilayer, 0, 0, 200, 300);
+	lyt->layer_set_visibility(ivilayer, true);
+	lyt->screen_add_layer(output, ivilayer);
+
+	lyt->layer_add_surface(ivilayer, ivisurf);
+	lyt->surface_set_source_rectangle(ivisurf, 0, 0, 200, 300);
+	lyt->surface_set_destination_rectangle(ivisurf, 0, 0, 200, 300);
+	lyt->surface_set_visibility(ivisurf, true);
+
+	lyt->commit_changes();
+
+	runner_assert(weston_surface_is_mapped(
+		      lyt->surface_get_weston_surface(ivisurf)));
+}
+
+RUNNER_TEST(surface_remap_p2)
+{
+	const struct ivi_layout_interface *lyt = ctx->layout_interface;
+	struct ivi_layout_surface *ivisurf;
+
+	ivisurf = lyt->get_surface_from_id(IVI_TEST_SURFACE_ID(0));
+	runner_assert_or_return(ivisurf != NULL);
+
+	runner_assert(!weston_surface_is_mapped(
+		      lyt->surface_get_weston_surface(ivisurf)));
+}
+
+RUNNER_TEST(surface_remap_p3)
+{
+	const struct ivi_layout_interface *lyt = ctx->layout_interface;
+	struct ivi_layout_surface *ivisurf;
+	struct ivi_layout_layer *ivilayer;
+
+	ivisurf = lyt->get_surface_from_id(IVI_TEST_SURFACE_ID(0));
+	runner_assert_or_return(ivisurf != NULL);
+
+	lyt->commit_changes();
+
+	runner_assert(weston_surface_is_mapped(
+		      lyt->surface_get_weston_surface(ivisurf)));
+
+	ivilayer = lyt->get_layer_from_id(IVI_TEST_LAYER_ID(0));
+	runner_assert_or_return(ivilayer != NULL);
+	lyt->layer_destroy(ivilayer);
+
+	lyt->commit_changes();
+}
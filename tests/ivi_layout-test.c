@@ -467,3 +467,76 @@ TEST(ivi_layout_surface_remove_notification)
 
 	runner_destroy(runner);
 }
+
+TEST(ivi_layout_commit_benchmark)
+{
+	struct client *client;
+	struct runner *runner;
+	struct ivi_window *winds[IVI_TEST_BENCH_SURFACE_COUNT];
+	int i;
+
+	client = create_client();
+	runner = client_create_runner(client);
+
+	for (i = 0; i < IVI_TEST_BENCH_SURFACE_COUNT; i++)
+		winds[i] = client_create_ivi_window(client,
+						    IVI_TEST_SURFACE_ID(i));
+
+	runner_run(runner, "commit_benchmark");
+
+	for (i = 0; i < IVI_TEST_BENCH_SURFACE_COUNT; i++)
+		ivi_window_destroy(winds[i]);
+	runner_destroy(runner);
+}
+
+TEST(ivi_layout_transition_fade_layers)
+{
+	struct client *client;
+	struct runner *runner;
+
+	client = create_client();
+	runner = client_create_runner(client);
+
+	runner_run(runner, "transition_fade_layers_p1");
+
+	/* Returns once the compositor has finished the fades. */
+	runner_run(runner, "transition_fade_layers_p2");
+	runner_run(runner, "transition_fade_layers_p3");
+
+	runner_destroy(runner);
+}
+
+TEST(ivi_layout_surface_remap)
+{
+	struct client *client;
+	struct runner *runner;
+	struct ivi_window *wind;
+	struct buffer *buffer;
+
+	client = create_client();
+	runner = client_create_runner(client);
+
+	wind = client_create_ivi_window(client, IVI_TEST_SURFACE_ID(0));
+	buffer = create_shm_buffer_a8r8g8b8(client, 200, 300);
+
+	wl_surface_attach(wind->wl_surface, buffer->proxy, 0, 0);
+	wl_surface_damage(wind->wl_surface, 0, 0, 200, 300);
+	wl_surface_commit(wind->wl_surface);
+
+	runner_run(runner, "surface_remap_p1");
+
+	wl_surface_attach(wind->wl_surface, NULL, 0, 0);
+	wl_surface_commit(wind->wl_surface);
+
+	runner_run(runner, "surface_remap_p2");
+
+	wl_surface_attach(wind->wl_surface, buffer->proxy, 0, 0);
+	wl_surface_damage(wind->wl_surface, 0, 0, 200, 300);
+	wl_surface_commit(wind->wl_surface);
+
+	runner_run(runner, "surface_remap_p3");
+
+	buffer_destroy(buffer);
+	ivi_window_destroy(wind);
+	runner_destroy(runner);
+}
@@ -26,6 +26,7 @@
 #include "config.h"
 
 #include <stdint.h>
+#include <string.h>
 
 #include "input-timestamps-helper.h"
 #include "shared/timespec-util.h"
@@ -155,3 +156,22 @@ TEST(keyboard_timestamps_stop_after_client_releases_wl_keyboard)
 
 	input_timestamps_destroy(input_ts);
 }
+
+TEST(keyboard_keymap_is_shared_and_read_only)
+{
+	struct client *a = create_client_with_keyboard_focus();
+	struct client *b = create_client_with_keyboard_focus();
+
+	client_roundtrip(a);
+	assert(a->input->keyboard->keymap);
+	assert(b->input->keyboard->keymap);
+	assert(strstr(a->input->keyboard->keymap, "xkb_keymap"));
+	assert(strcmp(a->input->keyboard->keymap,
+		      b->input->keyboard->keymap) == 0);
+
+#ifdef HAVE_MEMFD_CREATE
+	/* Sealed, so no client can change the keymap of the others. */
+	assert(!a->input->keyboard->keymap_shared_writable);
+	assert(!b->input->keyboard->keymap_shared_writable);
+#endif
+}
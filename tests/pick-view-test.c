@@ -0,0 +1,225 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*
+ * Hit-test microbenchmark for weston_compositor_pick_view(). It maps a
+ * wall of views, lets the compositor repaint once so the view list is
+ * built, and then picks the same random points through the compositor and
+ * through a plain linear scan of the view list. Both must agree, and the
+ * time each one took is logged.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+
+#include "compositor.h"
+#include "compositor/weston.h"
+#include "shared/helpers.h"
+#include "shared/timespec-util.h"
+
+#define N_VIEWS 2000
+#define N_PICKS 20000
+#define WALL_SIZE 4096
+
+struct bench {
+	struct weston_compositor *compositor;
+	struct weston_output *output;
+	int (*repaint)(struct weston_output *output,
+		       pixman_region32_t *damage,
+		       void *repaint_data);
+
+	struct weston_layer layer;
+	struct weston_view *views[N_VIEWS];
+};
+
+static struct bench bench_state;
+
+static struct weston_view *
+linear_pick_view(struct weston_compositor *compositor,
+		 wl_fixed_t x, wl_fixed_t y)
+{
+	struct weston_view *view;
+	wl_fixed_t view_x, view_y;
+	int ix = wl_fixed_to_int(x);
+	int iy = wl_fixed_to_int(y);
+
+	wl_list_for_each(view, &compositor->view_list, link) {
+		if (!pixman_region32_contains_point(
+				&view->transform.boundingbox, ix, iy, NULL))
+			continue;
+
+		weston_view_from_global_fixed(view, x, y, &view_x, &view_y);
+		if (!pixman_region32_contains_point(&view->surface->input,
+						    wl_fixed_to_int(view_x),
+						    wl_fixed_to_int(view_y),
+						    NULL))
+			continue;
+
+		return view;
+	}
+
+	return NULL;
+}
+
+static void
+bench_run(void *data)
+{
+	struct bench *bench = data;
+	struct weston_compositor *compositor = bench->compositor;
+	struct weston_view **expected;
+	struct weston_view *view;
+	wl_fixed_t *xs, *ys, vx, vy;
+	struct timespec start, end;
+	int64_t linear_nsec, grid_nsec;
+	int i, hits = 0;
+
+	xs = calloc(N_PICKS, sizeof *xs);
+	ys = calloc(N_PICKS, sizeof *ys);
+	expected = calloc(N_PICKS, sizeof *expected);
+	assert(xs && ys && expected);
+
+	srandom(1);
+	for (i = 0; i < N_PICKS; i++) {
+		xs[i] = wl_fixed_from_int(random() % (WALL_SIZE + 256) - 128);
+		ys[i] = wl_fixed_from_int(random() % (WALL_SIZE + 256) - 128);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < N_PICKS; i++)
+		expected[i] = linear_pick_view(compositor, xs[i], ys[i]);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	linear_nsec = timespec_sub_to_nsec(&end, &start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < N_PICKS; i++) {
+		view = weston_compositor_pick_view(compositor, xs[i], ys[i],
+						   &vx, &vy);
+		if (view != expected[i]) {
+			fprintf(stderr, "pick %d at %f,%f: got %p, expected %p\n",
+				i, wl_fixed_to_double(xs[i]),
+				wl_fixed_to_double(ys[i]),
+				view, expected[i]);
+			abort();
+		}
+		if (view)
+			hits++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	grid_nsec = timespec_sub_to_nsec(&end, &start);
+
+	fprintf(stderr, "pick-view: %d views, %d picks (%d hits)\n",
+		N_VIEWS, N_PICKS, hits);
+	fprintf(stderr, "pick-view: linear scan %8.1f ns/pick\n",
+		(double) linear_nsec / N_PICKS);
+	fprintf(stderr, "pick-view: compositor  %8.1f ns/pick\n",
+		(double) grid_nsec / N_PICKS);
+
+	free(xs);
+	free(ys);
+	free(expected);
+
+	for (i = 0; i < N_VIEWS; i++)
+		weston_surface_destroy(bench->views[i]->surface);
+
+	wl_display_terminate(compositor->wl_display);
+}
+
+static int
+bench_repaint(struct weston_output *output, pixman_region32_t *damage,
+	      void *repaint_data)
+{
+	struct bench *bench = &bench_state;
+	struct wl_event_loop *loop =
+		wl_display_get_event_loop(bench->compositor->wl_display);
+	int ret;
+
+	ret = bench->repaint(output, damage, repaint_data);
+
+	/* The view list is built now, run the picks outside of repaint. */
+	output->repaint = bench->repaint;
+	wl_event_loop_add_idle(loop, bench_run, bench);
+
+	return ret;
+}
+
+static void
+bench_start(void *data)
+{
+	struct bench *bench = data;
+	struct weston_compositor *compositor = bench->compositor;
+	struct weston_surface *surface;
+	struct weston_view *view;
+	int i;
+
+	assert(!wl_list_empty(&compositor->output_list));
+	bench->output = container_of(compositor->output_list.next,
+				     struct weston_output, link);
+
+	weston_layer_init(&bench->layer, compositor);
+	weston_layer_set_position(&bench->layer,
+				  WESTON_LAYER_POSITION_NORMAL);
+
+	srandom(0);
+	for (i = 0; i < N_VIEWS; i++) {
+		surface = weston_surface_create(compositor);
+		assert(surface);
+		view = weston_view_create(surface);
+		assert(view);
+
+		weston_surface_set_size(surface, 32 + random() % 224,
+					32 + random() % 224);
+		weston_view_set_position(view, random() % WALL_SIZE,
+					 random() % WALL_SIZE);
+		weston_layer_entry_insert(&bench->layer.view_list,
+					  &view->layer_link);
+		surface->is_mapped = true;
+		view->is_mapped = true;
+
+		bench->views[i] = view;
+	}
+
+	bench->repaint = bench->output->repaint;
+	bench->output->repaint = bench_repaint;
+	weston_output_schedule_repaint(bench->output);
+}
+
+WL_EXPORT int
+wet_module_init(struct weston_compositor *compositor,
+		int *argc, char *argv[])
+{
+	struct wl_event_loop *loop;
+
+	bench_state.compositor = compositor;
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+	wl_event_loop_add_idle(loop, bench_start, &bench_state);
+
+	return 0;
+}
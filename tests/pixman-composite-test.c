@@ -0,0 +1,269 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+
+#include "weston-test-runner.h"
+
+#include "shared/helpers.h"
+#include "pixman-composite.h"
+
+#define SRC_SIZE 256
+#define CLIP_CELL 16
+#define DEST_WIDTH 1024
+#define DEST_HEIGHT 768
+#define BENCH_ROUNDS 20
+
+struct setup {
+	pixman_image_t *src;
+	pixman_image_t *mask;
+	pixman_region32_t clip;
+	pixman_transform_t transform;
+	uint32_t *dest_data[2];
+	pixman_image_t *dest[2];
+};
+
+static void
+fill_pattern(uint32_t *data, int width, int height, uint32_t seed)
+{
+	int x, y;
+
+	for (y = 0; y < height; y++)
+		for (x = 0; x < width; x++)
+			data[y * width + x] =
+				(x * 0x01010101u) ^ (y * 0x00f00f0fu) ^ seed;
+}
+
+/* A viewported surface: the source is rotated by 30 degrees and scaled
+ * up about 2.3 times around the destination center, and clipped by a
+ * checkerboard of boxes.
+ */
+static void
+setup_init(struct setup *s, bool with_mask)
+{
+	pixman_color_t half = { 0, 0, 0, 0x8000 };
+	static uint32_t src_data[SRC_SIZE * SRC_SIZE];
+	double a = 30.0 * M_PI / 180.0;
+	int i, j;
+
+	fill_pattern(src_data, SRC_SIZE, SRC_SIZE, 0x80402010);
+	s->src = pixman_image_create_bits(PIXMAN_a8r8g8b8, SRC_SIZE, SRC_SIZE,
+					  src_data, SRC_SIZE * 4);
+	s->mask = with_mask ? pixman_image_create_solid_fill(&half) : NULL;
+
+	pixman_region32_init(&s->clip);
+	for (j = 0; j < SRC_SIZE / CLIP_CELL; j++) {
+		for (i = 0; i < SRC_SIZE / CLIP_CELL; i++) {
+			if ((i + j) % 2)
+				continue;
+			pixman_region32_union_rect(&s->clip, &s->clip,
+						   i * CLIP_CELL, j * CLIP_CELL,
+						   CLIP_CELL, CLIP_CELL);
+		}
+	}
+
+	pixman_transform_init_identity(&s->transform);
+	pixman_transform_translate(&s->transform, NULL,
+				   pixman_int_to_fixed(-DEST_WIDTH / 2),
+				   pixman_int_to_fixed(-DEST_HEIGHT / 2));
+	pixman_transform_rotate(&s->transform, NULL,
+				pixman_double_to_fixed(cos(a)),
+				pixman_double_to_fixed(sin(a)));
+	pixman_transform_scale(&s->transform, NULL,
+			       pixman_double_to_fixed(1.0 / 2.3),
+			       pixman_double_to_fixed(1.0 / 2.3));
+	pixman_transform_translate(&s->transform, NULL,
+				   pixman_int_to_fixed(SRC_SIZE / 2),
+				   pixman_int_to_fixed(SRC_SIZE / 2));
+
+	for (i = 0; i < 2; i++) {
+		s->dest_data[i] = malloc(DEST_WIDTH * DEST_HEIGHT * 4);
+		assert(s->dest_data[i]);
+		s->dest[i] = pixman_image_create_bits(PIXMAN_x8r8g8b8,
+						      DEST_WIDTH, DEST_HEIGHT,
+						      s->dest_data[i],
+						      DEST_WIDTH * 4);
+	}
+}
+
+static void
+setup_reset_dest(struct setup *s)
+{
+	fill_pattern(s->dest_data[0], DEST_WIDTH, DEST_HEIGHT, 0x12345678);
+	memcpy(s->dest_data[1], s->dest_data[0], DEST_WIDTH * DEST_HEIGHT * 4);
+}
+
+static void
+setup_fini(struct setup *s)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		pixman_image_unref(s->dest[i]);
+		free(s->dest_data[i]);
+	}
+
+	pixman_region32_fini(&s->clip);
+	if (s->mask)
+		pixman_image_unref(s->mask);
+	pixman_image_unref(s->src);
+}
+
+/* The previous implementation: every box composited over the whole
+ * destination.
+ */
+static void
+composite_clipped_full(pixman_image_t *src, pixman_image_t *mask,
+		       pixman_image_t *dest,
+		       const pixman_transform_t *transform,
+		       pixman_filter_t filter, pixman_region32_t *src_clip)
+{
+	pixman_format_code_t format = pixman_image_get_format(src);
+	int stride = pixman_image_get_stride(src);
+	uint8_t *data = (uint8_t *) pixman_image_get_data(src);
+	pixman_box32_t *boxes;
+	int n_box, i;
+
+	boxes = pixman_region32_rectangles(src_clip, &n_box);
+	for (i = 0; i < n_box; i++) {
+		pixman_transform_t adj = *transform;
+		pixman_image_t *boximg;
+
+		boximg = pixman_image_create_bits_no_clear(format,
+				boxes[i].x2 - boxes[i].x1,
+				boxes[i].y2 - boxes[i].y1,
+				(uint32_t *) (data + boxes[i].y1 * stride +
+					      boxes[i].x1 * 4),
+				stride);
+		pixman_transform_translate(&adj, NULL,
+					   pixman_int_to_fixed(-boxes[i].x1),
+					   pixman_int_to_fixed(-boxes[i].y1));
+		pixman_image_set_transform(boximg, &adj);
+		pixman_image_set_filter(boximg, filter, NULL, 0);
+		pixman_image_composite32(PIXMAN_OP_OVER, boximg, mask, dest,
+					 0, 0, 0, 0, 0, 0,
+					 pixman_image_get_width(dest),
+					 pixman_image_get_height(dest));
+		pixman_image_unref(boximg);
+	}
+}
+
+static double
+elapsed_ms(const struct timespec *a, const struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) * 1e3 + (b->tv_nsec - a->tv_nsec) / 1e6;
+}
+
+struct filter_mask {
+	pixman_filter_t filter;
+	bool with_mask;
+};
+
+static const struct filter_mask variants[] = {
+	{ PIXMAN_FILTER_NEAREST, false },
+	{ PIXMAN_FILTER_BILINEAR, false },
+	{ PIXMAN_FILTER_BILINEAR, true },
+};
+
+TEST_P(composite_clipped_matches_full_destination, variants)
+{
+	const struct filter_mask *v = data;
+	struct setup s;
+	int overdraw;
+
+	setup_init(&s, v->with_mask);
+	setup_reset_dest(&s);
+
+	composite_clipped_full(s.src, s.mask, s.dest[0], &s.transform,
+			       v->filter, &s.clip);
+	overdraw = composite_clipped(s.src, s.mask, s.dest[1], &s.transform,
+				     v->filter, &s.clip);
+
+	assert(overdraw == 0);
+	assert(memcmp(s.dest_data[0], s.dest_data[1],
+		      DEST_WIDTH * DEST_HEIGHT * 4) == 0);
+
+	setup_fini(&s);
+}
+
+TEST(source_box_maps_into_destination)
+{
+	pixman_transform_t t;
+	pixman_box32_t src = { 10, 20, 30, 40 };
+	pixman_box32_t dst;
+
+	/* Destination is the source scaled up 2x. */
+	pixman_transform_init_scale(&t, pixman_double_to_fixed(0.5),
+				    pixman_double_to_fixed(0.5));
+
+	assert(source_box_to_dest_box(&t, &src, 1000, 1000, &dst));
+	assert(dst.x1 <= 20 && dst.x1 >= 16);
+	assert(dst.y1 <= 40 && dst.y1 >= 36);
+	assert(dst.x2 >= 60 && dst.x2 <= 64);
+	assert(dst.y2 >= 80 && dst.y2 <= 84);
+
+	/* Clamped to the destination. */
+	assert(source_box_to_dest_box(&t, &src, 50, 50, &dst));
+	assert(dst.x2 == 50 && dst.y2 == 50);
+}
+
+TEST(composite_clipped_benchmark)
+{
+	struct setup s;
+	struct timespec t0, t1, t2;
+	int n_box, i;
+
+	setup_init(&s, false);
+	setup_reset_dest(&s);
+	pixman_region32_rectangles(&s.clip, &n_box);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < BENCH_ROUNDS; i++)
+		composite_clipped_full(s.src, s.mask, s.dest[0],
+				       &s.transform, PIXMAN_FILTER_BILINEAR,
+				       &s.clip);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	for (i = 0; i < BENCH_ROUNDS; i++)
+		composite_clipped(s.src, s.mask, s.dest[1], &s.transform,
+				  PIXMAN_FILTER_BILINEAR, &s.clip);
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+
+	fprintf(stderr, "%d clip boxes, %dx%d destination\n",
+		n_box, DEST_WIDTH, DEST_HEIGHT);
+	fprintf(stderr, "whole destination per box: %8.2f ms/frame\n",
+		elapsed_ms(&t0, &t1) / BENCH_ROUNDS);
+	fprintf(stderr, "box destination extents:   %8.2f ms/frame\n",
+		elapsed_ms(&t1, &t2) / BENCH_ROUNDS);
+
+	setup_fini(&s);
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Runs the headless backend at 144 Hz on a virtual presentation clock and
+ * checks that presentation feedback reports vsynced frames whose
+ * timestamps sit on the refresh grid and agree with the MSC.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include "shared/helpers.h"
+#include "shared/xalloc.h"
+#include "shared/timespec-util.h"
+#include "weston-test-client-helper.h"
+#include "presentation-time-client-protocol.h"
+
+#define REFRESH_MHZ 144000
+#define FRAMES 16
+
+char *server_parameters = "--refresh-rate=144000 --virtual-clock";
+
+struct feedback {
+	struct client *client;
+	struct wp_presentation_feedback *obj;
+	bool done;
+	bool presented;
+
+	uint64_t seq;
+	struct timespec time;
+	uint32_t refresh_nsec;
+	uint32_t flags;
+};
+
+static void
+feedback_sync_output(void *data,
+		     struct wp_presentation_feedback *presentation_feedback,
+		     struct wl_output *output)
+{
+}
+
+static void
+feedback_presented(void *data,
+		   struct wp_presentation_feedback *presentation_feedback,
+		   uint32_t tv_sec_hi,
+		   uint32_t tv_sec_lo,
+		   uint32_t tv_nsec,
+		   uint32_t refresh_nsec,
+		   uint32_t seq_hi,
+		   uint32_t seq_lo,
+		   uint32_t flags)
+{
+	struct feedback *fb = data;
+
+	fb->done = true;
+	fb->presented = true;
+	fb->seq = ((uint64_t)seq_hi << 32) + seq_lo;
+	timespec_from_proto(&fb->time, tv_sec_hi, tv_sec_lo, tv_nsec);
+	fb->refresh_nsec = refresh_nsec;
+	fb->flags = flags;
+}
+
+static void
+feedback_discarded(void *data,
+		   struct wp_presentation_feedback *presentation_feedback)
+{
+	struct feedback *fb = data;
+
+	fb->done = true;
+}
+
+static const struct wp_presentation_feedback_listener feedback_listener = {
+	feedback_sync_output,
+	feedback_presented,
+	feedback_discarded
+};
+
+static struct wp_presentation *
+bind_presentation(struct client *client)
+{
+	struct global *g;
+
+	wl_list_for_each(g, &client->global_list, link) {
+		if (strcmp(g->interface, wp_presentation_interface.name) == 0)
+			return wl_registry_bind(client->wl_registry, g->name,
+						&wp_presentation_interface, 1);
+	}
+
+	assert(0 && "no presentation found");
+	return NULL;
+}
+
+static void
+present_frame(struct client *client, struct wp_presentation *pres,
+	      struct feedback *fb)
+{
+	struct wl_surface *surface = client->surface->wl_surface;
+
+	fb->client = client;
+	fb->obj = wp_presentation_feedback(pres, surface);
+	wp_presentation_feedback_add_listener(fb->obj, &feedback_listener, fb);
+
+	wl_surface_attach(surface, client->surface->buffer->proxy, 0, 0);
+	wl_surface_damage(surface, 0, 0, 100, 100);
+	wl_surface_commit(surface);
+
+	while (!fb->done)
+		assert(wl_display_dispatch(client->wl_display) >= 0);
+
+	wp_presentation_feedback_destroy(fb->obj);
+}
+
+TEST(test_presentation_virtual_clock)
+{
+	struct client *client;
+	struct wp_presentation *pres;
+	struct feedback fb[FRAMES];
+	int64_t period = millihz_to_nsec(REFRESH_MHZ);
+	int64_t delta;
+	int i;
+
+	client = create_client_and_test_surface(100, 50, 123, 77);
+	assert(client);
+	pres = bind_presentation(client);
+
+	memset(fb, 0, sizeof fb);
+	for (i = 0; i < FRAMES; i++)
+		present_frame(client, pres, &fb[i]);
+
+	for (i = 0; i < FRAMES; i++) {
+		assert(fb[i].presented);
+		assert(fb[i].flags & WP_PRESENTATION_FEEDBACK_KIND_VSYNC);
+		assert(fb[i].refresh_nsec == period);
+
+		if (i == 0)
+			continue;
+
+		/* Every frame lands on a later vblank of the same grid,
+		 * and the MSC counts the vblanks in between. */
+		assert(fb[i].seq > fb[i - 1].seq);
+		delta = timespec_sub_to_nsec(&fb[i].time, &fb[i - 1].time);
+		assert(delta == (int64_t)(fb[i].seq - fb[i - 1].seq) * period);
+	}
+
+	printf("%d frames, seq %" PRIu64 "..%" PRIu64 ", period %" PRId64
+	       " ns\n", FRAMES, fb[0].seq, fb[FRAMES - 1].seq, period);
+
+	wp_presentation_destroy(pres);
+}
@@ -0,0 +1,229 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "shared/helpers.h"
+#include "weston-test-client-helper.h"
+#include "weston-repaint-stats-client-protocol.h"
+
+#define N_FRAMES 10
+#define N_STAGES (WESTON_REPAINT_STATS_REPORT_STAGE_STATE_CHANGES + 1)
+#define N_STAGES_V1 (WESTON_REPAINT_STATS_REPORT_STAGE_DAMAGE_AREA + 1)
+
+struct histogram {
+	uint32_t count;
+	uint32_t min, max, mean;
+	uint32_t p50, p90, p99, p999;
+};
+
+struct report {
+	uint64_t frames;
+	uint64_t missed;
+	struct histogram histogram[N_STAGES];
+	int n_histograms;
+	int done;
+};
+
+static struct weston_repaint_stats *
+get_repaint_stats(struct client *client, uint32_t version)
+{
+	struct global *g;
+	struct global *global_stats = NULL;
+	struct weston_repaint_stats *stats;
+
+	wl_list_for_each(g, &client->global_list, link) {
+		if (strcmp(g->interface, weston_repaint_stats_interface.name))
+			continue;
+
+		if (global_stats)
+			assert(0 && "multiple repaint stats objects");
+
+		global_stats = g;
+	}
+
+	assert(global_stats && "no repaint stats found");
+	assert(global_stats->version >= version);
+
+	stats = wl_registry_bind(client->wl_registry, global_stats->name,
+				 &weston_repaint_stats_interface, version);
+	assert(stats);
+
+	return stats;
+}
+
+static void
+report_counters(void *data, struct weston_repaint_stats_report *report,
+		uint32_t frames_hi, uint32_t frames_lo,
+		uint32_t missed_hi, uint32_t missed_lo)
+{
+	struct report *r = data;
+
+	r->frames = ((uint64_t)frames_hi << 32) | frames_lo;
+	r->missed = ((uint64_t)missed_hi << 32) | missed_lo;
+}
+
+static void
+report_histogram(void *data, struct weston_repaint_stats_report *report,
+		 uint32_t stage, uint32_t count,
+		 uint32_t min, uint32_t max, uint32_t mean,
+		 uint32_t p50, uint32_t p90, uint32_t p99, uint32_t p999)
+{
+	struct report *r = data;
+	struct histogram *h;
+
+	assert(stage < ARRAY_LENGTH(r->histogram));
+	h = &r->histogram[stage];
+	h->count = count;
+	h->min = min;
+	h->max = max;
+	h->mean = mean;
+	h->p50 = p50;
+	h->p90 = p90;
+	h->p99 = p99;
+	h->p999 = p999;
+	r->n_histograms++;
+}
+
+static void
+report_done(void *data, struct weston_repaint_stats_report *report)
+{
+	struct report *r = data;
+
+	r->done = 1;
+}
+
+static const struct weston_repaint_stats_report_listener report_listener = {
+	report_counters,
+	report_histogram,
+	report_done,
+};
+
+static void
+get_report(struct client *client, struct weston_repaint_stats *stats,
+	   struct report *r)
+{
+	struct weston_repaint_stats_report *report;
+
+	memset(r, 0, sizeof *r);
+	report = weston_repaint_stats_get_output_stats(stats,
+					client->output->wl_output);
+	weston_repaint_stats_report_add_listener(report, &report_listener, r);
+	client_roundtrip(client);
+	assert(r->done);
+	weston_repaint_stats_report_destroy(report);
+}
+
+static void
+check_histogram(const struct histogram *h)
+{
+	if (h->count == 0)
+		return;
+
+	assert(h->min <= h->mean && h->mean <= h->max);
+	assert(h->min <= h->p50);
+	assert(h->p50 <= h->p90);
+	assert(h->p90 <= h->p99);
+	assert(h->p99 <= h->p999);
+	assert(h->p999 <= h->max);
+}
+
+TEST(repaint_stats_count_frames)
+{
+	struct client *client;
+	struct weston_repaint_stats *stats;
+	struct wl_surface *surface;
+	struct report r;
+	struct histogram *h;
+	int frame;
+	int i;
+
+	client = create_client_and_test_surface(10, 10, 100, 100);
+	assert(client);
+	surface = client->surface->wl_surface;
+
+	stats = get_repaint_stats(client, 2);
+	weston_repaint_stats_reset(stats, client->output->wl_output);
+
+	for (i = 0; i < N_FRAMES; i++) {
+		wl_surface_attach(surface, client->surface->buffer->proxy, 0, 0);
+		wl_surface_damage(surface, 0, 0, 100, 100);
+		frame_callback_set(surface, &frame);
+		wl_surface_commit(surface);
+		frame_callback_wait(client, &frame);
+	}
+
+	get_report(client, stats, &r);
+	printf("%" PRIu64 " frames, %" PRIu64 " missed\n",
+	       r.frames, r.missed);
+	assert(r.frames >= N_FRAMES);
+	assert(r.missed <= r.frames);
+	assert(r.n_histograms == N_STAGES);
+
+	for (i = 0; i < (int)ARRAY_LENGTH(r.histogram); i++) {
+		h = &r.histogram[i];
+		printf("stage %d: count %u min %u p50 %u p99 %u max %u\n",
+		       i, h->count, h->min, h->p50, h->p99, h->max);
+		check_histogram(h);
+	}
+
+	/* Every posted repaint is sampled, and at most the last one can
+	 * still be waiting for its frame to finish. */
+	h = r.histogram;
+	assert(h[WESTON_REPAINT_STATS_REPORT_STAGE_START_TO_POSTED].count ==
+	       r.frames);
+	assert(h[WESTON_REPAINT_STATS_REPORT_STAGE_POSTED_TO_FINISH].count + 1
+	       >= r.frames);
+
+	/* The whole surface was damaged every frame. */
+	assert(h[WESTON_REPAINT_STATS_REPORT_STAGE_DAMAGE_AREA].max >=
+	       100 * 100);
+
+	weston_repaint_stats_destroy(stats);
+}
+
+TEST(repaint_stats_version_1_stages)
+{
+	struct client *client;
+	struct weston_repaint_stats *stats;
+	struct report r;
+
+	client = create_client_and_test_surface(10, 10, 100, 100);
+	assert(client);
+
+	/* The renderer stages were added in version 2. */
+	stats = get_repaint_stats(client, 1);
+	get_report(client, stats, &r);
+	assert(r.n_histograms == N_STAGES_V1);
+
+	weston_repaint_stats_destroy(stats);
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Screen share benchmark. The configuration starts sharing the first
+ * output into a nested headless weston running fullscreen-shell. The test
+ * then repaints the output, first moving a small view so only a little
+ * of the output is damaged each frame, then damaging the whole output,
+ * and reports the CPU time per frame of each phase. Each phase must have
+ * posted updates to the parent, and the parent must have answered with
+ * frames. screen-share.so logs the bytes copied and the time spent per
+ * update when the output goes away.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <assert.h>
+#include <time.h>
+
+#include "compositor.h"
+#include "compositor/weston.h"
+#include "compositor/screen-share.h"
+#include "shared/helpers.h"
+#include "shared/timespec-util.h"
+
+#define FRAMES_PER_PHASE 60
+
+enum bench_phase {
+	PHASE_SMALL_DAMAGE,
+	PHASE_FULL_DAMAGE,
+	PHASE_DONE,
+};
+
+static const char *phase_names[] = {
+	[PHASE_SMALL_DAMAGE] = "64x64 damage",
+	[PHASE_FULL_DAMAGE] = "full damage",
+};
+
+struct bench {
+	struct weston_compositor *compositor;
+	struct weston_output *output;
+	const struct weston_screen_share_api *api;
+	struct weston_screen_share_stats stats;
+	struct wl_listener frame_listener;
+
+	struct weston_layer layer;
+	struct weston_surface *surface;
+	struct weston_view *view;
+
+	enum bench_phase phase;
+	int frame;
+	struct timespec start;
+};
+
+static struct bench bench_state;
+
+static void
+bench_damage(struct bench *bench)
+{
+	struct weston_view *view = bench->view;
+
+	switch (bench->phase) {
+	case PHASE_SMALL_DAMAGE:
+		weston_view_set_position(view,
+					 (bench->frame * 8) %
+					 (bench->output->width - 64),
+					 view->geometry.y);
+		weston_view_schedule_repaint(view);
+		break;
+	case PHASE_FULL_DAMAGE:
+		weston_output_damage(bench->output);
+		break;
+	case PHASE_DONE:
+		break;
+	}
+}
+
+static void
+bench_frame(struct wl_listener *listener, void *data)
+{
+	struct bench *bench = container_of(listener, struct bench,
+					   frame_listener);
+	struct weston_screen_share_stats stats;
+	struct timespec now;
+	int ret;
+
+	if (bench->frame++ == 0)
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &bench->start);
+
+	if (bench->frame <= FRAMES_PER_PHASE) {
+		bench_damage(bench);
+		return;
+	}
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+
+	/* The numbers are meaningless unless the phase was shared. */
+	ret = bench->api->get_stats(bench->output, &stats);
+	assert(ret == 0);
+	assert(stats.frames > bench->stats.frames);
+	assert(stats.bytes > bench->stats.bytes);
+	assert(stats.parent_frames > bench->stats.parent_frames);
+	bench->stats = stats;
+
+	fprintf(stderr, "screen-share: %-12s %8.1f us CPU per frame\n",
+		phase_names[bench->phase],
+		timespec_sub_to_nsec(&now, &bench->start) /
+		(1000.0 * FRAMES_PER_PHASE));
+
+	bench->phase++;
+	bench->frame = 0;
+
+	if (bench->phase == PHASE_DONE) {
+		wl_list_remove(&bench->frame_listener.link);
+		weston_surface_destroy(bench->surface);
+		wl_display_terminate(bench->compositor->wl_display);
+		return;
+	}
+
+	bench_damage(bench);
+}
+
+static void
+bench_start(void *data)
+{
+	struct bench *bench = data;
+	struct weston_compositor *compositor = bench->compositor;
+	int ret;
+
+	assert(!wl_list_empty(&compositor->output_list));
+	bench->output = container_of(compositor->output_list.next,
+				     struct weston_output, link);
+
+	/* screen-share.so shares the first output on startup. */
+	bench->api = weston_screen_share_get_api(compositor);
+	assert(bench->api);
+	ret = bench->api->get_stats(bench->output, &bench->stats);
+	assert(ret == 0);
+
+	weston_layer_init(&bench->layer, compositor);
+	weston_layer_set_position(&bench->layer,
+				  WESTON_LAYER_POSITION_NORMAL);
+
+	bench->surface = weston_surface_create(compositor);
+	assert(bench->surface);
+	bench->view = weston_view_create(bench->surface);
+	assert(bench->view);
+
+	weston_surface_set_color(bench->surface, 1.0, 0.5, 0.0, 1.0);
+	weston_surface_set_size(bench->surface, 64, 64);
+	weston_view_set_position(bench->view, 0, 0);
+	weston_layer_entry_insert(&bench->layer.view_list,
+				  &bench->view->layer_link);
+	bench->surface->is_mapped = true;
+	bench->view->is_mapped = true;
+
+	bench->frame_listener.notify = bench_frame;
+	wl_signal_add(&bench->output->frame_signal, &bench->frame_listener);
+
+	bench->phase = PHASE_SMALL_DAMAGE;
+	weston_output_damage(bench->output);
+}
+
+WL_EXPORT int
+wet_module_init(struct weston_compositor *compositor,
+		int *argc, char *argv[])
+{
+	struct wl_event_loop *loop;
+
+	bench_state.compositor = compositor;
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+	wl_event_loop_add_idle(loop, bench_start, &bench_state);
+
+	return 0;
+}
@@ -32,7 +32,13 @@
 
 #include "weston-test-client-helper.h"
 
-char *server_parameters = "--use-pixman --width=320 --height=240"
+#ifdef TEST_GL_RENDERER
+#define RENDERER_OPTION "--use-gl"
+#else
+#define RENDERER_OPTION "--use-pixman"
+#endif
+
+char *server_parameters = RENDERER_OPTION " --width=320 --height=240"
 	" --shell=weston-test-desktop-shell.so";
 
 static struct wl_subcompositor *
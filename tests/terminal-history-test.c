@@ -0,0 +1,205 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "weston-test-runner.h"
+
+#include "shared/helpers.h"
+#include "clients/terminal-history.h"
+
+#define WIDTH 80
+
+static const struct attr fill = { 7, 0, 0, 0 };
+
+/* Row contents derived from the row number and a version, so that a
+ * replaced row can be told apart from its older copy. */
+static void
+make_row(uint32_t row, int version, int length,
+	 union utf8_char *data, struct attr *attr)
+{
+	int c;
+
+	memset(data, 0, WIDTH * sizeof *data);
+	for (c = 0; c < WIDTH; c++) {
+		if (c < length)
+			data[c].ch = 'a' + (row + version + c) % 26;
+		attr[c] = fill;
+		attr[c].fg = c < length / 2 ? (row + version) % 8 : 1;
+	}
+}
+
+static void
+check_row(struct history *history, uint32_t row, int version, int length)
+{
+	union utf8_char data[WIDTH], expect_data[WIDTH];
+	struct attr attr[WIDTH], expect_attr[WIDTH];
+
+	assert(history_contains(history, row));
+
+	make_row(row, version, length, expect_data, expect_attr);
+	history_get(history, row, data, attr, WIDTH, fill);
+	assert(memcmp(data, expect_data, sizeof data) == 0);
+	assert(memcmp(attr, expect_attr, sizeof attr) == 0);
+}
+
+/* Rows skipped over are stored empty. */
+static void
+check_empty_row(struct history *history, uint32_t row)
+{
+	union utf8_char data[WIDTH];
+	struct attr attr[WIDTH];
+	int c;
+
+	assert(history_contains(history, row));
+
+	history_get(history, row, data, attr, WIDTH, fill);
+	for (c = 0; c < WIDTH; c++) {
+		assert(data[c].ch == 0);
+		assert(memcmp(&attr[c], &fill, sizeof fill) == 0);
+	}
+}
+
+static void
+store_row(struct history *history, uint32_t row, int version, int length)
+{
+	union utf8_char data[WIDTH];
+	struct attr attr[WIDTH];
+
+	make_row(row, version, length, data, attr);
+	history_store(history, row, data, attr, WIDTH);
+}
+
+static int
+row_length(uint32_t row)
+{
+	return (row * 7) % (WIDTH + 1);
+}
+
+TEST(terminal_history_store_get)
+{
+	struct history history;
+	uint32_t row;
+
+	history_init(&history, 1000);
+
+	for (row = 0; row < 300; row++)
+		store_row(&history, row, 0, row_length(row));
+
+	assert(history.end == 300);
+	for (row = 0; row < 300; row++)
+		check_row(&history, row, 0, row_length(row));
+	assert(!history_contains(&history, 300));
+
+	history_release(&history);
+}
+
+TEST(terminal_history_replace)
+{
+	struct history history;
+	uint32_t row;
+
+	history_init(&history, 1000);
+
+	for (row = 0; row < 3 * HISTORY_BLOCK_ROWS; row++)
+		store_row(&history, row, 0, row_length(row));
+
+	/* Grow and shrink rows at the start, in the middle and at the end
+	 * of a block, and the last stored row. */
+	store_row(&history, HISTORY_BLOCK_ROWS, 1, WIDTH);
+	store_row(&history, HISTORY_BLOCK_ROWS + 10, 1, WIDTH);
+	store_row(&history, 2 * HISTORY_BLOCK_ROWS - 1, 1, 0);
+	store_row(&history, 3 * HISTORY_BLOCK_ROWS - 1, 1, WIDTH);
+	store_row(&history, HISTORY_BLOCK_ROWS + 10, 2, 3);
+
+	assert(history.end == 3 * HISTORY_BLOCK_ROWS);
+	for (row = 0; row < 3 * HISTORY_BLOCK_ROWS; row++) {
+		if (row == HISTORY_BLOCK_ROWS)
+			check_row(&history, row, 1, WIDTH);
+		else if (row == HISTORY_BLOCK_ROWS + 10)
+			check_row(&history, row, 2, 3);
+		else if (row == 2 * HISTORY_BLOCK_ROWS - 1)
+			check_row(&history, row, 1, 0);
+		else if (row == 3 * HISTORY_BLOCK_ROWS - 1)
+			check_row(&history, row, 1, WIDTH);
+		else
+			check_row(&history, row, 0, row_length(row));
+	}
+
+	history_release(&history);
+}
+
+TEST(terminal_history_drops_oldest_block)
+{
+	struct history history;
+	uint32_t row;
+
+	/* Room for one block, plus the one being filled. */
+	history_init(&history, HISTORY_BLOCK_ROWS);
+
+	for (row = 0; row < 3 * HISTORY_BLOCK_ROWS + 5; row++)
+		store_row(&history, row, 0, row_length(row));
+
+	assert(!history_contains(&history, HISTORY_BLOCK_ROWS - 1));
+	for (row = 2 * HISTORY_BLOCK_ROWS; row < history.end; row++)
+		check_row(&history, row, 0, row_length(row));
+
+	/* A row that was dropped can't be written back. */
+	store_row(&history, 0, 1, WIDTH);
+	assert(!history_contains(&history, 0));
+	check_row(&history, 2 * HISTORY_BLOCK_ROWS, 0,
+		  row_length(2 * HISTORY_BLOCK_ROWS));
+
+	history_release(&history);
+}
+
+TEST(terminal_history_gaps)
+{
+	struct history history;
+	uint32_t row;
+
+	history_init(&history, 1000);
+
+	store_row(&history, 0, 0, WIDTH);
+	store_row(&history, 10, 0, WIDTH);
+
+	check_row(&history, 0, 0, WIDTH);
+	for (row = 1; row < 10; row++)
+		check_empty_row(&history, row);
+	check_row(&history, 10, 0, WIDTH);
+
+	/* A gap bigger than the history starts over. */
+	row = 100000;
+	store_row(&history, row, 0, WIDTH);
+	assert(!history_contains(&history, 10));
+	check_row(&history, row, 0, WIDTH);
+
+	history_release(&history);
+}
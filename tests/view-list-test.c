@@ -0,0 +1,245 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Repaint benchmark for the compositor view list. Each phase maps a
+ * number of views into a layer, then moves one of them per frame and
+ * measures the CPU time spent per repaint. Moving a view only dirties
+ * geometry, so the view list must not be rebuilt, and the per-frame cost
+ * should grow much slower than the view count. The test finally restacks
+ * a view and checks that the view list follows.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include "compositor.h"
+#include "compositor/weston.h"
+#include "shared/helpers.h"
+#include "shared/timespec-util.h"
+
+#define FRAMES_PER_PHASE 30
+
+static const int view_counts[] = { 16, 64, 256, 1024 };
+
+struct bench {
+	struct weston_compositor *compositor;
+	struct weston_output *output;
+	int (*repaint)(struct weston_output *output,
+		       pixman_region32_t *damage,
+		       void *repaint_data);
+
+	struct weston_layer layer;
+	struct weston_view **views;
+	int n_views;
+
+	unsigned int phase;
+	int frame;
+	struct timespec cpu_start;
+};
+
+static struct bench bench_state;
+
+static void
+bench_next_phase(void *data);
+
+static void
+bench_clear_views(struct bench *bench)
+{
+	int i;
+
+	for (i = 0; i < bench->n_views; i++)
+		weston_surface_destroy(bench->views[i]->surface);
+
+	free(bench->views);
+	bench->views = NULL;
+	bench->n_views = 0;
+}
+
+static void
+bench_map_views(struct bench *bench, int count)
+{
+	struct weston_surface *surface;
+	struct weston_view *view;
+	int i;
+
+	bench->views = calloc(count, sizeof *bench->views);
+	assert(bench->views);
+
+	for (i = 0; i < count; i++) {
+		surface = weston_surface_create(bench->compositor);
+		assert(surface);
+		view = weston_view_create(surface);
+		assert(view);
+
+		weston_surface_set_size(surface, 64, 64);
+		weston_view_set_position(view, (i * 7) % 512, (i * 13) % 512);
+		weston_layer_entry_insert(&bench->layer.view_list,
+					  &view->layer_link);
+		surface->is_mapped = true;
+		view->is_mapped = true;
+
+		bench->views[i] = view;
+	}
+
+	bench->n_views = count;
+}
+
+static void
+bench_check_order(struct bench *bench)
+{
+	struct weston_view *view;
+	int i = bench->n_views - 1;
+
+	/* Views were inserted at the top of the layer one by one, so the
+	 * view list holds them in reverse creation order. */
+	wl_list_for_each(view, &bench->compositor->view_list, link) {
+		if (view->layer_link.layer != &bench->layer)
+			continue;
+
+		assert(i >= 0);
+		assert(view == bench->views[i]);
+		i--;
+	}
+	assert(i == -1);
+}
+
+static void
+bench_finish(struct bench *bench)
+{
+	struct weston_view *top;
+
+	/* Raise the bottom view, the next repaint must pick it up. */
+	top = bench->views[0];
+	weston_layer_entry_remove(&top->layer_link);
+	weston_layer_entry_insert(&bench->layer.view_list, &top->layer_link);
+	memmove(&bench->views[0], &bench->views[1],
+		(bench->n_views - 1) * sizeof *bench->views);
+	bench->views[bench->n_views - 1] = top;
+
+	bench->frame = -1;
+	weston_view_geometry_dirty(top);
+	weston_output_schedule_repaint(bench->output);
+}
+
+static int
+bench_repaint(struct weston_output *output, pixman_region32_t *damage,
+	      void *repaint_data)
+{
+	struct bench *bench = &bench_state;
+	struct wl_event_loop *loop =
+		wl_display_get_event_loop(bench->compositor->wl_display);
+	struct weston_view *view;
+	struct timespec now;
+	int ret;
+
+	ret = bench->repaint(output, damage, repaint_data);
+
+	if (bench->frame < 0) {
+		/* Restack check after the last phase. */
+		bench_check_order(bench);
+		bench_clear_views(bench);
+		output->repaint = bench->repaint;
+		wl_display_terminate(bench->compositor->wl_display);
+		return ret;
+	}
+
+	if (bench->frame == 0)
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &bench->cpu_start);
+
+	if (++bench->frame < FRAMES_PER_PHASE) {
+		view = bench->views[bench->frame % bench->n_views];
+		weston_view_set_position(view, view->geometry.x + 1,
+					 view->geometry.y);
+		weston_view_schedule_repaint(view);
+		return ret;
+	}
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	fprintf(stderr, "view-list: %5d views: %8.1f us CPU per frame\n",
+		bench->n_views,
+		timespec_sub_to_nsec(&now, &bench->cpu_start) /
+		(1000.0 * (FRAMES_PER_PHASE - 1)));
+
+	bench_check_order(bench);
+	bench->phase++;
+	wl_event_loop_add_idle(loop, bench_next_phase, bench);
+
+	return ret;
+}
+
+static void
+bench_next_phase(void *data)
+{
+	struct bench *bench = data;
+
+	if (bench->phase == ARRAY_LENGTH(view_counts)) {
+		bench_finish(bench);
+		return;
+	}
+
+	bench_clear_views(bench);
+	bench_map_views(bench, view_counts[bench->phase]);
+	bench->frame = 0;
+	weston_output_schedule_repaint(bench->output);
+}
+
+static void
+bench_start(void *data)
+{
+	struct bench *bench = data;
+	struct weston_compositor *compositor = bench->compositor;
+
+	assert(!wl_list_empty(&compositor->output_list));
+	bench->output = container_of(compositor->output_list.next,
+				     struct weston_output, link);
+	bench->repaint = bench->output->repaint;
+	bench->output->repaint = bench_repaint;
+
+	weston_layer_init(&bench->layer, compositor);
+	weston_layer_set_position(&bench->layer,
+				  WESTON_LAYER_POSITION_NORMAL);
+
+	bench_next_phase(bench);
+}
+
+WL_EXPORT int
+wet_module_init(struct weston_compositor *compositor,
+		int *argc, char *argv[])
+{
+	struct wl_event_loop *loop;
+
+	bench_state.compositor = compositor;
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+	wl_event_loop_add_idle(loop, bench_start, &bench_state);
+
+	return 0;
+}
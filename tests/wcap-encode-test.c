@@ -0,0 +1,265 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "weston-test-runner.h"
+
+#include "shared/helpers.h"
+#include "shared/timespec-util.h"
+#include "wcap-encode.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define BENCH_ROUNDS 20
+
+typedef void (*fill_func)(uint32_t *frame, int n, uint32_t seed);
+
+/* Mostly unchanged pixels, like a mostly static desktop. */
+static void
+fill_static(uint32_t *frame, int n, uint32_t seed)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		frame[i] = 0xff336699;
+	for (i = 0; i < n / 64; i++) {
+		seed = seed * 1103515245 + 12345;
+		frame[seed % n] = 0xff000000 | seed >> 8;
+	}
+}
+
+/* Horizontal gradients, changing in every pixel. */
+static void
+fill_gradient(uint32_t *frame, int n, uint32_t seed)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		frame[i] = 0xff000000 | ((i + seed) & 0xff) << 16 |
+			   (i & 0xff00) | (seed & 0xff);
+}
+
+/* Noise, with alpha garbage that the encoder has to ignore. */
+static void
+fill_noise(uint32_t *frame, int n, uint32_t seed)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		seed = seed * 1103515245 + 12345;
+		frame[i] = seed;
+	}
+}
+
+static const fill_func fills[] = {
+	fill_static,
+	fill_gradient,
+	fill_noise,
+};
+
+/* Encode one width x height rectangle of two consecutive frames. */
+static uint32_t *
+encode_rect(uint32_t *(*encode_span)(uint32_t *p, struct wcap_run *run,
+				     uint32_t *ref, const uint32_t *src,
+				     int n),
+	    uint32_t *out, uint32_t *ref, const uint32_t *src,
+	    int width, int height)
+{
+	struct wcap_run run = { 0 };
+	int j;
+
+	for (j = 0; j < height; j++)
+		out = encode_span(out, &run, ref + j * width,
+				  src + j * width, width);
+
+	return wcap_encode_flush(out, &run);
+}
+
+/* The decoding loop of wcap-decode, for rows in encoding order. */
+static void
+decode_rect(uint32_t *frame, const uint32_t *p, int count)
+{
+	uint32_t v;
+	int i = 0, j, k, l;
+	unsigned char r, g, b;
+
+	while (i < count) {
+		v = *p++;
+		l = v >> 24;
+		j = l < 0xe0 ? l + 1 : 1 << (l - 0xe0 + 7);
+		assert(i + j <= count);
+
+		for (k = 0; k < j; k++, i++) {
+			r = (frame[i] >> 16) + (v >> 16);
+			g = (frame[i] >> 8) + (v >> 8);
+			b = frame[i] + v;
+			frame[i] = 0xff000000 | (r << 16) | (g << 8) | b;
+		}
+	}
+}
+
+TEST_P(wcap_encode_matches_scalar, fills)
+{
+	const fill_func *fill = data;
+	static const int sizes[][2] = {
+		{ 1, 1 }, { 3, 5 }, { 7, 9 }, { 17, 3 }, { 64, 64 },
+		{ 333, 17 }, { WIDTH, 8 },
+	};
+	uint32_t *prev, *next, *ref_c, *ref, *out_c, *out, *end_c, *end;
+	uint32_t *decoded;
+	unsigned i;
+	int n, k;
+
+	for (i = 0; i < ARRAY_LENGTH(sizes); i++) {
+		n = sizes[i][0] * sizes[i][1];
+		prev = malloc(n * sizeof *prev);
+		next = malloc(n * sizeof *next);
+		ref_c = malloc(n * sizeof *ref_c);
+		ref = malloc(n * sizeof *ref);
+		out_c = malloc(n * sizeof *out_c);
+		out = malloc(n * sizeof *out);
+		decoded = malloc(n * sizeof *decoded);
+		assert(prev && next && ref_c && ref && out_c && out && decoded);
+
+		fill_noise(prev, n, i);
+		(*fill)(next, n, i + 1);
+		memcpy(ref_c, prev, n * sizeof *prev);
+		memcpy(ref, prev, n * sizeof *prev);
+
+		end_c = encode_rect(wcap_encode_span_c, out_c, ref_c, next,
+				    sizes[i][0], sizes[i][1]);
+		end = encode_rect(wcap_encode_span, out, ref, next,
+				  sizes[i][0], sizes[i][1]);
+
+		assert(end - out == end_c - out_c);
+		assert(end - out <= n);
+		assert(memcmp(out, out_c, (end - out) * sizeof *out) == 0);
+		assert(memcmp(ref, next, n * sizeof *ref) == 0);
+
+		/* Decoding restores the color channels of the frame. */
+		memcpy(decoded, prev, n * sizeof *prev);
+		decode_rect(decoded, out, n);
+		for (k = 0; k < n; k++)
+			assert(((decoded[k] ^ next[k]) & 0xffffff) == 0);
+
+		free(prev);
+		free(next);
+		free(ref_c);
+		free(ref);
+		free(out_c);
+		free(out);
+		free(decoded);
+	}
+}
+
+TEST(wcap_encode_long_runs)
+{
+	static const int lengths[] = { 1, 0xe0, 0xe1, 0x100, 0x1000, 12345 };
+	uint32_t *ref, *src, *out, *end, *decoded;
+	unsigned i;
+	int n, k;
+
+	for (i = 0; i < ARRAY_LENGTH(lengths); i++) {
+		n = lengths[i];
+		ref = calloc(n, sizeof *ref);
+		src = malloc(n * sizeof *src);
+		out = malloc(n * sizeof *out);
+		decoded = calloc(n, sizeof *decoded);
+		assert(ref && src && out && decoded);
+
+		for (k = 0; k < n; k++)
+			src[k] = 0xff102030;
+
+		end = encode_rect(wcap_encode_span, out, ref, src, n, 1);
+		assert(end - out <= 32);
+
+		decode_rect(decoded, out, n);
+		for (k = 0; k < n; k++)
+			assert(decoded[k] == 0xff102030);
+
+		free(ref);
+		free(src);
+		free(out);
+		free(decoded);
+	}
+}
+
+static double
+bench_encode(uint32_t *(*encode_span)(uint32_t *p, struct wcap_run *run,
+				      uint32_t *ref, const uint32_t *src,
+				      int n),
+	     fill_func fill, uint32_t *ref, uint32_t *src, uint32_t *out)
+{
+	struct timespec t0, t1;
+	int64_t nsec = 0;
+	int i;
+
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		fill(src, WIDTH * HEIGHT, i);
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		encode_rect(encode_span, out, ref, src, WIDTH, HEIGHT);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+
+		nsec += timespec_sub_to_nsec(&t1, &t0);
+	}
+
+	return nsec / (1e6 * BENCH_ROUNDS);
+}
+
+TEST(wcap_encode_benchmark)
+{
+	static const char *fill_names[] = { "static", "gradient", "noise" };
+	uint32_t *ref, *src, *out;
+	double ms_c, ms;
+	unsigned i;
+
+	ref = calloc(WIDTH * HEIGHT, sizeof *ref);
+	src = malloc(WIDTH * HEIGHT * sizeof *src);
+	out = malloc(WIDTH * HEIGHT * sizeof *out);
+	assert(ref && src && out);
+
+	for (i = 0; i < ARRAY_LENGTH(fills); i++) {
+		ms_c = bench_encode(wcap_encode_span_c, fills[i],
+				    ref, src, out);
+		ms = bench_encode(wcap_encode_span, fills[i], ref, src, out);
+
+		fprintf(stderr, "%-8s %dx%d frame: c %7.3f ms, %s %7.3f ms\n",
+			fill_names[i], WIDTH, HEIGHT, ms_c,
+			wcap_encode_impl_name(), ms);
+	}
+
+	free(ref);
+	free(src);
+	free(out);
+}
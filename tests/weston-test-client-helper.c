@@ -246,6 +246,23 @@ static void
 keyboard_handle_keymap(void *data, struct wl_keyboard *wl_keyboard,
 		       uint32_t format, int fd, uint32_t size)
 {
+	struct keyboard *keyboard = data;
+	void *map;
+
+	free(keyboard->keymap);
+	keyboard->keymap = NULL;
+
+	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map != MAP_FAILED) {
+		keyboard->keymap = strndup(map, size);
+		munmap(map, size);
+	}
+
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	keyboard->keymap_shared_writable = map != MAP_FAILED;
+	if (map != MAP_FAILED)
+		munmap(map, size);
+
 	close(fd);
 
 	fprintf(stderr, "test-client: got keyboard keymap\n");
@@ -563,6 +580,7 @@ input_destroy(struct input *inp)
 	}
 	if (inp->keyboard) {
 		wl_keyboard_release(inp->keyboard->wl_keyboard);
+		free(inp->keyboard->keymap);
 		free(inp->keyboard);
 	}
 	if (inp->touch) {
@@ -607,6 +625,7 @@ input_update_devices(struct input *input)
 		input->keyboard = keyboard;
 	} else if (!(caps & WL_SEAT_CAPABILITY_KEYBOARD) && input->keyboard) {
 		wl_keyboard_destroy(input->keyboard->wl_keyboard);
+		free(input->keyboard->keymap);
 		free(input->keyboard);
 		input->keyboard = NULL;
 	}
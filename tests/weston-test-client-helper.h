@@ -122,6 +122,8 @@ struct keyboard {
 	uint32_t key_time_msec;
 	struct timespec input_timestamp;
 	struct timespec key_time_timespec;
+	char *keymap;
+	bool keymap_shared_writable;
 };
 
 struct touch {
@@ -0,0 +1,388 @@
+/*
+ * Copyright © 2018 The Weston contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Converts the binary timeline written by weston into either the JSON
+ * stream format understood by Wesgr, or the Chrome trace event format
+ * that chrome://tracing and Perfetto load.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "timeline.h"
+#include "timeline-binary.h"
+
+enum output_format {
+	FORMAT_JSON,
+	FORMAT_CHROME,
+};
+
+struct converter {
+	enum output_format format;
+	FILE *in;
+	FILE *out;
+
+	char **names;		/* indexed by name record id */
+	uint32_t names_alloc;
+
+	uint64_t dropped;
+	int first_event;
+};
+
+static void
+usage(int error_code)
+{
+	fprintf(stderr, "Usage: weston-timeline-convert [OPTIONS] FILE\n\n"
+		"Convert a binary weston timeline to text on stdout.\n\n"
+		"  --json\tWrite the JSON stream format read by Wesgr (default)\n"
+		"  --chrome\tWrite Chrome trace event JSON\n"
+		"  --help\tThis help text\n\n");
+
+	exit(error_code);
+}
+
+static int
+string_table_set(char ***table, uint32_t *alloc, uint32_t id,
+		 const char *str)
+{
+	char **t;
+	uint32_t n;
+
+	if (id >= *alloc) {
+		n = id + 64;
+		t = realloc(*table, n * sizeof *t);
+		if (!t)
+			return -1;
+		memset(t + *alloc, 0, (n - *alloc) * sizeof *t);
+		*table = t;
+		*alloc = n;
+	}
+
+	free((*table)[id]);
+	(*table)[id] = strdup(str);
+
+	return (*table)[id] ? 0 : -1;
+}
+
+static const char *
+string_table_get(char **table, uint32_t alloc, uint32_t id)
+{
+	if (id >= alloc || !table[id])
+		return NULL;
+
+	return table[id];
+}
+
+static void
+string_table_free(char **table, uint32_t alloc)
+{
+	uint32_t i;
+
+	for (i = 0; i < alloc; i++)
+		free(table[i]);
+	free(table);
+}
+
+/* Record strings come from a file, make sure they are terminated. */
+static const char *
+record_string(char *str, size_t size)
+{
+	str[size - 1] = '\0';
+
+	return str;
+}
+
+static void
+fprint_quoted_string(FILE *fp, const char *str)
+{
+	if (!str) {
+		fprintf(fp, "null");
+		return;
+	}
+
+	fprintf(fp, "\"%s\"", str);
+}
+
+static void
+json_object(struct converter *conv, struct weston_timeline_record *rec)
+{
+	const char *desc = record_string(rec->u.object.desc,
+					 sizeof rec->u.object.desc);
+
+	if (rec->type == WESTON_TIMELINE_RECORD_OUTPUT) {
+		fprintf(conv->out, "{ \"id\":%u, "
+			"\"type\":\"weston_output\", \"name\":",
+			rec->u.object.id);
+		fprint_quoted_string(conv->out, desc[0] ? desc : NULL);
+		fprintf(conv->out, " }\n");
+		return;
+	}
+
+	fprintf(conv->out, "{ \"id\":%u, "
+		"\"type\":\"weston_surface\", \"desc\":", rec->u.object.id);
+	fprint_quoted_string(conv->out, desc[0] ? desc : NULL);
+	if (rec->u.object.main_surface)
+		fprintf(conv->out, ", \"main_surface\":%u",
+			rec->u.object.main_surface);
+	fprintf(conv->out, " }\n");
+}
+
+static void
+json_point(struct converter *conv, struct weston_timeline_record *rec,
+	   const char *name)
+{
+	struct weston_timeline_arg *arg;
+	uint32_t i;
+
+	fprintf(conv->out, "{ \"T\":[%" PRId64 ", %ld], \"N\":\"%s\"",
+		rec->u.point.tv_sec, (long)rec->u.point.tv_nsec, name);
+
+	for (i = 0; i < rec->n_args; i++) {
+		arg = &rec->u.point.args[i];
+
+		switch (arg->type) {
+		case TLT_OUTPUT:
+			fprintf(conv->out, ", \"wo\":%u", arg->id);
+			break;
+		case TLT_SURFACE:
+			fprintf(conv->out, ", \"ws\":%u", arg->id);
+			break;
+		case TLT_VBLANK:
+			fprintf(conv->out, ", \"vblank\":[%" PRId64 ", %ld]",
+				arg->tv_sec, (long)arg->tv_nsec);
+			break;
+		case TLT_GPU:
+			fprintf(conv->out, ", \"gpu\":[%" PRId64 ", %ld]",
+				arg->tv_sec, (long)arg->tv_nsec);
+			break;
+		}
+	}
+
+	fprintf(conv->out, " }\n");
+}
+
+static void
+chrome_begin_event(struct converter *conv)
+{
+	fprintf(conv->out, conv->first_event ? "\n" : ",\n");
+	conv->first_event = 0;
+}
+
+static void
+chrome_object(struct converter *conv, struct weston_timeline_record *rec)
+{
+	const char *desc = record_string(rec->u.object.desc,
+					 sizeof rec->u.object.desc);
+
+	if (rec->type != WESTON_TIMELINE_RECORD_OUTPUT)
+		return;
+
+	/* Each output gets its own track. */
+	chrome_begin_event(conv);
+	fprintf(conv->out, "{\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+		"\"name\":\"thread_name\",\"args\":{\"name\":",
+		rec->u.object.id);
+	fprint_quoted_string(conv->out, desc[0] ? desc : "output");
+	fprintf(conv->out, "}}");
+}
+
+static void
+chrome_point(struct converter *conv, struct weston_timeline_record *rec,
+	     const char *name)
+{
+	struct weston_timeline_arg *arg;
+	uint32_t tid = 0;
+	uint32_t i;
+	const char *sep = "";
+
+	for (i = 0; i < rec->n_args; i++)
+		if (rec->u.point.args[i].type == TLT_OUTPUT)
+			tid = rec->u.point.args[i].id;
+
+	chrome_begin_event(conv);
+	fprintf(conv->out, "{\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u,"
+		"\"name\":\"%s\",\"ts\":%.3f,\"args\":{",
+		tid, name,
+		rec->u.point.tv_sec * 1e6 + rec->u.point.tv_nsec / 1e3);
+
+	for (i = 0; i < rec->n_args; i++) {
+		arg = &rec->u.point.args[i];
+
+		switch (arg->type) {
+		case TLT_OUTPUT:
+			fprintf(conv->out, "%s\"wo\":%u", sep, arg->id);
+			break;
+		case TLT_SURFACE:
+			fprintf(conv->out, "%s\"ws\":%u", sep, arg->id);
+			break;
+		case TLT_VBLANK:
+			fprintf(conv->out, "%s\"vblank_us\":%.3f", sep,
+				arg->tv_sec * 1e6 + arg->tv_nsec / 1e3);
+			break;
+		case TLT_GPU:
+			fprintf(conv->out, "%s\"gpu_us\":%.3f", sep,
+				arg->tv_sec * 1e6 + arg->tv_nsec / 1e3);
+			break;
+		default:
+			continue;
+		}
+		sep = ",";
+	}
+
+	fprintf(conv->out, "}}");
+}
+
+static int
+convert_record(struct converter *conv, struct weston_timeline_record *rec)
+{
+	const char *name;
+
+	switch (rec->type) {
+	case WESTON_TIMELINE_RECORD_NAME:
+		return string_table_set(&conv->names, &conv->names_alloc,
+					rec->u.name.id,
+					record_string(rec->u.name.str,
+						      sizeof rec->u.name.str));
+	case WESTON_TIMELINE_RECORD_OUTPUT:
+	case WESTON_TIMELINE_RECORD_SURFACE:
+		if (conv->format == FORMAT_JSON)
+			json_object(conv, rec);
+		else
+			chrome_object(conv, rec);
+		return 0;
+	case WESTON_TIMELINE_RECORD_POINT:
+		if (rec->n_args > WESTON_TIMELINE_MAX_ARGS)
+			return -1;
+		name = string_table_get(conv->names, conv->names_alloc,
+					rec->u.point.name);
+		if (!name)
+			return -1;
+		if (conv->format == FORMAT_JSON)
+			json_point(conv, rec, name);
+		else
+			chrome_point(conv, rec, name);
+		return 0;
+	case WESTON_TIMELINE_RECORD_DROPPED:
+		conv->dropped += rec->u.dropped.count;
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+static int
+convert(struct converter *conv)
+{
+	struct weston_timeline_file_header header;
+	struct weston_timeline_record rec;
+	unsigned long n = 0;
+
+	if (fread(&header, sizeof header, 1, conv->in) != 1 ||
+	    memcmp(header.magic, WESTON_TIMELINE_MAGIC,
+		   sizeof header.magic) != 0) {
+		fprintf(stderr, "not a weston timeline file\n");
+		return -1;
+	}
+
+	if (header.version != WESTON_TIMELINE_VERSION ||
+	    header.record_size != sizeof rec) {
+		fprintf(stderr, "unsupported timeline version %u\n",
+			header.version);
+		return -1;
+	}
+
+	if (conv->format == FORMAT_CHROME)
+		fprintf(conv->out, "{\"traceEvents\":[");
+
+	while (fread(&rec, sizeof rec, 1, conv->in) == 1) {
+		if (convert_record(conv, &rec) < 0) {
+			fprintf(stderr, "corrupt record %lu\n", n);
+			return -1;
+		}
+		n++;
+	}
+
+	if (conv->format == FORMAT_CHROME)
+		fprintf(conv->out, "\n]}\n");
+
+	if (conv->dropped)
+		fprintf(stderr, "warning: %" PRIu64 " points were dropped "
+			"while recording\n", conv->dropped);
+
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct converter conv = {
+		.format = FORMAT_JSON,
+		.out = stdout,
+		.first_event = 1,
+	};
+	const char *filename = NULL;
+	int ret;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--help") == 0) {
+			usage(EXIT_SUCCESS);
+		} else if (strcmp(argv[i], "--json") == 0) {
+			conv.format = FORMAT_JSON;
+		} else if (strcmp(argv[i], "--chrome") == 0) {
+			conv.format = FORMAT_CHROME;
+		} else if (argv[i][0] == '-') {
+			fprintf(stderr,
+				"unknown option or invalid argument: %s\n", argv[i]);
+			usage(EXIT_FAILURE);
+		} else if (!filename) {
+			filename = argv[i];
+		} else {
+			usage(EXIT_FAILURE);
+		}
+	}
+
+	if (!filename)
+		usage(EXIT_FAILURE);
+
+	conv.in = fopen(filename, "rb");
+	if (!conv.in) {
+		perror(filename);
+		return EXIT_FAILURE;
+	}
+
+	ret = convert(&conv);
+
+	fclose(conv.in);
+	string_table_free(conv.names, conv.names_alloc);
+
+	return ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -198,14 +198,16 @@ usage(int exit_code)
 {
 	fprintf(stderr, "usage: wcap-decode "
 		"[--help] [--yuv4mpeg2] [--frame=<frame>] [--all] \n"
-		"\t[--rate=<num:denom>] <wcap file>\n\n"
+		"\t[--rate=<num:denom>] [--from=<ms>] [--to=<ms>] <wcap file>\n\n"
 		"\t--help\t\t\tthis help text\n"
 		"\t--yuv4mpeg2\t\tdump wcap file to stdout in yuv4mpeg2 format\n"
 		"\t--yuv4mpeg2-444\t\tdump wcap file to stdout in yuv4mpeg2 444 format\n"
 		"\t--frame=<frame>\t\twrite out the given frame number as png\n"
 		"\t--all\t\t\twrite all frames as pngs\n"
 		"\t--rate=<num:denom>\treplay frame rate for yuv4mpeg2,\n"
-		"\t\t\t\tspecified as an integer fraction\n\n");
+		"\t\t\t\tspecified as an integer fraction\n"
+		"\t--from=<ms>\t\tstart at the given time from the first frame\n"
+		"\t--to=<ms>\t\tstop after the given time from the first frame\n\n");
 
 	exit(exit_code);
 }
@@ -215,9 +217,10 @@ int main(int argc, char *argv[])
 	struct wcap_decoder *decoder;
 	int i, j, output_frame = -1, yuv4mpeg2 = 0, all = 0, has_frame;
 	int num = 30, denom = 1;
+	int from = -1, to = -1;
 	char filename[200];
 	char *mode;
-	uint32_t msecs, frame_time;
+	uint32_t msecs, frame_time, end_msecs;
 
 	for (i = 1, j = 1; i < argc; i++) {
 		if (strcmp(argv[i], "--yuv4mpeg2-444") == 0) {
@@ -234,6 +237,10 @@ int main(int argc, char *argv[])
 			;
 		} else if (sscanf(argv[i], "--rate=%d:%d", &num, &denom) == 2) {
 			;
+		} else if (sscanf(argv[i], "--from=%d", &from) == 1) {
+			;
+		} else if (sscanf(argv[i], "--to=%d", &to) == 1) {
+			;
 		} else if (strcmp(argv[i], "--") == 0) {
 			break;
 		} else if (argv[i][0] == '-') {
@@ -252,6 +259,10 @@ int main(int argc, char *argv[])
 		fprintf(stderr, "invalid rate, denom can not be 0\n");
 		exit(EXIT_FAILURE);
 	}
+	if ((to >= 0 && to < from) || from < -1 || to < -1) {
+		fprintf(stderr, "invalid time range\n");
+		exit(EXIT_FAILURE);
+	}
 
 	decoder = wcap_decoder_create(argv[1]);
 	if (decoder == NULL) {
@@ -280,10 +291,16 @@ int main(int argc, char *argv[])
 	}
 
 	i = 0;
-	has_frame = wcap_decoder_get_frame(decoder);
-	msecs = decoder->msecs;
+	if (from >= 0) {
+		msecs = decoder->start_msecs + from;
+		has_frame = wcap_decoder_seek(decoder, msecs);
+	} else {
+		has_frame = wcap_decoder_get_frame(decoder);
+		msecs = decoder->msecs;
+	}
+	end_msecs = to >= 0 ? decoder->start_msecs + to : UINT32_MAX;
 	frame_time = 1000 * denom / num;
-	while (has_frame) {
+	while (has_frame && msecs <= end_msecs) {
 		if (all || i == output_frame) {
 			snprintf(filename, sizeof filename,
 				 "wcap-frame-%d.png", i);
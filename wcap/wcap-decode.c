@@ -35,6 +35,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <fcntl.h>
+#include <stddef.h>
 
 #include <cairo.h>
 
@@ -107,6 +108,147 @@ wcap_decoder_get_frame(struct wcap_decoder *decoder)
 	return 1;
 }
 
+/* Go back to the state before the first frame. */
+static void
+wcap_decoder_rewind(struct wcap_decoder *decoder)
+{
+	struct wcap_header *header = decoder->map;
+
+	memset(decoder->frame, 0, decoder->width * decoder->height * 4);
+	decoder->p = header + 1;
+	decoder->count = 0;
+}
+
+static void
+wcap_decoder_load_keyframe(struct wcap_decoder *decoder,
+			   struct wcap_keyframe *key)
+{
+	struct wcap_rectangle rect = {
+		0, 0, decoder->width, decoder->height
+	};
+
+	memset(decoder->frame, 0, decoder->width * decoder->height * 4);
+	decoder->p = key + 1;
+	wcap_decoder_decode_rectangle(decoder, &rect);
+
+	decoder->p = (char *) decoder->map + key->offset;
+	decoder->msecs = key->msecs;
+	decoder->count = key->frame + 1;
+}
+
+/* Make the last frame at or before msecs the current frame, or the first
+ * frame if msecs is before it. Starts from the closest keyframe of the
+ * index when that skips frames, so the cost only depends on the distance
+ * to the previous keyframe or the current frame. Returns 0 if there are
+ * no frames.
+ */
+int
+wcap_decoder_seek(struct wcap_decoder *decoder, uint32_t msecs)
+{
+	struct wcap_frame_header *next;
+	struct wcap_keyframe *key = NULL;
+	uint32_t lo = 0, hi = decoder->n_keyframes, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (decoder->keyframes[mid]->msecs <= msecs)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo > 0)
+		key = decoder->keyframes[lo - 1];
+
+	if (decoder->count > 0 && decoder->msecs > msecs) {
+		if (key)
+			wcap_decoder_load_keyframe(decoder, key);
+		else
+			wcap_decoder_rewind(decoder);
+	} else if (key && key->frame >= decoder->count) {
+		wcap_decoder_load_keyframe(decoder, key);
+	}
+
+	if (decoder->count == 0 && !wcap_decoder_get_frame(decoder))
+		return 0;
+
+	while (decoder->p != decoder->end) {
+		next = decoder->p;
+		if (next->msecs > msecs)
+			break;
+		wcap_decoder_get_frame(decoder);
+	}
+
+	return 1;
+}
+
+/* Map the index next to the capture if there is one that matches it. */
+static void
+wcap_decoder_load_index(struct wcap_decoder *decoder, const char *filename)
+{
+	struct wcap_index_header *header;
+	struct wcap_keyframe *key;
+	char *name, *p, *end;
+	struct stat buf;
+	uint32_t n = 0;
+	int fd;
+
+	if (asprintf(&name, "%s.idx", filename) < 0)
+		return;
+	fd = open(name, O_RDONLY | O_CLOEXEC);
+	free(name);
+	if (fd == -1)
+		return;
+
+	if (fstat(fd, &buf) < 0 ||
+	    (size_t) buf.st_size < sizeof *header) {
+		close(fd);
+		return;
+	}
+
+	decoder->index_size = buf.st_size;
+	decoder->index_map = mmap(NULL, decoder->index_size,
+				  PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (decoder->index_map == MAP_FAILED) {
+		decoder->index_map = NULL;
+		return;
+	}
+
+	header = decoder->index_map;
+	if (header->magic != WCAP_INDEX_MAGIC ||
+	    (int) header->width != decoder->width ||
+	    (int) header->height != decoder->height) {
+		fprintf(stderr, "ignoring index that does not match "
+			"the capture\n");
+		return;
+	}
+
+	/* Count complete keyframes first, the index may be truncated if
+	 * the compositor did not stop recording cleanly. */
+	end = (char *) decoder->index_map + decoder->index_size;
+	for (p = (char *) (header + 1);
+	     end - p >= (ptrdiff_t) sizeof *key; n++) {
+		key = (struct wcap_keyframe *) p;
+		if ((size_t) (end - p - sizeof *key) / 4 <
+		    ((key->size + 1) & ~1u) ||
+		    key->offset > decoder->size)
+			break;
+		p += sizeof *key + ((key->size + 1) & ~1u) * 4;
+	}
+
+	decoder->keyframes = calloc(n, sizeof *decoder->keyframes);
+	if (decoder->keyframes == NULL)
+		return;
+
+	p = (char *) (header + 1);
+	for (decoder->n_keyframes = 0; decoder->n_keyframes < n;
+	     decoder->n_keyframes++) {
+		key = (struct wcap_keyframe *) p;
+		decoder->keyframes[decoder->n_keyframes] = key;
+		p += sizeof *key + ((key->size + 1) & ~1u) * 4;
+	}
+}
+
 struct wcap_decoder *
 wcap_decoder_create(const char *filename)
 {
@@ -115,7 +257,7 @@ wcap_decoder_create(const char *filename)
 	int frame_size;
 	struct stat buf;
 
-	decoder = malloc(sizeof *decoder);
+	decoder = calloc(1, sizeof *decoder);
 	if (decoder == NULL)
 		return NULL;
 
@@ -153,12 +295,21 @@ wcap_decoder_create(const char *filename)
 	}
 	memset(decoder->frame, 0, frame_size);
 
+	if (decoder->p != decoder->end)
+		decoder->start_msecs =
+			((struct wcap_frame_header *) decoder->p)->msecs;
+
+	wcap_decoder_load_index(decoder, filename);
+
 	return decoder;
 }
 
 void
 wcap_decoder_destroy(struct wcap_decoder *decoder)
 {
+	if (decoder->index_map)
+		munmap(decoder->index_map, decoder->index_size);
+	free(decoder->keyframes);
 	munmap(decoder->map, decoder->size);
 	close(decoder->fd);
 	free(decoder->frame);
@@ -50,6 +50,27 @@ struct wcap_rectangle {
 	int32_t x1, y1, x2, y2;
 };
 
+/* The optional seek index is stored next to a capture, in a file named
+ * like it with ".idx" appended. */
+#define WCAP_INDEX_MAGIC	0x57434958
+
+struct wcap_index_header {
+	uint32_t magic;
+	uint32_t width, height;
+	uint32_t reserved;
+};
+
+/* Each keyframe is followed by the frame as decoded after the frame with
+ * the given number, encoded as one rectangle covering the frame against
+ * all 0 pixels, in size words padded to a multiple of two. */
+struct wcap_keyframe {
+	uint32_t msecs;
+	uint32_t frame;
+	uint64_t offset;	/* of the next frame in the capture */
+	uint32_t size;
+	uint32_t reserved;
+};
+
 struct wcap_decoder {
 	int fd;
 	size_t size;
@@ -59,9 +80,17 @@ struct wcap_decoder {
 	uint32_t msecs;
 	uint32_t count;
 	int width, height;
+
+	uint32_t start_msecs;
+
+	void *index_map;
+	size_t index_size;
+	struct wcap_keyframe **keyframes;
+	uint32_t n_keyframes;
 };
 
 int wcap_decoder_get_frame(struct wcap_decoder *decoder);
+int wcap_decoder_seek(struct wcap_decoder *decoder, uint32_t msecs);
 struct wcap_decoder *wcap_decoder_create(const char *filename);
 void wcap_decoder_destroy(struct wcap_decoder *decoder);
 
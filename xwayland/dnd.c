@@ -41,7 +41,7 @@
 #include "xwayland.h"
 
 #include "cairo-util.h"
-#include "hash.h"
+#include "shared/hash.h"
 
 struct dnd_data_source {
 	struct weston_data_source base;
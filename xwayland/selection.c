@@ -27,12 +27,42 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <inttypes.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
 
 #include "xwayland.h"
 #include "shared/helpers.h"
+#include "shared/os-compatibility.h"
+#include "shared/timespec-util.h"
+
+/* Upper bound for the pipe buffers and INCR chunks of a transfer, both
+ * double from their defaults while a transfer keeps them full. */
+#define SELECTION_BUFFER_MAX (1024 * 1024)
+
+static void
+weston_wm_selection_start(struct weston_wm *wm)
+{
+	clock_gettime(CLOCK_MONOTONIC, &wm->selection_start);
+	wm->selection_bytes = 0;
+}
+
+static void
+weston_wm_selection_log_complete(struct weston_wm *wm, const char *what)
+{
+	struct timespec now;
+	int64_t nsec;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	nsec = timespec_sub_to_nsec(&now, &wm->selection_start);
+
+	weston_log("%s transfer complete, %" PRIu64 " bytes in %.1f ms "
+		   "(%.1f MiB/s)\n", what, wm->selection_bytes, nsec / 1e6,
+		   nsec > 0 ?
+		   wm->selection_bytes * 1e9 / nsec / (1024 * 1024) : 0.0);
+}
 
 static int
 writable_callback(int fd, uint32_t mask, void *data)
@@ -62,7 +92,11 @@ writable_callback(int fd, uint32_t mask, void *data)
 		len, xcb_get_property_value_length(wm->property_reply));
 
 	wm->property_start += len;
-	if (len == remainder) {
+	wm->selection_bytes += len;
+	if (len < remainder) {
+		/* The reader's pipe is full, let it hold more next time. */
+		os_pipe_grow(fd, SELECTION_BUFFER_MAX);
+	} else {
 		free(wm->property_reply);
 		wm->property_reply = NULL;
 		if (wm->property_source)
@@ -74,7 +108,7 @@ writable_callback(int fd, uint32_t mask, void *data)
 					    wm->selection_window,
 					    wm->atom.wl_selection);
 		} else {
-			weston_log("transfer complete\n");
+			weston_wm_selection_log_complete(wm, "X11 to wayland");
 			close(fd);
 		}
 	}
@@ -122,7 +156,7 @@ weston_wm_get_incr_chunk(struct weston_wm *wm)
 		 * for freeing it */
 		weston_wm_write_property(wm, reply);
 	} else {
-		weston_log("transfer complete\n");
+		weston_wm_selection_log_complete(wm, "X11 to wayland incr");
 		close(wm->data_source_fd);
 		free(reply);
 	}
@@ -159,6 +193,7 @@ data_source_send(struct weston_data_source *base,
 
 		fcntl(fd, F_SETFL, O_WRONLY | O_NONBLOCK);
 		wm->data_source_fd = fd;
+		weston_wm_selection_start(wm);
 	}
 }
 
@@ -348,6 +383,16 @@ weston_wm_flush_source_data(struct weston_wm *wm)
 	wm->selection_property_set = 1;
 	length = wm->source_data.size;
 	wm->source_data.size = 0;
+	wm->selection_bytes += length;
+
+	/* Every INCR chunk costs a round trip through the requestor, so
+	 * make them bigger while the transfer goes on. */
+	if (wm->incr)
+		wm->selection_chunk_size =
+			MIN(wm->selection_chunk_size * 2,
+			    MIN((size_t) SELECTION_BUFFER_MAX,
+				xcb_get_maximum_request_length(wm->conn) * 4 -
+				sizeof(xcb_change_property_request_t)));
 
 	return length;
 }
@@ -359,14 +404,18 @@ weston_wm_read_data_source(int fd, uint32_t mask, void *data)
 	int len, current, available;
 	void *p;
 
+	/* Read straight into the buffer that goes out in the next
+	 * ChangeProperty, it holds a whole chunk. */
 	current = wm->source_data.size;
-	if (wm->source_data.size < incr_chunk_size)
-		p = wl_array_add(&wm->source_data, incr_chunk_size);
-	else
-		p = (char *) wm->source_data.data + wm->source_data.size;
-	available = wm->source_data.alloc - current;
-
-	len = read(fd, p, available);
+	available = wm->selection_chunk_size - current;
+	p = wl_array_add(&wm->source_data, available);
+	if (p == NULL) {
+		weston_log("out of memory for selection data\n");
+		len = -1;
+	} else {
+		wm->source_data.size = current;
+		len = read(fd, p, available);
+	}
 	if (len == -1) {
 		weston_log("read error from data source: %m\n");
 		weston_wm_send_selection_notify(wm, XCB_ATOM_NONE);
@@ -376,11 +425,15 @@ weston_wm_read_data_source(int fd, uint32_t mask, void *data)
 		wl_array_release(&wm->source_data);
 	}
 
-	weston_log("read %d (available %d, mask 0x%x) bytes: \"%.*s\"\n",
-		len, available, mask, len, (char *) p);
+	weston_log("read %d (available %d, mask 0x%x) bytes\n",
+		len, available, mask);
+
+	if (wm->selection_pipe_size > 0 && len >= wm->selection_pipe_size)
+		wm->selection_pipe_size =
+			os_pipe_grow(fd, SELECTION_BUFFER_MAX);
 
 	wm->source_data.size = current + len;
-	if (wm->source_data.size >= incr_chunk_size) {
+	if (wm->source_data.size >= wm->selection_chunk_size) {
 		if (!wm->incr) {
 			weston_log("got %zu bytes, starting incr\n",
 				wm->source_data.size);
@@ -411,9 +464,9 @@ weston_wm_read_data_source(int fd, uint32_t mask, void *data)
 			weston_wm_flush_source_data(wm);
 		}
 	} else if (len == 0 && !wm->incr) {
-		weston_log("non-incr transfer complete\n");
 		/* Non-incr transfer all done. */
 		weston_wm_flush_source_data(wm);
+		weston_wm_selection_log_complete(wm, "wayland to X11");
 		weston_wm_send_selection_notify(wm, wm->selection_request.property);
 		xcb_flush(wm->conn);
 		wl_event_source_remove(wm->property_source);
@@ -462,6 +515,9 @@ weston_wm_send_data(struct weston_wm *wm, xcb_atom_t target, const char *mime_ty
 
 	wl_array_init(&wm->source_data);
 	wm->selection_target = target;
+	wm->selection_chunk_size = incr_chunk_size;
+	wm->selection_pipe_size = os_pipe_grow(p[0], SELECTION_BUFFER_MAX);
+	weston_wm_selection_start(wm);
 	wm->data_source_fd = p[0];
 	wm->property_source = wl_event_loop_add_fd(wm->server->loop,
 						   wm->data_source_fd,
@@ -503,6 +559,8 @@ weston_wm_send_incr_chunk(struct weston_wm *wm)
 			wm->flush_property_on_delete = 1;
 			wl_array_release(&wm->source_data);
 		} else {
+			weston_wm_selection_log_complete(wm,
+							 "wayland to X11 incr");
 			wm->selection_request.requestor = XCB_NONE;
 		}
 	}
@@ -46,7 +46,7 @@
 #include "xwayland-internal-interface.h"
 
 #include "cairo-util.h"
-#include "hash.h"
+#include "shared/hash.h"
 #include "shared/helpers.h"
 
 struct wm_size_hints {
@@ -145,7 +145,14 @@ struct weston_wm_window {
 	struct wl_listener surface_destroy_listener;
 	struct wl_event_source *repaint_source;
 	struct wl_event_source *configure_source;
-	int properties_dirty;
+	struct {
+		cairo_surface_t *surface;
+		char *text;
+		int frame_width;
+		uint32_t flags;
+		cairo_rectangle_int_t rect;	/* title area it was drawn for */
+	} title_cache;
+	uint32_t properties_dirty;	/* mask of 1 << WM_PROP_* */
 	int pid;
 	char *machine;
 	char *class;
@@ -497,6 +504,7 @@ dump_property(struct weston_wm *wm,
 	}
 }
 
+#ifdef WM_DEBUG
 static void
 read_and_dump_property(struct weston_wm *wm,
 		       xcb_window_t window, xcb_atom_t property)
@@ -512,6 +520,7 @@ read_and_dump_property(struct weston_wm *wm,
 
 	free(reply);
 }
+#endif
 
 /* We reuse some predefined, but otherwise useles atoms
  * as local type placeholders that never touch the X11 server,
@@ -522,6 +531,62 @@ read_and_dump_property(struct weston_wm *wm,
 #define TYPE_NET_WM_STATE	XCB_ATOM_CUT_BUFFER2
 #define TYPE_WM_NORMAL_HINTS	XCB_ATOM_CUT_BUFFER3
 
+/* The window properties the WM tracks, as bits of properties_dirty. */
+enum wm_window_prop {
+	WM_PROP_CLASS = 0,
+	WM_PROP_NAME,
+	WM_PROP_TRANSIENT_FOR,
+	WM_PROP_PROTOCOLS,
+	WM_PROP_NORMAL_HINTS,
+	WM_PROP_NET_WM_STATE,
+	WM_PROP_WINDOW_TYPE,
+	WM_PROP_NET_WM_NAME,
+	WM_PROP_PID,
+	WM_PROP_MOTIF_HINTS,
+	WM_PROP_CLIENT_MACHINE,
+	WM_PROP_COUNT
+};
+
+#define WM_PROPS_ALL ((1u << WM_PROP_COUNT) - 1)
+
+/* Both names end up in window->name, _NET_WM_NAME winning over WM_NAME,
+ * so a change to either has to read both again. */
+#define WM_PROPS_NAMES ((1u << WM_PROP_NAME) | (1u << WM_PROP_NET_WM_NAME))
+
+/* Returns the properties_dirty bits a PropertyNotify for the atom
+ * invalidates, 0 for atoms the WM does not cache. */
+static uint32_t
+weston_wm_property_mask(struct weston_wm *wm, xcb_atom_t atom)
+{
+	if (atom == XCB_ATOM_WM_CLASS)
+		return 1u << WM_PROP_CLASS;
+	if (atom == XCB_ATOM_WM_NAME || atom == wm->atom.net_wm_name)
+		return WM_PROPS_NAMES;
+	if (atom == XCB_ATOM_WM_TRANSIENT_FOR)
+		return 1u << WM_PROP_TRANSIENT_FOR;
+	if (atom == wm->atom.wm_protocols)
+		return 1u << WM_PROP_PROTOCOLS;
+	if (atom == wm->atom.wm_normal_hints)
+		return 1u << WM_PROP_NORMAL_HINTS;
+	if (atom == wm->atom.net_wm_state)
+		return 1u << WM_PROP_NET_WM_STATE;
+	if (atom == wm->atom.net_wm_window_type)
+		return 1u << WM_PROP_WINDOW_TYPE;
+	if (atom == wm->atom.net_wm_pid)
+		return 1u << WM_PROP_PID;
+	if (atom == wm->atom.motif_wm_hints)
+		return 1u << WM_PROP_MOTIF_HINTS;
+	if (atom == wm->atom.wm_client_machine)
+		return 1u << WM_PROP_CLIENT_MACHINE;
+
+	return 0;
+}
+
+/*
+ * Fetches the properties marked in properties_dirty, all requests are
+ * sent before waiting for the first reply. Properties that did not change
+ * since the last call keep their cached value.
+ */
 static void
 weston_wm_window_read_properties(struct weston_wm_window *window)
 {
@@ -532,18 +597,18 @@ weston_wm_window_read_properties(struct weston_wm_window *window)
 		xcb_atom_t atom;
 		xcb_atom_t type;
 		void *ptr;
-	} props[] = {
-		{ XCB_ATOM_WM_CLASS,           XCB_ATOM_STRING,            F(class) },
-		{ XCB_ATOM_WM_NAME,            XCB_ATOM_STRING,            F(name) },
-		{ XCB_ATOM_WM_TRANSIENT_FOR,   XCB_ATOM_WINDOW,            F(transient_for) },
-		{ wm->atom.wm_protocols,       TYPE_WM_PROTOCOLS,          NULL },
-		{ wm->atom.wm_normal_hints,    TYPE_WM_NORMAL_HINTS,       NULL },
-		{ wm->atom.net_wm_state,       TYPE_NET_WM_STATE,          NULL },
-		{ wm->atom.net_wm_window_type, XCB_ATOM_ATOM,              F(type) },
-		{ wm->atom.net_wm_name,        XCB_ATOM_STRING,            F(name) },
-		{ wm->atom.net_wm_pid,         XCB_ATOM_CARDINAL,          F(pid) },
-		{ wm->atom.motif_wm_hints,     TYPE_MOTIF_WM_HINTS,        NULL },
-		{ wm->atom.wm_client_machine,  XCB_ATOM_WM_CLIENT_MACHINE, F(machine) },
+	} props[WM_PROP_COUNT] = {
+		[WM_PROP_CLASS] =          { XCB_ATOM_WM_CLASS,           XCB_ATOM_STRING,            F(class) },
+		[WM_PROP_NAME] =           { XCB_ATOM_WM_NAME,            XCB_ATOM_STRING,            F(name) },
+		[WM_PROP_TRANSIENT_FOR] =  { XCB_ATOM_WM_TRANSIENT_FOR,   XCB_ATOM_WINDOW,            F(transient_for) },
+		[WM_PROP_PROTOCOLS] =      { wm->atom.wm_protocols,       TYPE_WM_PROTOCOLS,          NULL },
+		[WM_PROP_NORMAL_HINTS] =   { wm->atom.wm_normal_hints,    TYPE_WM_NORMAL_HINTS,       NULL },
+		[WM_PROP_NET_WM_STATE] =   { wm->atom.net_wm_state,       TYPE_NET_WM_STATE,          NULL },
+		[WM_PROP_WINDOW_TYPE] =    { wm->atom.net_wm_window_type, XCB_ATOM_ATOM,              F(type) },
+		[WM_PROP_NET_WM_NAME] =    { wm->atom.net_wm_name,        XCB_ATOM_STRING,            F(name) },
+		[WM_PROP_PID] =            { wm->atom.net_wm_pid,         XCB_ATOM_CARDINAL,          F(pid) },
+		[WM_PROP_MOTIF_HINTS] =    { wm->atom.motif_wm_hints,     TYPE_MOTIF_WM_HINTS,        NULL },
+		[WM_PROP_CLIENT_MACHINE] = { wm->atom.wm_client_machine,  XCB_ATOM_WM_CLIENT_MACHINE, F(machine) },
 	};
 #undef F
 
@@ -552,26 +617,43 @@ weston_wm_window_read_properties(struct weston_wm_window *window)
 	void *p;
 	uint32_t *xid;
 	xcb_atom_t *atom;
-	uint32_t i;
+	uint32_t dirty;
+	uint32_t i, j;
 	char name[1024];
 
-	if (!window->properties_dirty)
+	dirty = window->properties_dirty;
+	if (!dirty)
 		return;
 	window->properties_dirty = 0;
 
-	for (i = 0; i < ARRAY_LENGTH(props); i++)
+	for (i = 0; i < ARRAY_LENGTH(props); i++) {
+		if (!(dirty & (1u << i))) {
+			wm->property_stats.requests_saved++;
+			continue;
+		}
+
 		cookie[i] = xcb_get_property(wm->conn,
 					     0, /* delete */
 					     window->id,
 					     props[i].atom,
 					     XCB_ATOM_ANY, 0, 2048);
+		wm->property_stats.requests++;
+	}
 
-	window->decorate = window->override_redirect ? 0 : MWM_DECOR_EVERYTHING;
-	window->size_hints.flags = 0;
-	window->motif_hints.flags = 0;
-	window->delete_window = 0;
+	if (dirty & (1u << WM_PROP_MOTIF_HINTS)) {
+		window->decorate = window->override_redirect ?
+				   0 : MWM_DECOR_EVERYTHING;
+		window->motif_hints.flags = 0;
+	}
+	if (dirty & (1u << WM_PROP_NORMAL_HINTS))
+		window->size_hints.flags = 0;
+	if (dirty & (1u << WM_PROP_PROTOCOLS))
+		window->delete_window = 0;
 
 	for (i = 0; i < ARRAY_LENGTH(props); i++)  {
+		if (!(dirty & (1u << i)))
+			continue;
+
 		reply = xcb_get_property_reply(wm->conn, cookie[i], NULL);
 		if (!reply)
 			/* Bad window, typically */
@@ -609,8 +691,8 @@ weston_wm_window_read_properties(struct weston_wm_window *window)
 			break;
 		case TYPE_WM_PROTOCOLS:
 			atom = xcb_get_property_value(reply);
-			for (i = 0; i < reply->value_len; i++)
-				if (atom[i] == wm->atom.wm_delete_window) {
+			for (j = 0; j < reply->value_len; j++)
+				if (atom[j] == wm->atom.wm_delete_window) {
 					window->delete_window = 1;
 					break;
 				}
@@ -623,12 +705,12 @@ weston_wm_window_read_properties(struct weston_wm_window *window)
 		case TYPE_NET_WM_STATE:
 			window->fullscreen = 0;
 			atom = xcb_get_property_value(reply);
-			for (i = 0; i < reply->value_len; i++) {
-				if (atom[i] == wm->atom.net_wm_state_fullscreen)
+			for (j = 0; j < reply->value_len; j++) {
+				if (atom[j] == wm->atom.net_wm_state_fullscreen)
 					window->fullscreen = 1;
-				if (atom[i] == wm->atom.net_wm_state_maximized_vert)
+				if (atom[j] == wm->atom.net_wm_state_maximized_vert)
 					window->maximized_vert = 1;
-				if (atom[i] == wm->atom.net_wm_state_maximized_horz)
+				if (atom[j] == wm->atom.net_wm_state_maximized_horz)
 					window->maximized_horz = 1;
 			}
 			break;
@@ -652,7 +734,8 @@ weston_wm_window_read_properties(struct weston_wm_window *window)
 		free(reply);
 	}
 
-	if (window->pid > 0) {
+	if (window->pid > 0 &&
+	    (dirty & ((1u << WM_PROP_PID) | (1u << WM_PROP_CLIENT_MACHINE)))) {
 		gethostname(name, sizeof(name));
 		for (i = 0; i < sizeof(name); i++) {
 			if (name[i] == '\0')
@@ -1237,6 +1320,205 @@ weston_wm_handle_unmap_notify(struct weston_wm *wm, xcb_generic_event_t *event)
 	xcb_unmap_window(wm->conn, window->frame_id);
 }
 
+/* Width of the middle strip of a decoration template. */
+#define DECORATION_TEMPLATE_STRIP 16
+
+/*
+ * theme_render_frame() draws the shadow corners 64 pixels wide at an
+ * offset of 2, and the frame corners with the titlebar inside the
+ * margin. Everything between those only repeats along the edge.
+ */
+static void
+weston_wm_decoration_slices(struct theme *t, uint32_t flags,
+			    int *left, int *right, int *top, int *bottom)
+{
+	if (flags & THEME_FRAME_MAXIMIZED) {
+		*left = t->width;
+		*right = t->width;
+		*top = t->titlebar_height;
+		*bottom = t->width;
+	} else {
+		*left = MAX(2 + 64, t->margin + t->width);
+		*right = MAX(64 - 2 - 8, t->margin + t->width);
+		*top = MAX(2 + 64, t->margin + t->titlebar_height);
+		*bottom = MAX(64 - 2 - 8, t->margin + t->width);
+	}
+}
+
+static cairo_surface_t *
+weston_wm_get_decoration_template(struct weston_wm *wm,
+				  struct weston_wm_window *window,
+				  uint32_t flags)
+{
+	cairo_surface_t *template;
+	cairo_t *cr;
+	int left, right, top, bottom;
+
+	flags &= THEME_FRAME_ACTIVE | THEME_FRAME_MAXIMIZED;
+	if (wm->decoration_templates[flags])
+		return wm->decoration_templates[flags];
+
+	weston_wm_decoration_slices(wm->theme, flags,
+				    &left, &right, &top, &bottom);
+
+	/* A pixmap on the X server, so frames are assembled from it with
+	 * Render composites instead of drawing on the client side. */
+	template = cairo_surface_create_similar(window->cairo_surface,
+						CAIRO_CONTENT_COLOR_ALPHA,
+						left + DECORATION_TEMPLATE_STRIP + right,
+						top + DECORATION_TEMPLATE_STRIP + bottom);
+	cr = cairo_create(template);
+	theme_render_frame_background(wm->theme, cr,
+				      left + DECORATION_TEMPLATE_STRIP + right,
+				      top + DECORATION_TEMPLATE_STRIP + bottom,
+				      1, flags);
+	cairo_destroy(cr);
+
+	if (cairo_surface_status(template) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy(template);
+		return NULL;
+	}
+
+	wm->decoration_templates[flags] = template;
+
+	return template;
+}
+
+/* Nine-slice copy of the template: corners as they are, edges and
+ * middle stretched from the template strip. */
+static void
+weston_wm_window_blit_decoration(cairo_t *cr, cairo_surface_t *template,
+				 int width, int height,
+				 int left, int right, int top, int bottom)
+{
+	const int sx[3] = { 0, left, left + DECORATION_TEMPLATE_STRIP };
+	const int sy[3] = { 0, top, top + DECORATION_TEMPLATE_STRIP };
+	const int sw[3] = { left, DECORATION_TEMPLATE_STRIP, right };
+	const int sh[3] = { top, DECORATION_TEMPLATE_STRIP, bottom };
+	const int dx[3] = { 0, left, width - right };
+	const int dy[3] = { 0, top, height - bottom };
+	const int dw[3] = { left, width - left - right, right };
+	const int dh[3] = { top, height - top - bottom, bottom };
+	cairo_pattern_t *pattern;
+	cairo_matrix_t matrix;
+	int i, j;
+
+	pattern = cairo_pattern_create_for_surface(template);
+	cairo_pattern_set_filter(pattern, CAIRO_FILTER_NEAREST);
+	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source(cr, pattern);
+
+	for (j = 0; j < 3; j++) {
+		for (i = 0; i < 3; i++) {
+			cairo_matrix_init_translate(&matrix, sx[i], sy[j]);
+			cairo_matrix_scale(&matrix,
+					   (double) sw[i] / dw[i],
+					   (double) sh[j] / dh[j]);
+			cairo_matrix_translate(&matrix, -dx[i], -dy[j]);
+			cairo_pattern_set_matrix(pattern, &matrix);
+
+			cairo_rectangle(cr, dx[i], dy[j], dw[i], dh[j]);
+			cairo_fill(cr);
+		}
+	}
+
+	cairo_pattern_destroy(pattern);
+}
+
+static void
+weston_wm_window_clear_title_cache(struct weston_wm_window *window)
+{
+	if (window->title_cache.surface)
+		cairo_surface_destroy(window->title_cache.surface);
+	free(window->title_cache.text);
+	memset(&window->title_cache, 0, sizeof window->title_cache);
+}
+
+/* The title text only depends on the title, the frame width and the
+ * theme flags, keep it around until one of those changes. */
+static void
+weston_wm_window_draw_title(struct weston_wm_window *window, cairo_t *cr,
+			    int width, uint32_t flags)
+{
+	struct weston_wm *wm = window->wm;
+	cairo_rectangle_int_t rect;
+	cairo_t *title_cr;
+
+	frame_title_rect(window->frame,
+			 &rect.x, &rect.y, &rect.width, &rect.height);
+	if (!window->name || rect.width <= 0 || rect.height <= 0)
+		return;
+
+	if (!window->title_cache.surface ||
+	    window->title_cache.frame_width != width ||
+	    window->title_cache.flags != flags ||
+	    window->title_cache.rect.x != rect.x ||
+	    window->title_cache.rect.y != rect.y ||
+	    window->title_cache.rect.width != rect.width ||
+	    window->title_cache.rect.height != rect.height ||
+	    strcmp(window->title_cache.text, window->name) != 0) {
+		weston_wm_window_clear_title_cache(window);
+
+		window->title_cache.surface =
+			cairo_surface_create_similar(window->cairo_surface,
+						     CAIRO_CONTENT_COLOR_ALPHA,
+						     rect.width, rect.height);
+		title_cr = cairo_create(window->title_cache.surface);
+		cairo_translate(title_cr, -rect.x, -rect.y);
+		theme_render_frame_title(wm->theme, title_cr, width,
+					 window->name, &rect, flags);
+		cairo_destroy(title_cr);
+
+		window->title_cache.text = strdup(window->name);
+		window->title_cache.frame_width = width;
+		window->title_cache.flags = flags;
+		window->title_cache.rect = rect;
+		wm->decoration_stats.title_renders++;
+
+		if (!window->title_cache.text) {
+			weston_wm_window_clear_title_cache(window);
+			return;
+		}
+	}
+
+	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+	cairo_set_source_surface(cr, window->title_cache.surface,
+				 rect.x, rect.y);
+	cairo_rectangle(cr, rect.x, rect.y, rect.width, rect.height);
+	cairo_fill(cr);
+}
+
+static void
+weston_wm_window_draw_frame(struct weston_wm_window *window, cairo_t *cr,
+			    int width, int height)
+{
+	struct weston_wm *wm = window->wm;
+	cairo_surface_t *template;
+	uint32_t flags;
+	int left, right, top, bottom;
+
+	flags = frame_theme_flags(window->frame);
+	weston_wm_decoration_slices(wm->theme, flags,
+				    &left, &right, &top, &bottom);
+	template = weston_wm_get_decoration_template(wm, window, flags);
+
+	/* The shadow is clamped differently on tiny frames. */
+	if (!template || width <= left + right || height <= top + bottom) {
+		wm->decoration_stats.full_paints++;
+		frame_repaint(window->frame, cr);
+		return;
+	}
+
+	cairo_save(cr);
+	weston_wm_window_blit_decoration(cr, template, width, height,
+					 left, right, top, bottom);
+	weston_wm_window_draw_title(window, cr, width, flags);
+	cairo_restore(cr);
+
+	frame_repaint_buttons(window->frame, cr);
+	wm->decoration_stats.template_paints++;
+}
+
 static void
 weston_wm_window_draw_decoration(struct weston_wm_window *window)
 {
@@ -1254,7 +1536,7 @@ weston_wm_window_draw_decoration(struct weston_wm_window *window)
 		/* nothing */
 	} else if (window->decorate) {
 		frame_set_title(window->frame, window->name);
-		frame_repaint(window->frame, cr);
+		weston_wm_window_draw_frame(window, cr, width, height);
 	} else {
 		cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
 		cairo_set_source_rgba(cr, 0, 0, 0, 0);
@@ -1387,12 +1669,22 @@ weston_wm_handle_property_notify(struct weston_wm *wm, xcb_generic_event_t *even
 	xcb_property_notify_event_t *property_notify =
 		(xcb_property_notify_event_t *) event;
 	struct weston_wm_window *window;
+	uint32_t mask;
 
 	if (!wm_lookup_window(wm, property_notify->window, &window))
 		return;
 
-	window->properties_dirty = 1;
+	/* Only the named property is fetched again, and only once however
+	 * many notifies arrive before the next read. */
+	mask = weston_wm_property_mask(wm, property_notify->atom);
+	if (mask) {
+		wm->property_stats.notifies++;
+		if ((window->properties_dirty & mask) == mask)
+			wm->property_stats.notifies_coalesced++;
+		window->properties_dirty |= mask;
+	}
 
+#ifdef WM_DEBUG
 	wm_log("XCB_PROPERTY_NOTIFY: window %d, ", property_notify->window);
 	if (property_notify->state == XCB_PROPERTY_DELETE)
 		wm_log_continue("deleted %s\n",
@@ -1400,6 +1692,7 @@ weston_wm_handle_property_notify(struct weston_wm *wm, xcb_generic_event_t *even
 	else
 		read_and_dump_property(wm, property_notify->window,
 				       property_notify->atom);
+#endif
 
 	if (property_notify->atom == wm->atom.net_wm_name ||
 	    property_notify->atom == XCB_ATOM_WM_NAME)
@@ -1429,7 +1722,7 @@ weston_wm_window_create(struct weston_wm *wm,
 
 	window->wm = wm;
 	window->id = id;
-	window->properties_dirty = 1;
+	window->properties_dirty = WM_PROPS_ALL;
 	window->override_redirect = override;
 	window->width = width;
 	window->height = height;
@@ -1459,6 +1752,7 @@ weston_wm_window_destroy(struct weston_wm_window *window)
 
 	if (window->repaint_source)
 		wl_event_source_remove(window->repaint_source);
+	weston_wm_window_clear_title_cache(window);
 	if (window->cairo_surface)
 		cairo_surface_destroy(window->cairo_surface);
 
@@ -2589,6 +2883,25 @@ weston_wm_create(struct weston_xserver *wxs, int fd)
 void
 weston_wm_destroy(struct weston_wm *wm)
 {
+	unsigned int i;
+
+	weston_log("xwm: %" PRIu64 " property notifies (%" PRIu64
+		   " coalesced), %" PRIu64 " property requests, %" PRIu64
+		   " saved by the property cache\n",
+		   wm->property_stats.notifies,
+		   wm->property_stats.notifies_coalesced,
+		   wm->property_stats.requests,
+		   wm->property_stats.requests_saved);
+	weston_log("xwm: %" PRIu64 " decorations assembled from templates, %"
+		   PRIu64 " fully repainted, %" PRIu64 " title renders\n",
+		   wm->decoration_stats.template_paints,
+		   wm->decoration_stats.full_paints,
+		   wm->decoration_stats.title_renders);
+
+	for (i = 0; i < ARRAY_LENGTH(wm->decoration_templates); i++)
+		if (wm->decoration_templates[i])
+			cairo_surface_destroy(wm->decoration_templates[i]);
+
 	/* FIXME: Free windows in hash. */
 	hash_table_destroy(wm->window_hash);
 	weston_wm_destroy_cursors(wm);
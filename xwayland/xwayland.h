@@ -87,10 +87,30 @@ struct weston_wm {
 	int selection_property_set;
 	int flush_property_on_delete;
 	struct wl_listener selection_listener;
+	size_t selection_chunk_size;	/* grows while an INCR transfer runs */
+	int selection_pipe_size;
+	struct timespec selection_start;
+	uint64_t selection_bytes;
 
 	xcb_window_t dnd_window;
 	xcb_window_t dnd_owner;
 
+	struct {
+		uint64_t notifies;		/* of cached properties */
+		uint64_t notifies_coalesced;	/* already pending a fetch */
+		uint64_t requests;		/* GetProperty sent */
+		uint64_t requests_saved;	/* vs. fetching all of them */
+	} property_stats;
+
+	/* Frame backgrounds, indexed by THEME_FRAME_ACTIVE and
+	 * THEME_FRAME_MAXIMIZED, see weston_wm_window_draw_frame(). */
+	cairo_surface_t *decoration_templates[4];
+	struct {
+		uint64_t template_paints;	/* assembled from a template */
+		uint64_t full_paints;		/* frame_repaint() fallback */
+		uint64_t title_renders;		/* title text drawn */
+	} decoration_stats;
+
 	struct {
 		xcb_atom_t		 wm_protocols;
 		xcb_atom_t		 wm_normal_hints;